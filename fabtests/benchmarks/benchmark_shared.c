@@ -33,6 +33,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <rdma/fi_errno.h>
 
@@ -47,6 +48,43 @@
  */
 static int inject_size_set;
 
+/*
+ * Latency histogram, in the style of HdrHistogram.  Values below
+ * 2 * FT_HIST_SUB_CNT ns get a bucket each.  Above that a bucket covers
+ * all values with the same top FT_HIST_SUB_BITS + 1 bits, which bounds the
+ * error of a reported percentile to 1/FT_HIST_SUB_CNT of its value.
+ */
+#define FT_HIST_SUB_BITS	7
+#define FT_HIST_SUB_CNT		(1 << FT_HIST_SUB_BITS)
+#define FT_HIST_MAX_BITS	40
+#define FT_HIST_CNT		((FT_HIST_MAX_BITS - FT_HIST_SUB_BITS + 1) * \
+				 FT_HIST_SUB_CNT)
+#define FT_OUTLIER_MAX		1024
+
+struct ft_outlier {
+	int		index;
+	uint64_t	ns;
+};
+
+static struct {
+	uint64_t		counts[FT_HIST_CNT];
+	uint64_t		total;
+	uint64_t		max;
+	struct ft_outlier	slow[FT_OUTLIER_MAX];
+	int			slow_cnt;
+} lat;
+
+static int lat_enabled;
+static char *lat_dump_file;
+static int lat_outliers;
+
+/* Interval timer: one sample per iteration or window, in ns per transfer */
+struct ft_lat_timer {
+	uint64_t	start;
+	int		done;
+	int		index;
+};
+
 void ft_parse_benchmark_opts(int op, char *optarg)
 {
 	switch (op) {
@@ -63,11 +101,32 @@ void ft_parse_benchmark_opts(int op, char *optarg)
 	case 'W':
 		opts.window_size = atoi(optarg);
 		break;
+	case 'L':
+		lat_enabled = 1;
+		break;
+	case 'Y':
+		lat_dump_file = optarg;
+		lat_enabled = 1;
+		break;
+	case 'R':
+		lat_outliers = MIN(MAX(atoi(optarg), 0), FT_OUTLIER_MAX);
+		lat_enabled = 1;
+		break;
 	default:
 		break;
 	}
 }
 
+/* Largest message the benchmarks send with inject, 0 for none */
+size_t ft_benchmark_inject_size(void)
+{
+	if (opts.options & FT_OPT_ENABLE_HMEM)
+		return 0;
+
+	return inject_size_set ? hints->tx_attr->inject_size :
+				 fi->tx_attr->inject_size;
+}
+
 void ft_benchmark_usage(void)
 {
 	FT_PRINT_OPTS_USAGE("-v", "enables data_integrity checks");
@@ -77,17 +136,194 @@ void ft_benchmark_usage(void)
 			"* The following condition is required to have at least "
 			"one window\nsize # of messsages to be sent: "
 			"# of iterations > window size");
+	FT_PRINT_OPTS_USAGE("-L", "report p50/p90/p99/p99.9/max latency per "
+			    "transfer,\ntimed per iteration or per window");
+	FT_PRINT_OPTS_USAGE("-Y <file>", "write the raw latency histogram as "
+			    "CSV (implies -L)");
+	FT_PRINT_OPTS_USAGE("-R <count>", "list the <count> slowest iterations "
+			    "or windows (implies -L)");
 }
 
-int pingpong(void)
+static int ft_lat_msb(uint64_t v)
 {
-	int ret, i, inject_size;
+	int msb = 0;
 
-	inject_size = inject_size_set ?
-			hints->tx_attr->inject_size : fi->tx_attr->inject_size;
+	if (v >> 32) {
+		v >>= 32;
+		msb += 32;
+	}
+	if (v >> 16) {
+		v >>= 16;
+		msb += 16;
+	}
+	if (v >> 8) {
+		v >>= 8;
+		msb += 8;
+	}
+	if (v >> 4) {
+		v >>= 4;
+		msb += 4;
+	}
+	if (v >> 2) {
+		v >>= 2;
+		msb += 2;
+	}
+	return msb + (int) (v >> 1);
+}
 
-	if (opts.options & FT_OPT_ENABLE_HMEM)
-		inject_size = 0;
+static int ft_lat_bucket(uint64_t ns)
+{
+	int msb, shift;
+
+	ns = MIN(ns, (1ULL << FT_HIST_MAX_BITS) - 1);
+	msb = ft_lat_msb(ns);
+	shift = msb > FT_HIST_SUB_BITS ? msb - FT_HIST_SUB_BITS : 0;
+	return (shift << FT_HIST_SUB_BITS) + (int) (ns >> shift);
+}
+
+static void ft_lat_range(int bucket, uint64_t *low, uint64_t *high)
+{
+	int shift = bucket < 2 * FT_HIST_SUB_CNT ? 0 :
+		    (bucket >> FT_HIST_SUB_BITS) - 1;
+	uint64_t sub = bucket - (shift << FT_HIST_SUB_BITS);
+
+	*low = sub << shift;
+	*high = ((sub + 1) << shift) - 1;
+}
+
+/* The slowest samples are kept sorted, slowest first */
+static void ft_lat_outlier(int index, uint64_t ns)
+{
+	int i;
+
+	if (lat.slow_cnt == lat_outliers) {
+		if (!lat_outliers || ns <= lat.slow[lat.slow_cnt - 1].ns)
+			return;
+		i = lat.slow_cnt - 1;
+	} else {
+		i = lat.slow_cnt++;
+	}
+
+	for (; i > 0 && lat.slow[i - 1].ns < ns; i--)
+		lat.slow[i] = lat.slow[i - 1];
+	lat.slow[i].index = index;
+	lat.slow[i].ns = ns;
+}
+
+static void ft_lat_begin(struct ft_lat_timer *timer)
+{
+	if (!lat_enabled)
+		return;
+
+	memset(&lat, 0, sizeof(lat));
+	timer->done = 0;
+	timer->index = 0;
+	timer->start = ft_gettime_ns();
+}
+
+/* done counts the measured transfers completed, and is <= 0 in warmup */
+static void ft_lat_mark(struct ft_lat_timer *timer, int done)
+{
+	uint64_t now, ns;
+
+	if (!lat_enabled || done <= timer->done)
+		return;
+
+	now = ft_gettime_ns();
+	ns = (now - timer->start) / (done - timer->done);
+	lat.counts[ft_lat_bucket(ns)]++;
+	lat.total++;
+	lat.max = MAX(lat.max, ns);
+	ft_lat_outlier(timer->index++, ns);
+
+	timer->done = done;
+	timer->start = now;
+}
+
+static double ft_lat_percentile(double pct)
+{
+	uint64_t low, high, cnt = 0, rank;
+	int i;
+
+	rank = (uint64_t) (pct / 100 * lat.total + 0.5);
+	rank = MAX(rank, 1);
+	for (i = 0; i < FT_HIST_CNT; i++) {
+		cnt += lat.counts[i];
+		if (cnt >= rank)
+			break;
+	}
+
+	ft_lat_range(i, &low, &high);
+	return MIN((low + high) / 2.0, lat.max) / 1000.0;
+}
+
+static void ft_lat_dump(void)
+{
+	static int dumped;
+	uint64_t low, high;
+	FILE *file;
+	int i;
+
+	file = fopen(lat_dump_file, dumped ? "a" : "w");
+	if (!file) {
+		FT_ERR("Unable to open %s\n", lat_dump_file);
+		return;
+	}
+
+	if (!dumped)
+		fprintf(file, "bytes,low_ns,high_ns,count\n");
+	dumped = 1;
+
+	for (i = 0; i < FT_HIST_CNT; i++) {
+		if (!lat.counts[i])
+			continue;
+		ft_lat_range(i, &low, &high);
+		fprintf(file, "%zu,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+			opts.transfer_size, low, high, lat.counts[i]);
+	}
+	fclose(file);
+}
+
+static void ft_lat_report(const char *unit)
+{
+	static const double pcts[] = { 50, 90, 99, 99.9 };
+	static const char *names[] = { "p50", "p90", "p99", "p99.9" };
+	int i;
+
+	if (!lat_enabled || !lat.total)
+		return;
+
+	if (opts.machr) {
+		printf("- { xfer_size: %zu, ", opts.transfer_size);
+		for (i = 0; i < ARRAY_SIZE(pcts); i++)
+			printf("%s_usec: %f, ", names[i],
+			       ft_lat_percentile(pcts[i]));
+		printf("max_usec: %f }\n", lat.max / 1000.0);
+	} else {
+		printf("%8s", "");
+		for (i = 0; i < ARRAY_SIZE(pcts); i++)
+			printf("%s %.2f  ", names[i],
+			       ft_lat_percentile(pcts[i]));
+		printf("max %.2f usec/xfer\n", lat.max / 1000.0);
+
+		if (lat.slow_cnt) {
+			printf("%8sslowest %s:", "", unit);
+			for (i = 0; i < lat.slow_cnt; i++)
+				printf(" %d (%.2f)", lat.slow[i].index,
+				       lat.slow[i].ns / 1000.0);
+			printf("\n");
+		}
+	}
+
+	if (lat_dump_file)
+		ft_lat_dump();
+}
+
+int pingpong(void)
+{
+	size_t inject_size = ft_benchmark_inject_size();
+	struct ft_lat_timer timer = {0};
+	int ret, i;
 
 	ret = ft_sync();
 	if (ret)
@@ -95,8 +331,10 @@ int pingpong(void)
 
 	if (opts.dst_addr) {
 		for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
-			if (i == opts.warmup_iterations)
+			if (i == opts.warmup_iterations) {
 				ft_start();
+				ft_lat_begin(&timer);
+			}
 
 			if (opts.transfer_size < inject_size)
 				ret = ft_inject(ep, remote_fi_addr, opts.transfer_size);
@@ -108,11 +346,15 @@ int pingpong(void)
 			ret = ft_rx(ep, opts.transfer_size);
 			if (ret)
 				return ret;
+
+			ft_lat_mark(&timer, 2 * (i + 1 - opts.warmup_iterations));
 		}
 	} else {
 		for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
-			if (i == opts.warmup_iterations)
+			if (i == opts.warmup_iterations) {
 				ft_start();
+				ft_lat_begin(&timer);
+			}
 
 			ret = ft_rx(ep, opts.transfer_size);
 			if (ret)
@@ -124,6 +366,8 @@ int pingpong(void)
 				ret = ft_tx(ep, remote_fi_addr, opts.transfer_size, &tx_ctx);
 			if (ret)
 				return ret;
+
+			ft_lat_mark(&timer, 2 * (i + 1 - opts.warmup_iterations));
 		}
 	}
 	ft_stop();
@@ -133,6 +377,7 @@ int pingpong(void)
 				opts.argc, opts.argv);
 	else
 		show_perf(NULL, opts.transfer_size, opts.iterations, &start, &end, 2);
+	ft_lat_report("iterations");
 
 	return 0;
 }
@@ -168,13 +413,9 @@ static int bw_rx_comp()
 
 int bandwidth(void)
 {
-	int ret, i, j, inject_size;
-
-	inject_size = inject_size_set ?
-			hints->tx_attr->inject_size : fi->tx_attr->inject_size;
-
-	if (opts.options & FT_OPT_ENABLE_HMEM)
-		inject_size = 0;
+	size_t inject_size = ft_benchmark_inject_size();
+	struct ft_lat_timer timer = {0};
+	int ret, i, j;
 
 	ret = ft_sync();
 	if (ret)
@@ -196,8 +437,10 @@ int bandwidth(void)
 					return ret;
 			}
 
-			if (i == opts.warmup_iterations)
+			if (i == opts.warmup_iterations) {
 				ft_start();
+				ft_lat_begin(&timer);
+			}
 
 			if (opts.transfer_size < inject_size)
 				ret = ft_inject(ep, remote_fi_addr, opts.transfer_size);
@@ -211,6 +454,7 @@ int bandwidth(void)
 				ret = bw_tx_comp();
 				if (ret)
 					return ret;
+				ft_lat_mark(&timer, i + 1 - opts.warmup_iterations);
 				j = 0;
 			}
 		}
@@ -219,8 +463,10 @@ int bandwidth(void)
 			return ret;
 	} else {
 		for (i = j = 0; i < opts.iterations + opts.warmup_iterations; i++) {
-			if (i == opts.warmup_iterations)
+			if (i == opts.warmup_iterations) {
 				ft_start();
+				ft_lat_begin(&timer);
+			}
 
 			ret = ft_post_rx(ep, opts.transfer_size, &rx_ctx_arr[j].context);
 			if (ret)
@@ -230,6 +476,7 @@ int bandwidth(void)
 				ret = bw_rx_comp();
 				if (ret)
 					return ret;
+				ft_lat_mark(&timer, i + 1 - opts.warmup_iterations);
 				j = 0;
 			}
 		}
@@ -237,6 +484,7 @@ int bandwidth(void)
 		if (ret)
 			return ret;
 	}
+	ft_lat_mark(&timer, opts.iterations);
 	ft_stop();
 
 	if (opts.machr)
@@ -244,6 +492,7 @@ int bandwidth(void)
 				opts.argc, opts.argv);
 	else
 		show_perf(NULL, opts.transfer_size, opts.iterations, &start, &end, 1);
+	ft_lat_report("windows");
 
 	return 0;
 }
@@ -269,21 +518,19 @@ static int bw_rma_comp(enum ft_rma_opcodes rma_op)
 
 int bandwidth_rma(enum ft_rma_opcodes rma_op, struct fi_rma_iov *remote)
 {
-	int ret, i, j, inject_size;
-
-	inject_size = inject_size_set ?
-			hints->tx_attr->inject_size: fi->tx_attr->inject_size;
-
-	if (opts.options & FT_OPT_ENABLE_HMEM)
-		inject_size = 0;
+	size_t inject_size = ft_benchmark_inject_size();
+	struct ft_lat_timer timer = {0};
+	int ret, i, j;
 
 	ret = ft_sync();
 	if (ret)
 		return ret;
 
 	for (i = j = 0; i < opts.iterations + opts.warmup_iterations; i++) {
-		if (i == opts.warmup_iterations)
+		if (i == opts.warmup_iterations) {
 			ft_start();
+			ft_lat_begin(&timer);
+		}
 
 		switch (rma_op) {
 		case FT_RMA_WRITE:
@@ -342,12 +589,14 @@ int bandwidth_rma(enum ft_rma_opcodes rma_op, struct fi_rma_iov *remote)
 			ret = bw_rma_comp(rma_op);
 			if (ret)
 				return ret;
+			ft_lat_mark(&timer, i + 1 - opts.warmup_iterations);
 			j = 0;
 		}
 	}
 	ret = bw_rma_comp(rma_op);
 	if (ret)
 		return ret;
+	ft_lat_mark(&timer, opts.iterations);
 	ft_stop();
 
 	if (opts.machr)
@@ -355,5 +604,6 @@ int bandwidth_rma(enum ft_rma_opcodes rma_op, struct fi_rma_iov *remote)
 				opts.argc, opts.argv);
 	else
 		show_perf(NULL, opts.transfer_size, opts.iterations, &start, &end, 1);
+	ft_lat_report("windows");
 	return 0;
 }
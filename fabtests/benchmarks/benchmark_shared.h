@@ -40,11 +40,12 @@ extern "C" {
 
 #include <rdma/fi_rma.h>
 
-#define BENCHMARK_OPTS "vkj:W:"
+#define BENCHMARK_OPTS "vkj:W:LY:R:"
 #define FT_BENCHMARK_MAX_MSG_SIZE (test_size[TEST_CNT - 1].size)
 
 void ft_parse_benchmark_opts(int op, char *optarg);
 void ft_benchmark_usage(void);
+size_t ft_benchmark_inject_size(void);
 int pingpong(void);
 int bandwidth(void);
 int bandwidth_rma(enum ft_rma_opcodes op, struct fi_rma_iov *remote);
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2024 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Completion rate per CQ format.  A single process sends tagged messages to
+ * itself over a loopback RDM endpoint, a window at a time, and drains the
+ * send and receive completions in batches.  The test is repeated with a
+ * fresh domain for each CQ format so the formats can be compared directly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <rdma/fi_cm.h>
+#include <rdma/fi_errno.h>
+#include <rdma/fi_tagged.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+#define CR_TAG		0x1234
+
+static const struct {
+	enum fi_cq_format	format;
+	const char		*name;
+	size_t			size;
+} cr_formats[] = {
+	{ FI_CQ_FORMAT_CONTEXT, "context", sizeof(struct fi_cq_entry) },
+	{ FI_CQ_FORMAT_MSG, "msg", sizeof(struct fi_cq_msg_entry) },
+	{ FI_CQ_FORMAT_DATA, "data", sizeof(struct fi_cq_data_entry) },
+	{ FI_CQ_FORMAT_TAGGED, "tagged", sizeof(struct fi_cq_tagged_entry) },
+};
+
+static struct fi_info *base_hints;
+static struct fi_context2 *ctx_arr;
+static struct fi_cq_tagged_entry *comp_buf;
+
+static int reap_cq(struct fid_cq *cq, size_t total, uint64_t *read_ns)
+{
+	uint64_t start;
+	size_t done = 0;
+	ssize_t ret;
+
+	while (done < total) {
+		start = ft_gettime_ns();
+		ret = fi_cq_read(cq, comp_buf, total - done);
+		if (ret > 0) {
+			*read_ns += ft_gettime_ns() - start;
+			done += ret;
+		} else if (ret == -FI_EAVAIL) {
+			return ft_cq_readerr(cq);
+		} else if (ret != -FI_EAGAIN) {
+			FT_PRINTERR("fi_cq_read", ret);
+			return (int) ret;
+		}
+	}
+	return 0;
+}
+
+static int post_window(void)
+{
+	size_t size = opts.transfer_size;
+	ssize_t ret;
+	int i;
+
+	for (i = 0; i < opts.window_size; i++) {
+		do {
+			ret = fi_trecv(ep, rx_buf, size, mr_desc,
+				       FI_ADDR_UNSPEC, CR_TAG, 0, &ctx_arr[i]);
+			if (ret == -FI_EAGAIN)
+				(void) fi_cq_read(rxcq, NULL, 0);
+		} while (ret == -FI_EAGAIN);
+		if (ret) {
+			FT_PRINTERR("fi_trecv", ret);
+			return (int) ret;
+		}
+	}
+
+	for (i = 0; i < opts.window_size; i++) {
+		do {
+			ret = fi_tsend(ep, tx_buf, size, mr_desc,
+				       remote_fi_addr, CR_TAG,
+				       &ctx_arr[opts.window_size + i]);
+			if (ret == -FI_EAGAIN)
+				(void) fi_cq_read(txcq, NULL, 0);
+		} while (ret == -FI_EAGAIN);
+		if (ret) {
+			FT_PRINTERR("fi_tsend", ret);
+			return (int) ret;
+		}
+	}
+	return 0;
+}
+
+static int init_loopback(void)
+{
+	char addr[FT_MAX_CTRL_MSG];
+	size_t addrlen = sizeof(addr);
+	int ret;
+
+	ret = ft_getinfo(hints, &fi);
+	if (ret)
+		return ret;
+
+	ret = ft_open_fabric_res();
+	if (ret)
+		return ret;
+
+	ret = ft_alloc_active_res(fi);
+	if (ret)
+		return ret;
+
+	ret = ft_enable_ep(ep, eq, av, txcq, rxcq, txcntr, rxcntr);
+	if (ret)
+		return ret;
+
+	ret = ft_alloc_msgs();
+	if (ret)
+		return ret;
+
+	ret = fi_getname(&ep->fid, addr, &addrlen);
+	if (ret) {
+		FT_PRINTERR("fi_getname", ret);
+		return ret;
+	}
+
+	return ft_av_insert(av, addr, 1, &remote_fi_addr, 0, NULL);
+}
+
+static int run_format(int index)
+{
+	uint64_t start = 0, elapsed, read_ns = 0;
+	size_t comps;
+	int i, ret;
+
+	hints = fi_dupinfo(base_hints);
+	if (!hints)
+		return -FI_ENOMEM;
+
+	cq_attr.format = cr_formats[index].format;
+	ret = init_loopback();
+	if (ret)
+		goto out;
+
+	for (i = 0; i < opts.warmup_iterations + opts.iterations; i++) {
+		if (i == opts.warmup_iterations) {
+			read_ns = 0;
+			start = ft_gettime_ns();
+		}
+
+		ret = post_window();
+		if (ret)
+			goto out;
+
+		ret = reap_cq(txcq, opts.window_size, &read_ns);
+		if (ret)
+			goto out;
+
+		ret = reap_cq(rxcq, opts.window_size, &read_ns);
+		if (ret)
+			goto out;
+	}
+	elapsed = ft_gettime_ns() - start;
+
+	comps = (size_t) opts.iterations * opts.window_size * 2;
+	printf("%-10s%-8zu%-12zu%-14.3f%.1f\n", cr_formats[index].name,
+	       cr_formats[index].size, comps, comps * 1000.0 / elapsed,
+	       (double) read_ns / comps);
+out:
+	ft_free_res();
+	return ret;
+}
+
+static int run(void)
+{
+	int i, ret;
+
+	ctx_arr = calloc(opts.window_size * 2, sizeof(*ctx_arr));
+	comp_buf = calloc(opts.window_size, sizeof(*comp_buf));
+	if (!ctx_arr || !comp_buf) {
+		ret = -FI_ENOMEM;
+		goto out;
+	}
+
+	printf("%-10s%-8s%-12s%-14s%s\n", "format", "bytes", "comps",
+	       "Mcomps/sec", "read ns/comp");
+	for (i = 0; i < ARRAY_SIZE(cr_formats); i++) {
+		ret = run_format(i);
+		if (ret)
+			break;
+	}
+out:
+	free(comp_buf);
+	free(ctx_arr);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_SIZE;
+	opts.transfer_size = 4;
+	opts.src_addr = "127.0.0.1";
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt_long(argc, argv, "h" CS_OPTS INFO_OPTS
+				 BENCHMARK_OPTS, long_opts, &lopt_idx)) != -1) {
+		switch (op) {
+		default:
+			if (!ft_parse_long_opts(op, optarg))
+				continue;
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case '?':
+		case 'h':
+			ft_usage(argv[0], "Completion rate for each CQ format "
+				 "over a loopback endpoint.");
+			ft_benchmark_usage();
+			ft_longopts_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps |= FI_TAGGED | FI_LOCAL_COMM;
+	hints->mode |= FI_CONTEXT | FI_CONTEXT2;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+	hints->addr_format = opts.address_format;
+
+	base_hints = hints;
+	hints = NULL;
+	ret = run();
+
+	fi_freeinfo(base_hints);
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2024 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Many-to-one message rate test.  The client side forks -C sender
+ * processes, each with its own endpoint, which all stream messages to a
+ * single receiving endpoint.  The server reports the aggregate rate, which
+ * is bound by how well the provider handles concurrent producers targeting
+ * the same peer.  With -x the receiver asks the rxd provider to drop one in
+ * every n packets, to show goodput under incast with loss.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/wait.h>
+
+#include <rdma/fi_errno.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+static char *drop_rate;
+
+static int run_server(void)
+{
+	fi_addr_t *addrs;
+	int i, j, total, ret;
+
+	if (drop_rate && setenv("FI_OFI_RXD_DROP_RATE", drop_rate, 1))
+		return -errno;
+
+	addrs = calloc(opts.num_connections, sizeof(*addrs));
+	if (!addrs)
+		return -FI_ENOMEM;
+
+	ret = ft_init_fabric();
+	if (ret)
+		goto out;
+
+	addrs[0] = remote_fi_addr;
+	for (i = 1; i < opts.num_connections; i++) {
+		ret = ft_init_av();
+		if (ret)
+			goto out;
+		addrs[i] = remote_fi_addr;
+	}
+
+	ft_start();
+	for (i = 0; i < opts.num_connections; i++) {
+		ret = ft_tx(ep, addrs[i], 4, &tx_ctx);
+		if (ret)
+			goto out;
+	}
+
+	total = opts.num_connections * opts.iterations;
+	for (i = j = 0; i < total; i++) {
+		ret = ft_post_rx(ep, opts.transfer_size, &rx_ctx_arr[j].context);
+		if (ret)
+			goto out;
+
+		if (++j == opts.window_size) {
+			/* rx_seq is always one ahead */
+			ret = ft_get_rx_comp(rx_seq - 1);
+			if (ret)
+				goto out;
+			j = 0;
+		}
+	}
+	ret = ft_get_rx_comp(rx_seq - 1);
+	if (ret)
+		goto out;
+	ft_stop();
+
+	for (i = 0; i < opts.num_connections; i++) {
+		ret = ft_tx(ep, addrs[i], 4, &tx_ctx);
+		if (ret)
+			goto out;
+	}
+
+	show_perf(NULL, opts.transfer_size, total, &start, &end, 1);
+out:
+	free(addrs);
+	return ret;
+}
+
+static int run_sender(void)
+{
+	int i, j, ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	/* wait until every sender has registered with the server */
+	ret = ft_rx(ep, 4);
+	if (ret)
+		return ret;
+
+	for (i = j = 0; i < opts.iterations; i++) {
+		if (opts.transfer_size <= fi->tx_attr->inject_size)
+			ret = ft_inject(ep, remote_fi_addr, opts.transfer_size);
+		else
+			ret = ft_post_tx(ep, remote_fi_addr, opts.transfer_size,
+					 NO_CQ_DATA, &tx_ctx_arr[j].context);
+		if (ret)
+			return ret;
+
+		if (++j == opts.window_size) {
+			ret = ft_get_tx_comp(tx_seq);
+			if (ret)
+				return ret;
+			j = 0;
+		}
+	}
+	ret = ft_get_tx_comp(tx_seq);
+	if (ret)
+		return ret;
+
+	return ft_rx(ep, 4);
+}
+
+static int run_client(void)
+{
+	int i, status, ret = 0;
+	pid_t pid;
+
+	for (i = 0; i < opts.num_connections; i++) {
+		pid = fork();
+		if (pid < 0) {
+			FT_PRINTERR("fork", -errno);
+			ret = -errno;
+			break;
+		}
+		if (!pid) {
+			ret = run_sender();
+			if (ret)
+				FT_PRINTERR("run_sender", -ret);
+			ft_free_res();
+			exit(ft_exit_code(ret));
+		}
+	}
+
+	while (wait(&status) > 0) {
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			ret = -FI_EOTHER;
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_BW | FT_OPT_SIZE;
+	opts.transfer_size = 64;
+	opts.num_connections = 4;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt_long(argc, argv, "hx:" CS_OPTS INFO_OPTS
+				 BENCHMARK_OPTS, long_opts, &lopt_idx)) != -1) {
+		switch (op) {
+		case 'x':
+			drop_rate = optarg;
+			break;
+		default:
+			if (!ft_parse_long_opts(op, optarg))
+				continue;
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Many-to-one message rate test for RDM endpoints.");
+			ft_benchmark_usage();
+			FT_PRINT_OPTS_USAGE("-C <number>", "number of sender processes");
+			FT_PRINT_OPTS_USAGE("-x <number>", "receiver drops one in "
+					    "number packets (rxd only)");
+			ft_longopts_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	if (opts.num_connections <= 0) {
+		FT_ERR("number of senders must be positive\n");
+		return EXIT_FAILURE;
+	}
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->domain_attr->resource_mgmt = FI_RM_ENABLED;
+	hints->caps = FI_MSG;
+	hints->mode |= FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+	hints->addr_format = opts.address_format;
+
+	ret = opts.dst_addr ? run_client() : run_server();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
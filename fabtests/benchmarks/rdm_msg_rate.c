@@ -0,0 +1,681 @@
+/*
+ * Copyright (c) 2024 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Message rate with multiple threads.  Each client thread streams a window
+ * of messages to the matching server thread and waits for a small ack
+ * before sending the next window.  Threads use an endpoint each, or with
+ * -x all threads share one endpoint and its CQs, which measures the cost
+ * of contention in the provider.  Completions are credited to the thread
+ * that posted the operation, whichever thread reads them.  Tagged messages
+ * carry the thread id; untagged messages on a shared endpoint match any
+ * thread's receive.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_tagged.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+#define MR_TAG		0x5678
+#define MR_ACK_SIZE	4
+#define MR_POLL_CNT	16
+#define MR_MAX_CORES	256
+
+enum {
+	MR_OUT_TEXT,
+	MR_OUT_CSV,
+	MR_OUT_JSON,
+};
+
+struct rate_thread;
+
+struct rate_ctx {
+	struct fi_context2	ctx;
+	struct rate_thread	*owner;
+};
+
+struct rate_thread {
+	pthread_t		thread;
+	int			id;
+	struct fid_ep		*ep;
+	struct fid_cq		*txcq;
+	struct fid_cq		*rxcq;
+	struct fid_mr		*mr;
+	void			*desc;
+	fi_addr_t		addr;
+	char			*buf;
+	struct rate_ctx		*ctx;
+	uint64_t		posted;
+	uint64_t		done;
+	int			ret;
+	uint64_t		start;
+	uint64_t		end;
+};
+
+static struct rate_thread *threads;
+static int thread_cnt = 1;
+static int shared_ep;
+static int use_send;
+static int tagged;
+static int out_fmt = MR_OUT_TEXT;
+static int cores[MR_MAX_CORES];
+static int core_cnt;
+
+static struct fid_ep **rate_eps;
+static struct fid_cq **rate_txcqs;
+static struct fid_cq **rate_rxcqs;
+static fi_addr_t *rate_addrs;
+static int rate_ep_cnt;
+
+static pthread_barrier_t barrier;
+static pthread_mutex_t cq_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t inject_size;
+
+static int rate_read_cq(struct fid_cq *cq)
+{
+	struct fi_cq_entry comp[MR_POLL_CNT];
+	struct rate_ctx *ctx;
+	ssize_t ret;
+	int i;
+
+	ret = fi_cq_read(cq, comp, MR_POLL_CNT);
+	if (ret > 0) {
+		for (i = 0; i < ret; i++) {
+			ctx = comp[i].op_context;
+			ctx->owner->done++;
+		}
+		return 0;
+	}
+
+	if (ret == -FI_EAVAIL)
+		return ft_cq_readerr(cq);
+	if (ret != -FI_EAGAIN) {
+		FT_PRINTERR("fi_cq_read", ret);
+		return (int) ret;
+	}
+	return 0;
+}
+
+/* With a shared endpoint any thread may reap another thread's completion */
+static int rate_poll(struct rate_thread *t, uint64_t *done)
+{
+	int ret;
+
+	if (shared_ep)
+		pthread_mutex_lock(&cq_lock);
+
+	ret = rate_read_cq(t->txcq);
+	if (!ret)
+		ret = rate_read_cq(t->rxcq);
+	*done = t->done;
+
+	if (shared_ep)
+		pthread_mutex_unlock(&cq_lock);
+	return ret;
+}
+
+static int rate_wait(struct rate_thread *t)
+{
+	uint64_t done;
+	int ret;
+
+	do {
+		ret = rate_poll(t, &done);
+		if (ret)
+			return ret;
+	} while (done < t->posted);
+	return 0;
+}
+
+static int rate_post_recv(struct rate_thread *t, void *buf, size_t size,
+			  struct rate_ctx *ctx)
+{
+	uint64_t done;
+	ssize_t ret;
+	int err;
+
+	do {
+		if (tagged)
+			ret = fi_trecv(t->ep, buf, size, t->desc, t->addr,
+				       MR_TAG + t->id, 0, ctx);
+		else
+			ret = fi_recv(t->ep, buf, size, t->desc, t->addr, ctx);
+		if (ret == -FI_EAGAIN) {
+			err = rate_poll(t, &done);
+			if (err)
+				return err;
+		}
+	} while (ret == -FI_EAGAIN);
+
+	if (ret) {
+		FT_PRINTERR(tagged ? "fi_trecv" : "fi_recv", ret);
+		return (int) ret;
+	}
+	t->posted++;
+	return 0;
+}
+
+static int rate_post_send(struct rate_thread *t, void *buf, size_t size,
+			  struct rate_ctx *ctx)
+{
+	int inject = size < inject_size && !use_send;
+	uint64_t done;
+	ssize_t ret;
+	int err;
+
+	do {
+		if (inject && tagged)
+			ret = fi_tinject(t->ep, buf, size, t->addr,
+					 MR_TAG + t->id);
+		else if (inject)
+			ret = fi_inject(t->ep, buf, size, t->addr);
+		else if (tagged)
+			ret = fi_tsend(t->ep, buf, size, t->desc, t->addr,
+				       MR_TAG + t->id, ctx);
+		else
+			ret = fi_send(t->ep, buf, size, t->desc, t->addr, ctx);
+		if (ret == -FI_EAGAIN) {
+			err = rate_poll(t, &done);
+			if (err)
+				return err;
+		}
+	} while (ret == -FI_EAGAIN);
+
+	if (ret) {
+		FT_PRINTERR(inject ? "fi_inject" : "fi_send", ret);
+		return (int) ret;
+	}
+	if (!inject)
+		t->posted++;
+	return 0;
+}
+
+/* The ack is received into the tail of the buffer and uses the last context */
+static int rate_client(struct rate_thread *t, int cnt)
+{
+	char *ack = t->buf + opts.transfer_size;
+	int i, ret;
+
+	ret = rate_post_recv(t, ack, MR_ACK_SIZE, &t->ctx[opts.window_size]);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < cnt; i++) {
+		ret = rate_post_send(t, t->buf, opts.transfer_size, &t->ctx[i]);
+		if (ret)
+			return ret;
+	}
+	return rate_wait(t);
+}
+
+static int rate_server_post(struct rate_thread *t, int cnt)
+{
+	int i, ret;
+
+	for (i = 0; i < cnt; i++) {
+		ret = rate_post_recv(t, t->buf, opts.transfer_size, &t->ctx[i]);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/* The next window's receives are posted before the ack releases the client */
+static int rate_server(struct rate_thread *t, int next)
+{
+	char *ack = t->buf + opts.transfer_size;
+	int ret;
+
+	ret = rate_wait(t);
+	if (ret)
+		return ret;
+
+	ret = rate_server_post(t, next);
+	if (ret)
+		return ret;
+
+	return rate_post_send(t, ack, MR_ACK_SIZE, &t->ctx[opts.window_size]);
+}
+
+static int rate_run(struct rate_thread *t, int iters)
+{
+	int i, cnt, ret;
+
+	cnt = MIN(opts.window_size, iters);
+	if (!opts.dst_addr) {
+		ret = rate_server_post(t, cnt);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < iters; i += cnt) {
+		cnt = MIN(opts.window_size, iters - i);
+		if (opts.dst_addr) {
+			ret = rate_client(t, cnt);
+		} else {
+			ret = rate_server(t, MIN(opts.window_size,
+						 iters - i - cnt));
+		}
+		if (ret)
+			return ret;
+	}
+
+	/* The final ack must complete before the buffer is reused */
+	return rate_wait(t);
+}
+
+static void rate_pin(struct rate_thread *t)
+{
+	cpu_set_t mask;
+
+	if (!core_cnt)
+		return;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cores[t->id % core_cnt], &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask))
+		FT_WARN("Pin thread %d to core %d failed\n", t->id,
+			cores[t->id % core_cnt]);
+}
+
+static void *rate_thread_fn(void *arg)
+{
+	struct rate_thread *t = arg;
+
+	rate_pin(t);
+
+	t->ret = rate_run(t, opts.warmup_iterations);
+	pthread_barrier_wait(&barrier);
+	if (t->ret)
+		return NULL;
+
+	t->start = ft_gettime_ns();
+	t->ret = rate_run(t, opts.iterations);
+	t->end = ft_gettime_ns();
+	return NULL;
+}
+
+static const char *rate_op_str(void)
+{
+	return tagged ? "tagged" : "msg";
+}
+
+static void rate_report(uint64_t elapsed)
+{
+	static int header = 1;
+	uint64_t msgs = (uint64_t) opts.iterations * thread_cnt;
+	double sec = elapsed / 1e9;
+	double mrate = msgs / (elapsed / 1e3);
+	double mbps = msgs * opts.transfer_size / (elapsed / 1e3);
+	int inject = opts.transfer_size < inject_size && !use_send;
+	char str[FT_STR_LEN];
+
+	switch (out_fmt) {
+	case MR_OUT_CSV:
+		if (header)
+			printf("provider,threads,endpoints,op,inject,bytes,"
+			       "window,messages,seconds,mmsgs_per_sec,"
+			       "mb_per_sec\n");
+		printf("%s,%d,%d,%s,%d,%zu,%d,%" PRIu64 ",%.6f,%.4f,%.2f\n",
+		       fi->fabric_attr->prov_name, thread_cnt, rate_ep_cnt,
+		       rate_op_str(), inject, opts.transfer_size,
+		       opts.window_size, msgs, sec, mrate, mbps);
+		break;
+	case MR_OUT_JSON:
+		printf("{\"provider\": \"%s\", \"threads\": %d, "
+		       "\"endpoints\": %d, \"op\": \"%s\", \"inject\": %s, "
+		       "\"bytes\": %zu, \"window\": %d, \"messages\": %" PRIu64
+		       ", \"seconds\": %.6f, \"mmsgs_per_sec\": %.4f, "
+		       "\"mb_per_sec\": %.2f}\n",
+		       fi->fabric_attr->prov_name, thread_cnt, rate_ep_cnt,
+		       rate_op_str(), inject ? "true" : "false",
+		       opts.transfer_size, opts.window_size, msgs, sec, mrate,
+		       mbps);
+		break;
+	default:
+		if (header)
+			printf("%-8s%-8s%-8s%-8s%-10s%10s%12s%12s\n", "bytes",
+			       "threads", "eps", "op", "msgs", "time",
+			       "Mmsgs/sec", "MB/sec");
+		printf("%-8s%-8d%-8d%-8s", size_str(str, opts.transfer_size),
+		       thread_cnt, rate_ep_cnt, rate_op_str());
+		printf("%-10s%9.2fs%12.4f%12.2f\n", cnt_str(str, msgs), sec,
+		       mrate, mbps);
+		break;
+	}
+	header = 0;
+	fflush(stdout);
+}
+
+static int rate_test(void)
+{
+	uint64_t start = UINT64_MAX, end = 0;
+	int i, ret;
+
+	ret = pthread_barrier_init(&barrier, NULL, thread_cnt);
+	if (ret)
+		return -ret;
+
+	ret = ft_sync();
+	if (ret)
+		goto out;
+
+	for (i = 0; i < thread_cnt; i++) {
+		threads[i].posted = 0;
+		threads[i].done = 0;
+		threads[i].ret = 0;
+		ret = pthread_create(&threads[i].thread, NULL, rate_thread_fn,
+				     &threads[i]);
+		if (ret) {
+			FT_PRINTERR("pthread_create", ret);
+			thread_cnt = i;
+			break;
+		}
+	}
+
+	for (i = 0; i < thread_cnt; i++) {
+		pthread_join(threads[i].thread, NULL);
+		if (threads[i].ret && !ret)
+			ret = threads[i].ret;
+		start = MIN(start, threads[i].start);
+		end = MAX(end, threads[i].end);
+	}
+
+	if (!ret)
+		rate_report(end - start);
+out:
+	pthread_barrier_destroy(&barrier);
+	return ret;
+}
+
+static int rate_setup_ep(int idx)
+{
+	int ret;
+
+	fi_freeinfo(hints);
+	hints = fi_dupinfo(fi);
+	fi_freeinfo(fi);
+
+	hints->src_addr = NULL;
+	hints->src_addrlen = 0;
+
+	ret = fi_getinfo(FT_FIVERSION, opts.src_addr, NULL, 0, hints, &fi);
+	if (ret) {
+		FT_PRINTERR("fi_getinfo", ret);
+		return ret;
+	}
+
+	ret = fi_endpoint(domain, fi, &rate_eps[idx], NULL);
+	if (ret) {
+		FT_PRINTERR("fi_endpoint", ret);
+		return ret;
+	}
+
+	ret = ft_alloc_ep_res(fi, &rate_txcqs[idx], &rate_rxcqs[idx],
+			      NULL, NULL);
+	if (ret)
+		return ret;
+
+	ret = ft_enable_ep(rate_eps[idx], eq, av, rate_txcqs[idx],
+			   rate_rxcqs[idx], NULL, NULL);
+	if (ret)
+		return ret;
+
+	return ft_init_av_addr(av, rate_eps[idx], &rate_addrs[idx]);
+}
+
+static int rate_setup_thread(struct rate_thread *t)
+{
+	size_t size = FT_BENCHMARK_MAX_MSG_SIZE + MR_ACK_SIZE;
+	int i, idx = shared_ep ? 0 : t->id;
+
+	if (opts.options & FT_OPT_SIZE)
+		size = opts.transfer_size + MR_ACK_SIZE;
+
+	t->ep = rate_eps[idx];
+	t->txcq = rate_txcqs[idx];
+	t->rxcq = rate_rxcqs[idx];
+	t->addr = rate_addrs[idx];
+
+	t->ctx = calloc(opts.window_size + 1, sizeof(*t->ctx));
+	t->buf = calloc(1, size);
+	if (!t->ctx || !t->buf)
+		return -FI_ENOMEM;
+
+	for (i = 0; i <= opts.window_size; i++)
+		t->ctx[i].owner = t;
+
+	return ft_reg_mr(fi, t->buf, size, ft_info_to_mr_access(fi),
+			 FT_MR_KEY + 0x100 + t->id, &t->mr, &t->desc);
+}
+
+static void rate_free(void)
+{
+	int i;
+
+	for (i = 0; threads && i < thread_cnt; i++) {
+		FT_CLOSE_FID(threads[i].mr);
+		free(threads[i].buf);
+		free(threads[i].ctx);
+	}
+
+	for (i = 0; rate_eps && i < rate_ep_cnt; i++) {
+		FT_CLOSE_FID(rate_eps[i]);
+		FT_CLOSE_FID(rate_txcqs[i]);
+		FT_CLOSE_FID(rate_rxcqs[i]);
+	}
+
+	free(threads);
+	free(rate_eps);
+	free(rate_txcqs);
+	free(rate_rxcqs);
+	free(rate_addrs);
+}
+
+static int rate_setup(void)
+{
+	int i, ret;
+
+	rate_ep_cnt = shared_ep ? 1 : thread_cnt;
+	threads = calloc(thread_cnt, sizeof(*threads));
+	rate_eps = calloc(rate_ep_cnt, sizeof(*rate_eps));
+	rate_txcqs = calloc(rate_ep_cnt, sizeof(*rate_txcqs));
+	rate_rxcqs = calloc(rate_ep_cnt, sizeof(*rate_rxcqs));
+	rate_addrs = calloc(rate_ep_cnt, sizeof(*rate_addrs));
+	if (!threads || !rate_eps || !rate_txcqs || !rate_rxcqs ||
+	    !rate_addrs)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < rate_ep_cnt; i++) {
+		ret = rate_setup_ep(i);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < thread_cnt; i++) {
+		threads[i].id = i;
+		ret = rate_setup_thread(&threads[i]);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static int run(void)
+{
+	int i, ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	/* The main endpoint keeps its CQ format for the ft control messages */
+	cq_attr.format = FI_CQ_FORMAT_CONTEXT;
+	ret = rate_setup();
+	if (ret)
+		goto out;
+
+	inject_size = ft_benchmark_inject_size();
+	if (!(opts.options & FT_OPT_SIZE)) {
+		for (i = 0; i < TEST_CNT; i++) {
+			if (!ft_use_size(i, opts.sizes_enabled))
+				continue;
+			opts.transfer_size = test_size[i].size;
+			ret = rate_test();
+			if (ret)
+				goto out;
+		}
+	} else {
+		ret = rate_test();
+		if (ret)
+			goto out;
+	}
+
+	ft_finalize();
+out:
+	rate_free();
+	return ret;
+}
+
+static int parse_cores(char *list)
+{
+	char *tok, *saveptr;
+
+	for (tok = strtok_r(list, ",", &saveptr); tok;
+	     tok = strtok_r(NULL, ",", &saveptr)) {
+		if (core_cnt == MR_MAX_CORES)
+			return -FI_EINVAL;
+		cores[core_cnt++] = atoi(tok);
+	}
+	return core_cnt ? 0 : -FI_EINVAL;
+}
+
+static void usage(char *name)
+{
+	ft_csusage(name, "Multi-threaded message rate test for RDM endpoints.");
+	FT_PRINT_OPTS_USAGE("-T <threads>", "number of threads (default 1)");
+	FT_PRINT_OPTS_USAGE("-x", "threads share one endpoint and its CQs");
+	FT_PRINT_OPTS_USAGE("-n", "use fi_send for small messages, not "
+			    "fi_inject");
+	FT_PRINT_OPTS_USAGE("-g", "use tagged messages");
+	FT_PRINT_OPTS_USAGE("-A <core,core,...>", "pin thread i to the i-th "
+			    "core in the list, wrapping around");
+	FT_PRINT_OPTS_USAGE("-O <text|csv|json>", "output format, json is "
+			    "one object per line");
+	FT_PRINT_OPTS_USAGE("-j", "maximum inject message size");
+	FT_PRINT_OPTS_USAGE("-W", "window size (for bandwidth tests)");
+	ft_longopts_usage();
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_BW;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt_long(argc, argv, "hT:xngA:O:" CS_OPTS INFO_OPTS
+				 "j:W:", long_opts, &lopt_idx)) != -1) {
+		switch (op) {
+		default:
+			if (!ft_parse_long_opts(op, optarg))
+				continue;
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'T':
+			thread_cnt = atoi(optarg);
+			if (thread_cnt < 1) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'x':
+			shared_ep = 1;
+			break;
+		case 'n':
+			use_send = 1;
+			break;
+		case 'g':
+			tagged = 1;
+			break;
+		case 'A':
+			if (parse_cores(optarg)) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'O':
+			if (!strcasecmp(optarg, "csv")) {
+				out_fmt = MR_OUT_CSV;
+			} else if (!strcasecmp(optarg, "json")) {
+				out_fmt = MR_OUT_JSON;
+			} else if (strcasecmp(optarg, "text")) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case '?':
+		case 'h':
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->domain_attr->resource_mgmt = FI_RM_ENABLED;
+	hints->caps = tagged ? FI_TAGGED : FI_MSG;
+	hints->mode |= FI_CONTEXT | FI_CONTEXT2;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = thread_cnt > 1 ?
+					FI_THREAD_SAFE : FI_THREAD_DOMAIN;
+	hints->addr_format = opts.address_format;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2024 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Tag matching cost versus queue depth.  For each depth the receiver posts
+ * that many receives with distinct tags and the sender sends the tags in
+ * reverse posting order, so every arrival has to be matched against the
+ * full posted queue.  With -u, the sender goes first and the receiver
+ * posts in reverse order, stressing the unexpected message queue instead.
+ * The receiver reports the time per matched message at each depth.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <inttypes.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_tagged.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+/* keep clear of the sequence based tags used by ft_sync() */
+#define TM_TAG_BASE	(1ULL << 40)
+
+static int max_depth = 1024;
+static bool unexp_mode;
+static struct fi_context2 *ctx_arr;
+static uint64_t tx_done, rx_done;
+
+static int reap_cq(struct fid_cq *cq, uint64_t *done, uint64_t total)
+{
+	struct fi_cq_tagged_entry comp[16];
+	ssize_t ret;
+
+	while (*done < total) {
+		ret = fi_cq_read(cq, comp, ARRAY_SIZE(comp));
+		if (ret > 0) {
+			*done += ret;
+		} else if (ret == -FI_EAVAIL) {
+			return ft_cq_readerr(cq);
+		} else if (ret != -FI_EAGAIN) {
+			FT_PRINTERR("fi_cq_read", ret);
+			return (int) ret;
+		}
+	}
+	return 0;
+}
+
+static int post_recv(int i, uint64_t tag)
+{
+	fi_addr_t addr;
+	ssize_t ret;
+
+	addr = (hints->caps & FI_DIRECTED_RECV) ? remote_fi_addr :
+						  FI_ADDR_UNSPEC;
+	do {
+		ret = fi_trecv(ep, rx_buf, opts.transfer_size +
+			       ft_rx_prefix_size(), mr_desc, addr, tag, 0,
+			       &ctx_arr[i]);
+		if (ret == -FI_EAGAIN)
+			(void) fi_cq_read(rxcq, NULL, 0);
+	} while (ret == -FI_EAGAIN);
+
+	if (ret)
+		FT_PRINTERR("fi_trecv", ret);
+	return (int) ret;
+}
+
+static int post_send(int i, uint64_t tag)
+{
+	size_t size = opts.transfer_size + ft_tx_prefix_size();
+	ssize_t ret;
+
+	do {
+		if (opts.transfer_size <= fi->tx_attr->inject_size)
+			ret = fi_tinject(ep, tx_buf, size, remote_fi_addr, tag);
+		else
+			ret = fi_tsend(ep, tx_buf, size, mr_desc,
+				       remote_fi_addr, tag, &ctx_arr[i]);
+		if (ret == -FI_EAGAIN)
+			(void) fi_cq_read(txcq, NULL, 0);
+	} while (ret == -FI_EAGAIN);
+
+	if (ret) {
+		FT_PRINTERR("fi_tsend", ret);
+		return (int) ret;
+	}
+
+	if (opts.transfer_size <= fi->tx_attr->inject_size)
+		tx_done++;
+	return 0;
+}
+
+/*
+ * In the default mode the receiver posts its receives, then tells the sender
+ * to go with a control message.  Only the sender receives control messages,
+ * so every receive completion at the receiver belongs to the batch.  In
+ * unexpected mode the two sides sync out of band before and after the
+ * sender's batch, so the receiver only posts once every message was sent.
+ */
+static int send_batch(int depth, uint64_t *tx_total)
+{
+	int i, ret;
+
+	ret = unexp_mode ? ft_sync() : ft_rx(ep, 1);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < depth; i++) {
+		ret = post_send(i, TM_TAG_BASE +
+				(unexp_mode ? i : depth - 1 - i));
+		if (ret)
+			return ret;
+	}
+
+	*tx_total += depth;
+	ret = reap_cq(txcq, &tx_done, *tx_total);
+	if (ret)
+		return ret;
+
+	return unexp_mode ? ft_sync() : 0;
+}
+
+static int recv_batch(int depth, uint64_t *rx_total, uint64_t *elapsed)
+{
+	uint64_t start_ns = 0;
+	int i, ret;
+
+	if (unexp_mode) {
+		ret = ft_sync();
+		if (ret)
+			return ret;
+
+		ret = ft_sync();
+		if (ret)
+			return ret;
+
+		start_ns = ft_gettime_ns();
+		for (i = depth - 1; i >= 0; i--) {
+			ret = post_recv(i, TM_TAG_BASE + i);
+			if (ret)
+				return ret;
+		}
+	} else {
+		for (i = 0; i < depth; i++) {
+			ret = post_recv(i, TM_TAG_BASE + i);
+			if (ret)
+				return ret;
+		}
+
+		ret = ft_tx(ep, remote_fi_addr, 1, &tx_ctx);
+		if (ret)
+			return ret;
+		start_ns = ft_gettime_ns();
+	}
+
+	*rx_total += depth;
+	ret = reap_cq(rxcq, &rx_done, *rx_total);
+	*elapsed += ft_gettime_ns() - start_ns;
+	return ret;
+}
+
+static int run(void)
+{
+	uint64_t total = 0, elapsed;
+	int depth, iter, iters, ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	ctx_arr = calloc(max_depth, sizeof(*ctx_arr));
+	if (!ctx_arr)
+		return -FI_ENOMEM;
+
+	if (!opts.dst_addr)
+		printf("%-10s%-10s%-12s%-12s%s\n", "depth", "iters", "msgs",
+		       "usec/msg", "Mmsg/sec");
+
+	for (depth = 1; depth <= max_depth; depth <<= 1) {
+		iters = MAX(1, opts.iterations / depth);
+		elapsed = 0;
+		for (iter = 0; iter < iters; iter++) {
+			ret = opts.dst_addr ? send_batch(depth, &total) :
+				recv_batch(depth, &total, &elapsed);
+			if (ret)
+				goto out;
+		}
+
+		if (!opts.dst_addr) {
+			printf("%-10d%-10d%-12d%-12.3f%.3f\n", depth, iters,
+			       depth * iters,
+			       elapsed / 1000.0 / (depth * iters),
+			       (depth * iters) * 1000.0 / elapsed);
+		}
+	}
+
+	ret = ft_finalize();
+out:
+	free(ctx_arr);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_SIZE;
+	opts.transfer_size = 4;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt_long(argc, argv, "q:ruh" CS_OPTS INFO_OPTS
+				 BENCHMARK_OPTS, long_opts, &lopt_idx)) != -1) {
+		switch (op) {
+		default:
+			if (!ft_parse_long_opts(op, optarg))
+				continue;
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'q':
+			max_depth = atoi(optarg);
+			break;
+		case 'r':
+			hints->caps |= FI_DIRECTED_RECV;
+			break;
+		case 'u':
+			unexp_mode = true;
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Tag matching rate versus posted or "
+				   "unexpected queue depth.");
+			ft_benchmark_usage();
+			FT_PRINT_OPTS_USAGE("-q <depth>",
+				"maximum queue depth, swept in powers of 2 "
+				"(default 1024)");
+			FT_PRINT_OPTS_USAGE("-r", "post receives with a source "
+				"address (FI_DIRECTED_RECV)");
+			FT_PRINT_OPTS_USAGE("-u", "match against unexpected "
+				"messages, requires -b");
+			ft_longopts_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	if (max_depth <= 0) {
+		FT_ERR("queue depth must be positive\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Unexpected messages may stall the data path until they are
+	 * matched, so the sync following them must go out of band.
+	 */
+	if (unexp_mode && !(opts.options & FT_OPT_OOB_SYNC)) {
+		FT_ERR("unexpected mode requires out of band sync (-b)\n");
+		return EXIT_FAILURE;
+	}
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->domain_attr->resource_mgmt = FI_RM_ENABLED;
+	hints->caps |= FI_TAGGED;
+	hints->mode |= FI_CONTEXT | FI_CONTEXT2;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+	hints->addr_format = opts.address_format;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -32,6 +32,8 @@
 #include <getopt.h>
 #include <unistd.h>
 
+#include <rdma/fi_tagged.h>
+
 #include <shared.h>
 
 
@@ -190,6 +192,116 @@ out:
 	return ret;
 }
 
+#define LATE_TAG 0xa5a5
+
+/* Wait for the late receive, ignoring the receive posted at setup */
+static int av_late_wait(struct fi_context *ctx)
+{
+	struct fi_cq_tagged_entry comp;
+	fi_addr_t src_addr;
+	int ret, i;
+
+	for (i = 0; i < 5000; i++) {
+		ret = fi_cq_readfrom(rxcq, &comp, 1, &src_addr);
+		if (ret == -FI_EAGAIN) {
+			usleep(1000);
+			continue;
+		}
+		if (ret < 0) {
+			ft_cq_readerr(rxcq);
+			return ret;
+		}
+		if (comp.op_context != ctx)
+			continue;
+		if ((fi->caps & FI_SOURCE) && src_addr != remote_fi_addr) {
+			FT_ERR("source %" PRIu64 ", expected %" PRIu64,
+			       src_addr, remote_fi_addr);
+			return -FI_EOTHER;
+		}
+		return 0;
+	}
+	FT_ERR("directed receive did not match the earlier message");
+	return -FI_ETIMEDOUT;
+}
+
+/* A message that arrives before its sender is in the AV must still match
+ * a directed receive posted after the sender is inserted.
+ */
+static int av_late_insert_test(void)
+{
+	struct fi_context late_ctx;
+	int ret, i;
+
+	fprintf(stdout, "AV insertion after message arrival: ");
+	hints = fi_dupinfo(base_hints);
+	if (!hints)
+		return -FI_ENOMEM;
+
+	hints->caps |= FI_DIRECTED_RECV | FI_SOURCE;
+	/* the setup receive must not be directed at a stale address */
+	remote_fi_addr = FI_ADDR_UNSPEC;
+	ret = ft_init_fabric();
+	if (ret)
+		goto out;
+
+	if (!opts.dst_addr) {
+		ret = fi_av_remove(av, &remote_fi_addr, 1, 0);
+		if (ret) {
+			FT_PRINTERR("fi_av_remove", ret);
+			goto out;
+		}
+	}
+
+	ret = ft_sync();
+	if (ret)
+		goto out;
+
+	if (opts.dst_addr) {
+		ret = ft_post_tx_buf(ep, remote_fi_addr, opts.transfer_size,
+				     NO_CQ_DATA, &late_ctx, tx_buf, mr_desc,
+				     LATE_TAG);
+		if (ret)
+			goto out;
+		ret = ft_get_tx_comp(tx_seq);
+		if (ret)
+			goto out;
+	} else {
+		/* progress until the message is queued as unexpected */
+		for (i = 0; i < 200; i++) {
+			(void) fi_cq_read(rxcq, NULL, 0);
+			usleep(1000);
+		}
+	}
+
+	ret = ft_sync();
+	if (ret)
+		goto out;
+
+	ret = ft_init_av();
+	if (ret)
+		goto out;
+
+	if (!opts.dst_addr) {
+		ret = fi_trecv(ep, rx_buf, rx_size, mr_desc, remote_fi_addr,
+			       LATE_TAG, 0, &late_ctx);
+		if (ret) {
+			FT_PRINTERR("fi_trecv", ret);
+			goto out;
+		}
+		ret = av_late_wait(&late_ctx);
+		if (ret)
+			goto out;
+	}
+
+	(void) ft_sync();
+out:
+	fprintf(stdout, "%s\n", ret ? "FAIL" : "PASS");
+	fi_freeinfo(hints);
+	hints = NULL;
+	ft_free_res();
+	return ret;
+}
+
 /*
  Test flow proposal for directed receive
  client (dst_addr):
@@ -249,6 +361,14 @@ int main(int argc, char **argv)
 	if (ret && ret != -FI_ENODATA)
 		goto out;
 
+	if (base_hints->caps & FI_TAGGED) {
+		if (opts.dst_addr)
+			sleep(1);
+		ret = av_late_insert_test();
+		if (ret && ret != -FI_ENODATA)
+			goto out;
+	}
+
 out:
 	return ft_exit_code(ret);
 }
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2024 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * The client sends repeatedly from one memfd backed buffer, which shm can
+ * carry with its attach protocol.  The last 8 bytes of each message hold
+ * the iteration, so a receiver that copies from a stale mapping fails.
+ * Run with FI_SHM_DISABLE_CMA=1 to cover attach without CMA, and with
+ * FI_SHM_DISABLE_ATTACH=1 on the server to cover its SAR fallback.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <rdma/fi_errno.h>
+
+#include <shared.h>
+
+#define MEMFD_MR_KEY	(FT_MR_KEY + 1)
+
+static struct fid_mr *memfd_mr;
+static void *memfd_desc;
+static char *memfd_buf;
+static size_t memfd_size;
+static int memfd = -1;
+
+static int alloc_memfd(void)
+{
+#if HAVE_MEMFD_CREATE
+	long page_size;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	memfd_size = (opts.transfer_size + page_size - 1) & ~(page_size - 1);
+
+	memfd = memfd_create("fi_memfd_send", MFD_CLOEXEC);
+	if (memfd < 0) {
+		FT_PRINTERR("memfd_create", -errno);
+		return -errno;
+	}
+
+	if (ftruncate(memfd, memfd_size)) {
+		FT_PRINTERR("ftruncate", -errno);
+		return -errno;
+	}
+
+	memfd_buf = mmap(NULL, memfd_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, memfd, 0);
+	if (memfd_buf == MAP_FAILED) {
+		memfd_buf = NULL;
+		FT_PRINTERR("mmap", -errno);
+		return -errno;
+	}
+
+	return ft_reg_mr(fi, memfd_buf, memfd_size, FI_SEND, MEMFD_MR_KEY,
+			 &memfd_mr, &memfd_desc);
+#else
+	fprintf(stderr, "memfd_create is not available\n");
+	return -FI_ENOSYS;
+#endif
+}
+
+static void free_memfd(void)
+{
+	FT_CLOSE_FID(memfd_mr);
+	if (memfd_buf)
+		munmap(memfd_buf, memfd_size);
+	if (memfd >= 0)
+		close(memfd);
+}
+
+static char *stamp(char *buf)
+{
+	return buf + opts.transfer_size - sizeof(uint64_t);
+}
+
+static int run_client(void)
+{
+	uint64_t i;
+	int ret;
+
+	ret = alloc_memfd();
+	if (ret)
+		return ret;
+
+	ret = ft_fill_buf(memfd_buf, opts.transfer_size - sizeof(i));
+	if (ret)
+		return ret;
+
+	for (i = 0; i < opts.iterations; i++) {
+		memcpy(stamp(memfd_buf), &i, sizeof(i));
+		ret = ft_post_tx_buf(ep, remote_fi_addr, opts.transfer_size,
+				     NO_CQ_DATA, &tx_ctx, memfd_buf,
+				     memfd_desc, ft_tag);
+		if (ret)
+			return ret;
+
+		ret = ft_get_tx_comp(tx_seq);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int run_server(void)
+{
+	uint64_t i, seen;
+	int ret;
+
+	/* A receive is already posted by ft_init_fabric */
+	for (i = 0; i < opts.iterations; i++) {
+		ret = ft_get_rx_comp(rx_seq);
+		if (ret)
+			return ret;
+
+		ret = ft_check_buf(rx_buf, opts.transfer_size - sizeof(i));
+		if (ret)
+			return ret;
+
+		memcpy(&seen, stamp(rx_buf), sizeof(seen));
+		if (seen != i) {
+			fprintf(stderr, "Message %" PRIu64 " holds data of "
+				"message %" PRIu64 "\n", i, seen);
+			return -FI_EIO;
+		}
+
+		ret = ft_post_rx(ep, opts.transfer_size, &rx_ctx);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int run(void)
+{
+	int ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	ret = opts.dst_addr ? run_client() : run_server();
+	if (ret)
+		goto out;
+
+	ret = ft_finalize();
+	if (!ret)
+		printf("%d sends of %zu bytes from a memfd buffer verified\n",
+		       opts.iterations, opts.transfer_size);
+out:
+	free_memfd();
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_SIZE;
+	opts.transfer_size = 65536;
+	opts.iterations = 16;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "hI:S:" ADDR_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parse_addr_opts(op, optarg, &opts);
+			ft_parseinfo(op, optarg, hints, &opts);
+			break;
+		case 'I':
+			opts.iterations = atoi(optarg);
+			break;
+		case 'S':
+			opts.transfer_size = strtoul(optarg, NULL, 0);
+			break;
+		case '?':
+		case 'h':
+			ft_usage(argv[0], "Repeated sends from a memfd buffer.");
+			FT_PRINT_OPTS_USAGE("-I <number>",
+					    "number of iterations (default 16)");
+			FT_PRINT_OPTS_USAGE("-S <size>",
+					    "message size (default 65536)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	if (opts.transfer_size < sizeof(uint64_t)) {
+		fprintf(stderr, "Message size must be at least 8 bytes\n");
+		return EXIT_FAILURE;
+	}
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2024 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Both sides open a set of peer endpoints and exchange their addresses.
+ * Each side then preconnects its main endpoint to the peer endpoints of
+ * the other side, with one address that is not in the AV among them.
+ * The request must report that address with FI_EADDRNOTAVAIL, followed
+ * by a single completion that counts the connected peers, and a second
+ * request must be refused while the first is outstanding.  A message
+ * to every peer endpoint then checks that the connections work.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_endpoint.h>
+#include <rdma/fi_eq.h>
+
+#include <shared.h>
+
+static struct fid_ep **peer_eps;
+static struct fid_cq **peer_txcqs, **peer_rxcqs;
+static struct fi_context *peer_ctx;
+static fi_addr_t *peer_addrs;
+static char *peer_bufs;
+static struct fid_mr *peer_mr;
+static void *peer_desc;
+static struct fi_info *peer_info;
+static int num_peers = 4;
+static int preconnect_ctx;
+
+static void free_peer_res(void)
+{
+	int i;
+
+	FT_CLOSE_FID(peer_mr);
+	for (i = 0; peer_eps && i < num_peers; i++) {
+		FT_CLOSE_FID(peer_eps[i]);
+		FT_CLOSE_FID(peer_txcqs[i]);
+		FT_CLOSE_FID(peer_rxcqs[i]);
+	}
+
+	free(peer_eps);
+	free(peer_txcqs);
+	free(peer_rxcqs);
+	free(peer_ctx);
+	free(peer_addrs);
+	free(peer_bufs);
+	fi_freeinfo(peer_info);
+}
+
+/* The peer endpoints take any free port, rather than the one given by
+ * the -B option to the main endpoint.
+ */
+static int get_peer_info(void)
+{
+	struct fi_info *peer_hints;
+	int ret;
+
+	peer_hints = fi_dupinfo(fi);
+	if (!peer_hints)
+		return -FI_ENOMEM;
+
+	free(peer_hints->src_addr);
+	peer_hints->src_addr = NULL;
+	peer_hints->src_addrlen = 0;
+	ret = fi_getinfo(FT_FIVERSION, opts.src_addr, NULL, 0, peer_hints,
+			 &peer_info);
+	if (ret)
+		FT_PRINTERR("fi_getinfo", ret);
+
+	fi_freeinfo(peer_hints);
+	return ret;
+}
+
+static int alloc_peer_res(void)
+{
+	int i, ret;
+
+	peer_eps = calloc(num_peers, sizeof(*peer_eps));
+	peer_txcqs = calloc(num_peers, sizeof(*peer_txcqs));
+	peer_rxcqs = calloc(num_peers, sizeof(*peer_rxcqs));
+	peer_ctx = calloc(num_peers, sizeof(*peer_ctx));
+	peer_addrs = calloc(num_peers, sizeof(*peer_addrs));
+	peer_bufs = calloc(num_peers, opts.transfer_size);
+	if (!peer_eps || !peer_txcqs || !peer_rxcqs || !peer_ctx ||
+	    !peer_addrs || !peer_bufs)
+		return -FI_ENOMEM;
+
+	ret = get_peer_info();
+	if (ret)
+		return ret;
+
+	ret = ft_reg_mr(fi, peer_bufs, num_peers * opts.transfer_size,
+			FI_RECV, FT_MR_KEY + 1, &peer_mr, &peer_desc);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < num_peers; i++) {
+		ret = fi_endpoint(domain, peer_info, &peer_eps[i], NULL);
+		if (ret) {
+			FT_PRINTERR("fi_endpoint", ret);
+			return ret;
+		}
+
+		ret = ft_alloc_ep_res(peer_info, &peer_txcqs[i], &peer_rxcqs[i],
+				      NULL, NULL);
+		if (ret)
+			return ret;
+
+		ret = ft_enable_ep(peer_eps[i], eq, av, peer_txcqs[i],
+				   peer_rxcqs[i], NULL, NULL);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < num_peers; i++) {
+		ret = ft_init_av_addr(av, peer_eps[i], &peer_addrs[i]);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* The peer endpoints accept connections only as they are progressed */
+static void progress_all(void)
+{
+	int i;
+
+	(void) fi_cq_read(txcq, NULL, 0);
+	(void) fi_cq_read(rxcq, NULL, 0);
+	for (i = 0; i < num_peers; i++) {
+		(void) fi_cq_read(peer_txcqs[i], NULL, 0);
+		(void) fi_cq_read(peer_rxcqs[i], NULL, 0);
+	}
+}
+
+static int read_preconnect_event(struct fi_eq_err_entry *entry)
+{
+	uint32_t event;
+	ssize_t ret;
+
+	memset(entry, 0, sizeof(*entry));
+	do {
+		progress_all();
+		ret = fi_eq_read(eq, &event, entry, sizeof(*entry), 0);
+	} while (ret == -FI_EAGAIN);
+
+	if (ret == -FI_EAVAIL) {
+		ret = fi_eq_readerr(eq, entry, 0);
+		if (ret != sizeof(*entry)) {
+			FT_PRINTERR("fi_eq_readerr", ret);
+			return (int) ret;
+		}
+		event = FI_PRECONNECT_COMPLETE;
+	} else if (ret < 0) {
+		FT_PRINTERR("fi_eq_read", ret);
+		return (int) ret;
+	}
+
+	if (event != FI_PRECONNECT_COMPLETE || entry->fid != &ep->fid ||
+	    entry->context != &preconnect_ctx) {
+		fprintf(stderr, "Unexpected event %s\n",
+			fi_tostr(&event, FI_TYPE_EQ_EVENT));
+		return -FI_EOTHER;
+	}
+
+	return 0;
+}
+
+/* Returns the number of connected peers, after checking that each entry
+ * in the bad set was reported as FI_EADDRNOTAVAIL and nothing else was.
+ */
+static int wait_preconnect(size_t bad)
+{
+	struct fi_eq_err_entry entry, next;
+	size_t errors = 0;
+	uint32_t event;
+	int ret;
+
+	for (;;) {
+		ret = read_preconnect_event(&entry);
+		if (ret)
+			return ret;
+
+		if (!entry.err)
+			break;
+
+		if (entry.err != FI_EADDRNOTAVAIL || entry.data != bad) {
+			fprintf(stderr, "Entry %" PRIu64 " failed: %s\n",
+				entry.data, fi_strerror(entry.err));
+			return -FI_EOTHER;
+		}
+		errors++;
+	}
+
+	if (errors != (bad == SIZE_MAX ? 0 : 1)) {
+		fprintf(stderr, "%zu entries reported as not in the AV\n",
+			errors);
+		return -FI_EOTHER;
+	}
+
+	ret = (int) fi_eq_read(eq, &event, &next, sizeof(next), FI_PEEK);
+	if (ret != -FI_EAGAIN) {
+		fprintf(stderr, "Event after the preconnect completion\n");
+		return -FI_EOTHER;
+	}
+
+	return (int) entry.data;
+}
+
+/* A request for peers that are all connected may complete before
+ * fi_setopt returns, so is not checked for -FI_EBUSY.
+ */
+static int preconnect(fi_addr_t *addrs, size_t count, size_t bad,
+		      bool check_busy)
+{
+	struct fi_preconnect req;
+	int ret;
+
+	req.addr = addrs;
+	req.count = count;
+	req.context = &preconnect_ctx;
+	ret = fi_setopt(&ep->fid, FI_OPT_ENDPOINT, FI_OPT_PRECONNECT,
+			&req, sizeof(req));
+	if (ret == -FI_ENOPROTOOPT) {
+		fprintf(stderr, "FI_OPT_PRECONNECT is not supported\n");
+		return -FI_ENODATA;
+	} else if (ret) {
+		FT_PRINTERR("fi_setopt", ret);
+		return ret;
+	}
+
+	ret = check_busy ? fi_setopt(&ep->fid, FI_OPT_ENDPOINT,
+				     FI_OPT_PRECONNECT, &req, sizeof(req)) :
+			   -FI_EBUSY;
+	if (ret != -FI_EBUSY) {
+		fprintf(stderr, "Second request returned %d, expected %d\n",
+			ret, -FI_EBUSY);
+		return -FI_EOTHER;
+	}
+
+	return wait_preconnect(bad);
+}
+
+static int send_to_peers(void)
+{
+	struct fi_cq_tagged_entry comp;
+	ssize_t rd;
+	int i, ret;
+
+	for (i = 0; i < num_peers; i++) {
+		ret = fi_recv(peer_eps[i], peer_bufs + i * opts.transfer_size,
+			      opts.transfer_size, peer_desc, FI_ADDR_UNSPEC,
+			      &peer_ctx[i]);
+		if (ret) {
+			FT_PRINTERR("fi_recv", ret);
+			return ret;
+		}
+	}
+
+	for (i = 0; i < num_peers; i++) {
+		ret = ft_post_tx(ep, peer_addrs[i], opts.transfer_size,
+				 NO_CQ_DATA, &tx_ctx);
+		if (ret)
+			return ret;
+
+		ret = ft_get_tx_comp(tx_seq);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < num_peers; i++) {
+		do {
+			progress_all();
+			rd = fi_cq_read(peer_rxcqs[i], &comp, 1);
+		} while (rd == -FI_EAGAIN);
+
+		if (rd == -FI_EAVAIL)
+			return ft_cq_readerr(peer_rxcqs[i]);
+		if (rd < 0) {
+			FT_PRINTERR("fi_cq_read", rd);
+			return (int) rd;
+		}
+	}
+
+	return 0;
+}
+
+static int run(void)
+{
+	fi_addr_t *addrs;
+	size_t bad;
+	int ret;
+
+	ret = ft_init();
+	if (ret)
+		return ret;
+
+	ret = ft_init_oob();
+	if (ret)
+		return ret;
+
+	ret = ft_getinfo(hints, &fi);
+	if (ret)
+		return ret;
+
+	ret = ft_open_fabric_res();
+	if (ret)
+		return ret;
+
+	ret = ft_alloc_active_res(fi);
+	if (ret)
+		return ret;
+
+	/* Preconnect events are reported on the EQ of the endpoint */
+	FT_EP_BIND(ep, eq, 0);
+	ret = ft_enable_ep_recv();
+	if (ret)
+		return ret;
+
+	ret = ft_init_av();
+	if (ret)
+		return ret;
+
+	ret = alloc_peer_res();
+	if (ret)
+		return ret;
+
+	addrs = calloc(num_peers + 1, sizeof(*addrs));
+	if (!addrs)
+		return -FI_ENOMEM;
+
+	bad = num_peers / 2;
+	memcpy(addrs, peer_addrs, bad * sizeof(*addrs));
+	addrs[bad] = FI_ADDR_NOTAVAIL;
+	memcpy(&addrs[bad + 1], &peer_addrs[bad],
+	       (num_peers - bad) * sizeof(*addrs));
+
+	ret = preconnect(addrs, num_peers + 1, bad, true);
+	if (ret >= 0 && ret != num_peers) {
+		fprintf(stderr, "%d peers connected, expected %d\n",
+			ret, num_peers);
+		ret = -FI_EOTHER;
+	}
+	if (ret < 0)
+		goto out;
+	printf("Preconnected to %d peers\n", ret);
+
+	/* Connected peers complete again without failures */
+	ret = preconnect(peer_addrs, num_peers, SIZE_MAX, false);
+	if (ret >= 0 && ret != num_peers) {
+		fprintf(stderr, "%d peers reconnected, expected %d\n",
+			ret, num_peers);
+		ret = -FI_EOTHER;
+	}
+	if (ret < 0)
+		goto out;
+
+	ret = send_to_peers();
+	if (ret)
+		goto out;
+
+	ret = ft_finalize();
+	if (!ret)
+		printf("PASSED preconnect\n");
+out:
+	free(addrs);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_SIZE | FT_OPT_OOB_ADDR_EXCH;
+	opts.transfer_size = 64;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "hC:" ADDR_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parse_addr_opts(op, optarg, &opts);
+			ft_parseinfo(op, optarg, hints, &opts);
+			break;
+		case 'C':
+			num_peers = atoi(optarg);
+			break;
+		case '?':
+		case 'h':
+			ft_usage(argv[0], "Preconnect to a set of peers.");
+			FT_PRINT_OPTS_USAGE("-C <number>",
+					    "number of peer endpoints (default 4)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	if (num_peers < 1) {
+		fprintf(stderr, "At least one peer endpoint is needed\n");
+		return EXIT_FAILURE;
+	}
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	opts.av_size = num_peers + 1;
+
+	ret = run();
+
+	free_peer_res();
+	ft_free_res();
+	return ft_exit_code(ret);
+}
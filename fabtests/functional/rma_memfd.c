@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2024 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * The server registers a memfd backed buffer and then blocks on the out of
+ * band socket without progressing its endpoint.  The client writes to,
+ * reads from and adds to the buffer, and each operation must complete
+ * within the timeout.  Providers that complete RMA to shared mappings
+ * without the target (shm with FI_SHM_ENABLE_DIRECT_RMA=1) pass.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_atomic.h>
+
+#include <shared.h>
+
+#define MEMFD_MR_KEY	(FT_MR_KEY + 1)
+
+static struct fid_mr *memfd_mr;
+static char *memfd_buf;
+static size_t memfd_size;
+static int memfd = -1;
+static int comp_timeout = 10;
+
+/* Layout of the memfd buffer: write target, read source, atomic target */
+static char *write_buf(void)
+{
+	return memfd_buf;
+}
+
+static char *read_buf(void)
+{
+	return memfd_buf + opts.transfer_size;
+}
+
+static uint64_t *atomic_buf(void)
+{
+	return (uint64_t *) (memfd_buf + 2 * opts.transfer_size);
+}
+
+static int alloc_memfd(void)
+{
+#if HAVE_MEMFD_CREATE
+	long page_size;
+	int ret;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	memfd_size = 2 * opts.transfer_size + sizeof(uint64_t);
+	memfd_size = (memfd_size + page_size - 1) & ~(page_size - 1);
+
+	memfd = memfd_create("fi_rma_memfd", MFD_CLOEXEC);
+	if (memfd < 0) {
+		FT_PRINTERR("memfd_create", -errno);
+		return -errno;
+	}
+
+	if (ftruncate(memfd, memfd_size)) {
+		FT_PRINTERR("ftruncate", -errno);
+		return -errno;
+	}
+
+	memfd_buf = mmap(NULL, memfd_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, memfd, 0);
+	if (memfd_buf == MAP_FAILED) {
+		memfd_buf = NULL;
+		FT_PRINTERR("mmap", -errno);
+		return -errno;
+	}
+
+	memset(memfd_buf, 0, memfd_size);
+	ret = ft_fill_buf(read_buf(), opts.transfer_size);
+	if (ret)
+		return ret;
+
+	return ft_reg_mr(fi, memfd_buf, memfd_size,
+			 FI_REMOTE_READ | FI_REMOTE_WRITE, MEMFD_MR_KEY,
+			 &memfd_mr, NULL);
+#else
+	fprintf(stderr, "memfd_create is not available\n");
+	return -FI_ENOSYS;
+#endif
+}
+
+static void free_memfd(void)
+{
+	FT_CLOSE_FID(memfd_mr);
+	if (memfd_buf)
+		munmap(memfd_buf, memfd_size);
+	if (memfd >= 0)
+		close(memfd);
+}
+
+static int get_tx_comp(const char *op)
+{
+	int ret;
+
+	ret = ft_get_cq_comp(txcq, &tx_cq_cntr, tx_seq, comp_timeout);
+	if (ret)
+		fprintf(stderr, "%s did not complete without target progress\n",
+			op);
+	return ret;
+}
+
+static int run_client(struct fi_rma_iov *remote_iov)
+{
+	struct fi_rma_iov remote = *remote_iov;
+	uint64_t *operand = (uint64_t *) tx_buf;
+	size_t count;
+	int ret;
+
+	ret = fi_atomicvalid(ep, FI_UINT64, FI_SUM, &count);
+	if (ret)
+		return ret;
+
+	ret = ft_fill_buf(tx_buf, opts.transfer_size);
+	if (ret)
+		return ret;
+
+	ret = ft_post_rma(FT_RMA_WRITE, ep, opts.transfer_size, &remote,
+			  &tx_ctx);
+	if (ret)
+		return ret;
+
+	ret = get_tx_comp("fi_write");
+	if (ret)
+		return ret;
+
+	remote.addr = remote_iov->addr + opts.transfer_size;
+	memset(rx_buf, 0, opts.transfer_size);
+	ret = ft_post_rma(FT_RMA_READ, ep, opts.transfer_size, &remote,
+			  &tx_ctx);
+	if (ret)
+		return ret;
+
+	ret = get_tx_comp("fi_read");
+	if (ret)
+		return ret;
+
+	ret = ft_check_buf(rx_buf, opts.transfer_size);
+	if (ret)
+		return ret;
+
+	*operand = 1;
+	remote.addr = remote_iov->addr + 2 * opts.transfer_size;
+	do {
+		ret = fi_atomic(ep, operand, 1, mr_desc, remote_fi_addr,
+				remote.addr, remote.key, FI_UINT64, FI_SUM,
+				&tx_ctx);
+		if (ret == -FI_EAGAIN)
+			(void) fi_cq_read(txcq, NULL, 0);
+	} while (ret == -FI_EAGAIN);
+	if (ret)
+		return ret;
+
+	tx_seq++;
+	return get_tx_comp("fi_atomic");
+}
+
+static int run_server(void)
+{
+	int ret;
+
+	ret = ft_check_buf(write_buf(), opts.transfer_size);
+	if (ret)
+		return ret;
+
+	if (*atomic_buf() != 1) {
+		fprintf(stderr, "Atomic result %" PRIu64 " != 1\n",
+			*atomic_buf());
+		return -FI_EIO;
+	}
+
+	return 0;
+}
+
+static int run(void)
+{
+	struct fi_rma_iov rma_iov;
+	int ret, status;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	/* Connect the endpoints while both sides still progress */
+	if (opts.dst_addr) {
+		ret = ft_tx(ep, remote_fi_addr, 1, &tx_ctx);
+		if (!ret)
+			ret = ft_rx(ep, 1);
+	} else {
+		ret = ft_rx(ep, 1);
+		if (!ret)
+			ret = ft_tx(ep, remote_fi_addr, 1, &tx_ctx);
+	}
+	if (ret)
+		return ret;
+
+	if (!opts.dst_addr) {
+		ret = alloc_memfd();
+		if (ret)
+			goto out;
+
+		rma_iov.addr = (fi->domain_attr->mr_mode & FI_MR_VIRT_ADDR) ?
+			       (uintptr_t) memfd_buf : 0;
+		rma_iov.len = memfd_size;
+		rma_iov.key = fi_mr_key(memfd_mr);
+		ret = ft_sock_send(oob_sock, &rma_iov, sizeof(rma_iov));
+		if (ret)
+			goto out;
+
+		/* Block without progressing until the client is done.
+		 * ft_sock_recv would drive progress while it waits.
+		 */
+		ret = ft_poll_fd(oob_sock, -1);
+		if (ret)
+			goto out;
+
+		ret = ft_sock_recv(oob_sock, &status, sizeof(status));
+		if (ret)
+			goto out;
+
+		ret = status ? status : run_server();
+		status = ret;
+		ret = ft_sock_send(oob_sock, &status, sizeof(status));
+		if (!ret)
+			ret = status;
+	} else {
+		ret = ft_sock_recv(oob_sock, &rma_iov, sizeof(rma_iov));
+		if (ret)
+			goto out;
+
+		status = run_client(&rma_iov);
+		ret = ft_sock_send(oob_sock, &status, sizeof(status));
+		if (ret)
+			goto out;
+
+		ret = ft_sock_recv(oob_sock, &status, sizeof(status));
+		if (!ret)
+			ret = status;
+	}
+
+	if (!ret)
+		printf("RMA write, read and atomic completed without target "
+		       "progress\n");
+out:
+	free_memfd();
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_SIZE | FT_OPT_OOB_CTRL;
+	opts.transfer_size = 4096;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "hT:" ADDR_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parse_addr_opts(op, optarg, &opts);
+			ft_parseinfo(op, optarg, hints, &opts);
+			break;
+		case 'T':
+			comp_timeout = atoi(optarg);
+			break;
+		case '?':
+		case 'h':
+			ft_usage(argv[0], "RMA to a memfd registration while "
+				 "the target does not progress.");
+			FT_PRINT_OPTS_USAGE("-T <seconds>",
+					    "completion timeout (default 10)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG | FI_RMA | FI_ATOMIC;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -276,6 +276,82 @@ static int sum_all_reduce_test_run()
 	return -FI_ENOEQ;
 }
 
+/*
+ * Large enough, and not a multiple of the group size, to exercise the
+ * segmented allreduce and broadcast algorithms and their uneven blocks.
+ */
+#define VECTOR_CNT	(64 * 1024 + 3)
+
+static int sum_all_reduce_vector_test_run()
+{
+	uint64_t done_flag;
+	uint64_t *data, *result;
+	uint64_t expect_base = 0, nranks = 0;
+	size_t count = VECTOR_CNT;
+	uint64_t i;
+	struct fi_collective_attr attr;
+	int err;
+
+	if (!is_my_rank_participating())
+		return FI_SUCCESS;
+
+	attr.op = FI_SUM;
+	attr.datatype = FI_UINT64;
+	attr.mode = 0;
+	err = fi_query_collective(domain, FI_ALLREDUCE, &attr, 0);
+	if (err) {
+		FT_DEBUG("SUM AllReduce collective not supported: %d (%s)\n",
+			 err, fi_strerror(err));
+		return err;
+	}
+
+	data = malloc(count * sizeof(*data));
+	result = malloc(count * sizeof(*result));
+	if (!data || !result) {
+		err = -FI_ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < count; i++)
+		data[i] = pm_job.my_rank + i;
+
+	for (i = av_set_attr.start_addr;
+	     i <= av_set_attr.end_addr;
+	     i += av_set_attr.stride) {
+		expect_base += i;
+		nranks++;
+	}
+
+	coll_addr = fi_mc_addr(coll_mc);
+	err = fi_allreduce(ep, data, count, NULL, result, NULL, coll_addr,
+			   FI_UINT64, FI_SUM, 0, &done_flag);
+	if (err) {
+		FT_DEBUG("collective allreduce failed: %d (%s)\n",
+			 err, fi_strerror(err));
+		goto out;
+	}
+
+	err = wait_for_comp(&done_flag);
+	if (err)
+		goto out;
+
+	for (i = 0; i < count; i++) {
+		if (result[i] != expect_base + nranks * i) {
+			FT_DEBUG("allreduce failed; expect[%ld]: %ld, "
+				 "actual[%ld]: %ld\n", i,
+				 expect_base + nranks * i, i, result[i]);
+			err = -FI_ENOEQ;
+			goto out;
+		}
+	}
+	err = FI_SUCCESS;
+
+out:
+	free(data);
+	free(result);
+	return err;
+}
+
 static int all_gather_test_run()
 {
 	uint64_t done_flag;
@@ -403,14 +479,12 @@ out:
 	return ret;
 }
 
-static int broadcast_test_run()
+static int broadcast_test(size_t data_cnt, fi_addr_t root)
 {
 	uint64_t done_flag;
 	uint64_t *result, *data;
 	uint64_t i;
 	struct fi_collective_attr attr;
-	fi_addr_t root = 0;
-	size_t data_cnt = pm_job.num_ranks;
 	int err;
 
 	attr.op = FI_NOOP;
@@ -434,8 +508,8 @@ static int broadcast_test_run()
 		return -FI_ENOMEM;
 	}
 
-	for (i = 0; i < pm_job.num_ranks; ++i)
-		data[i] = pm_job.num_ranks - 1 - i;
+	for (i = 0; i < data_cnt; ++i)
+		data[i] = data_cnt - 1 - i;
 
 	coll_addr = fi_mc_addr(coll_mc);
 	if (pm_job.my_rank == root) {
@@ -476,6 +550,237 @@ out:
 	return err;
 }
 
+static int broadcast_test_run()
+{
+	return broadcast_test(pm_job.num_ranks, 0);
+}
+
+/* Spans several pipeline segments, from a root other than rank 0 */
+static int broadcast_vector_test_run()
+{
+	return broadcast_test(VECTOR_CNT, pm_job.num_ranks - 1);
+}
+
+static int alltoall_test(size_t count)
+{
+	uint64_t done_flag;
+	uint64_t *data, *result;
+	uint64_t nranks = pm_job.num_ranks, rank = pm_job.my_rank;
+	uint64_t i, j, expect;
+	struct fi_collective_attr attr;
+	int err;
+
+	attr.op = FI_NOOP;
+	attr.datatype = FI_UINT64;
+	attr.mode = 0;
+
+	err = fi_query_collective(domain, FI_ALLTOALL, &attr, 0);
+	if (err) {
+		FT_DEBUG("Alltoall collective not supported: %d (%s)\n", err,
+			 fi_strerror(err));
+		return err;
+	}
+
+	data = malloc(nranks * count * sizeof(*data));
+	result = malloc(nranks * count * sizeof(*result));
+	if (!data || !result) {
+		err = -FI_ENOMEM;
+		goto out;
+	}
+
+	/* block j of rank i holds (i * nranks + j) * count + offset */
+	for (i = 0; i < nranks * count; i++)
+		data[i] = rank * nranks * count + i;
+
+	coll_addr = fi_mc_addr(coll_mc);
+	err = fi_alltoall(ep, data, count, NULL, result, NULL, coll_addr,
+			  FI_UINT64, 0, &done_flag);
+	if (err) {
+		FT_DEBUG("collective alltoall failed: %d (%s)\n",
+			 err, fi_strerror(err));
+		goto out;
+	}
+
+	err = wait_for_comp(&done_flag);
+	if (err)
+		goto out;
+
+	for (i = 0; i < nranks; i++) {
+		for (j = 0; j < count; j++) {
+			expect = (i * nranks + rank) * count + j;
+			if (result[i * count + j] != expect) {
+				FT_DEBUG("alltoall failed; expect[%ld]: %ld, "
+					 "actual: %ld\n", i * count + j,
+					 expect, result[i * count + j]);
+				err = -FI_ENOEQ;
+				goto out;
+			}
+		}
+	}
+	err = FI_SUCCESS;
+
+out:
+	free(data);
+	free(result);
+	return err;
+}
+
+static int alltoall_test_run()
+{
+	return alltoall_test(1);
+}
+
+/* Blocks too large for Bruck's algorithm, so pairwise exchange is used */
+static int alltoall_vector_test_run()
+{
+	return alltoall_test(1027);
+}
+
+static int reduce_scatter_test(size_t count)
+{
+	uint64_t done_flag;
+	uint64_t *data, *result;
+	uint64_t nranks = pm_job.num_ranks, rank = pm_job.my_rank;
+	uint64_t i, expect_base = 0, expect;
+	struct fi_collective_attr attr;
+	int err;
+
+	attr.op = FI_SUM;
+	attr.datatype = FI_UINT64;
+	attr.mode = 0;
+
+	err = fi_query_collective(domain, FI_REDUCE_SCATTER, &attr, 0);
+	if (err) {
+		FT_DEBUG("SUM reduce-scatter collective not supported: %d (%s)\n",
+			 err, fi_strerror(err));
+		return err;
+	}
+
+	data = malloc(nranks * count * sizeof(*data));
+	result = malloc(count * sizeof(*result));
+	if (!data || !result) {
+		err = -FI_ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < nranks * count; i++)
+		data[i] = rank + i;
+
+	for (i = 0; i < nranks; i++)
+		expect_base += i;
+
+	coll_addr = fi_mc_addr(coll_mc);
+	err = fi_reduce_scatter(ep, data, count, NULL, result, NULL, coll_addr,
+				FI_UINT64, FI_SUM, 0, &done_flag);
+	if (err) {
+		FT_DEBUG("collective reduce-scatter failed: %d (%s)\n",
+			 err, fi_strerror(err));
+		goto out;
+	}
+
+	err = wait_for_comp(&done_flag);
+	if (err)
+		goto out;
+
+	for (i = 0; i < count; i++) {
+		expect = expect_base + nranks * (rank * count + i);
+		if (result[i] != expect) {
+			FT_DEBUG("reduce-scatter failed; expect[%ld]: %ld, "
+				 "actual[%ld]: %ld\n", i, expect, i, result[i]);
+			err = -FI_ENOEQ;
+			goto out;
+		}
+	}
+	err = FI_SUCCESS;
+
+out:
+	free(data);
+	free(result);
+	return err;
+}
+
+static int reduce_scatter_test_run()
+{
+	return reduce_scatter_test(1027);
+}
+
+/* Large enough for the ring algorithm */
+static int reduce_scatter_vector_test_run()
+{
+	return reduce_scatter_test(VECTOR_CNT);
+}
+
+static int gather_test(size_t count, fi_addr_t root)
+{
+	uint64_t done_flag;
+	uint64_t *data, *result = NULL;
+	uint64_t nranks = pm_job.num_ranks;
+	uint64_t i;
+	struct fi_collective_attr attr;
+	int err;
+
+	attr.op = FI_NOOP;
+	attr.datatype = FI_UINT64;
+	attr.mode = 0;
+
+	err = fi_query_collective(domain, FI_GATHER, &attr, 0);
+	if (err) {
+		FT_DEBUG("Gather collective not supported: %d (%s)\n", err,
+			 fi_strerror(err));
+		return err;
+	}
+
+	data = malloc(count * sizeof(*data));
+	if (pm_job.my_rank == root)
+		result = malloc(nranks * count * sizeof(*result));
+	if (!data || (pm_job.my_rank == root && !result)) {
+		err = -FI_ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < count; i++)
+		data[i] = pm_job.my_rank * count + i;
+
+	coll_addr = fi_mc_addr(coll_mc);
+	err = fi_gather(ep, data, count, NULL, result, NULL, coll_addr, root,
+			FI_UINT64, 0, &done_flag);
+	if (err) {
+		FT_DEBUG("collective gather failed: %d (%s)\n",
+			 err, fi_strerror(err));
+		goto out;
+	}
+
+	err = wait_for_comp(&done_flag);
+	if (err || pm_job.my_rank != root)
+		goto out;
+
+	for (i = 0; i < nranks * count; i++) {
+		if (result[i] != i) {
+			FT_DEBUG("gather failed; expect[%ld]: %ld, "
+				 "actual[%ld]: %ld\n", i, i, i, result[i]);
+			err = -FI_ENOEQ;
+			goto out;
+		}
+	}
+	err = FI_SUCCESS;
+
+out:
+	free(data);
+	free(result);
+	return err;
+}
+
+static int gather_test_run()
+{
+	return gather_test(1, 0);
+}
+
+/* A root other than rank 0 reorders the gathered blocks */
+static int gather_vector_test_run()
+{
+	return gather_test(1027, pm_job.num_ranks - 1);
+}
+
 struct coll_test tests[] = {
 	{
 		.name = "join_test",
@@ -501,6 +806,18 @@ struct coll_test tests[] = {
 		.run = sum_all_reduce_test_run,
 		.teardown = coll_teardown
 	},
+	{
+		.name = "sum_all_reduce_vector_test",
+		.setup = coll_setup,
+		.run = sum_all_reduce_vector_test_run,
+		.teardown = coll_teardown
+	},
+	{
+		.name = "sum_all_reduce_vector_w_stride_test",
+		.setup = coll_setup_w_stride,
+		.run = sum_all_reduce_vector_test_run,
+		.teardown = coll_teardown
+	},
 	{
 		.name = "all_gather_test",
 		.setup = coll_setup,
@@ -519,6 +836,48 @@ struct coll_test tests[] = {
 		.run = broadcast_test_run,
 		.teardown = coll_teardown,
 	},
+	{
+		.name = "broadcast_vector_test",
+		.setup = coll_setup,
+		.run = broadcast_vector_test_run,
+		.teardown = coll_teardown,
+	},
+	{
+		.name = "alltoall_test",
+		.setup = coll_setup,
+		.run = alltoall_test_run,
+		.teardown = coll_teardown,
+	},
+	{
+		.name = "alltoall_vector_test",
+		.setup = coll_setup,
+		.run = alltoall_vector_test_run,
+		.teardown = coll_teardown,
+	},
+	{
+		.name = "reduce_scatter_test",
+		.setup = coll_setup,
+		.run = reduce_scatter_test_run,
+		.teardown = coll_teardown,
+	},
+	{
+		.name = "reduce_scatter_vector_test",
+		.setup = coll_setup,
+		.run = reduce_scatter_vector_test_run,
+		.teardown = coll_teardown,
+	},
+	{
+		.name = "gather_test",
+		.setup = coll_setup,
+		.run = gather_test_run,
+		.teardown = coll_teardown,
+	},
+	{
+		.name = "gather_vector_test",
+		.setup = coll_setup,
+		.run = gather_vector_test_run,
+		.teardown = coll_teardown,
+	},
 };
 
 const int NUM_TESTS = ARRAY_SIZE(tests);
@@ -143,6 +143,7 @@ functional_tests=(
 	"fi_bw -e msg -v -T 1"
 	"fi_rdm_multi_client -C 10 -I 5"
 	"fi_rdm_multi_client -C 10 -I 5 -U"
+	"fi_rdm_preconnect"
 )
 
 short_tests=(
@@ -176,6 +177,9 @@ short_tests=(
 	"fi_rdm_tagged_bw -I 5 -U"
 	"fi_rdm_tagged_bw -I 5 -v"
 	"fi_rdm_tagged_bw -I 5 -v -U"
+	"fi_rdm_many_to_one -I 5"
+	"fi_rdm_msg_rate -I 5 -T 2"
+	"fi_rdm_tag_match -I 64 -q 64"
 	"fi_dgram_pingpong -I 5"
 )
 
@@ -216,6 +220,11 @@ standard_tests=(
 	"fi_rdm_tagged_bw -U"
 	"fi_rdm_tagged_bw -v"
 	"fi_rdm_tagged_bw -v -U"
+	"fi_rdm_many_to_one"
+	"fi_rdm_msg_rate -T 2"
+	"fi_rdm_msg_rate -T 2 -x -g"
+	"fi_rdm_tag_match"
+	"fi_rdm_tag_match -r"
 	"fi_dgram_pingpong"
 	"fi_dgram_pingpong -k"
 )
@@ -229,6 +238,7 @@ unit_tests=(
 	"fi_cq_test"
 	"fi_mr_test"
 	"fi_cntr_test"
+	"fi_cq_rate -I 100"
 )
 
 regression_tests=(
@@ -39,6 +39,7 @@
 #include <limits.h>
 #include <stdio.h>
 #include <malloc.h>
+#include <pthread.h>
 
 #include "unit_common.h"
 #include "shared.h"
@@ -56,6 +57,8 @@ enum alloc_type {
 static void *reuse_addr = NULL;
 static char err_buf[512];
 static size_t mr_buf_size = 16384;
+static int mr_threads = 8;
+static int mr_iterations = 100000;
 
 /* Given a time value, determine the expected cached time value. The assumption
  * is the cache value should at least have a CACHE_IMPROVEMENT_PERCENT time
@@ -729,12 +732,167 @@ static int mr_cache_rocr_test(void)
 	return ret;
 }
 
+/* Buffers registered by each contention thread.  Every thread works on its
+ * own buffers, so after the first pass all registrations are cache hits and
+ * the measured rate reflects contention on the cache itself.
+ */
+#define MR_CONTENTION_BUFS 16
+
+struct mr_contention_thread {
+	pthread_t thread;
+	int id;
+	void *bufs[MR_CONTENTION_BUFS];
+	int64_t elapsed;
+	int ret;
+};
+
+static pthread_barrier_t mr_contention_barrier;
+
+static void *mr_contention_run(void *arg)
+{
+	struct mr_contention_thread *ctx = arg;
+	struct timespec start_time, end_time;
+	struct iovec iov = {
+		.iov_len = mr_buf_size,
+	};
+	struct fi_mr_attr mr_attr = {
+		.mr_iov = &iov,
+		.iov_count = 1,
+		.access = ft_info_to_mr_access(fi),
+	};
+	struct fid_mr *mr;
+	int i, buf;
+
+	pthread_barrier_wait(&mr_contention_barrier);
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+	for (i = 0; i < mr_iterations; i++) {
+		buf = i % MR_CONTENTION_BUFS;
+		iov.iov_base = ctx->bufs[buf];
+		mr_attr.requested_key = FT_MR_KEY + 1 +
+					ctx->id * MR_CONTENTION_BUFS + buf;
+
+		ctx->ret = fi_mr_regattr(domain, &mr_attr, 0, &mr);
+		if (ctx->ret)
+			return NULL;
+
+		ctx->ret = fi_close(&mr->fid);
+		if (ctx->ret)
+			return NULL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end_time);
+	ctx->elapsed = get_elapsed(&start_time, &end_time, NANO);
+	return NULL;
+}
+
+/* Run registration and deregistration of cached buffers from the given
+ * number of threads and return the aggregate rate in operations per second.
+ */
+static int mr_contention_rate(struct mr_contention_thread *ctx,
+			      int threads, double *rate)
+{
+	int64_t elapsed = 0;
+	int i, ret;
+
+	ret = pthread_barrier_init(&mr_contention_barrier, NULL, threads);
+	if (ret) {
+		FT_UNIT_STRERR(err_buf, "pthread_barrier_init failed", -ret);
+		return -ret;
+	}
+
+	for (i = 0; i < threads; i++) {
+		ctx[i].ret = 0;
+		ret = pthread_create(&ctx[i].thread, NULL, mr_contention_run,
+				     &ctx[i]);
+		if (ret) {
+			FT_UNIT_STRERR(err_buf, "pthread_create failed", -ret);
+			threads = i;
+			ret = -ret;
+			break;
+		}
+	}
+
+	for (i = 0; i < threads; i++) {
+		pthread_join(ctx[i].thread, NULL);
+		if (ctx[i].ret && !ret) {
+			ret = ctx[i].ret;
+			FT_UNIT_STRERR(err_buf, "fi_mr_regattr/fi_close failed",
+				       ret);
+		}
+		elapsed = MAX(elapsed, ctx[i].elapsed);
+	}
+
+	pthread_barrier_destroy(&mr_contention_barrier);
+	if (!ret)
+		*rate = (double) threads * mr_iterations * 1000000000 /
+			MAX(elapsed, 1);
+	return ret;
+}
+
+/* Measure how MR cache lookups scale with the number of threads
+ * registering concurrently.  The test fails only on registration errors;
+ * the rates are reported for comparison.
+ */
+static int mr_cache_contention_test(void)
+{
+	struct mr_contention_thread *ctx;
+	double single_rate, multi_rate;
+	int i, j, ret;
+	int testret = FAIL;
+
+	if (fi->domain_attr->threading != FI_THREAD_SAFE) {
+		sprintf(err_buf, "domain is not FI_THREAD_SAFE");
+		return SKIPPED;
+	}
+
+	ctx = calloc(mr_threads, sizeof(*ctx));
+	if (!ctx) {
+		FT_UNIT_STRERR(err_buf, "calloc failed", -ENOMEM);
+		return TEST_RET_VAL(-ENOMEM, testret);
+	}
+
+	for (i = 0; i < mr_threads; i++) {
+		ctx[i].id = i;
+		for (j = 0; j < MR_CONTENTION_BUFS; j++) {
+			ctx[i].bufs[j] = malloc(mr_buf_size);
+			if (!ctx[i].bufs[j]) {
+				ret = -ENOMEM;
+				FT_UNIT_STRERR(err_buf, "malloc failed", ret);
+				goto free;
+			}
+		}
+	}
+
+	ret = mr_contention_rate(ctx, 1, &single_rate);
+	if (ret)
+		goto free;
+
+	ret = mr_contention_rate(ctx, mr_threads, &multi_rate);
+	if (ret)
+		goto free;
+
+	printf("MR registrations/sec: 1 thread %.0f, %d threads %.0f "
+	       "(%.2fx)\n", single_rate, mr_threads, multi_rate,
+	       multi_rate / single_rate);
+	testret = PASS;
+free:
+	for (i = 0; i < mr_threads; i++) {
+		for (j = 0; j < MR_CONTENTION_BUFS; j++)
+			free(ctx[i].bufs[j]);
+	}
+	free(ctx);
+	return TEST_RET_VAL(ret, testret);
+}
+
 struct test_entry test_array[] = {
 	TEST_ENTRY(mr_cache_mmap_test, "MR cache eviction test using MMAP"),
 	TEST_ENTRY(mr_cache_brk_test, "MR cache eviction test using BRK"),
 	TEST_ENTRY(mr_cache_sbrk_test, "MR cache eviction test using SBRK"),
 	TEST_ENTRY(mr_cache_cuda_test, "MR cache eviction test using CUDA"),
 	TEST_ENTRY(mr_cache_rocr_test, "MR cache eviction test using ROCR"),
+	TEST_ENTRY(mr_cache_contention_test,
+		   "MR cache lookup contention across threads"),
 	{ NULL, "" }
 };
 
@@ -750,8 +908,15 @@ static void usage(char *name)
 		"allocation is returned. This can be used to verify the \n"
 		"underlying physical memory changes between MMAP, BRK, and \n"
 		"SBRK allocations. When running as non-root, the reported \n"
-		"physical address is always zero.");
+		"physical address is always zero.\n\n"
+		"The contention test registers cached buffers from several\n"
+		"threads and reports the aggregate registration rate.  It\n"
+		"is skipped when the domain is not FI_THREAD_SAFE.");
 	FT_PRINT_OPTS_USAGE("-s <bytes>", "Memory region size to be tested.");
+	FT_PRINT_OPTS_USAGE("-T <threads>",
+			    "Threads used by the contention test (default 8).");
+	FT_PRINT_OPTS_USAGE("-N <iterations>",
+			    "Registrations per contention thread (default 100000).");
 	FT_PRINT_OPTS_USAGE("-H", "Enable provider FI_HMEM support");
 }
 
@@ -777,7 +942,7 @@ int main(int argc, char **argv)
 	if (!hints)
 		return EXIT_FAILURE;
 
-	while ((op = getopt(argc, argv, FAB_OPTS "h" "s:")) != -1) {
+	while ((op = getopt(argc, argv, FAB_OPTS "h" "s:T:N:")) != -1) {
 		switch (op) {
 		default:
 			ft_parseinfo(op, optarg, hints, &opts);
@@ -797,6 +962,22 @@ int main(int argc, char **argv)
 				goto out;
 			}
 			break;
+		case 'T':
+			mr_threads = atoi(optarg);
+			if (mr_threads <= 0) {
+				ret = -EINVAL;
+				FT_PRINTERR("Invalid thread count", ret);
+				goto out;
+			}
+			break;
+		case 'N':
+			mr_iterations = atoi(optarg);
+			if (mr_iterations <= 0) {
+				ret = -EINVAL;
+				FT_PRINTERR("Invalid iteration count", ret);
+				goto out;
+			}
+			break;
 		case '?':
 		case 'h':
 			usage(argv[0]);
@@ -808,6 +989,8 @@ int main(int argc, char **argv)
 	hints->domain_attr->mode = ~0;
 	hints->domain_attr->mr_mode = ~(FI_MR_BASIC | FI_MR_SCALABLE);
 	hints->caps |= FI_MSG | FI_RMA;
+	/* the contention test registers from several threads at once */
+	hints->domain_attr->threading = FI_THREAD_SAFE;
 
 	if (opts.options & FT_OPT_ENABLE_HMEM)
 		hints->caps |= FI_HMEM;
@@ -816,6 +999,10 @@ int main(int argc, char **argv)
 	if (ret) {
 		hints->caps &= ~FI_RMA;
 		ret = fi_getinfo(FT_FIVERSION, NULL, 0, 0, hints, &fi);
+	}
+	if (ret) {
+		hints->domain_attr->threading = FI_THREAD_UNSPEC;
+		ret = fi_getinfo(FT_FIVERSION, NULL, 0, 0, hints, &fi);
 		if (ret) {
 			FT_PRINTERR("fi_getinfo", ret);
 			goto out;
@@ -69,6 +69,23 @@ static inline int ofi_alloc_hugepage_buf(void **memptr, size_t size)
 	return ofi_mmap_anon_pages(memptr, size, MAP_HUGETLB);
 }
 
+#ifndef MPOL_LOCAL
+# define MPOL_LOCAL 4
+#endif
+
+/* Place pages on the node of the thread that first touches them,
+ * overriding any process-wide interleave policy.
+ */
+static inline int ofi_mbind_local(void *addr, size_t size)
+{
+#ifdef SYS_mbind
+	return syscall(SYS_mbind, addr, size, MPOL_LOCAL, NULL, 0, 0) ?
+	       -errno : 0;
+#else
+	return -FI_ENOSYS;
+#endif
+}
+
 static inline int ofi_hugepage_enabled(void)
 {
 	size_t len;
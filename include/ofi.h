@@ -217,6 +217,14 @@ enum {
 	OFI_CLFLUSHOPT_BIT	= (1 << 23),
 	OFI_CLFLUSH_REG		= 3,
 	OFI_CLFLUSH_BIT		= (1 << 19),
+	OFI_OSXSAVE_REG		= 2,
+	OFI_OSXSAVE_BIT		= (1 << 27),
+	OFI_AVX2_REG		= 1,
+	OFI_AVX2_BIT		= (1 << 5),
+	OFI_AVX512F_REG		= 1,
+	OFI_AVX512F_BIT		= (1 << 16),
+	OFI_AVX512BW_REG	= 1,
+	OFI_AVX512BW_BIT	= (1 << 30),
 };
 
 int ofi_cpu_supports(unsigned func, unsigned reg, unsigned bit);
@@ -424,6 +432,17 @@ static inline uint32_t ofi_xorshift_random_r(uint32_t *seed)
 
 uint32_t ofi_generate_seed(void);
 
+/* Spread threads over (1 << shift) slots by a multiplicative hash of
+ * their id, for striping state that would otherwise be thread local.
+ */
+static inline size_t ofi_thread_slot(int shift)
+{
+	uint64_t id;
+
+	id = (uint64_t) (uintptr_t) pthread_self() * 0x9e3779b97f4a7c15ULL;
+	return (size_t) (id >> (64 - shift));
+}
+
 size_t ofi_vrb_speed(uint8_t speed, uint8_t width);
 
 int ofi_open_log(uint32_t version, void *attr, size_t attr_len,
@@ -86,6 +86,19 @@ extern void (*ofi_atomic_swap_handlers[OFI_SWAP_OP_CNT][OFI_DATATYPE_CNT])
 	ofi_atomic_swap_handlers[op - OFI_SWAP_OP_START][datatype](dst, src, \
 								cmp, res, cnt)
 
+/* Non-atomic counterparts of the write handlers, for callers that own the
+ * destination buffer or already serialize updates to it.  dst and src must
+ * not overlap.  Entries without a dedicated kernel fall back to the atomic
+ * write handler.
+ */
+extern void (*ofi_reduce_handlers[OFI_WRITE_OP_CNT][OFI_DATATYPE_CNT])
+			(void *dst, const void *src, size_t cnt);
+
+#define ofi_reduce_handler(op, datatype, dst, src, cnt) \
+	ofi_reduce_handlers[op][datatype](dst, src, cnt)
+
+void ofi_reduce_init(void);
+
 int ofi_atomic_valid(const struct fi_provider *prov,
 		     enum fi_datatype datatype, enum fi_op op, uint64_t flags);
 
@@ -50,6 +50,9 @@ enum util_coll_op_type {
 	UTIL_COLL_BROADCAST_OP,
 	UTIL_COLL_ALLGATHER_OP,
 	UTIL_COLL_SCATTER_OP,
+	UTIL_COLL_ALLTOALL_OP,
+	UTIL_COLL_REDUCE_SCATTER_OP,
+	UTIL_COLL_GATHER_OP,
 };
 
 static const char * const log_util_coll_op_type[] = {
@@ -58,7 +61,10 @@ static const char * const log_util_coll_op_type[] = {
 	[UTIL_COLL_ALLREDUCE_OP] = "COLL_ALLREDUCE",
 	[UTIL_COLL_BROADCAST_OP] = "COLL_BROADCAST",
 	[UTIL_COLL_ALLGATHER_OP] = "COLL_ALLGATHER",
-	[UTIL_COLL_SCATTER_OP] = "COLL_SCATTER"
+	[UTIL_COLL_SCATTER_OP] = "COLL_SCATTER",
+	[UTIL_COLL_ALLTOALL_OP] = "COLL_ALLTOALL",
+	[UTIL_COLL_REDUCE_SCATTER_OP] = "COLL_REDUCE_SCATTER",
+	[UTIL_COLL_GATHER_OP] = "COLL_GATHER"
 };
 
 enum coll_work_type {
@@ -157,6 +163,9 @@ struct util_coll_operation {
 		struct allreduce_data	allreduce;
 		void			*scatter;
 		struct broadcast_data	broadcast;
+		void			*alltoall;
+		void			*reduce_scatter;
+		void			*gather;
 	} data;
 	util_coll_comp_fn_t		comp_fn;
 	uint64_t			flags;
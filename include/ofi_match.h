@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2024 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Hashed tag matching queue.
+ *
+ * A match queue holds either posted receives or unexpected messages.
+ * Entries that name an exact source and tag are bucketed on a hash of
+ * (source, tag), so the common MPI case of many fully specified receives
+ * matches in constant time.  Posted receives that use a wildcard (source
+ * or ignore bits) go on an ordered list instead.  Every posted entry takes
+ * a sequence number when inserted, and a hashed match is only used if no
+ * older wildcard entry also matches, which preserves posting order across
+ * both structures.
+ *
+ * An unexpected queue hashes every message and also keeps all of them on
+ * the ordered list in arrival order.  Fully specified receives look up the
+ * hash; wildcard receives scan the list.
+ *
+ * Without OFI_MQ_DIRECTED the source address is not part of the match and
+ * is ignored by both hashing and matching.  With OFI_MQ_LIST nothing is
+ * hashed, and the queue degenerates into a single ordered list.
+ *
+ * An unexpected message may arrive before its sender is inserted into the
+ * AV, and is then queued with FI_ADDR_NOTAVAIL.  If the owner sets a
+ * resolve callback, such messages are kept on an unresolved list instead
+ * of the hash.  Their source is looked up again whenever they are
+ * examined, and once it resolves they move into the hash.
+ *
+ * Synchronization must be provided by the caller.
+ */
+
+#ifndef _OFI_MATCH_H_
+#define _OFI_MATCH_H_
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <rdma/fabric.h>
+#include <rdma/fi_errno.h>
+#include <ofi.h>
+#include <ofi_list.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+	OFI_MQ_DIRECTED	= 1 << 0,	/* match on source address */
+	OFI_MQ_UNEXP	= 1 << 1,	/* queue holds messages, not receives */
+	OFI_MQ_LIST	= 1 << 2,	/* disable hashing */
+};
+
+#define OFI_MQ_DEF_SIZE	1024
+#define OFI_MQ_SEQ_START	(1ULL << 63)
+
+struct ofi_mq_entry {
+	struct dlist_entry	hash_entry;
+	struct dlist_entry	list_entry;
+	fi_addr_t		addr;
+	uint64_t		tag;
+	uint64_t		ignore;
+	uint64_t		seq;
+};
+
+struct ofi_mq {
+	struct dlist_entry	*hash;
+	size_t			hash_mask;
+	struct dlist_entry	list;
+	struct dlist_entry	unresolved;
+	fi_addr_t		(*resolve)(struct ofi_mq_entry *entry);
+	uint64_t		seq;
+	uint64_t		head_seq;
+	size_t			cnt;
+	int			flags;
+};
+
+static inline int ofi_mq_init(struct ofi_mq *mq, size_t size, int flags)
+{
+	size_t i;
+
+	if (flags & OFI_MQ_LIST)
+		size = 1;
+	size = roundup_power_of_two(size ? size : OFI_MQ_DEF_SIZE);
+	mq->hash = calloc(size, sizeof(*mq->hash));
+	if (!mq->hash)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < size; i++)
+		dlist_init(&mq->hash[i]);
+
+	mq->hash_mask = size - 1;
+	dlist_init(&mq->list);
+	dlist_init(&mq->unresolved);
+	mq->resolve = NULL;
+	mq->seq = OFI_MQ_SEQ_START;
+	mq->head_seq = OFI_MQ_SEQ_START;
+	mq->cnt = 0;
+	mq->flags = flags;
+	return 0;
+}
+
+static inline void ofi_mq_cleanup(struct ofi_mq *mq)
+{
+	free(mq->hash);
+	mq->hash = NULL;
+}
+
+static inline bool ofi_mq_empty(struct ofi_mq *mq)
+{
+	return !mq->cnt;
+}
+
+static inline struct dlist_entry *
+ofi_mq_bucket(struct ofi_mq *mq, fi_addr_t addr, uint64_t tag)
+{
+	uint64_t hash;
+
+	hash = tag;
+	if (mq->flags & OFI_MQ_DIRECTED)
+		hash ^= addr * 0x9e3779b97f4a7c15ULL;
+	hash ^= hash >> 29;
+	hash *= 0xbf58476d1ce4e5b9ULL;
+	hash ^= hash >> 32;
+	return &mq->hash[hash & mq->hash_mask];
+}
+
+static inline bool ofi_mq_same_addr(struct ofi_mq *mq, fi_addr_t addr1,
+				    fi_addr_t addr2)
+{
+	return !(mq->flags & OFI_MQ_DIRECTED) || addr1 == addr2;
+}
+
+static inline bool ofi_mq_match_addr(struct ofi_mq *mq, fi_addr_t recv_addr,
+				     fi_addr_t addr)
+{
+	return !(mq->flags & OFI_MQ_DIRECTED) || recv_addr == FI_ADDR_UNSPEC ||
+	       recv_addr == addr;
+}
+
+static inline bool ofi_mq_is_exact(struct ofi_mq *mq, fi_addr_t addr,
+				   uint64_t ignore)
+{
+	return !ignore && !(mq->flags & OFI_MQ_LIST) &&
+	       ((mq->flags & OFI_MQ_UNEXP) ||
+			   !(mq->flags & OFI_MQ_DIRECTED) ||
+			   addr != FI_ADDR_UNSPEC);
+}
+
+static inline bool ofi_mq_unresolved(struct ofi_mq *mq, fi_addr_t addr)
+{
+	return mq->resolve && !(mq->flags & OFI_MQ_LIST) &&
+	       addr == FI_ADDR_NOTAVAIL;
+}
+
+static inline int ofi_mq_seq_after(struct dlist_entry *item, const void *arg)
+{
+	return container_of(item, struct ofi_mq_entry, hash_entry)->seq >
+	       ((const struct ofi_mq_entry *) arg)->seq;
+}
+
+/* Returns the entry's source, resolving it first if it was unknown when
+ * the entry was queued.  A resolved hashed entry joins its bucket in
+ * arrival order.
+ */
+static inline fi_addr_t
+ofi_mq_entry_addr(struct ofi_mq *mq, struct ofi_mq_entry *entry)
+{
+	fi_addr_t addr;
+
+	if (entry->addr != FI_ADDR_NOTAVAIL || !mq->resolve)
+		return entry->addr;
+
+	addr = mq->resolve(entry);
+	if (addr == FI_ADDR_NOTAVAIL)
+		return addr;
+
+	entry->addr = addr;
+	if (!dlist_empty(&entry->hash_entry)) {
+		dlist_remove(&entry->hash_entry);
+		dlist_insert_order(ofi_mq_bucket(mq, addr, entry->tag),
+				   ofi_mq_seq_after, &entry->hash_entry);
+	}
+	return addr;
+}
+
+static inline void ofi_mq_insert(struct ofi_mq *mq, struct ofi_mq_entry *entry)
+{
+	entry->seq = mq->seq++;
+	mq->cnt++;
+
+	if (ofi_mq_unresolved(mq, entry->addr) && !entry->ignore)
+		dlist_insert_tail(&entry->hash_entry, &mq->unresolved);
+	else if (ofi_mq_is_exact(mq, entry->addr, entry->ignore))
+		dlist_insert_tail(&entry->hash_entry,
+				  ofi_mq_bucket(mq, entry->addr, entry->tag));
+	else
+		dlist_init(&entry->hash_entry);
+
+	if (!dlist_empty(&entry->hash_entry) && !(mq->flags & OFI_MQ_UNEXP))
+		dlist_init(&entry->list_entry);
+	else
+		dlist_insert_tail(&entry->list_entry, &mq->list);
+}
+
+/* Queues an entry ahead of everything already in the queue, for a receive
+ * that is split off of one that was posted earlier (e.g. FI_MULTI_RECV).
+ */
+static inline void
+ofi_mq_insert_head(struct ofi_mq *mq, struct ofi_mq_entry *entry)
+{
+	entry->seq = --mq->head_seq;
+	mq->cnt++;
+
+	if (ofi_mq_is_exact(mq, entry->addr, entry->ignore))
+		dlist_insert_head(&entry->hash_entry,
+				  ofi_mq_bucket(mq, entry->addr, entry->tag));
+	else
+		dlist_init(&entry->hash_entry);
+
+	if (!dlist_empty(&entry->hash_entry) && !(mq->flags & OFI_MQ_UNEXP))
+		dlist_init(&entry->list_entry);
+	else
+		dlist_insert_head(&entry->list_entry, &mq->list);
+}
+
+static inline void ofi_mq_remove(struct ofi_mq *mq, struct ofi_mq_entry *entry)
+{
+	assert(mq->cnt);
+	mq->cnt--;
+	dlist_remove_init(&entry->hash_entry);
+	dlist_remove_init(&entry->list_entry);
+}
+
+/* Returns the oldest posted receive that matches an incoming message */
+static inline struct ofi_mq_entry *
+ofi_mq_match_msg(struct ofi_mq *mq, fi_addr_t addr, uint64_t tag)
+{
+	struct ofi_mq_entry *entry, *found = NULL;
+
+	assert(!(mq->flags & OFI_MQ_UNEXP));
+	dlist_foreach_container(ofi_mq_bucket(mq, addr, tag),
+				struct ofi_mq_entry, entry, hash_entry) {
+		if (entry->tag == tag && ofi_mq_same_addr(mq, entry->addr, addr)) {
+			found = entry;
+			break;
+		}
+	}
+
+	dlist_foreach_container(&mq->list, struct ofi_mq_entry, entry,
+				list_entry) {
+		if (found && entry->seq > found->seq)
+			break;
+		if (ofi_mq_match_addr(mq, entry->addr, addr) &&
+		    ((entry->tag | entry->ignore) == (tag | entry->ignore)))
+			return entry;
+	}
+	return found;
+}
+
+/* Returns the oldest unexpected message that matches a receive */
+static inline struct ofi_mq_entry *
+ofi_mq_match_recv(struct ofi_mq *mq, fi_addr_t addr, uint64_t tag,
+		  uint64_t ignore)
+{
+	struct ofi_mq_entry *entry, *found = NULL;
+	struct dlist_entry *tmp;
+
+	assert(mq->flags & OFI_MQ_UNEXP);
+	if (!ignore && !(mq->flags & OFI_MQ_LIST) &&
+	    (!(mq->flags & OFI_MQ_DIRECTED) || addr != FI_ADDR_UNSPEC)) {
+		dlist_foreach_container(ofi_mq_bucket(mq, addr, tag),
+					struct ofi_mq_entry, entry, hash_entry) {
+			if (entry->tag == tag &&
+			    ofi_mq_same_addr(mq, entry->addr, addr)) {
+				found = entry;
+				break;
+			}
+		}
+
+		/* an older message may have arrived before its sender was
+		 * inserted into the AV */
+		dlist_foreach_container_safe(&mq->unresolved,
+					     struct ofi_mq_entry, entry,
+					     hash_entry, tmp) {
+			if (found && entry->seq > found->seq)
+				break;
+			if (ofi_mq_entry_addr(mq, entry) == addr &&
+			    entry->tag == tag)
+				return entry;
+		}
+		return found;
+	}
+
+	dlist_foreach_container(&mq->list, struct ofi_mq_entry, entry,
+				list_entry) {
+		if (ofi_mq_match_addr(mq, addr, ofi_mq_entry_addr(mq, entry)) &&
+		    ((entry->tag | ignore) == (tag | ignore)))
+			return entry;
+	}
+	return NULL;
+}
+
+/* Walks every entry, in no particular order.  Used for cancel and cleanup */
+static inline struct ofi_mq_entry *
+ofi_mq_find(struct ofi_mq *mq,
+	    bool (*match)(struct ofi_mq_entry *entry, void *arg), void *arg)
+{
+	struct ofi_mq_entry *entry;
+	struct dlist_entry *tmp;
+	size_t i;
+
+	dlist_foreach_container_safe(&mq->list, struct ofi_mq_entry, entry,
+				     list_entry, tmp) {
+		if (match(entry, arg))
+			return entry;
+	}
+
+	if (mq->flags & (OFI_MQ_UNEXP | OFI_MQ_LIST))
+		return NULL;
+
+	for (i = 0; i <= mq->hash_mask; i++) {
+		dlist_foreach_container_safe(&mq->hash[i], struct ofi_mq_entry,
+					     entry, hash_entry, tmp) {
+			if (match(entry, arg))
+				return entry;
+		}
+	}
+	return NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _OFI_MATCH_H_ */
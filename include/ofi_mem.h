@@ -312,6 +312,7 @@ enum {
 	OFI_BUFPOOL_NO_TRACK		= 1 << 2,
 	OFI_BUFPOOL_HUGEPAGES		= 1 << 3,
 	OFI_BUFPOOL_NONSHARED		= 1 << 4,
+	OFI_BUFPOOL_THREAD_SAFE		= 1 << 5,
 };
 
 struct ofi_bufpool_region;
@@ -328,6 +329,30 @@ struct ofi_bufpool_attr {
 	int		flags;
 };
 
+/*
+ * OFI_BUFPOOL_THREAD_SAFE pools front the free list with magazines: small
+ * per-thread caches of free buffers, selected by hashing the calling
+ * thread, that ofi_buf_alloc and ofi_buf_free work against without
+ * touching shared state.  A magazine that runs dry refills a batch of
+ * OFI_BUFPOOL_MAG_SIZE buffers from the depot (the pool free list, under
+ * pool->lock), growing the pool if needed; one that fills to twice that
+ * returns its coldest batch.  A buffer may be freed by any thread, it is
+ * cached by whichever thread frees it.  Regions are mapped pages bound to
+ * the node of the thread whose allocation grew the pool.
+ */
+#define OFI_BUFPOOL_MAG_SHIFT	4
+#define OFI_BUFPOOL_MAG_CNT	(1 << OFI_BUFPOOL_MAG_SHIFT)
+#define OFI_BUFPOOL_MAG_SIZE	32
+
+union ofi_bufpool_mag {
+	struct {
+		ofi_mutex_t		lock;
+		struct slist		bufs;
+		size_t			cnt;
+	};
+	uint8_t				pad[128];
+};
+
 struct ofi_bufpool {
 	union {
 		struct slist		entries;
@@ -342,6 +367,10 @@ struct ofi_bufpool {
 	size_t				alloc_size;
 	size_t				region_size;
 	struct ofi_bufpool_attr		attr;
+
+	/* OFI_BUFPOOL_THREAD_SAFE only */
+	ofi_mutex_t			lock;
+	union ofi_bufpool_mag		*mags;
 };
 
 struct ofi_bufpool_region {
@@ -417,6 +446,10 @@ static inline struct ofi_bufpool *ofi_buf_pool(void *buf)
 	return ofi_buf_region(buf)->pool;
 }
 
+void *ofi_bufpool_mag_alloc(struct ofi_bufpool *pool);
+void ofi_bufpool_mag_free(struct ofi_bufpool *pool,
+			  struct ofi_bufpool_hdr *buf_hdr);
+
 static inline void ofi_buf_free(void *buf)
 {
 	assert(ofi_atomic_dec32(&ofi_buf_region(buf)->use_cnt) >= 0);
@@ -424,6 +457,11 @@ static inline void ofi_buf_free(void *buf)
 	assert(ofi_buf_hdr(buf)->magic == OFI_MAGIC_SIZE_T);
 	assert(ofi_buf_hdr(buf)->ftr->magic == OFI_MAGIC_SIZE_T);
 
+	if (ofi_buf_pool(buf)->attr.flags & OFI_BUFPOOL_THREAD_SAFE) {
+		ofi_bufpool_mag_free(ofi_buf_pool(buf), ofi_buf_hdr(buf));
+		return;
+	}
+
 	slist_insert_head(&ofi_buf_hdr(buf)->entry.slist,
 			  &ofi_buf_pool(buf)->free_list.entries);
 }
@@ -467,6 +505,7 @@ static inline void *ofi_bufpool_get_ibuf(struct ofi_bufpool *pool, size_t index)
 	return buf;
 }
 
+/* For OFI_BUFPOOL_THREAD_SAFE pools this only reports on the depot */
 static inline int ofi_bufpool_empty(struct ofi_bufpool *pool)
 {
 	return slist_empty(&pool->free_list.entries);
@@ -482,6 +521,9 @@ static inline void *ofi_buf_alloc(struct ofi_bufpool *pool)
 	struct ofi_bufpool_hdr *buf_hdr;
 
 	assert(!(pool->attr.flags & OFI_BUFPOOL_INDEXED));
+	if (pool->attr.flags & OFI_BUFPOOL_THREAD_SAFE)
+		return ofi_bufpool_mag_alloc(pool);
+
 	if (ofi_bufpool_empty(pool)) {
 		if (ofi_bufpool_grow(pool))
 			return NULL;
@@ -132,7 +132,8 @@ union ofi_mr_hmem_info {
 struct ofi_mr_entry {
 	struct ofi_mr_info		info;
 	struct ofi_rbnode		*node;
-	int				use_cnt;
+	ofi_atomic32_t			use_cnt;
+	ofi_atomic32_t			lru_state;
 	struct dlist_entry		list_entry;
 	union ofi_mr_hmem_info		hmem_info;
 	uint8_t				data[];
@@ -307,6 +308,30 @@ extern struct ofi_mr_cache_params	cache_params;
 
 #define OFI_HMEM_MAX 6
 
+/*
+ * Lookups only read the cache, so they take a read lock on one of several
+ * stripes, picked by thread.  Anything that changes the tree write locks
+ * every stripe.  Hits do not touch the LRU list.  An entry is queued the
+ * first time its use count drops to zero and only marked on later releases,
+ * which flush treats as a second chance.  Flush skips entries still in use.
+ * Lookups queue entries under the cache lock.  Writers hold every stripe,
+ * so they change the lists without it.  The uncached counters are also
+ * updated outside any stripe, so they always need the cache lock.
+ */
+#define OFI_MR_CACHE_STRIPE_SHIFT	4
+#define OFI_MR_CACHE_STRIPES		(1 << OFI_MR_CACHE_STRIPE_SHIFT)
+
+/* Padded so that no two stripe locks share a cache line */
+union ofi_mr_cache_stripe {
+	struct {
+		pthread_rwlock_t	lock;
+		ofi_atomic64_t		search_cnt;
+		ofi_atomic64_t		hit_cnt;
+		ofi_atomic64_t		delete_cnt;
+	};
+	uint8_t				pad[128];
+};
+
 struct ofi_mr_cache {
 	struct util_domain		*domain;
 	struct ofi_mem_monitor		*monitors[OFI_HMEM_MAX];
@@ -322,11 +347,9 @@ struct ofi_mr_cache {
 	size_t				cached_size;
 	size_t				uncached_cnt;
 	size_t				uncached_size;
-	size_t				search_cnt;
-	size_t				delete_cnt;
-	size_t				hit_cnt;
 	size_t				notify_cnt;
 	struct ofi_bufpool		*entry_pool;
+	union ofi_mr_cache_stripe	stripes[OFI_MR_CACHE_STRIPES];
 
 	int				(*add_region)(struct ofi_mr_cache *cache,
 						      struct ofi_mr_entry *entry);
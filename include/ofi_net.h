@@ -159,6 +159,32 @@ struct ofi_sockapi_uring {
 	uint64_t credits;
 };
 
+/*
+ * Provided buffer ring - receive buffers handed to the kernel, which picks
+ * one for each multishot receive completion.  Filled buffers are chained
+ * per socket through next[] until the data has been consumed.
+ */
+#define OFI_URING_BUF_NONE UINT16_MAX
+
+struct io_uring_buf_ring;
+
+struct ofi_uring_bufring {
+	struct io_uring_buf_ring *ring;
+	uint8_t *bufs;
+	size_t buf_size;
+	uint16_t cnt;
+	uint16_t bgid;
+	uint16_t avail;
+	uint16_t *next;
+	uint32_t *len;
+};
+
+static inline void *
+ofi_uring_bufring_buf(struct ofi_uring_bufring *bufring, uint16_t bid)
+{
+	return &bufring->bufs[bid * bufring->buf_size];
+}
+
 struct ofi_sockapi {
 	struct ofi_sockapi_uring tx_uring;
 	struct ofi_sockapi_uring rx_uring;
@@ -234,8 +260,35 @@ ssize_t ofi_sockapi_recvv_uring(struct ofi_sockapi *sockapi, SOCKET sock,
 				struct iovec *iov, size_t cnt, int flags,
 				struct ofi_sockctx *ctx);
 
+ssize_t ofi_sockapi_recv_multishot_uring(struct ofi_sockapi *sockapi,
+					 SOCKET sock,
+					 struct ofi_uring_bufring *bufring,
+					 int flags, struct ofi_sockctx *ctx);
+ssize_t ofi_sockapi_cancel_uring(struct ofi_sockapi_uring *uring,
+				 struct ofi_sockctx *ctx);
+
 int ofi_uring_init(ofi_io_uring_t *io_uring, size_t entries);
 int ofi_uring_destroy(ofi_io_uring_t *io_uring);
+int ofi_uring_wait_cqe(ofi_io_uring_t *io_uring);
+
+int ofi_uring_bufring_init(ofi_io_uring_t *io_uring,
+			   struct ofi_uring_bufring *bufring,
+			   size_t cnt, size_t buf_size, uint16_t bgid);
+void ofi_uring_bufring_destroy(ofi_io_uring_t *io_uring,
+			       struct ofi_uring_bufring *bufring);
+void ofi_uring_bufring_put(struct ofi_uring_bufring *bufring, uint16_t bid);
+
+static inline bool ofi_uring_cqe_more(ofi_io_uring_cqe_t *cqe)
+{
+	return cqe->flags & IORING_CQE_F_MORE;
+}
+
+static inline int ofi_uring_cqe_bid(ofi_io_uring_cqe_t *cqe)
+{
+	if (!(cqe->flags & IORING_CQE_F_BUFFER))
+		return -1;
+	return cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+}
 
 static inline int ofi_uring_get_fd(ofi_io_uring_t *io_uring)
 {
@@ -304,8 +357,30 @@ ofi_sockapi_recvv_uring(struct ofi_sockapi *sockapi, SOCKET sock,
 	return -FI_ENOSYS;
 }
 
+static inline ssize_t
+ofi_sockapi_recv_multishot_uring(struct ofi_sockapi *sockapi, SOCKET sock,
+				 struct ofi_uring_bufring *bufring, int flags,
+				 struct ofi_sockctx *ctx)
+{
+	return -FI_ENOSYS;
+}
+
+static inline ssize_t
+ofi_sockapi_cancel_uring(struct ofi_sockapi_uring *uring,
+			 struct ofi_sockctx *ctx)
+{
+	return -FI_ENOSYS;
+}
+
 #define ofi_uring_init(io_uring, entries) -FI_ENOSYS
 #define ofi_uring_destroy(io_uring) -FI_ENOSYS
+#define ofi_uring_wait_cqe(io_uring) -FI_ENOSYS
+#define ofi_uring_bufring_init(io_uring, bufring, cnt, buf_size, bgid) \
+	-FI_ENOSYS
+#define ofi_uring_bufring_destroy(io_uring, bufring) do {} while(0)
+#define ofi_uring_bufring_put(bufring, bid) do {} while(0)
+#define ofi_uring_cqe_more(cqe) false
+#define ofi_uring_cqe_bid(cqe) -1
 #define ofi_uring_get_fd(io_uring) INVALID_SOCKET
 #define ofi_uring_sq_ready(io_uring) 0
 #define ofi_uring_sq_space_left(io_uring) 0
@@ -417,6 +492,18 @@ struct ofi_bsock {
 	size_t zerocopy_size;
 	uint32_t async_index;
 	uint32_t done_index;
+
+	/* Set when receives complete through a multishot io_uring recv */
+	struct ofi_uring_bufring *bufring;
+	size_t rxbuf_bytes;
+	uint32_t rxbuf_off;
+	uint16_t rxbuf_head;
+	uint16_t rxbuf_tail;
+	bool rx_eof;
+	/* Data copied out of the provided buffers, read before them */
+	uint8_t *rxstash;
+	size_t rxstash_len;
+	size_t rxstash_off;
 };
 
 static inline void
@@ -434,17 +521,32 @@ ofi_bsock_init(struct ofi_bsock *bsock, struct ofi_sockapi *sockapi,
 	/* first async op will wrap back to 0 as the starting index */
 	bsock->async_index = UINT32_MAX;
 	bsock->done_index = UINT32_MAX;
+
+	bsock->bufring = NULL;
+	bsock->rxbuf_bytes = 0;
+	bsock->rxbuf_off = 0;
+	bsock->rxbuf_head = OFI_URING_BUF_NONE;
+	bsock->rxbuf_tail = OFI_URING_BUF_NONE;
+	bsock->rx_eof = false;
+	bsock->rxstash = NULL;
+	bsock->rxstash_len = 0;
+	bsock->rxstash_off = 0;
 }
 
+void ofi_bsock_rxbuf_add(struct ofi_bsock *bsock, uint16_t bid, size_t len);
+void ofi_bsock_rxbuf_discard(struct ofi_bsock *bsock);
+int ofi_bsock_rxbuf_stash(struct ofi_bsock *bsock);
+
 static inline void ofi_bsock_discard(struct ofi_bsock *bsock)
 {
 	ofi_byteq_discard(&bsock->rq);
 	ofi_byteq_discard(&bsock->sq);
+	ofi_bsock_rxbuf_discard(bsock);
 }
 
 static inline size_t ofi_bsock_readable(struct ofi_bsock *bsock)
 {
-	return ofi_byteq_readable(&bsock->rq);
+	return ofi_byteq_readable(&bsock->rq) + bsock->rxbuf_bytes;
 }
 
 static inline size_t ofi_bsock_tosend(struct ofi_bsock *bsock)
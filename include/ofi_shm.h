@@ -37,6 +37,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <sched.h>
 #include <sys/un.h>
 
 #include <ofi_atom.h>
@@ -53,7 +54,7 @@ extern "C" {
 #endif
 
 
-#define SMR_VERSION	4
+#define SMR_VERSION	8
 
 #ifdef HAVE_ATOMICS
 #define SMR_FLAG_ATOMIC	(1 << 0)
@@ -68,6 +69,8 @@ extern "C" {
 #endif
 
 #define SMR_FLAG_IPC_SOCK (1 << 2)
+#define SMR_FLAG_DIRECT_RMA	(1 << 3)
+#define SMR_FLAG_DIRECT_ATOMIC	(1 << 4)
 
 #define SMR_CMD_SIZE		256	/* align with 64-byte cache line */
 
@@ -79,6 +82,7 @@ enum {
 	smr_src_mmap,	/* mmap-based fallback protocol */
 	smr_src_sar,	/* segmentation fallback protocol */
 	smr_src_ipc,	/* device IPC handle protocol */
+	smr_src_attach,	/* sender pages mapped by the receiver */
 	smr_src_max,
 };
 
@@ -91,6 +95,7 @@ enum {
 #define SMR_TX_COMPLETION	(1 << 2)
 #define SMR_RX_COMPLETION	(1 << 3)
 #define SMR_MULTI_RECV		(1 << 4)
+#define SMR_ATTACH_SAR		(1 << 5)
 
 /* CMA capability */
 enum {
@@ -127,6 +132,32 @@ struct smr_msg_hdr {
 	};
 } __attribute__ ((aligned(16)));
 
+/* smr_attach_info type */
+enum {
+	SMR_ATTACH_FILE,	/* shared file mapping, reached through fd */
+	SMR_ATTACH_XPMEM,	/* sender address space exported with XPMEM */
+};
+
+/*
+ * Reference to a sender mapping for smr_src_attach:
+ * 	handle - sender's id for the mapping, never reused by that sender
+ * 	addr - sender address of the data, for the CMA fallback
+ * 	map_off, map_len - mapping as a file offset or XPMEM address
+ * 	offset - offset of the data in the mapping
+ */
+struct smr_attach_info {
+	uint64_t		handle;
+	uint64_t		addr;
+	uint64_t		map_off;
+	uint64_t		map_len;
+	uint64_t		offset;
+	uint64_t		dev;
+	uint64_t		ino;
+	int64_t			segid;
+	int32_t			fd;
+	uint32_t		type;
+};
+
 #define SMR_BUF_BATCH_MAX	64
 #define SMR_MSG_DATA_LEN	(SMR_CMD_SIZE - sizeof(struct smr_msg_hdr))
 
@@ -142,6 +173,7 @@ union smr_cmd_data {
 		int16_t		sar[SMR_BUF_BATCH_MAX];
 	};
 	struct ipc_info		ipc_info;
+	struct smr_attach_info	attach;
 };
 
 struct smr_cmd_msg {
@@ -185,6 +217,7 @@ struct smr_peer_data {
 	struct smr_addr		addr;
 	uint32_t		sar_status;
 	uint32_t		name_sent;
+	uint32_t		attach_failed;
 };
 
 extern struct dlist_entry ep_name_list;
@@ -213,14 +246,64 @@ struct smr_peer {
 	struct smr_region	*region;
 };
 
-#define SMR_MAX_PEERS	256
+/*
+ * The peer map is sized from the AV count, but never below SMR_DEF_PEERS so
+ * that peers which connect to us without being in our AV still fit.
+ * Entries are allocated in chunks as ids are handed out, so a large map
+ * only costs memory for the peers actually in use.  Chunks are never moved
+ * or freed while the map exists, which keeps lookups lock-free.
+ */
+#define SMR_DEF_PEERS		256
+#define SMR_MAX_PEERS		(1 << 16)
+#define SMR_PEER_CHUNK_BITS	6
+#define SMR_PEER_CHUNK_SIZE	(1 << SMR_PEER_CHUNK_BITS)
+#define SMR_PEER_MAX_CHUNKS	(SMR_MAX_PEERS / SMR_PEER_CHUNK_SIZE)
+
+/* Number of SAR buffers in each region, shared by all senders */
+#define SMR_SAR_BUF_CNT		256
 
 struct smr_map {
 	ofi_spin_t		lock;
 	int64_t			cur_id;
 	int 			num_peers;
+	int64_t			max_peers;
 	struct ofi_rbmap	rbmap;
-	struct smr_peer		peers[SMR_MAX_PEERS];
+	struct smr_peer		*peers[SMR_PEER_MAX_CHUNKS];
+};
+
+static inline struct smr_peer *smr_map_peer(struct smr_map *map, int64_t id)
+{
+	assert(id >= 0 && id < map->max_peers);
+	assert(map->peers[id >> SMR_PEER_CHUNK_BITS]);
+	return &map->peers[id >> SMR_PEER_CHUNK_BITS]
+			  [id & (SMR_PEER_CHUNK_SIZE - 1)];
+}
+
+/*
+ * Registrations backed by a shared file mapping are published in the
+ * region of every endpoint of the registering domain.  Peers map the same
+ * file pages and complete RMA and atomics to them without target progress.
+ * An entry is valid while its gen is odd.  The table version changes
+ * whenever an entry is published.
+ */
+#define SMR_MR_TABLE_SIZE	64
+#define SMR_MR_PATH_MAX		128
+
+struct smr_mr_entry {
+	ofi_atomic64_t	gen;
+	uint64_t	key;
+	uint64_t	addr;	  /* remote address of the first registered byte */
+	uint64_t	len;
+	uint64_t	access;
+	uint64_t	file_off; /* file offset of the first registered byte */
+	uint64_t	dev;
+	uint64_t	ino;
+	char		path[SMR_MR_PATH_MAX];
+};
+
+struct smr_mr_table {
+	ofi_atomic64_t		version;
+	struct smr_mr_entry	entry[SMR_MR_TABLE_SIZE];
 };
 
 struct smr_region {
@@ -231,21 +314,25 @@ struct smr_region {
 	uint8_t		cma_cap_peer;
 	uint8_t		cma_cap_self;
 	uint32_t	max_sar_buf_per_peer;
+	int64_t		max_peers;
 	void		*base_addr;
-	pthread_spinlock_t	lock; /* lock for shm access
-				 Must hold smr->lock before tx/rx cq locks
-				 in order to progress or post recv */
+	pthread_spinlock_t	lock; /* lock for the inject and SAR pools
+				 Must hold smr->lock before tx/rx cq locks.
+				 The cmd queue does not require it */
 	ofi_atomic32_t	signal;
 
 	struct smr_map	*map;
 
 	size_t		total_size;
-	size_t		cmd_cnt; /* Doubles as a tracker for number of cmds AND
+	ofi_atomic64_t	cmd_cnt; /* Doubles as a tracker for number of cmds AND
 				    number of inject buffers available for use,
 				    to ensure 1:1 ratio of cmds to inject bufs.
 				    Might not always be paired consistently with
 				    cmd alloc/free depending on protocol
-				    (Ex. unexpected messages, RMA requests) */
+				    (Ex. unexpected messages, RMA requests).
+				    Senders must take a credit with
+				    smr_cmd_credit_get before reserving a
+				    cmd queue slot */
 	size_t		sar_cnt;
 
 	/* offsets from start of smr_region */
@@ -256,6 +343,7 @@ struct smr_region {
 	size_t		peer_data_offset;
 	size_t		name_offset;
 	size_t		sock_name_offset;
+	size_t		mr_table_offset;
 };
 
 struct smr_resp {
@@ -280,18 +368,129 @@ enum smr_status {
 	SMR_STATUS_OFFSET = 1024, 	/* Beginning of shm-specific codes */
 	SMR_STATUS_SAR_FREE, 		/* buffer can be used */
 	SMR_STATUS_SAR_READY, 		/* buffer has data in it */
+	SMR_STATUS_ATTACH_SAR, 		/* resend the attach through SAR */
 };
 
 struct smr_sar_buf {
 	uint8_t		buf[SMR_SAR_SIZE];
 };
 
-OFI_DECLARE_CIRQUE(struct smr_cmd, smr_cmd_queue);
-OFI_DECLARE_CIRQUE(struct smr_resp, smr_resp_queue);
+#define SMR_CACHE_LINE_SIZE	64
+
+/*
+ * Multi-producer, single-consumer ring template.
+ *
+ * Producers reserve a run of slots with a single fetch-and-add on the write
+ * ticket, fill them in place, and publish each slot by setting its sequence
+ * number to ticket + 1.  The consumer owns the read position and recycles a
+ * slot by moving its sequence a full lap ahead (ticket + size), which is
+ * what a producer holding the next lap's ticket waits for.  Slots are
+ * published individually, so a producer that reserves several slots must
+ * commit them from last to first for the consumer to see the run whole.
+ *
+ * The ring does not track capacity for producers: every reserved slot must
+ * be covered by a credit taken beforehand (see smr_region::cmd_cnt), and a
+ * reserved slot must always be committed, even if only as a no-op.  A
+ * credit is returned only once the consumer has read its slot, so a
+ * producer holding a credit waits at most for the consumer to finish
+ * recycling the slot.
+ * Producers that are already serialized (e.g. by an endpoint lock) can use
+ * name_next/name_advance to fill a slot before deciding to keep it.
+ */
+#define SMR_DECLARE_MPSC_QUEUE(entrytype, name)				\
+struct name ## _entry {							\
+	ofi_atomic64_t	seq;						\
+	entrytype	buf;						\
+} __attribute__ ((aligned(SMR_CACHE_LINE_SIZE)));			\
+									\
+struct name {								\
+	size_t		size;						\
+	size_t		size_mask;					\
+	int64_t		rpos;						\
+	uint8_t		pad0[SMR_CACHE_LINE_SIZE -			\
+			     2 * sizeof(size_t) - sizeof(int64_t)];	\
+	ofi_atomic64_t	wpos;						\
+	uint8_t		pad1[SMR_CACHE_LINE_SIZE -			\
+			     sizeof(ofi_atomic64_t)];			\
+	struct name ## _entry entry[];					\
+} __attribute__ ((aligned(SMR_CACHE_LINE_SIZE)));			\
+									\
+static inline void name ## _init(struct name *q, size_t size)		\
+{									\
+	size_t i;							\
+									\
+	assert(size == roundup_power_of_two(size));			\
+	q->size = size;							\
+	q->size_mask = size - 1;					\
+	q->rpos = 0;							\
+	ofi_atomic_initialize64(&q->wpos, 0);				\
+	for (i = 0; i < size; i++)					\
+		ofi_atomic_initialize64(&q->entry[i].seq, i);		\
+}									\
+									\
+static inline int64_t name ## _reserve(struct name *q, int64_t cnt)	\
+{									\
+	return ofi_atomic_add64(&q->wpos, cnt) - cnt;			\
+}									\
+									\
+static inline entrytype *name ## _get(struct name *q, int64_t pos)	\
+{									\
+	struct name ## _entry *e = &q->entry[pos & q->size_mask];	\
+									\
+	/* slot is still owned by the consumer from the previous lap */	\
+	while (ofi_atomic_get64(&e->seq) != pos)			\
+		sched_yield();						\
+	return &e->buf;							\
+}									\
+									\
+static inline void name ## _commit(struct name *q, int64_t pos)	\
+{									\
+	ofi_atomic_set64(&q->entry[pos & q->size_mask].seq, pos + 1);	\
+}									\
+									\
+static inline entrytype *name ## _next(struct name *q)			\
+{									\
+	return name ## _get(q, ofi_atomic_get64(&q->wpos));		\
+}									\
+									\
+static inline void name ## _advance(struct name *q)			\
+{									\
+	name ## _commit(q, name ## _reserve(q, 1));			\
+}									\
+									\
+static inline entrytype *name ## _head(struct name *q)			\
+{									\
+	struct name ## _entry *e = &q->entry[q->rpos & q->size_mask];	\
+									\
+	return ofi_atomic_get64(&e->seq) == q->rpos + 1 ?		\
+	       &e->buf : NULL;						\
+}									\
+									\
+static inline void name ## _discard(struct name *q)			\
+{									\
+	ofi_atomic_set64(&q->entry[q->rpos & q->size_mask].seq,	\
+			 q->rpos + q->size);				\
+	q->rpos++;							\
+}									\
+									\
+static inline bool name ## _isempty(struct name *q)			\
+{									\
+	return name ## _head(q) == NULL;				\
+}									\
+									\
+static inline bool name ## _isfull(struct name *q)			\
+{									\
+	return ofi_atomic_get64(&q->wpos) - q->rpos >=			\
+	       (int64_t) q->size;					\
+}									\
+void dummy ## name (void) /* work-around global ; scope */
+
+SMR_DECLARE_MPSC_QUEUE(struct smr_cmd, smr_cmd_queue);
+SMR_DECLARE_MPSC_QUEUE(struct smr_resp, smr_resp_queue);
 
 static inline struct smr_region *smr_peer_region(struct smr_region *smr, int i)
 {
-	return smr->map->peers[i].region;
+	return smr_map_peer(smr->map, i)->region;
 }
 static inline struct smr_cmd_queue *smr_cmd_queue(struct smr_region *smr)
 {
@@ -323,22 +522,47 @@ static inline char *smr_sock_name(struct smr_region *smr)
 	return (char *) smr + smr->sock_name_offset;
 }
 
+static inline struct smr_mr_table *smr_mr_table(struct smr_region *smr)
+{
+	return (struct smr_mr_table *) ((char *) smr + smr->mr_table_offset);
+}
+
 static inline void smr_set_map(struct smr_region *smr, struct smr_map *map)
 {
 	smr->map = map;
 }
 
+static inline bool smr_cmd_credit_get(struct smr_region *smr, int64_t cnt)
+{
+	int64_t avail;
+
+	do {
+		avail = ofi_atomic_get64(&smr->cmd_cnt);
+		if (avail < cnt)
+			return false;
+	} while (!ofi_atomic_cas_bool_weak64(&smr->cmd_cnt, avail,
+					     avail - cnt));
+	return true;
+}
+
+static inline void smr_cmd_credit_put(struct smr_region *smr, int64_t cnt)
+{
+	ofi_atomic_add64(&smr->cmd_cnt, cnt);
+}
+
 struct smr_attr {
 	const char	*name;
 	size_t		rx_count;
 	size_t		tx_count;
+	size_t		peer_count;
 };
 
 size_t smr_calculate_size_offsets(size_t tx_count, size_t rx_count,
+				  size_t peer_count,
 				  size_t *cmd_offset, size_t *resp_offset,
 				  size_t *inject_offset, size_t *sar_offset,
 				  size_t *peer_offset, size_t *name_offset,
-				  size_t *sock_offset);
+				  size_t *sock_offset, size_t *mr_offset);
 void	smr_cma_check(struct smr_region *region, struct smr_region *peer_region);
 void	smr_cleanup(void);
 int	smr_map_create(const struct fi_provider *prov, int peer_count,
@@ -78,10 +78,12 @@ extern "C" {
  * ERROR: EQ entry was the result of a failed operation,
  *        or the caller is trying to read the next entry
  *        if it is an error.
- * AUX: CQ entries are stored in the auxiliary queue
+ *
+ * CQ overflow and error entries are held in the CQ's auxiliary queue.
+ * Each one reserves a slot in the completion ring.  The ring head is
+ * such a slot when the first auxiliary entry's cq_slot points at it.
  */
 #define UTIL_FLAG_ERROR		(1ULL << 60)
-#define UTIL_FLAG_AUX		(1ULL << 61)
 
 /* Indicates that an EP has been bound to a counter */
 #define OFI_CNTR_ENABLED	(1ULL << 61)
@@ -491,16 +493,40 @@ int ofi_wait_yield_open(struct fid_fabric *fabric, struct fi_wait_attr *attr,
  * without introducing private interfaces to the CQ.
  */
 
-typedef void (*fi_cq_read_func)(void **dst, void *src);
-
 struct util_cq_aux_entry {
-	struct fi_cq_tagged_entry	*cq_slot;
+	void				*cq_slot;
 	struct fi_cq_err_entry		comp;
 	fi_addr_t			src;
 	struct slist_entry		list_entry;
 };
 
-OFI_DECLARE_CIRQUE(struct fi_cq_tagged_entry, util_comp_cirq);
+/*
+ * Completion ring.  Entries are stored in the format the CQ was opened
+ * with, entry_size bytes apart, so reads hand them out without conversion.
+ * The counters follow struct ofi_cirque, so the ofi_cirque_* count and
+ * index macros apply; use the helpers below to address entries.
+ */
+struct util_comp_cirq {
+	size_t		size;
+	size_t		size_mask;
+	size_t		rcnt;
+	size_t		wcnt;
+	size_t		entry_size;
+	uint8_t		buf[];
+};
+
+static inline void *
+util_comp_cirq_entry(struct util_comp_cirq *cirq, size_t index)
+{
+	return &cirq->buf[index * cirq->entry_size];
+}
+
+#define util_comp_cirq_head(cirq) \
+	util_comp_cirq_entry(cirq, ofi_cirque_rindex(cirq))
+#define util_comp_cirq_tail(cirq) \
+	util_comp_cirq_entry(cirq, ofi_cirque_tindex(cirq))
+#define util_comp_cirq_next(cirq) \
+	util_comp_cirq_entry(cirq, ofi_cirque_windex(cirq))
 
 typedef void (*ofi_cq_progress_func)(struct util_cq *cq);
 
@@ -518,7 +544,6 @@ struct util_cq {
 	fi_addr_t		*src;
 
 	struct slist		aux_queue;
-	fi_cq_read_func		read_entry;
 	int			internal_wait;
 	ofi_atomic32_t		wakeup;
 	ofi_cq_progress_func	progress;
@@ -550,18 +575,63 @@ int ofi_cq_write_overflow(struct util_cq *cq, void *context, uint64_t flags,
 			  size_t len, void *buf, uint64_t data, uint64_t tag,
 			  fi_addr_t src);
 
+/* Domains opened with FI_THREAD_DOMAIN or FI_THREAD_COMPLETION serialize
+ * all access to the CQ, so the ring is used without calling into cq_lock.
+ */
+static inline void ofi_cq_lock(struct util_cq *cq)
+{
+	if (cq->cq_lock.lock_type != OFI_LOCK_NOOP)
+		ofi_genlock_lock(&cq->cq_lock);
+}
 
+static inline void ofi_cq_unlock(struct util_cq *cq)
+{
+	if (cq->cq_lock.lock_type != OFI_LOCK_NOOP)
+		ofi_genlock_unlock(&cq->cq_lock);
+}
+
+static inline int ofi_cq_lock_held(struct util_cq *cq)
+{
+	return cq->cq_lock.lock_type == OFI_LOCK_NOOP ||
+	       ofi_genlock_held(&cq->cq_lock);
+}
+
+/* Return the number of completions, up to count, that can be read in
+ * place starting at *comp.  The run ends at the end of the ring or at an
+ * entry held in the auxiliary queue.  Caller must hold the CQ lock and
+ * release the entries with ofi_cq_consume().
+ */
+size_t ofi_cq_peek(struct util_cq *cq, void **comp, size_t count);
+
+static inline void ofi_cq_consume(struct util_cq *cq, size_t count)
+{
+	assert(count <= ofi_cirque_usedcnt(cq->cirq));
+	cq->cirq->rcnt += count;
+}
+
+/* The CQ formats share a common prefix, so only the fields present in
+ * the CQ format are written.
+ */
 static inline void
 ofi_cq_write_entry(struct util_cq *cq, void *context, uint64_t flags,
 		   size_t len, void *buf, uint64_t data, uint64_t tag)
 {
-	struct fi_cq_tagged_entry *comp = ofi_cirque_next(cq->cirq);
+	struct fi_cq_tagged_entry *comp = util_comp_cirq_next(cq->cirq);
+
 	comp->op_context = context;
+	if (cq->cirq->entry_size == sizeof(struct fi_cq_entry))
+		goto commit;
+
 	comp->flags = flags;
 	comp->len = len;
+	if (cq->cirq->entry_size == sizeof(struct fi_cq_msg_entry))
+		goto commit;
+
 	comp->buf = buf;
 	comp->data = data;
-	comp->tag = tag;
+	if (cq->cirq->entry_size == sizeof(struct fi_cq_tagged_entry))
+		comp->tag = tag;
+commit:
 	ofi_cirque_commit(cq->cirq);
 }
 
@@ -580,7 +650,7 @@ ofi_cq_write(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 {
 	int ret;
 
-	ofi_genlock_lock(&cq->cq_lock);
+	ofi_cq_lock(cq);
 	if (ofi_cirque_freecnt(cq->cirq) > 1) {
 		ofi_cq_write_entry(cq, context, flags, len, buf, data, tag);
 		ret = 0;
@@ -588,7 +658,7 @@ ofi_cq_write(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 		ret = ofi_cq_write_overflow(cq, context, flags, len,
 					    buf, data, tag, FI_ADDR_NOTAVAIL);
 	}
-	ofi_genlock_unlock(&cq->cq_lock);
+	ofi_cq_unlock(cq);
 	return ret;
 }
 
@@ -598,7 +668,7 @@ ofi_cq_write_src(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 {
 	int ret;
 
-	ofi_genlock_lock(&cq->cq_lock);
+	ofi_cq_lock(cq);
 	if (ofi_cirque_freecnt(cq->cirq) > 1) {
 		ofi_cq_write_src_entry(cq, context, flags, len, buf, data,
 				       tag, src);
@@ -607,7 +677,7 @@ ofi_cq_write_src(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 		ret = ofi_cq_write_overflow(cq, context, flags, len,
 					    buf, data, tag, src);
 	}
-	ofi_genlock_unlock(&cq->cq_lock);
+	ofi_cq_unlock(cq);
 	return ret;
 }
 
@@ -847,6 +917,7 @@ int ofi_ip_av_create(struct fid_domain *domain_fid, struct fi_av_attr *attr,
 void *ofi_av_get_addr(struct util_av *av, fi_addr_t fi_addr);
 #define ofi_ip_av_get_addr ofi_av_get_addr
 void *ofi_av_addr_context(struct util_av *av, fi_addr_t fi_addr);
+bool ofi_av_addr_valid(struct util_av *av, fi_addr_t fi_addr);
 
 fi_addr_t ofi_ip_av_get_fi_addr(struct util_av *av, const void *addr);
 
@@ -87,6 +87,11 @@ static inline int ofi_alloc_hugepage_buf(void **memptr, size_t size)
 	return -FI_ENOSYS;
 }
 
+static inline int ofi_mbind_local(void *addr, size_t size)
+{
+	return -FI_ENOSYS;
+}
+
 static inline size_t ofi_ifaddr_get_speed(struct ifaddrs *ifa)
 {
 	return 0;
@@ -68,6 +68,28 @@ enum {
 	FI_OPT_RX_SIZE,
 	FI_OPT_FI_HMEM_P2P,		/* int */
 	FI_OPT_XPU_TRIGGER,		/* struct fi_trigger_xpu */
+	FI_OPT_PRECONNECT,		/* struct fi_preconnect */
+	FI_OPT_CONN_STATS,		/* struct fi_conn_stats */
+};
+
+/*
+ * Parameters for FI_OPT_PRECONNECT.  Connections to the listed addresses
+ * are established in the background, and completion is reported as an
+ * FI_PRECONNECT_COMPLETE event on the EQ bound to the endpoint.
+ */
+struct fi_preconnect {
+	const fi_addr_t		*addr;
+	size_t			count;
+	void			*context;
+};
+
+/*
+ * Returned by FI_OPT_CONN_STATS on providers that close idle connections
+ * underneath reliable-unconnected endpoints.
+ */
+struct fi_conn_stats {
+	uint64_t		evicted;
+	uint64_t		reconnected;
 };
 
 /*
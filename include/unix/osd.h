@@ -138,6 +138,61 @@ ofi_recvmsg_udp(SOCKET fd, struct msghdr *msg, int flags)
 	return recvmsg(fd, msg, flags);
 }
 
+/* glibc only declares struct mmsghdr and the mmsg calls with _GNU_SOURCE */
+#if HAVE_SENDMMSG && HAVE_RECVMMSG && \
+    (defined(_GNU_SOURCE) || !defined(__GLIBC__))
+static inline int
+ofi_sendmmsg_udp(SOCKET fd, struct mmsghdr *msgvec, unsigned int vlen,
+		 int flags)
+{
+	return sendmmsg(fd, msgvec, vlen, flags);
+}
+
+static inline int
+ofi_recvmmsg_udp(SOCKET fd, struct mmsghdr *msgvec, unsigned int vlen,
+		 int flags)
+{
+	return recvmmsg(fd, msgvec, vlen, flags, NULL);
+}
+#else
+struct mmsghdr {
+	struct msghdr	msg_hdr;
+	unsigned int	msg_len;
+};
+
+static inline int
+ofi_sendmmsg_udp(SOCKET fd, struct mmsghdr *msgvec, unsigned int vlen,
+		 int flags)
+{
+	unsigned int i;
+	ssize_t ret;
+
+	for (i = 0; i < vlen; i++) {
+		ret = sendmsg(fd, &msgvec[i].msg_hdr, flags);
+		if (ret < 0)
+			return i ? (int) i : -1;
+		msgvec[i].msg_len = (unsigned int) ret;
+	}
+	return (int) vlen;
+}
+
+static inline int
+ofi_recvmmsg_udp(SOCKET fd, struct mmsghdr *msgvec, unsigned int vlen,
+		 int flags)
+{
+	unsigned int i;
+	ssize_t ret;
+
+	for (i = 0; i < vlen; i++) {
+		ret = recvmsg(fd, &msgvec[i].msg_hdr, flags);
+		if (ret < 0)
+			return i ? (int) i : -1;
+		msgvec[i].msg_len = (unsigned int) ret;
+	}
+	return (int) vlen;
+}
+#endif
+
 static inline int ofi_shutdown(SOCKET socket, int how)
 {
 	return shutdown(socket, how);
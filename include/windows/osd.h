@@ -796,6 +796,43 @@ ofi_sendmsg_udp(SOCKET fd, const struct msghdr *msg, int flags)
 
 ssize_t ofi_recvmsg_udp(SOCKET fd, struct msghdr *msg, int flags);
 
+struct mmsghdr {
+	struct msghdr	msg_hdr;
+	unsigned int	msg_len;
+};
+
+static inline int
+ofi_sendmmsg_udp(SOCKET fd, struct mmsghdr *msgvec, unsigned int vlen,
+		 int flags)
+{
+	unsigned int i;
+	ssize_t ret;
+
+	for (i = 0; i < vlen; i++) {
+		ret = ofi_sendmsg_udp(fd, &msgvec[i].msg_hdr, flags);
+		if (ret < 0)
+			return i ? (int) i : -1;
+		msgvec[i].msg_len = (unsigned int) ret;
+	}
+	return (int) vlen;
+}
+
+static inline int
+ofi_recvmmsg_udp(SOCKET fd, struct mmsghdr *msgvec, unsigned int vlen,
+		 int flags)
+{
+	unsigned int i;
+	ssize_t ret;
+
+	for (i = 0; i < vlen; i++) {
+		ret = ofi_recvmsg_udp(fd, &msgvec[i].msg_hdr, flags);
+		if (ret < 0)
+			return i ? (int) i : -1;
+		msgvec[i].msg_len = (unsigned int) ret;
+	}
+	return (int) vlen;
+}
+
 static inline int ofi_shutdown(SOCKET socket, int how)
 {
 	return shutdown(socket, how);
@@ -916,6 +953,11 @@ static inline int ofi_alloc_hugepage_buf(void **memptr, size_t size)
 	return -FI_ENOSYS;
 }
 
+static inline int ofi_mbind_local(void *addr, size_t size)
+{
+	return -FI_ENOSYS;
+}
+
 static inline int ofi_hugepage_enabled(void)
 {
 	return 0;
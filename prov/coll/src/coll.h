@@ -66,6 +66,9 @@
 #define COLL_TX_OP_FLAGS (0)
 #define COLL_RX_OP_FLAGS (0)
 
+/* Above this group size, ring allreduce is only used for large buffers */
+#define COLL_RING_MAX_RANKS 64
+
 enum {
 	COLL_RX_SIZE = 65536,
 	COLL_TX_SIZE = 16384,
@@ -128,6 +131,12 @@ extern struct fi_provider coll_prov;
 extern struct util_prov coll_util_prov;
 extern struct fi_fabric_attr coll_fabric_attr;
 extern struct fi_info coll_info;
+extern size_t coll_allreduce_rabenseifner_min;
+extern size_t coll_allreduce_ring_min;
+extern size_t coll_bcast_segment_size;
+extern size_t coll_bcast_chain_min;
+extern size_t coll_alltoall_bruck_max;
+extern size_t coll_reduce_scatter_ring_min;
 
 int coll_fabric(struct fi_fabric_attr *attr, struct fid_fabric **fabric,
 		void *context);
@@ -190,5 +199,22 @@ ssize_t coll_ep_broadcast(struct fid_ep *ep, void *buf, size_t count,
 			  void *desc, fi_addr_t coll_addr, fi_addr_t root_addr,
 			  enum fi_datatype datatype, uint64_t flags,
 			  void *context);
+
+ssize_t coll_ep_alltoall(struct fid_ep *ep, const void *buf, size_t count,
+			 void *desc, void *result, void *result_desc,
+			 fi_addr_t coll_addr, enum fi_datatype datatype,
+			 uint64_t flags, void *context);
+
+ssize_t coll_ep_reduce_scatter(struct fid_ep *ep, const void *buf,
+			       size_t count, void *desc, void *result,
+			       void *result_desc, fi_addr_t coll_addr,
+			       enum fi_datatype datatype, enum fi_op op,
+			       uint64_t flags, void *context);
+
+ssize_t coll_ep_gather(struct fid_ep *ep, const void *buf, size_t count,
+		       void *desc, void *result, void *result_desc,
+		       fi_addr_t coll_addr, fi_addr_t root_addr,
+		       enum fi_datatype datatype, uint64_t flags,
+		       void *context);
 #endif /* _COLL_H_ */
 
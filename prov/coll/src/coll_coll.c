@@ -342,6 +342,106 @@ static int coll_sched_comp(struct util_coll_operation *coll_op)
 }
 
 /*
+ * Ranks beyond the largest power of two fold their data into a partner,
+ * so that the main exchange runs on a power of two number of ranks.  The
+ * rank's id within that exchange is returned, or -1 if it sits out.
+ */
+static int coll_sched_fold(struct util_coll_operation *coll_op, void *result,
+			   void *tmp_buf, uint64_t count,
+			   enum fi_datatype datatype, enum fi_op op,
+			   uint64_t rem, uint64_t *new_id)
+{
+	uint64_t local = coll_op->mc->local_rank;
+	int ret;
+
+	if (local >= 2 * rem) {
+		*new_id = local - rem;
+		return FI_SUCCESS;
+	}
+
+	if (local % 2 == 0) {
+		*new_id = (uint64_t) -1;
+		return coll_sched_send(coll_op, local + 1, result, count,
+				       datatype, 1);
+	}
+
+	*new_id = local / 2;
+	ret = coll_sched_recv(coll_op, local - 1, tmp_buf, count, datatype, 1);
+	if (ret)
+		return ret;
+
+	return coll_sched_reduce(coll_op, tmp_buf, result, count, datatype,
+				 op, 1);
+}
+
+/* Returns the folded result to the ranks that sat out the exchange */
+static int coll_sched_unfold(struct util_coll_operation *coll_op,
+			     void *result, uint64_t count,
+			     enum fi_datatype datatype, uint64_t rem)
+{
+	uint64_t local = coll_op->mc->local_rank;
+
+	if (local >= 2 * rem)
+		return FI_SUCCESS;
+
+	if (local % 2)
+		return coll_sched_send(coll_op, local - 1, result, count,
+				       datatype, 1);
+
+	return coll_sched_recv(coll_op, local + 1, result, count, datatype, 1);
+}
+
+static uint64_t coll_fold_rank(uint64_t new_id, uint64_t rem)
+{
+	return (new_id < rem) ? new_id * 2 + 1 : new_id + rem;
+}
+
+/*
+ * Splits count values into nblocks nearly equal blocks, with the first
+ * count % nblocks blocks one value larger.
+ */
+static uint64_t coll_block_offset(uint64_t count, uint64_t nblocks,
+				  uint64_t block)
+{
+	return block * (count / nblocks) + MIN(block, count % nblocks);
+}
+
+static uint64_t coll_block_count(uint64_t count, uint64_t nblocks,
+				 uint64_t first, uint64_t last)
+{
+	return coll_block_offset(count, nblocks, last) -
+	       coll_block_offset(count, nblocks, first);
+}
+
+/*
+ * Exchanges a range of blocks with a peer.  Both sides compute matching
+ * counts, so an empty range is skipped on both sides.
+ */
+static int coll_sched_sendrecv(struct util_coll_operation *coll_op,
+			       uint64_t remote, void *send_buf,
+			       uint64_t send_cnt, void *recv_buf,
+			       uint64_t recv_cnt, enum fi_datatype datatype)
+{
+	int ret;
+
+	if (send_cnt) {
+		ret = coll_sched_send(coll_op, remote, send_buf, send_cnt,
+				      datatype, 0);
+		if (ret)
+			return ret;
+	}
+
+	if (recv_cnt)
+		return coll_sched_recv(coll_op, remote, recv_buf, recv_cnt,
+				       datatype, 1);
+
+	return FI_SUCCESS;
+}
+
+/*
+ * Recursive doubling allreduce.  Every round exchanges the whole buffer,
+ * which gives the fewest rounds and suits small counts.
+ *
  * TODO:
  * when this fails, clean up the already scheduled work in this function
  */
@@ -362,36 +462,15 @@ static int coll_do_allreduce(struct util_coll_operation *coll_op,
 	/* copy initial send data to result */
 	memcpy(result, send_buf, count * ofi_datatype_size(datatype));
 
-	if (local < 2 * rem) {
-		if (local % 2 == 0) {
-			ret = coll_sched_send(coll_op, local + 1, result,
-					      count, datatype, 1);
-			if (ret)
-				return ret;
-
-			my_new_id = (uint64_t)-1;
-		} else {
-			ret = coll_sched_recv(coll_op, local - 1,
-					      tmp_buf, count, datatype, 1);
-			if (ret)
-				return ret;
-
-			my_new_id = local / 2;
-
-			ret = coll_sched_reduce(coll_op, tmp_buf, result,
-						count, datatype, op, 1);
-			if (ret)
-				return ret;
-		}
-	} else {
-		my_new_id = local - rem;
-	}
+	ret = coll_sched_fold(coll_op, result, tmp_buf, count, datatype, op,
+			      rem, &my_new_id);
+	if (ret)
+		return ret;
 
 	if (my_new_id != -1) {
 		while (mask < pof2) {
 			next_remote = my_new_id ^ mask;
-			remote = (next_remote < rem) ? next_remote * 2 + 1 :
-				next_remote + rem;
+			remote = coll_fold_rank(next_remote, rem);
 
 			/* receive remote data into tmp buf */
 			ret = coll_sched_recv(coll_op, remote, tmp_buf,
@@ -431,22 +510,243 @@ static int coll_do_allreduce(struct util_coll_operation *coll_op,
 		}
 	}
 
-	if (local < 2 * rem) {
-		if (local % 2) {
-			ret = coll_sched_send(coll_op, local - 1, result,
-					      count, datatype, 1);
+	return coll_sched_unfold(coll_op, result, count, datatype, rem);
+}
+
+/*
+ * Rabenseifner's allreduce: a reduce-scatter by recursive halving followed
+ * by an allgather by recursive doubling.  Each rank moves about 2 * count
+ * values in total instead of count * log(p), at the cost of twice the
+ * number of rounds.  The buffer is treated as pof2 blocks, and the indices
+ * below track the window of blocks that this rank is still responsible
+ * for.
+ */
+static int coll_do_allreduce_rabenseifner(struct util_coll_operation *coll_op,
+					  const void *send_buf, void *result,
+					  void *tmp_buf, uint64_t count,
+					  enum fi_datatype datatype,
+					  enum fi_op op)
+{
+	uint64_t rem, pof2, my_new_id, remote, next_remote, mask;
+	uint64_t send_idx, recv_idx, last_idx, half;
+	uint64_t send_cnt, recv_cnt, recv_off;
+	size_t dt_size = ofi_datatype_size(datatype);
+	char *res = result, *tmp = tmp_buf;
+	int ret;
+
+	pof2 = rounddown_power_of_two(coll_op->mc->av_set->fi_addr_count);
+	rem = coll_op->mc->av_set->fi_addr_count - pof2;
+
+	memcpy(result, send_buf, count * dt_size);
+
+	ret = coll_sched_fold(coll_op, result, tmp_buf, count, datatype, op,
+			      rem, &my_new_id);
+	if (ret)
+		return ret;
+
+	if (my_new_id == -1)
+		goto unfold;
+
+	send_idx = recv_idx = 0;
+	last_idx = pof2;
+	for (mask = 1; mask < pof2; ) {
+		next_remote = my_new_id ^ mask;
+		remote = coll_fold_rank(next_remote, rem);
+		half = pof2 / (mask * 2);
+
+		if (my_new_id < next_remote) {
+			send_idx = recv_idx + half;
+			send_cnt = coll_block_count(count, pof2, send_idx,
+						    last_idx);
+			recv_cnt = coll_block_count(count, pof2, recv_idx,
+						    send_idx);
+		} else {
+			recv_idx = send_idx + half;
+			send_cnt = coll_block_count(count, pof2, send_idx,
+						    recv_idx);
+			recv_cnt = coll_block_count(count, pof2, recv_idx,
+						    last_idx);
+		}
+
+		recv_off = coll_block_offset(count, pof2, recv_idx) * dt_size;
+		ret = coll_sched_sendrecv(coll_op, remote,
+				res + coll_block_offset(count, pof2,
+							send_idx) * dt_size,
+				send_cnt, tmp + recv_off, recv_cnt, datatype);
+		if (ret)
+			return ret;
+
+		if (recv_cnt) {
+			ret = coll_sched_reduce(coll_op, tmp + recv_off,
+						res + recv_off, recv_cnt,
+						datatype, op, 1);
 			if (ret)
 				return ret;
+		}
+
+		send_idx = recv_idx;
+		mask <<= 1;
+		if (mask < pof2)
+			last_idx = recv_idx + pof2 / mask;
+	}
+
+	for (mask = pof2 >> 1; mask > 0; mask >>= 1) {
+		next_remote = my_new_id ^ mask;
+		remote = coll_fold_rank(next_remote, rem);
+		half = pof2 / (mask * 2);
+
+		if (my_new_id < next_remote) {
+			if (mask != pof2 / 2)
+				last_idx += half;
+			recv_idx = send_idx + half;
+			send_cnt = coll_block_count(count, pof2, send_idx,
+						    recv_idx);
+			recv_cnt = coll_block_count(count, pof2, recv_idx,
+						    last_idx);
 		} else {
-			ret = coll_sched_recv(coll_op, local + 1, result,
-					      count, datatype, 1);
+			recv_idx = send_idx - half;
+			send_cnt = coll_block_count(count, pof2, send_idx,
+						    last_idx);
+			recv_cnt = coll_block_count(count, pof2, recv_idx,
+						    send_idx);
+		}
+
+		ret = coll_sched_sendrecv(coll_op, remote,
+				res + coll_block_offset(count, pof2,
+							send_idx) * dt_size,
+				send_cnt,
+				res + coll_block_offset(count, pof2,
+							recv_idx) * dt_size,
+				recv_cnt, datatype);
+		if (ret)
+			return ret;
+
+		if (my_new_id > next_remote)
+			send_idx = recv_idx;
+	}
+
+unfold:
+	return coll_sched_unfold(coll_op, result, count, datatype, rem);
+}
+
+/*
+ * Ring allreduce: p - 1 reduce-scatter steps followed by p - 1 allgather
+ * steps, each passing one block to the right neighbor.  Bandwidth optimal
+ * for any number of ranks, with latency that grows linearly in p.
+ */
+static int coll_do_allreduce_ring(struct util_coll_operation *coll_op,
+				  const void *send_buf, void *result,
+				  void *tmp_buf, uint64_t count,
+				  enum fi_datatype datatype, enum fi_op op)
+{
+	uint64_t i, numranks, local, left, right, send_blk, recv_blk;
+	uint64_t send_cnt, recv_cnt, recv_off;
+	size_t dt_size = ofi_datatype_size(datatype);
+	char *res = result, *tmp = tmp_buf;
+	int ret;
+
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	local = coll_op->mc->local_rank;
+	left = (numranks + local - 1) % numranks;
+	right = (local + 1) % numranks;
+
+	memcpy(result, send_buf, count * dt_size);
+
+	for (i = 0; i < numranks - 1; i++) {
+		send_blk = (numranks + local - i) % numranks;
+		recv_blk = (2 * numranks + local - i - 1) % numranks;
+		send_cnt = coll_block_count(count, numranks, send_blk,
+					    send_blk + 1);
+		recv_cnt = coll_block_count(count, numranks, recv_blk,
+					    recv_blk + 1);
+		recv_off = coll_block_offset(count, numranks, recv_blk) *
+			   dt_size;
+
+		if (send_cnt) {
+			ret = coll_sched_send(coll_op, right,
+				res + coll_block_offset(count, numranks,
+							send_blk) * dt_size,
+				send_cnt, datatype, 0);
+			if (ret)
+				return ret;
+		}
+
+		if (!recv_cnt)
+			continue;
+
+		ret = coll_sched_recv(coll_op, left, tmp + recv_off, recv_cnt,
+				      datatype, 1);
+		if (ret)
+			return ret;
+
+		ret = coll_sched_reduce(coll_op, tmp + recv_off,
+					res + recv_off, recv_cnt, datatype,
+					op, 1);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < numranks - 1; i++) {
+		send_blk = (numranks + local - i + 1) % numranks;
+		recv_blk = (numranks + local - i) % numranks;
+		send_cnt = coll_block_count(count, numranks, send_blk,
+					    send_blk + 1);
+		recv_cnt = coll_block_count(count, numranks, recv_blk,
+					    recv_blk + 1);
+
+		if (send_cnt) {
+			ret = coll_sched_send(coll_op, right,
+				res + coll_block_offset(count, numranks,
+							send_blk) * dt_size,
+				send_cnt, datatype, 0);
+			if (ret)
+				return ret;
+		}
+
+		if (recv_cnt) {
+			ret = coll_sched_recv(coll_op, left,
+				res + coll_block_offset(count, numranks,
+							recv_blk) * dt_size,
+				recv_cnt, datatype, 1);
 			if (ret)
 				return ret;
 		}
 	}
+
 	return FI_SUCCESS;
 }
 
+typedef int (*coll_allreduce_fn_t)(struct util_coll_operation *coll_op,
+				   const void *send_buf, void *result,
+				   void *tmp_buf, uint64_t count,
+				   enum fi_datatype datatype, enum fi_op op);
+
+/*
+ * Recursive doubling wins while latency dominates.  Rabenseifner needs at
+ * least one value per block and wins for medium sizes.  Ring moves the same
+ * amount of data, but without the extra full buffer exchange that
+ * Rabenseifner pays for groups that are not a power of two, and it keeps
+ * each transfer to a single neighbor.
+ */
+static coll_allreduce_fn_t
+coll_select_allreduce(struct util_coll_operation *coll_op, uint64_t count,
+		      enum fi_datatype datatype)
+{
+	uint64_t numranks = coll_op->mc->av_set->fi_addr_count;
+	size_t nbytes = count * ofi_datatype_size(datatype);
+
+	if (numranks < 2 || count < numranks ||
+	    nbytes < coll_allreduce_rabenseifner_min)
+		return coll_do_allreduce;
+
+	if (nbytes >= coll_allreduce_ring_min ||
+	    (rounddown_power_of_two(numranks) != numranks &&
+	     numranks <= COLL_RING_MAX_RANKS))
+		return coll_do_allreduce_ring;
+
+	return coll_do_allreduce_rabenseifner;
+}
+
 /* allgather implemented using ring algorithm */
 static int coll_do_allgather(struct util_coll_operation *coll_op,
 			     const void *send_buf, void *result, size_t count,
@@ -645,6 +945,399 @@ static int coll_do_scatter(struct util_coll_operation *coll_op,
 	return FI_SUCCESS;
 }
 
+/*
+ * Pipelined broadcast.  The buffer is split into segments that stream down
+ * a binomial tree rooted at root, or down a chain of ranks for very large
+ * buffers.  The receive of each segment fences the sends that forward it,
+ * so a rank forwards segment k while segment k + 1 is arriving.
+ */
+static int coll_do_bcast_pipeline(struct util_coll_operation *coll_op,
+				  void *buf, uint64_t count, uint64_t root,
+				  enum fi_datatype datatype, uint64_t seg_cnt,
+				  bool chain)
+{
+	uint64_t numranks, local, rel, mask, off, cnt, i;
+	uint64_t parent = (uint64_t) -1, children[64];
+	size_t dt_size = ofi_datatype_size(datatype);
+	size_t nchildren = 0;
+	char *seg;
+	int ret;
+
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	local = coll_op->mc->local_rank;
+	rel = (local + numranks - root) % numranks;
+
+	if (chain) {
+		if (rel)
+			parent = (local + numranks - 1) % numranks;
+		if (rel + 1 < numranks)
+			children[nchildren++] = (local + 1) % numranks;
+	} else {
+		for (mask = 1; mask < numranks; mask <<= 1) {
+			if (rel & mask) {
+				parent = (local + numranks - mask) % numranks;
+				break;
+			}
+		}
+		/* largest subtree first */
+		for (mask >>= 1; mask > 0; mask >>= 1) {
+			if (rel + mask < numranks)
+				children[nchildren++] =
+					(local + mask) % numranks;
+		}
+	}
+
+	for (off = 0; off < count; off += cnt) {
+		cnt = MIN(seg_cnt, count - off);
+		seg = (char *) buf + off * dt_size;
+
+		if (parent != (uint64_t) -1) {
+			ret = coll_sched_recv(coll_op, parent, seg, cnt,
+					      datatype, 1);
+			if (ret)
+				return ret;
+		}
+
+		/*
+		 * A fence only holds back the work after it, so the last send
+		 * is fenced to keep the completion behind every forward.
+		 */
+		for (i = 0; i < nchildren; i++) {
+			ret = coll_sched_send(coll_op, children[i], seg, cnt,
+					      datatype, off + cnt == count &&
+					      i == nchildren - 1);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return FI_SUCCESS;
+}
+
+/*
+ * Pairwise exchange alltoall.  In step i every rank sends to local + i and
+ * receives from local - i, so each pair of ranks exchanges exactly once
+ * and only one message per rank is in flight at a time.
+ */
+static int coll_do_alltoall_pairwise(struct util_coll_operation *coll_op,
+				     const void *send_buf, void *result,
+				     uint64_t count, enum fi_datatype datatype)
+{
+	uint64_t i, numranks, local, dest, src;
+	size_t nbytes = count * ofi_datatype_size(datatype);
+	int ret;
+
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	local = coll_op->mc->local_rank;
+
+	memcpy((char *) result + local * nbytes,
+	       (char *) send_buf + local * nbytes, nbytes);
+
+	for (i = 1; i < numranks; i++) {
+		dest = (local + i) % numranks;
+		src = (local + numranks - i) % numranks;
+
+		ret = coll_sched_send(coll_op, dest,
+				      (char *) send_buf + dest * nbytes,
+				      count, datatype, 0);
+		if (ret)
+			return ret;
+
+		ret = coll_sched_recv(coll_op, src,
+				      (char *) result + src * nbytes,
+				      count, datatype, 1);
+		if (ret)
+			return ret;
+	}
+
+	return FI_SUCCESS;
+}
+
+/*
+ * Bruck's alltoall.  The blocks are rotated so that block i is destined
+ * for rank local + i.  In round k every block whose index has bit k set is
+ * forwarded k ranks to the right, which takes log(p) rounds at the cost of
+ * moving each block up to log(p) times.  Suits small blocks.  tmp_buf
+ * holds the rotated blocks followed by a send and a receive area of
+ * (p + 1) / 2 blocks each.
+ */
+static int coll_do_alltoall_bruck(struct util_coll_operation *coll_op,
+				  const void *send_buf, void *result,
+				  void *tmp_buf, uint64_t count,
+				  enum fi_datatype datatype)
+{
+	uint64_t i, k, n, run, numranks, local, half;
+	size_t nbytes = count * ofi_datatype_size(datatype);
+	char *rot, *pack, *unpack;
+	int ret;
+
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	local = coll_op->mc->local_rank;
+	half = (numranks + 1) / 2;
+	rot = tmp_buf;
+	pack = rot + numranks * nbytes;
+	unpack = pack + half * nbytes;
+
+	memcpy(rot, (char *) send_buf + local * nbytes,
+	       (numranks - local) * nbytes);
+	memcpy(rot + (numranks - local) * nbytes, send_buf, local * nbytes);
+
+	for (k = 1; k < numranks; k <<= 1) {
+		/* blocks with bit k set come in runs of k */
+		for (i = k, n = 0; i < numranks; i += 2 * k, n += run) {
+			run = MIN(k, numranks - i);
+			ret = coll_sched_copy(coll_op, rot + i * nbytes,
+					      pack + n * nbytes, run * count,
+					      datatype, 1);
+			if (ret)
+				return ret;
+		}
+
+		ret = coll_sched_send(coll_op, (local + k) % numranks, pack,
+				      n * count, datatype, 0);
+		if (ret)
+			return ret;
+
+		ret = coll_sched_recv(coll_op,
+				      (local + numranks - k) % numranks,
+				      unpack, n * count, datatype, 1);
+		if (ret)
+			return ret;
+
+		for (i = k, n = 0; i < numranks; i += 2 * k, n += run) {
+			run = MIN(k, numranks - i);
+			ret = coll_sched_copy(coll_op, unpack + n * nbytes,
+					      rot + i * nbytes, run * count,
+					      datatype, 1);
+			if (ret)
+				return ret;
+		}
+	}
+
+	/* block i now holds the data sent by rank local - i */
+	for (i = 0; i < numranks; i++) {
+		ret = coll_sched_copy(coll_op, rot + i * nbytes,
+				      (char *) result +
+				      ((local + numranks - i) % numranks) *
+				      nbytes, count, datatype, 1);
+		if (ret)
+			return ret;
+	}
+
+	return FI_SUCCESS;
+}
+
+/*
+ * Ring reduce-scatter over the p blocks of count values in send_buf.  In
+ * step i a rank passes its partial sum of block local - i - 1 to the right
+ * and folds the one arriving from the left into its own copy, so after
+ * p - 1 steps block local is complete.  tmp_buf holds the p blocks being
+ * reduced followed by one receive block.
+ */
+static int coll_do_reduce_scatter_ring(struct util_coll_operation *coll_op,
+				       const void *send_buf, void *result,
+				       void *tmp_buf, uint64_t count,
+				       enum fi_datatype datatype,
+				       enum fi_op op)
+{
+	uint64_t i, numranks, local, left, right, send_blk, recv_blk;
+	size_t nbytes = count * ofi_datatype_size(datatype);
+	char *work = tmp_buf, *recv_buf;
+	int ret;
+
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	local = coll_op->mc->local_rank;
+	left = (numranks + local - 1) % numranks;
+	right = (local + 1) % numranks;
+	recv_buf = work + numranks * nbytes;
+
+	memcpy(work, send_buf, numranks * nbytes);
+
+	for (i = 0; i < numranks - 1; i++) {
+		send_blk = (2 * numranks + local - i - 1) % numranks;
+		recv_blk = (2 * numranks + local - i - 2) % numranks;
+
+		ret = coll_sched_send(coll_op, right, work + send_blk * nbytes,
+				      count, datatype, 0);
+		if (ret)
+			return ret;
+
+		ret = coll_sched_recv(coll_op, left, recv_buf, count,
+				      datatype, 1);
+		if (ret)
+			return ret;
+
+		ret = coll_sched_reduce(coll_op, recv_buf,
+					work + recv_blk * nbytes, count,
+					datatype, op, 1);
+		if (ret)
+			return ret;
+	}
+
+	return coll_sched_copy(coll_op, work + local * nbytes, result, count,
+			       datatype, 1);
+}
+
+/* First block held by folded rank new_id, see coll_sched_fold */
+static uint64_t coll_fold_block(uint64_t new_id, uint64_t rem)
+{
+	return (new_id < rem) ? new_id * 2 : new_id + rem;
+}
+
+/*
+ * Recursive halving reduce-scatter.  Each round swaps half of the blocks
+ * still owned with a partner and reduces the other half, so after log(p)
+ * rounds a rank owns only its own block.  For groups that are not a power
+ * of two the extra ranks fold in first, and each surviving rank carries the
+ * block of the rank it absorbed, returning it at the end.  tmp_buf holds
+ * the p blocks being reduced followed by p receive blocks.
+ */
+static int coll_do_reduce_scatter_halving(struct util_coll_operation *coll_op,
+					  const void *send_buf, void *result,
+					  void *tmp_buf, uint64_t count,
+					  enum fi_datatype datatype,
+					  enum fi_op op)
+{
+	uint64_t numranks, local, rem, pof2, my_new_id, remote, mask;
+	uint64_t lo, keep, give, keep_off, give_off, keep_cnt, give_cnt;
+	size_t nbytes = count * ofi_datatype_size(datatype);
+	char *work = tmp_buf, *recv_buf;
+	int ret;
+
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	local = coll_op->mc->local_rank;
+	pof2 = rounddown_power_of_two(numranks);
+	rem = numranks - pof2;
+	recv_buf = work + numranks * nbytes;
+
+	memcpy(work, send_buf, numranks * nbytes);
+
+	ret = coll_sched_fold(coll_op, work, recv_buf, numranks * count,
+			      datatype, op, rem, &my_new_id);
+	if (ret)
+		return ret;
+
+	if (my_new_id == -1)
+		return coll_sched_recv(coll_op, local + 1, result, count,
+				       datatype, 1);
+
+	for (lo = 0, mask = pof2 >> 1; mask > 0; mask >>= 1) {
+		remote = coll_fold_rank(my_new_id ^ mask, rem);
+		if (my_new_id & mask) {
+			keep = lo + mask;
+			give = lo;
+		} else {
+			keep = lo;
+			give = lo + mask;
+		}
+
+		keep_off = coll_fold_block(keep, rem);
+		give_off = coll_fold_block(give, rem);
+		keep_cnt = coll_fold_block(keep + mask, rem) - keep_off;
+		give_cnt = coll_fold_block(give + mask, rem) - give_off;
+
+		ret = coll_sched_sendrecv(coll_op, remote,
+					  work + give_off * nbytes,
+					  give_cnt * count,
+					  recv_buf + keep_off * nbytes,
+					  keep_cnt * count, datatype);
+		if (ret)
+			return ret;
+
+		ret = coll_sched_reduce(coll_op, recv_buf + keep_off * nbytes,
+					work + keep_off * nbytes,
+					keep_cnt * count, datatype, op, 1);
+		if (ret)
+			return ret;
+
+		lo = keep;
+	}
+
+	if (local < 2 * rem) {
+		ret = coll_sched_send(coll_op, local - 1,
+				      work + (local - 1) * nbytes, count,
+				      datatype, 1);
+		if (ret)
+			return ret;
+	}
+
+	return coll_sched_copy(coll_op, work + local * nbytes, result, count,
+			       datatype, 1);
+}
+
+/*
+ * Gather implemented with a binomial tree, the mirror image of scatter.
+ * Every rank collects the blocks of its subtree, in rank order relative to
+ * root, and passes them up to its parent.  buf is the collection buffer for
+ * inner ranks, and receives the subtree data in that relative order.
+ */
+static int coll_do_gather(struct util_coll_operation *coll_op,
+			  const void *data, void *result, void **temp,
+			  size_t count, uint64_t root,
+			  enum fi_datatype datatype)
+{
+	uint64_t local, numranks, rel, mask, subtree;
+	size_t nbytes = count * ofi_datatype_size(datatype);
+	char *buf;
+	int ret;
+
+	local = coll_op->mc->local_rank;
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	rel = (local + numranks - root) % numranks;
+
+	if (count == 0)
+		return FI_SUCCESS;
+
+	/* leaves send their own data straight up */
+	if (rel % 2)
+		return coll_sched_send(coll_op, (local + numranks - 1) %
+				       numranks, (void *) data, count,
+				       datatype, 1);
+
+	subtree = rel ? util_binomial_tree_values_to_recv(rel, numranks) :
+			numranks;
+	if (local == root && root == 0) {
+		buf = result;
+	} else {
+		*temp = malloc(subtree * nbytes);
+		if (!*temp)
+			return -FI_ENOMEM;
+		buf = *temp;
+	}
+	memcpy(buf, data, nbytes);
+
+	for (mask = 1; mask < numranks; mask <<= 1) {
+		if (rel & mask) {
+			return coll_sched_send(coll_op,
+					       (local + numranks - mask) %
+					       numranks, buf, subtree * count,
+					       datatype, 1);
+		}
+
+		if (rel + mask < numranks) {
+			ret = coll_sched_recv(coll_op,
+					      (local + mask) % numranks,
+					      buf + mask * nbytes,
+					      MIN(mask, numranks - rel - mask) *
+					      count, datatype, 1);
+			if (ret)
+				return ret;
+		}
+	}
+
+	if (buf == result)
+		return FI_SUCCESS;
+
+	/* root's block j belongs to rank root + j */
+	ret = coll_sched_copy(coll_op, buf, (char *) result + root * nbytes,
+			      (numranks - root) * count, datatype, 1);
+	if (ret)
+		return ret;
+
+	return coll_sched_copy(coll_op, buf + (numranks - root) * nbytes,
+			       result, root * count, datatype, 1);
+}
+
 static int coll_close(struct fid *fid)
 {
 	struct util_coll_mc *coll_mc;
@@ -745,6 +1438,18 @@ void coll_collective_comp(struct util_coll_operation *coll_op)
 		free(coll_op->data.broadcast.scatter);
 		break;
 
+	case UTIL_COLL_ALLTOALL_OP:
+		free(coll_op->data.alltoall);
+		break;
+
+	case UTIL_COLL_REDUCE_SCATTER_OP:
+		free(coll_op->data.reduce_scatter);
+		break;
+
+	case UTIL_COLL_GATHER_OP:
+		free(coll_op->data.gather);
+		break;
+
 	case UTIL_COLL_JOIN_OP:
 	case UTIL_COLL_BARRIER_OP:
 	case UTIL_COLL_ALLGATHER_OP:
@@ -759,10 +1464,9 @@ static ssize_t coll_process_reduce_item(struct util_coll_reduce_item *reduce_ite
 	if (reduce_item->op < FI_MIN || reduce_item->op > FI_BXOR)
 		return -FI_ENOSYS;
 
-	ofi_atomic_write_handler(reduce_item->op, reduce_item->datatype,
-				 reduce_item->inout_buf,
-				 reduce_item->in_buf,
-				 reduce_item->count);
+	ofi_reduce_handler(reduce_item->op, reduce_item->datatype,
+			   reduce_item->inout_buf, reduce_item->in_buf,
+			   reduce_item->count);
 	return FI_SUCCESS;
 }
 
@@ -833,7 +1537,8 @@ void coll_ep_progress(struct util_ep *util_ep)
 						 hdr);
 			ret = coll_process_xfer_item(xfer_item);
 			if (ret && ret == -FI_EAGAIN) {
-				slist_insert_tail(&work_item->ready_entry,
+				/* retry first, sends to a peer must stay ordered */
+				slist_insert_head(&work_item->ready_entry,
 						  &util_ep->coll_ready_queue);
 				goto out;
 			}
@@ -1059,7 +1764,8 @@ ssize_t coll_ep_allreduce(struct fid_ep *ep, const void *buf, size_t count,
 		goto err1;
 	}
 
-	ret = coll_do_allreduce(allreduce_op, buf, result,
+	ret = coll_select_allreduce(allreduce_op, count, datatype)(
+				allreduce_op, buf, result,
 				allreduce_op->data.allreduce.data, count,
 				datatype, op);
 	if (ret)
@@ -1160,7 +1866,8 @@ ssize_t coll_ep_broadcast(struct fid_ep *ep, void *buf, size_t count,
 	struct util_coll_mc *coll_mc;
 	struct util_coll_operation *broadcast_op;
 	struct util_ep *util_ep;
-	uint64_t chunk_cnt, numranks, local;
+	uint64_t chunk_cnt, numranks, local, seg_cnt;
+	size_t nbytes;
 	int ret;
 
 	coll_mc = (struct util_coll_mc *) ((uintptr_t) coll_addr);
@@ -1170,6 +1877,18 @@ ssize_t coll_ep_broadcast(struct fid_ep *ep, void *buf, size_t count,
 	if (!broadcast_op)
 		return -FI_ENOMEM;
 
+	nbytes = count * ofi_datatype_size(datatype);
+	if (coll_bcast_segment_size && nbytes > coll_bcast_segment_size) {
+		seg_cnt = MAX(coll_bcast_segment_size /
+			      ofi_datatype_size(datatype), 1);
+		ret = coll_do_bcast_pipeline(broadcast_op, buf, count,
+					     root_addr, datatype, seg_cnt,
+					     nbytes >= coll_bcast_chain_min);
+		if (ret)
+			goto err1;
+		goto comp;
+	}
+
 	local = broadcast_op->mc->local_rank;
 	numranks = broadcast_op->mc->av_set->fi_addr_count;
 	chunk_cnt = (count + numranks - 1) / numranks;
@@ -1197,6 +1916,7 @@ ssize_t coll_ep_broadcast(struct fid_ep *ep, void *buf, size_t count,
 	if (ret)
 		goto err2;
 
+comp:
 	ret = coll_sched_comp(broadcast_op);
 	if (ret)
 		goto err2;
@@ -1212,6 +1932,160 @@ err1:
 	return ret;
 }
 
+ssize_t coll_ep_alltoall(struct fid_ep *ep, const void *buf, size_t count,
+			 void *desc, void *result, void *result_desc,
+			 fi_addr_t coll_addr, enum fi_datatype datatype,
+			 uint64_t flags, void *context)
+{
+	struct util_coll_mc *coll_mc;
+	struct util_coll_operation *alltoall_op;
+	struct util_ep *util_ep;
+	uint64_t numranks;
+	size_t nbytes;
+	int ret;
+
+	coll_mc = (struct util_coll_mc *) ((uintptr_t) coll_addr);
+	alltoall_op = coll_create_op(ep, coll_mc, UTIL_COLL_ALLTOALL_OP,
+				     flags, context,
+				     coll_collective_comp);
+	if (!alltoall_op)
+		return -FI_ENOMEM;
+
+	numranks = coll_mc->av_set->fi_addr_count;
+	nbytes = count * ofi_datatype_size(datatype);
+	if (!count)
+		goto comp;
+
+	if (numranks > 2 && nbytes <= coll_alltoall_bruck_max) {
+		alltoall_op->data.alltoall =
+			malloc((numranks + 2 * ((numranks + 1) / 2)) * nbytes);
+		if (!alltoall_op->data.alltoall) {
+			ret = -FI_ENOMEM;
+			goto err1;
+		}
+
+		ret = coll_do_alltoall_bruck(alltoall_op, buf, result,
+					     alltoall_op->data.alltoall,
+					     count, datatype);
+	} else {
+		ret = coll_do_alltoall_pairwise(alltoall_op, buf, result,
+						count, datatype);
+	}
+	if (ret)
+		goto err2;
+
+comp:
+	ret = coll_sched_comp(alltoall_op);
+	if (ret)
+		goto err2;
+
+	util_ep = container_of(ep, struct util_ep, ep_fid);
+	coll_progress_work(util_ep, alltoall_op);
+
+	return FI_SUCCESS;
+err2:
+	free(alltoall_op->data.alltoall);
+err1:
+	free(alltoall_op);
+	return ret;
+}
+
+ssize_t coll_ep_reduce_scatter(struct fid_ep *ep, const void *buf,
+			       size_t count, void *desc, void *result,
+			       void *result_desc, fi_addr_t coll_addr,
+			       enum fi_datatype datatype, enum fi_op op,
+			       uint64_t flags, void *context)
+{
+	struct util_coll_mc *coll_mc;
+	struct util_coll_operation *reduce_scatter_op;
+	struct util_ep *util_ep;
+	uint64_t numranks;
+	size_t nbytes;
+	int ret;
+
+	coll_mc = (struct util_coll_mc *) ((uintptr_t) coll_addr);
+	reduce_scatter_op = coll_create_op(ep, coll_mc,
+					   UTIL_COLL_REDUCE_SCATTER_OP,
+					   flags, context,
+					   coll_collective_comp);
+	if (!reduce_scatter_op)
+		return -FI_ENOMEM;
+
+	numranks = coll_mc->av_set->fi_addr_count;
+	nbytes = count * ofi_datatype_size(datatype);
+	if (!count)
+		goto comp;
+
+	reduce_scatter_op->data.reduce_scatter = malloc(2 * numranks * nbytes);
+	if (!reduce_scatter_op->data.reduce_scatter) {
+		ret = -FI_ENOMEM;
+		goto err1;
+	}
+
+	if (numranks * nbytes >= coll_reduce_scatter_ring_min)
+		ret = coll_do_reduce_scatter_ring(reduce_scatter_op, buf,
+				result, reduce_scatter_op->data.reduce_scatter,
+				count, datatype, op);
+	else
+		ret = coll_do_reduce_scatter_halving(reduce_scatter_op, buf,
+				result, reduce_scatter_op->data.reduce_scatter,
+				count, datatype, op);
+	if (ret)
+		goto err2;
+
+comp:
+	ret = coll_sched_comp(reduce_scatter_op);
+	if (ret)
+		goto err2;
+
+	util_ep = container_of(ep, struct util_ep, ep_fid);
+	coll_progress_work(util_ep, reduce_scatter_op);
+
+	return FI_SUCCESS;
+err2:
+	free(reduce_scatter_op->data.reduce_scatter);
+err1:
+	free(reduce_scatter_op);
+	return ret;
+}
+
+ssize_t coll_ep_gather(struct fid_ep *ep, const void *buf, size_t count,
+		       void *desc, void *result, void *result_desc,
+		       fi_addr_t coll_addr, fi_addr_t root_addr,
+		       enum fi_datatype datatype, uint64_t flags,
+		       void *context)
+{
+	struct util_coll_mc *coll_mc;
+	struct util_coll_operation *gather_op;
+	struct util_ep *util_ep;
+	int ret;
+
+	coll_mc = (struct util_coll_mc *) ((uintptr_t) coll_addr);
+	gather_op = coll_create_op(ep, coll_mc, UTIL_COLL_GATHER_OP,
+				   flags, context,
+				   coll_collective_comp);
+	if (!gather_op)
+		return -FI_ENOMEM;
+
+	ret = coll_do_gather(gather_op, buf, result, &gather_op->data.gather,
+			     count, root_addr, datatype);
+	if (ret)
+		goto err;
+
+	ret = coll_sched_comp(gather_op);
+	if (ret)
+		goto err;
+
+	util_ep = container_of(ep, struct util_ep, ep_fid);
+	coll_progress_work(util_ep, gather_op);
+
+	return FI_SUCCESS;
+err:
+	free(gather_op->data.gather);
+	free(gather_op);
+	return ret;
+}
+
 ssize_t coll_peer_xfer_complete(struct fid_ep *ep,
 				struct fi_cq_tagged_entry *cqe,
 				fi_addr_t src_addr)
@@ -1275,9 +2149,12 @@ int coll_query_collective(struct fid_domain *dom_fid,
 	case FI_ALLGATHER:
 	case FI_SCATTER:
 	case FI_BROADCAST:
+	case FI_ALLTOALL:
+	case FI_GATHER:
 		ret = FI_SUCCESS;
 		break;
 	case FI_ALLREDUCE:
+	case FI_REDUCE_SCATTER:
 		if (FI_MIN <= attr->op && FI_BXOR >= attr->op)
 			ret = fi_query_atomic(peer_domain, attr->datatype,
 					      attr->op, &attr->datatype_attr,
@@ -1285,10 +2162,7 @@ int coll_query_collective(struct fid_domain *dom_fid,
 		else
 			return -FI_ENOSYS;
 		break;
-	case FI_ALLTOALL:
-	case FI_REDUCE_SCATTER:
 	case FI_REDUCE:
-	case FI_GATHER:
 	default:
 		return -FI_ENOSYS;
 	}
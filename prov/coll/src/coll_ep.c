@@ -69,13 +69,13 @@ static struct fi_ops_collective coll_ops_collective = {
 	.barrier = coll_ep_barrier,
 	.barrier2 = coll_ep_barrier2,
 	.broadcast = coll_ep_broadcast,
-	.alltoall = fi_coll_no_alltoall,
+	.alltoall = coll_ep_alltoall,
 	.allreduce = coll_ep_allreduce,
 	.allgather = coll_ep_allgather,
-	.reduce_scatter = fi_coll_no_reduce_scatter,
+	.reduce_scatter = coll_ep_reduce_scatter,
 	.reduce = fi_coll_no_reduce,
 	.scatter = coll_ep_scatter,
-	.gather = fi_coll_no_gather,
+	.gather = coll_ep_gather,
 	.msg = fi_coll_no_msg,
 };
 
@@ -32,6 +32,13 @@
 
 #include "coll.h"
 
+size_t coll_allreduce_rabenseifner_min = 2048;
+size_t coll_allreduce_ring_min = 1024 * 1024;
+size_t coll_bcast_segment_size = 64 * 1024;
+size_t coll_bcast_chain_min = 8 * 1024 * 1024;
+size_t coll_alltoall_bruck_max = 256;
+size_t coll_reduce_scatter_ring_min = 1024 * 1024;
+
 static int coll_getinfo(uint32_t version, const char *node, const char *service,
 			uint64_t flags, const struct fi_info *hints,
 			struct fi_info **info)
@@ -60,5 +67,48 @@ struct fi_provider coll_prov = {
 
 COLL_INI
 {
+	fi_param_define(&coll_prov, "allreduce_rabenseifner_min",
+			FI_PARAM_SIZE_T,
+			"Smallest allreduce, in bytes, that uses Rabenseifner's "
+			"reduce-scatter/allgather algorithm instead of "
+			"recursive doubling.  (default: 2048)");
+	fi_param_define(&coll_prov, "allreduce_ring_min", FI_PARAM_SIZE_T,
+			"Smallest allreduce, in bytes, that uses the ring "
+			"algorithm.  Groups of up to 64 ranks that are not a "
+			"power of two use ring from the Rabenseifner "
+			"threshold.  "
+			"(default: 1048576)");
+	fi_param_define(&coll_prov, "bcast_segment_size", FI_PARAM_SIZE_T,
+			"Segment size, in bytes, for pipelined broadcast.  "
+			"Larger broadcasts are streamed down the tree one "
+			"segment at a time.  0 disables pipelining.  "
+			"(default: 65536)");
+	fi_param_define(&coll_prov, "bcast_chain_min", FI_PARAM_SIZE_T,
+			"Smallest broadcast, in bytes, that is pipelined along "
+			"a chain of ranks instead of a binomial tree.  "
+			"(default: 8388608)");
+	fi_param_define(&coll_prov, "alltoall_bruck_max", FI_PARAM_SIZE_T,
+			"Largest per-rank block, in bytes, for which alltoall "
+			"uses Bruck's algorithm instead of pairwise exchange.  "
+			"(default: 256)");
+	fi_param_define(&coll_prov, "reduce_scatter_ring_min",
+			FI_PARAM_SIZE_T,
+			"Smallest reduce-scatter input, in bytes, that uses "
+			"the ring algorithm instead of recursive halving.  "
+			"(default: 1048576)");
+
+	fi_param_get_size_t(&coll_prov, "allreduce_rabenseifner_min",
+			    &coll_allreduce_rabenseifner_min);
+	fi_param_get_size_t(&coll_prov, "allreduce_ring_min",
+			    &coll_allreduce_ring_min);
+	fi_param_get_size_t(&coll_prov, "bcast_segment_size",
+			    &coll_bcast_segment_size);
+	fi_param_get_size_t(&coll_prov, "bcast_chain_min",
+			    &coll_bcast_chain_min);
+	fi_param_get_size_t(&coll_prov, "alltoall_bruck_max",
+			    &coll_alltoall_bruck_max);
+	fi_param_get_size_t(&coll_prov, "reduce_scatter_ring_min",
+			    &coll_reduce_scatter_ring_min);
+
 	return &coll_prov;
 }
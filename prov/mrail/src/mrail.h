@@ -93,6 +93,16 @@ extern struct mrail_config mrail_config[MRAIL_MAX_CONFIG];
 extern int mrail_num_config;
 extern int mrail_local_rank;
 
+/* Configured rail weights, in FI_OFI_MRAIL_ADDR order.  Rail rates are
+ * measured instead when none are given. */
+extern uint64_t *mrail_rail_weights;
+extern size_t mrail_num_rail_weights;
+
+/* Busy time in ns over which a rail's rate is sampled */
+#define MRAIL_RATE_WINDOW		1000000
+/* A rail is not skipped for queueing less than this many bytes */
+#define MRAIL_BACKLOG_MIN_SIZE		65536
+
 extern struct fi_ops_rma mrail_ops_rma;
 
 struct mrail_match_attr {
@@ -178,6 +188,8 @@ struct mrail_tx_buf {
 	struct mrail_rndv_hdr	rndv_hdr;
 	struct mrail_rndv_req	*rndv_req;
 	fid_t			rndv_mr_fid;
+	/* bytes accounted to the rail's queue until completion */
+	size_t			len;
 };
 
 struct mrail_pkt {
@@ -270,6 +282,16 @@ struct mrail_ep {
 	struct {
 		struct fid_ep 		*ep;
 		struct fi_info		*info;
+		/* bytes posted to the rail and not yet completed */
+		ofi_atomic64_t		queued;
+		/* configured weight, or 0 to use the measured rate */
+		uint64_t		weight;
+		/* measured rate in bytes per usec, 0 until measured */
+		uint64_t		rate;
+		uint64_t		last_comp;
+		uint64_t		win_bytes;
+		uint64_t		win_time;
+		uint64_t		stripe_bytes;
 	}			*rails;
 	size_t			num_eps;
 	ofi_atomic32_t		tx_rail;
@@ -377,12 +399,42 @@ static inline int mrail_get_policy(size_t size)
 	return mrail_config[i].policy;
 }
 
+uint64_t mrail_get_rail_weights(struct mrail_ep *mrail_ep, uint64_t *weights);
+
+/* Round-robin over the rails that are not backlogged */
+static inline size_t mrail_get_tx_rail_rr_avail(struct mrail_ep *mrail_ep)
+{
+	uint64_t *weights = alloca(sizeof(*weights) * mrail_ep->num_eps);
+	size_t i, rail = 0;
+
+	mrail_get_rail_weights(mrail_ep, weights);
+	for (i = 0; i < mrail_ep->num_eps; i++) {
+		rail = mrail_get_tx_rail_rr(mrail_ep);
+		if (weights[rail])
+			break;
+	}
+	return rail;
+}
+
 static inline size_t mrail_get_tx_rail(struct mrail_ep *mrail_ep, int policy)
 {
-	return policy == MRAIL_POLICY_FIXED ?
-				mrail_ep->default_tx_rail :
-				mrail_get_tx_rail_rr(mrail_ep);
+	if (policy == MRAIL_POLICY_FIXED)
+		return mrail_ep->default_tx_rail;
+
+	return mrail_ep->num_eps > 1 ? mrail_get_tx_rail_rr_avail(mrail_ep) :
+				       mrail_get_tx_rail_rr(mrail_ep);
+}
 
+static inline void
+mrail_rail_queue(struct mrail_ep *mrail_ep, size_t rail, size_t len)
+{
+	ofi_atomic_add64(&mrail_ep->rails[rail].queued, len);
+}
+
+static inline void
+mrail_rail_done(struct mrail_ep *mrail_ep, size_t rail, size_t len)
+{
+	ofi_atomic_sub64(&mrail_ep->rails[rail].queued, len);
 }
 
 struct mrail_subreq {
@@ -393,6 +445,9 @@ struct mrail_subreq {
 	struct fi_rma_iov rma_iov[MRAIL_IOV_LIMIT];
 	size_t iov_count;
 	size_t rma_iov_count;
+	size_t rail;
+	size_t len;
+	uint64_t post_time;
 };
 
 struct mrail_req {
@@ -58,6 +58,7 @@ struct fi_ep_attr mrail_ep_attr = {
 	.protocol 		= FI_PROTO_MRAIL,
 	.protocol_version 	= 1,
 	.max_msg_size 		= SIZE_MAX,
+	.mem_tag_format		= FI_TAG_GENERIC,
 	.msg_prefix_size	= SIZE_MAX,
 	.max_order_raw_size 	= SIZE_MAX,
 	.max_order_war_size 	= SIZE_MAX,
@@ -136,8 +136,10 @@ static int mrail_av_insert(struct fid_av *av_fid, const void *addr, size_t count
 		}
 
 		peer_info->addr = index_rail0;
+		ofi_mutex_lock(&mrail_av->util_av.lock);
 		ret = ofi_av_insert_addr(&mrail_av->util_av, peer_info,
 					 &index);
+		ofi_mutex_unlock(&mrail_av->util_av.lock);
 		if (ret) {
 			FI_WARN(&mrail_prov, FI_LOG_AV, \
 				"Unable to get rail fi_addr\n");
@@ -55,7 +55,8 @@ static int mrail_cq_write_send_comp(struct util_cq *cq,
 	if (tx_buf->hdr.protocol == MRAIL_PROTO_RNDV &&
 	    tx_buf->hdr.protocol_cmd == MRAIL_RNDV_REQ) {
 		free(tx_buf->rndv_req);
-		fi_close(tx_buf->rndv_mr_fid);
+		if (tx_buf->rndv_mr_fid)
+			fi_close(tx_buf->rndv_mr_fid);
 	}
 
 	ofi_ep_lock_acquire(&tx_buf->ep->util_ep);
@@ -508,6 +509,40 @@ static struct fi_ops_cq mrail_cq_ops = {
 	.strerror = fi_no_cq_strerror,
 };
 
+/*
+ * Update the rate of the subreq's rail.  Each stripe is timed from when it
+ * was posted or the rail's previous stripe completed, whichever is later,
+ * so stripes queued behind each other are not charged for the wait.  The
+ * rate is taken over windows of busy time, since a single stripe may
+ * complete as soon as it is buffered.
+ */
+static void mrail_update_rail_rate(struct mrail_ep *mrail_ep,
+				   struct mrail_subreq *subreq)
+{
+	uint64_t now, start, rate;
+
+	mrail_rail_done(mrail_ep, subreq->rail, subreq->len);
+
+	now = ofi_gettime_ns();
+	ofi_ep_lock_acquire(&mrail_ep->util_ep);
+	start = MAX(subreq->post_time, mrail_ep->rails[subreq->rail].last_comp);
+	mrail_ep->rails[subreq->rail].last_comp = now;
+	mrail_ep->rails[subreq->rail].stripe_bytes += subreq->len;
+	mrail_ep->rails[subreq->rail].win_bytes += subreq->len;
+	mrail_ep->rails[subreq->rail].win_time += now - start;
+
+	if (mrail_ep->rails[subreq->rail].win_time >= MRAIL_RATE_WINDOW) {
+		rate = MAX(mrail_ep->rails[subreq->rail].win_bytes * 1000 /
+			   mrail_ep->rails[subreq->rail].win_time, 1);
+		if (mrail_ep->rails[subreq->rail].rate)
+			rate = (mrail_ep->rails[subreq->rail].rate * 7 + rate) / 8;
+		mrail_ep->rails[subreq->rail].rate = rate;
+		mrail_ep->rails[subreq->rail].win_bytes = 0;
+		mrail_ep->rails[subreq->rail].win_time = 0;
+	}
+	ofi_ep_lock_release(&mrail_ep->util_ep);
+}
+
 static void mrail_handle_rma_completion(struct util_cq *cq,
 		struct fi_cq_tagged_entry *comp)
 {
@@ -518,6 +553,8 @@ static void mrail_handle_rma_completion(struct util_cq *cq,
 	subreq = comp->op_context;
 	req = subreq->parent;
 
+	mrail_update_rail_rate(req->mrail_ep, subreq);
+
 	if (ofi_atomic_dec32(&req->expected_subcomps) == 0) {
 		if (req->comp.flags & MRAIL_RNDV_FLAG) {
 			mrail_finish_rndv_recv(cq, req, comp);
@@ -578,6 +615,7 @@ void mrail_poll_cq(struct util_cq *cq)
 			mrail_handle_rma_completion(cq, &comp);
 		} else if (comp.flags & FI_SEND) {
 			tx_buf = comp.op_context;
+			mrail_rail_done(tx_buf->ep, idx, tx_buf->len);
 			if (tx_buf->hdr.protocol == MRAIL_PROTO_RNDV) {
 				if (tx_buf->hdr.protocol_cmd == MRAIL_RNDV_REQ) {
 					/* buf will be freed when ACK comes */
@@ -320,6 +320,44 @@ static void mrail_copy_iov_hdr(struct mrail_hdr *hdr, struct iovec *iov_dest,
 	memcpy(&iov_dest[1], iov_src, sizeof(*iov_src) * count);
 }
 
+/*
+ * Fill in the weight of each rail and return their sum.  Rails whose rate
+ * has not been measured yet are given the best rate seen so far, so that
+ * they get traffic and a measurement.  A rail holding more than twice its
+ * share of the queued bytes is falling behind and gets a weight of 0.  At
+ * least one rail is always below its share.
+ */
+uint64_t mrail_get_rail_weights(struct mrail_ep *mrail_ep, uint64_t *weights)
+{
+	uint64_t queued, total_queued = 0, total_weight = 0, max_weight = 0;
+	size_t i;
+
+	for (i = 0; i < mrail_ep->num_eps; i++) {
+		weights[i] = mrail_ep->rails[i].weight ?
+			     mrail_ep->rails[i].weight : mrail_ep->rails[i].rate;
+		max_weight = MAX(max_weight, weights[i]);
+		total_queued += ofi_atomic_get64(&mrail_ep->rails[i].queued);
+	}
+
+	for (i = 0; i < mrail_ep->num_eps; i++) {
+		if (!weights[i])
+			weights[i] = max_weight ? max_weight : 1;
+		total_weight += weights[i];
+	}
+
+	for (i = 0; i < mrail_ep->num_eps; i++) {
+		queued = ofi_atomic_get64(&mrail_ep->rails[i].queued);
+		if (queued > MRAIL_BACKLOG_MIN_SIZE &&
+		    queued * total_weight > 2 * total_queued * weights[i])
+			weights[i] = 0;
+	}
+
+	for (i = 0, total_weight = 0; i < mrail_ep->num_eps; i++)
+		total_weight += weights[i];
+
+	return total_weight;
+}
+
 static struct mrail_tx_buf *mrail_get_tx_buf(struct mrail_ep *mrail_ep,
 					     void *context, uint32_t seq,
 					     uint8_t op, uint64_t flags)
@@ -380,6 +418,8 @@ int mrail_send_rndv_ack_blocking(struct mrail_ep *mrail_ep,
 	FI_DBG(&mrail_prov, FI_LOG_EP_DATA, "Posting rdnv ack "
 	       " dest_addr: 0x%" PRIx64 " on rail: %d\n", dest_addr, i);
 
+	tx_buf->len = rndv_pkt_size;
+	mrail_rail_queue(mrail_ep, i, tx_buf->len);
 	do {
 		ret = fi_sendmsg(mrail_ep->rails[i].ep, &msg, flags);
 		if (ret == -FI_EAGAIN) {
@@ -393,6 +433,7 @@ int mrail_send_rndv_ack_blocking(struct mrail_ep *mrail_ep,
 	if (ret) {
 		FI_WARN(&mrail_prov, FI_LOG_EP_DATA,
 			"Unable to fi_sendmsg on rail: %" PRIu32 "\n", i);
+		mrail_rail_done(mrail_ep, i, tx_buf->len);
 		ofi_buf_free(tx_buf);
 	}
 
@@ -538,10 +579,13 @@ mrail_send_common(struct fid_ep *ep_fid, const struct iovec *iov, void **desc,
 	       " dest_addr: 0x%" PRIx64 " tag: 0x%" PRIx64 " seq: %d"
 	       " on rail: %d\n", len, dest_addr, tag, peer_info->seq_no - 1, rail);
 
+	tx_buf->len = total_len;
+	mrail_rail_queue(mrail_ep, rail, tx_buf->len);
 	ret = fi_sendmsg(mrail_ep->rails[rail].ep, &msg, flags | FI_COMPLETION);
 	if (ret) {
 		FI_WARN(&mrail_prov, FI_LOG_EP_DATA,
 			"Unable to fi_sendmsg on rail: %" PRIu32 "\n", rail);
+		mrail_rail_done(mrail_ep, rail, tx_buf->len);
 		goto err2;
 	} else if (!(flags & FI_COMPLETION)) {
 		ofi_ep_tx_cntr_inc(&mrail_ep->util_ep);
@@ -551,7 +595,8 @@ mrail_send_common(struct fid_ep *ep_fid, const struct iovec *iov, void **desc,
 err2:
 	if (tx_buf->hdr.protocol == MRAIL_PROTO_RNDV) {
 		free(tx_buf->rndv_req);
-		fi_close(tx_buf->rndv_mr_fid);
+		if (tx_buf->rndv_mr_fid)
+			fi_close(tx_buf->rndv_mr_fid);
 	}
 	ofi_buf_free(tx_buf);
 err1:
@@ -782,6 +827,10 @@ static int mrail_ep_close(fid_t fid)
 	mrail_ep_free_bufs(mrail_ep);
 
 	for (i = 0; i < mrail_ep->num_eps; i++) {
+		FI_INFO(&mrail_prov, FI_LOG_EP_CTRL, "rail %zu: weight %"
+			PRIu64 " rate %" PRIu64 " MB/s, %" PRIu64
+			" bytes striped\n", i, mrail_ep->rails[i].weight,
+			mrail_ep->rails[i].rate, mrail_ep->rails[i].stripe_bytes);
 		ret = fi_close(&mrail_ep->rails[i].ep->fid);
 		if (ret)
 			retv = ret;
@@ -1019,6 +1068,16 @@ int mrail_ep_open(struct fid_domain *domain_fid, struct fi_info *info,
 			goto err;
 		}
 		mrail_ep->rails[i].info = fi;
+		ofi_atomic_initialize64(&mrail_ep->rails[i].queued, 0);
+	}
+
+	if (mrail_num_rail_weights == mrail_ep->num_eps) {
+		for (i = 0; i < mrail_ep->num_eps; i++)
+			mrail_ep->rails[i].weight = mrail_rail_weights[i];
+	} else if (mrail_num_rail_weights) {
+		FI_WARN(&mrail_prov, FI_LOG_EP_CTRL, "%zu rail weights given "
+			"for %zu rails, using measured rates\n",
+			mrail_num_rail_weights, mrail_ep->num_eps);
 	}
 
 	ret = mrail_ep_alloc_bufs(mrail_ep);
@@ -46,6 +46,9 @@ struct mrail_config mrail_config[MRAIL_MAX_CONFIG] = {
 int mrail_num_config = 2;
 int mrail_local_rank = 0;
 
+uint64_t *mrail_rail_weights = NULL;
+size_t mrail_num_rail_weights = 0;
+
 static inline char **mrail_split_addr_strc(const char *addr_strc)
 {
 	char **addr_strv = ofi_split_and_alloc(addr_strc, ",", NULL);
@@ -57,6 +60,45 @@ static inline char **mrail_split_addr_strc(const char *addr_strc)
 	return addr_strv;
 }
 
+static void mrail_parse_rail_weights(void)
+{
+	char *str, *token, *p;
+	char **weight_strv;
+	size_t i, count;
+
+	fi_param_define(&mrail_prov, "rail_weights", FI_PARAM_STRING,
+			"Comma separated list of positive relative rail weights, "
+			"one per rail in FI_OFI_MRAIL_ADDR order.  Striped "
+			"transfers are split in proportion to the weights.  If "
+			"not set, the weights are the rail rates measured from "
+			"completed transfers");
+	if (fi_param_get_str(&mrail_prov, "rail_weights", &str))
+		return;
+
+	weight_strv = ofi_split_and_alloc(str, ",", &count);
+	if (!weight_strv)
+		return;
+
+	mrail_rail_weights = calloc(count, sizeof(*mrail_rail_weights));
+	if (!mrail_rail_weights)
+		goto free;
+
+	for (i = 0; i < count; i++) {
+		token = weight_strv[i];
+		mrail_rail_weights[i] = strtoull(token, &p, 0);
+		if (p == token || *p || !mrail_rail_weights[i]) {
+			FI_WARN(&mrail_prov, FI_LOG_CORE, "Invalid rail weight "
+				"%s, using measured rates\n", token);
+			free(mrail_rail_weights);
+			mrail_rail_weights = NULL;
+			goto free;
+		}
+	}
+	mrail_num_rail_weights = count;
+free:
+	ofi_free_string_array(weight_strv);
+}
+
 static int mrail_parse_env_vars(void)
 {
 	char *str, *token, *alg, *p;
@@ -101,6 +143,8 @@ static int mrail_parse_env_vars(void)
 		mrail_num_config = i;
 	}
 
+	mrail_parse_rail_weights();
+
 	fi_param_define(&mrail_prov, "addr_strc", FI_PARAM_STRING, "Deprecated. "
 			"Replaced by FI_OFI_MRAIL_ADDR.");
 
@@ -520,6 +564,7 @@ static void mrail_fini(void)
 	size_t i;
 	for (i = 0; i < mrail_num_info; i++)
 		fi_freeinfo(mrail_info_vec[i]);
+	free(mrail_rail_weights);
 }
 
 struct fi_provider mrail_prov = {
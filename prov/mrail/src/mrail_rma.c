@@ -60,8 +60,7 @@ static void mrail_subreq_to_rail(struct mrail_subreq *subreq, uint32_t rail,
 	}
 }
 
-static ssize_t mrail_post_subreq(uint32_t rail,
-		struct mrail_subreq *subreq)
+static ssize_t mrail_post_subreq(struct mrail_subreq *subreq)
 {
 	ssize_t ret;
 	struct iovec rail_iov[MRAIL_IOV_LIMIT];
@@ -71,6 +70,7 @@ static ssize_t mrail_post_subreq(uint32_t rail,
 
 	struct mrail_req *req = subreq->parent;
 	struct mrail_ep *mrail_ep = req->mrail_ep;
+	size_t rail = subreq->rail;
 
 	uint64_t flags = req->flags;
 
@@ -84,6 +84,9 @@ static ssize_t mrail_post_subreq(uint32_t rail,
 	msg.rma_iov_count	= subreq->rma_iov_count;
 	msg.context		= &subreq->context;
 
+	subreq->post_time = ofi_gettime_ns();
+	mrail_rail_queue(mrail_ep, rail, subreq->len);
+
 	if (req->op_type == FI_READ) {
 		ret = fi_readmsg(mrail_ep->rails[rail].ep, &msg, flags);
 	} else {
@@ -98,26 +101,24 @@ static ssize_t mrail_post_subreq(uint32_t rail,
 		ret = fi_writemsg(mrail_ep->rails[rail].ep, &msg, flags);
 	}
 
+	if (ret)
+		mrail_rail_done(mrail_ep, rail, subreq->len);
 	return ret;
 }
 
 static ssize_t mrail_post_req(struct mrail_req *req)
 {
 	size_t i;
-	uint32_t rail;
 	ssize_t ret = 0;
 
 	while (req->pending_subreq >= 0) {
-		/* Try all rails before giving up */
+		/* Give the rail a few chances before giving up */
 		for (i = 0; i < req->mrail_ep->num_eps; ++i) {
-			rail = mrail_get_tx_rail_rr(req->mrail_ep);
-
-			ret = mrail_post_subreq(rail,
-					&req->subreqs[req->pending_subreq]);
+			ret = mrail_post_subreq(&req->subreqs[req->pending_subreq]);
 			if (ret != -FI_EAGAIN) {
 				break;
 			} else {
-				/* One of the rails is busy. Try progressing. */
+				/* The rail is busy. Try progressing. */
 				mrail_poll_cq(req->mrail_ep->util_ep.tx_cq);
 			}
 		}
@@ -180,14 +181,47 @@ void mrail_progress_deferred_reqs(struct mrail_ep *mrail_ep)
 	}
 }
 
+/*
+ * Split total_len across the rails in proportion to their weight.  Rails
+ * that are falling behind, or whose share rounds down to nothing, get no
+ * stripe.  Returns the number of stripes, which is at least one.
+ */
+static size_t mrail_get_stripes(struct mrail_ep *mrail_ep, size_t total_len,
+				size_t *stripe_rail, size_t *stripe_len)
+{
+	uint64_t *weights = alloca(sizeof(*weights) * mrail_ep->num_eps);
+	uint64_t total_weight, weight = 0;
+	size_t i, start = 0, end, count = 0;
+
+	total_weight = mrail_get_rail_weights(mrail_ep, weights);
+
+	for (i = 0; i < mrail_ep->num_eps; i++) {
+		if (!weights[i])
+			continue;
+
+		weight += weights[i];
+		end = (weight == total_weight) ? total_len :
+		      (size_t) ((double) total_len * weight / total_weight);
+		if (end == start && (count || weight != total_weight))
+			continue;
+
+		stripe_rail[count] = i;
+		stripe_len[count++] = end - start;
+		start = end;
+	}
+
+	return count;
+}
+
 static ssize_t mrail_prepare_rma_subreqs(struct mrail_ep *mrail_ep,
 		const struct fi_msg_rma *msg, struct mrail_req *req)
 {
 	ssize_t ret;
 	struct mrail_subreq *subreq;
+	size_t *stripe_rail = alloca(sizeof(*stripe_rail) * mrail_ep->num_eps);
+	size_t *stripe_len = alloca(sizeof(*stripe_len) * mrail_ep->num_eps);
 	size_t subreq_count;
 	size_t total_len;
-	size_t chunk_len;
 	size_t subreq_len;
 	size_t iov_index;
 	size_t iov_offset;
@@ -195,16 +229,10 @@ static ssize_t mrail_prepare_rma_subreqs(struct mrail_ep *mrail_ep,
 	size_t rma_iov_offset;
 	int i;
 
-	/* For now, stripe across all rails.
-	 * This could be determined by a dynamic scheduler instead.
-	 */
-	subreq_count = mrail_ep->num_eps;
-
-	total_len = ofi_total_iov_len(msg->msg_iov, msg->iov_count); 
-	chunk_len = total_len / subreq_count;
+	total_len = ofi_total_iov_len(msg->msg_iov, msg->iov_count);
+	subreq_count = mrail_get_stripes(mrail_ep, total_len, stripe_rail,
+					 stripe_len);
 
-	/* The first chunk is the longest */
-	subreq_len =  chunk_len + (total_len % subreq_count);
 	iov_index = 0;
 	iov_offset = 0;
 	rma_iov_index = 0;
@@ -220,8 +248,11 @@ static ssize_t mrail_prepare_rma_subreqs(struct mrail_ep *mrail_ep,
 	 */
 	for (i = (subreq_count - 1); i >= 0; --i) {
 		subreq = &req->subreqs[i];
+		subreq_len = stripe_len[subreq_count - 1 - i];
 
 		subreq->parent = req;
+		subreq->rail = stripe_rail[subreq_count - 1 - i];
+		subreq->len = subreq_len;
 
 		ret = ofi_copy_iov_desc(subreq->iov, subreq->descs,
 				&subreq->iov_count,
@@ -239,9 +270,6 @@ static ssize_t mrail_prepare_rma_subreqs(struct mrail_ep *mrail_ep,
 		if (ret) {
 			goto out;
 		}
-
-		/* All the other chunks have the same length */
-		subreq_len = chunk_len;
 	}
 
 	ofi_atomic_initialize32(&req->expected_subcomps, subreq_count);
@@ -393,7 +421,7 @@ static ssize_t mrail_ep_inject_write(struct fid_ep *ep_fid, const void *buf,
 	mrail_ep = container_of(ep_fid, struct mrail_ep, util_ep.ep_fid.fid);
 	mr_map = (struct mrail_addr_key *) key;
 
-	rail = mrail_get_tx_rail_rr(mrail_ep);
+	rail = mrail_get_tx_rail(mrail_ep, MRAIL_POLICY_ROUND_ROBIN);
 	ret = fi_inject_write(mrail_ep->rails[rail].ep, buf, len,
 			      dest_addr, addr, mr_map[rail].key);
 	if (ret) {
@@ -56,6 +56,7 @@
 #include <ofi_enosys.h>
 #include <ofi_rbuf.h>
 #include <ofi_list.h>
+#include <ofi_match.h>
 #include <ofi_signal.h>
 #include <ofi_util.h>
 #include <ofi_proto.h>
@@ -90,8 +91,14 @@ extern size_t xnet_zerocopy_size;
 extern int xnet_trace_msg;
 extern int xnet_disable_autoprog;
 extern int xnet_io_uring;
+extern size_t xnet_io_uring_rx_bufs;
 extern int xnet_max_saved;
 extern size_t xnet_max_inject;
+extern size_t xnet_max_conns;
+extern int xnet_conn_idle_time;
+extern int xnet_coalesce_time;
+extern int xnet_progress_shards;
+extern char *xnet_progress_affinity;
 
 struct xnet_xfer_entry;
 struct xnet_ep;
@@ -166,17 +173,20 @@ struct xnet_active_tx {
 	struct xnet_xfer_entry	*entry;
 };
 
+/* Posted tagged receives are kept in tag_queue.  Unexpected tagged messages
+ * are indexed in saved_msgs, if the message was buffered by
+ * xnet_get_save_rx(), or in unexp_eps, if it is still sitting at the head
+ * of the endpoint's socket.  The rx endpoint (or its saved_queue) remains
+ * the owner of an unexpected message; the srx indexes only speed up lookup.
+ */
 struct xnet_srx {
 	struct fid_ep		rx_fid;
 	struct xnet_domain	*domain;
 	struct slist		rx_queue;
-	struct slist		tag_queue;
-	struct ofi_dyn_arr	src_tag_queues;
-	struct xnet_xfer_entry	*(*match_tag_rx)(struct xnet_srx *srx,
-						 struct xnet_ep *ep,
-						 uint64_t tag);
+	struct ofi_mq		tag_queue;
+	struct ofi_mq		saved_msgs;
+	struct ofi_mq		unexp_eps;
 
-	uint64_t		tag_seq_no;
 	struct ofi_bufpool	*buf_pool;
 	uint64_t		op_flags;
 	size_t			min_multi_recv_size;
@@ -198,7 +208,7 @@ struct xnet_ep {
 	OFI_DBG_VAR(uint8_t, rx_id)
 
 	struct dlist_entry	unexp_entry;
-	struct dlist_entry	saved_entry;
+	struct ofi_mq_entry	unexp_match;
 	struct slist		rx_queue;
 	struct slist		tx_queue;
 	struct slist		priority_queue;
@@ -219,6 +229,14 @@ struct xnet_ep {
 	void (*report_success)(struct xnet_ep *ep, struct util_cq *cq,
 			       struct xnet_xfer_entry *xfer_entry);
 	short			pollflags;
+	/* waiting for buffers or SQ space to re-arm the uring recv */
+	struct dlist_entry	uring_rx_entry;
+
+	/* coalescing of back to back sends, in ns */
+	uint64_t		tx_post_time;
+	uint64_t		tx_hold_time;
+
+	struct xnet_progress	*progress;
 };
 
 struct xnet_event {
@@ -232,6 +250,14 @@ enum {
 	XNET_CONN_INDEXED = BIT(0),
 	XNET_CONN_TX_LOOPBACK = BIT(1),
 	XNET_CONN_RX_LOOPBACK = BIT(2),
+	XNET_CONN_CLOSING = BIT(3),
+	XNET_CONN_EVICTED = BIT(4),
+	XNET_CONN_REQ_SENT = BIT(5),
+	XNET_CONN_REQ_RCVD = BIT(6),
+	XNET_CONN_DONE_SENT = BIT(7),
+	XNET_CONN_DONE_RCVD = BIT(8),
+	XNET_CONN_PASSIVE = BIT(9),
+	XNET_CONN_CAN_CLOSE = BIT(10),
 };
 
 struct xnet_conn {
@@ -240,6 +266,30 @@ struct xnet_conn {
 	struct util_peer_addr	*peer;
 	uint32_t		remote_pid;
 	int			flags;
+	/* open conns, least recently used first, when max_conns is set,
+	 * or the progress close_list once the conn is closing
+	 */
+	struct dlist_entry	lru_entry;
+	uint64_t		last_use;
+};
+
+/* An outstanding FI_OPT_PRECONNECT request.  Pending entries are linked
+ * by peer index, so a CM event only advances the entries of its peer.
+ * Resolved entries have their addr set to FI_ADDR_NOTAVAIL.
+ */
+struct xnet_preconnect_entry {
+	struct xnet_preconnect_entry *next;
+	fi_addr_t		addr;
+	size_t			index;
+	int			attempts;
+};
+
+struct xnet_preconnect {
+	void			*context;
+	size_t			count;
+	size_t			connected;
+	struct index_map	peer_map;
+	struct xnet_preconnect_entry entry[];
 };
 
 struct xnet_rdm {
@@ -251,6 +301,12 @@ struct xnet_rdm {
 	struct index_map	conn_idx_map;
 	struct xnet_conn	*rx_loopback;
 	union ofi_sock_ip	addr;
+
+	struct dlist_entry	conn_lru;
+	size_t			conn_cnt;
+	uint64_t		evict_cnt;
+	uint64_t		reconnect_cnt;
+	struct xnet_preconnect	*preconnect;
 };
 
 int xnet_rdm_ep(struct fid_domain *domain, struct fi_info *info,
@@ -259,6 +315,7 @@ ssize_t xnet_get_conn(struct xnet_rdm *rdm, fi_addr_t dest_addr,
 		      struct xnet_conn **conn);
 struct xnet_ep *xnet_get_rx_ep(struct xnet_rdm *rdm, fi_addr_t addr);
 void xnet_freeall_conns(struct xnet_rdm *rdm);
+int xnet_preconnect(struct xnet_rdm *rdm, const struct fi_preconnect *req);
 
 struct xnet_uring {
 	struct fid fid;
@@ -294,6 +351,15 @@ struct xnet_uring {
  * This simplifies the number of locks needed to access various objects and
  * avoids complicated nested locking that would otherwise be needed to
  * handle event processing.
+ *
+ * A domain exporting msg endpoints may carry additional progress instances,
+ * or shards, each with its own lock, epoll set, io_uring pair, and thread.
+ * A msg endpoint is assigned to one instance when it is created and stays
+ * there, so all socket I/O and completions for a connection are handled
+ * in order by a single thread.  Objects shared between endpoints (shared
+ * receive contexts, rdm endpoints) stay on the domain's own instance.
+ * CQs of a sharded domain are written from several instances, so they
+ * carry their own lock.
  */
 struct xnet_progress {
 	struct fid		fid;
@@ -302,21 +368,25 @@ struct xnet_progress {
 	struct ofi_genlock	*active_lock;
 
 	struct dlist_entry	unexp_msg_list;
-	struct dlist_entry	unexp_tag_list;
-	struct dlist_entry	saved_tag_list;
 	struct fd_signal	signal;
 
 	struct slist		event_list;
+	/* rdm conns going through the close handshake */
+	struct dlist_entry	close_list;
 	struct ofi_bufpool	*xfer_pool;
 
 	struct xnet_uring	tx_uring;
 	struct xnet_uring	rx_uring;
 	struct ofi_sockapi	sockapi;
+	struct ofi_uring_bufring rx_bufring;
+	struct dlist_entry	uring_rx_list;
 
 	struct ofi_dynpoll	epoll_fd;
 
 	bool			auto_progress;
 	pthread_t		thread;
+	/* CPU the progress thread is bound to, or -1 */
+	int			cpu;
 };
 
 int xnet_init_progress(struct xnet_progress *progress, struct fi_info *info);
@@ -330,7 +400,10 @@ void xnet_run_progress(struct xnet_progress *progress, bool clear_signal);
 int xnet_progress_wait(struct xnet_progress *progress, int timeout);
 void xnet_run_conn(struct xnet_conn_handle *conn, bool pin, bool pout, bool perr);
 void xnet_handle_event_list(struct xnet_progress *progress);
-void xnet_progress_unexp(struct xnet_progress *progress);
+void xnet_progress_close_list(struct xnet_progress *progress);
+void xnet_touch_rx_conn(struct xnet_ep *ep);
+void xnet_recv_close(struct xnet_ep *ep, uint8_t op_data);
+int xnet_queue_ctrl(struct xnet_ep *ep, uint8_t op_data);
 
 int xnet_trywait(struct fid_fabric *fid_fabric, struct fid **fids, int count);
 int xnet_monitor_sock(struct xnet_progress *progress, SOCKET sock,
@@ -379,10 +452,7 @@ struct xnet_xfer_entry {
 	struct iovec		iov[XNET_IOV_LIMIT+1];
 	struct xnet_ep		*ep;
 	void			(*cntr_inc)(struct util_ep *ep);
-	uint64_t		tag_seq_no;
-	uint64_t		tag;
-	uint64_t		ignore;
-	fi_addr_t		src_addr;
+	struct ofi_mq_entry	match;
 	uint64_t		cq_flags;
 	uint32_t		ctrl_flags;
 	uint32_t		async_index;
@@ -402,14 +472,20 @@ struct xnet_xfer_entry {
 struct xnet_domain {
 	struct util_domain		util_domain;
 	struct xnet_progress		progress;
+
+	/* progress instances beyond the domain's own, msg domains only */
+	struct xnet_progress		*shards;
+	int				shard_cnt;
+	ofi_atomic32_t			next_shard;
 };
 
+struct xnet_progress *xnet_select_progress(struct xnet_domain *domain,
+					   const struct fi_info *info,
+					   SOCKET sock);
+
 static inline struct xnet_progress *xnet_ep2_progress(struct xnet_ep *ep)
 {
-	struct xnet_domain *domain;
-	domain = container_of(ep->util_ep.domain, struct xnet_domain,
-			      util_domain);
-	return &domain->progress;
+	return ep->progress;
 }
 
 static inline struct xnet_progress *xnet_rdm2_progress(struct xnet_rdm *rdm)
@@ -506,6 +582,17 @@ void xnet_reset_rx(struct xnet_ep *ep);
 
 void xnet_progress_rx(struct xnet_ep *ep);
 void xnet_progress_async(struct xnet_ep *ep);
+void xnet_start_uring_rx(struct xnet_ep *ep);
+void xnet_stop_uring_rx(struct xnet_ep *ep);
+
+/* When receiving through io_uring, data arrives as multishot completions.
+ * POLLIN then only records whether the ep is accepting data and is never
+ * armed on the socket.
+ */
+static inline uint32_t xnet_ep_events(struct xnet_ep *ep)
+{
+	return ep->bsock.bufring ? ep->pollflags & ~POLLIN : ep->pollflags;
+}
 
 void xnet_hdr_none(struct xnet_ep *ep, struct xnet_base_hdr *hdr);
 void xnet_hdr_bswap(struct xnet_ep *ep, struct xnet_base_hdr *hdr);
@@ -625,6 +712,26 @@ static inline bool xnet_has_unexp(struct xnet_ep *ep)
 	return ep->cur_rx.handler && !ep->cur_rx.entry;
 }
 
+/* An endpoint waiting for a receive buffer is queued on the progress
+ * unexp_msg_list for untagged messages, or indexed in the srx unexp_eps
+ * for tagged ones.
+ */
+static inline bool xnet_is_unexp(struct xnet_ep *ep)
+{
+	return !dlist_empty(&ep->unexp_entry) ||
+	       !dlist_empty(&ep->unexp_match.list_entry);
+}
+
+static inline bool xnet_srx_directed(struct xnet_srx *srx)
+{
+	return srx->tag_queue.flags & OFI_MQ_DIRECTED;
+}
+
+struct xnet_xfer_entry *
+xnet_match_tag_rx(struct xnet_srx *srx, struct xnet_ep *ep, uint64_t tag);
+void xnet_insert_unexp_tag(struct xnet_ep *ep, uint64_t tag);
+void xnet_remove_unexp(struct xnet_ep *ep);
+void xnet_remove_saved(struct xnet_ep *ep, struct xnet_xfer_entry *saved_entry);
 void xnet_recv_saved(struct xnet_xfer_entry *saved_entry,
 		     struct xnet_xfer_entry *rx_entry);
 void xnet_complete_saved(struct xnet_xfer_entry *saved_entry);
@@ -177,6 +177,7 @@ void xnet_req_done(struct xnet_ep *ep)
 	ep->state = XNET_CONNECTED;
 	free(ep->cm_msg);
 	ep->cm_msg = NULL;
+	xnet_start_uring_rx(ep);
 	return;
 
 disable:
@@ -277,7 +278,7 @@ void xnet_connect_done(struct xnet_ep *ep)
 	ep->state = XNET_REQ_SENT;
 	ep->pollflags = POLLIN;
 	ofi_dynpoll_mod(&progress->epoll_fd, ep->bsock.sock,
-			ep->pollflags, &ep->util_ep.ep_fid.fid);
+			xnet_ep_events(ep), &ep->util_ep.ep_fid.fid);
 	xnet_signal_progress(progress);
 	return;
 
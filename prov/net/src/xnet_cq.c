@@ -261,6 +261,7 @@ int xnet_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 		 struct fid_cq **cq_fid, void *context)
 {
 	struct xnet_fabric *fabric;
+	struct xnet_domain *net_domain;
 	struct xnet_cq *cq;
 	struct fi_cq_attr cq_attr;
 	int ret;
@@ -283,10 +284,21 @@ int xnet_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 	if (ret)
 		goto free_cq;
 
+	net_domain = container_of(domain, struct xnet_domain,
+				  util_domain.domain_fid);
+	/* Sharded progress instances write completions under their own
+	 * locks, not the domain's. */
+	if (net_domain->shard_cnt) {
+		ofi_genlock_destroy(&cq->util_cq.cq_lock);
+		ret = ofi_genlock_init(&cq->util_cq.cq_lock, OFI_LOCK_MUTEX);
+		if (ret)
+			goto cleanup;
+	}
+
 	if (cq->util_cq.wait) {
 		fabric = container_of(cq->util_cq.domain->fabric, struct xnet_fabric,
 				      util_fabric);
-		if (fabric->progress.auto_progress)
+		if (fabric->progress.auto_progress || net_domain->shard_cnt)
 			ret = xnet_start_progress(xnet_cq2_progress(cq));
 		else
 			ret = xnet_cq_add_progress(cq, xnet_cq2_progress(cq),
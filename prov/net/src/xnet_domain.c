@@ -133,6 +133,127 @@ static struct fi_ops_domain xnet_domain_ops = {
 	.query_collective = fi_no_query_collective,
 };
 
+/* Endpoints created from a thread running on a CPU that a progress thread
+ * is bound to go to that instance.  Otherwise, accepted connections are
+ * spread by a hash of the peer's address and port.  Connecting endpoints
+ * are assigned round-robin, since connections to the same server share a
+ * destination address.
+ */
+struct xnet_progress *xnet_select_progress(struct xnet_domain *domain,
+					   const struct fi_info *info,
+					   SOCKET sock)
+{
+	struct sockaddr_storage addr;
+	const uint8_t *byte;
+	socklen_t addrlen;
+	uint32_t hash;
+	size_t len, j;
+	int i, cpu;
+
+	if (!domain->shard_cnt ||
+	    info->ep_attr->rx_ctx_cnt == FI_SHARED_CONTEXT)
+		return &domain->progress;
+
+#ifdef __linux__
+	cpu = sched_getcpu();
+	if (cpu >= 0) {
+		if (domain->progress.cpu == cpu)
+			return &domain->progress;
+		for (i = 0; i < domain->shard_cnt; i++) {
+			if (domain->shards[i].cpu == cpu)
+				return &domain->shards[i];
+		}
+	}
+#else
+	OFI_UNUSED(cpu);
+#endif
+
+	addrlen = sizeof(addr);
+	if (sock == INVALID_SOCKET ||
+	    ofi_getpeername(sock, (struct sockaddr *) &addr, &addrlen)) {
+		hash = (uint32_t) ofi_atomic_inc32(&domain->next_shard);
+		goto out;
+	}
+
+	byte = (const uint8_t *) &addr;
+	len = ofi_sizeofaddr((struct sockaddr *) &addr);
+
+	/* FNV-1a */
+	for (hash = 2166136261U, j = 0; j < len; j++)
+		hash = (hash ^ byte[j]) * 16777619U;
+out:
+	hash %= domain->shard_cnt + 1;
+	return hash ? &domain->shards[hash - 1] : &domain->progress;
+}
+
+static void xnet_close_shards(struct xnet_domain *domain)
+{
+	while (domain->shard_cnt)
+		xnet_close_progress(&domain->shards[--domain->shard_cnt]);
+	free(domain->shards);
+	domain->shards = NULL;
+}
+
+/* Sharding relies on every instance having its own thread. */
+static int xnet_init_shards(struct xnet_domain *domain, struct fi_info *info)
+{
+	char *cpus, *entry, *saveptr = NULL;
+	int i, cnt, ret;
+
+	if (xnet_progress_shards <= 1 || !info || !info->ep_attr ||
+	    info->ep_attr->type != FI_EP_MSG)
+		return 0;
+
+	if (xnet_disable_autoprog) {
+		FI_WARN(&xnet_prov, FI_LOG_DOMAIN, "progress_shards requires "
+			"auto progress, using a single progress instance\n");
+		return 0;
+	}
+
+	cnt = xnet_progress_shards - 1;
+	domain->shards = calloc(cnt, sizeof(*domain->shards));
+	if (!domain->shards)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < cnt; i++) {
+		ret = xnet_init_progress(&domain->shards[i], info);
+		if (ret)
+			goto err;
+		domain->shard_cnt++;
+	}
+	ofi_atomic_initialize32(&domain->next_shard, 0);
+
+	if (xnet_progress_affinity) {
+		cpus = strdup(xnet_progress_affinity);
+		if (!cpus) {
+			ret = -FI_ENOMEM;
+			goto err;
+		}
+		entry = strtok_r(cpus, ",", &saveptr);
+		for (i = 0; entry && i <= cnt; i++) {
+			if (i)
+				domain->shards[i - 1].cpu = atoi(entry);
+			else
+				domain->progress.cpu = atoi(entry);
+			entry = strtok_r(NULL, ",", &saveptr);
+		}
+		free(cpus);
+	}
+
+	ret = xnet_start_progress(&domain->progress);
+	for (i = 0; !ret && i < cnt; i++)
+		ret = xnet_start_progress(&domain->shards[i]);
+	if (ret)
+		goto err;
+
+	FI_INFO(&xnet_prov, FI_LOG_DOMAIN, "%d progress instances\n",
+		xnet_progress_shards);
+	return 0;
+err:
+	xnet_close_shards(domain);
+	return ret;
+}
+
 static void xnet_del_wait_eq_list(struct xnet_domain *domain)
 {
 	struct xnet_fabric *fabric;
@@ -175,6 +296,7 @@ static int xnet_domain_close(fid_t fid)
 	if (ret)
 		return ret;
 
+	xnet_close_shards(domain);
 	xnet_close_progress(&domain->progress);
 	free(domain);
 	return FI_SUCCESS;
@@ -266,6 +388,10 @@ int xnet_domain_open(struct fid_fabric *fabric_fid, struct fi_info *info,
 	if (ret)
 		goto close_prog;
 
+	ret = xnet_init_shards(domain, info);
+	if (ret)
+		goto del_wait;
+
 	domain->util_domain.domain_fid.fid.ops = &xnet_domain_fi_ops;
 	domain->util_domain.domain_fid.ops = &xnet_domain_ops;
 	domain->util_domain.domain_fid.mr = &xnet_domain_fi_ops_mr;
@@ -273,6 +399,9 @@ int xnet_domain_open(struct fid_fabric *fabric_fid, struct fi_info *info,
 
 	return FI_SUCCESS;
 
+del_wait:
+	if (!fabric->progress.auto_progress)
+		xnet_del_wait_eq_list(domain);
 close_prog:
 	xnet_close_progress(&domain->progress);
 close:
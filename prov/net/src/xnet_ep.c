@@ -192,7 +192,7 @@ int xnet_setup_socket(SOCKET sock, struct fi_info *info)
 
 static int xnet_monitor_ep(struct xnet_progress *progress, struct xnet_ep *ep)
 {
-	return xnet_monitor_sock(progress, ep->bsock.sock, ep->pollflags,
+	return xnet_monitor_sock(progress, ep->bsock.sock, xnet_ep_events(ep),
 				 &ep->util_ep.ep_fid.fid);
 }
 
@@ -286,18 +286,23 @@ xnet_ep_accept(struct fid_ep *ep_fid, const void *param, size_t paramlen)
 	ofi_genlock_lock(&progress->lock);
 	ep->pollflags = POLLIN;
 	ret = xnet_monitor_ep(progress, ep);
-	ofi_genlock_unlock(&progress->lock);
 	if (ret)
-		return ret;
+		goto unlock;
 
+	xnet_start_uring_rx(ep);
+
+	/* Report the connection before a progress thread can see the
+	 * socket and report a shutdown. */
 	cm_entry.fid = &ep->util_ep.ep_fid.fid;
 	cm_entry.info = NULL;
 	ret = xnet_eq_write(ep->util_ep.eq, FI_CONNECTED, &cm_entry,
 			    sizeof(cm_entry), 0);
-	if (ret < 0) {
+	if (ret < 0)
 		FI_WARN(&xnet_prov, FI_LOG_EP_CTRL, "Error writing to EQ\n");
+unlock:
+	ofi_genlock_unlock(&progress->lock);
+	if (ret < 0)
 		return ret;
-	}
 
 	/* Only free conn on success; on failure, app may try to reject */
 	free(conn);
@@ -321,6 +326,8 @@ xnet_ep_flush_queue(struct xnet_ep *ep, struct slist *queue, struct xnet_cq *cq)
 
 static void xnet_ep_flush_all_queues(struct xnet_ep *ep)
 {
+	struct xnet_xfer_entry *xfer;
+	struct slist_entry *entry;
 	struct xnet_cq *cq;
 
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
@@ -338,6 +345,10 @@ static void xnet_ep_flush_all_queues(struct xnet_ep *ep)
 	xnet_ep_flush_queue(ep, &ep->rma_read_queue, cq);
 	xnet_ep_flush_queue(ep, &ep->need_ack_queue, cq);
 	xnet_ep_flush_queue(ep, &ep->async_queue, cq);
+	for (entry = ep->saved_queue.head; entry; entry = entry->next) {
+		xfer = container_of(entry, struct xnet_xfer_entry, entry);
+		ofi_mq_remove(&ep->srx->saved_msgs, &xfer->match);
+	}
 	xnet_ep_flush_queue(ep, &ep->saved_queue, cq);
 	ep->saved_cnt = 0;
 
@@ -370,7 +381,8 @@ void xnet_ep_disable(struct xnet_ep *ep, int cm_err, void* err_data,
 	};
 
 	dlist_remove_init(&ep->unexp_entry);
-	dlist_remove_init(&ep->saved_entry);
+	xnet_remove_unexp(ep);
+	dlist_remove_init(&ep->uring_rx_entry);
 	xnet_halt_sock(xnet_ep2_progress(ep), ep->bsock.sock);
 
 	ret = ofi_shutdown(ep->bsock.sock, SHUT_RDWR);
@@ -525,8 +537,9 @@ static int xnet_ep_close(struct fid *fid)
 	progress = xnet_ep2_progress(ep);
 	ofi_genlock_lock(&progress->lock);
 	dlist_remove_init(&ep->unexp_entry);
-	dlist_remove_init(&ep->saved_entry);
+	xnet_remove_unexp(ep);
 	xnet_halt_sock(progress, ep->bsock.sock);
+	xnet_stop_uring_rx(ep);
 	xnet_ep_flush_all_queues(ep);
 	ofi_genlock_unlock(&progress->lock);
 
@@ -595,6 +608,9 @@ static int xnet_ep_bind(struct fid *fid, struct fid *bfid, uint64_t flags)
 	if (bfid->fclass == FI_CLASS_SRX_CTX) {
 		srx = container_of(bfid, struct xnet_srx, rx_fid.fid);
 		ep->srx = srx;
+		/* the srx is serialized by the domain's progress instance */
+		ep->progress = xnet_srx2_progress(srx);
+		ep->bsock.sockapi = &ep->progress->sockapi;
 		return FI_SUCCESS;
 	}
 
@@ -657,6 +673,7 @@ int xnet_endpoint(struct fid_domain *domain, struct fi_info *info,
 	struct xnet_ep *ep;
 	struct xnet_pep *pep;
 	struct xnet_conn_handle *conn;
+	SOCKET peer_sock = INVALID_SOCKET;
 	int ret;
 
 	ep = calloc(1, sizeof(*ep));
@@ -668,6 +685,15 @@ int xnet_endpoint(struct fid_domain *domain, struct fi_info *info,
 	if (ret)
 		goto err1;
 
+	if (info->handle &&
+	    ((fid_t) info->handle)->fclass == FI_CLASS_CONNREQ) {
+		conn = container_of(info->handle, struct xnet_conn_handle, fid);
+		peer_sock = conn->sock;
+	}
+	ep->progress = xnet_select_progress(container_of(domain,
+					struct xnet_domain,
+					util_domain.domain_fid),
+					info, peer_sock);
 	ofi_bsock_init(&ep->bsock, &xnet_ep2_progress(ep)->sockapi,
 		       xnet_staging_sbuf_size, xnet_prefetch_rbuf_size);
 	if (info->handle) {
@@ -738,7 +764,9 @@ int xnet_endpoint(struct fid_domain *domain, struct fi_info *info,
 	}
 
 	dlist_init(&ep->unexp_entry);
-	dlist_init(&ep->saved_entry);
+	dlist_init(&ep->unexp_match.list_entry);
+	dlist_init(&ep->unexp_match.hash_entry);
+	dlist_init(&ep->uring_rx_entry);
 	slist_init(&ep->rx_queue);
 	slist_init(&ep->tx_queue);
 	slist_init(&ep->priority_queue);
@@ -67,8 +67,14 @@ size_t xnet_zerocopy_size = SIZE_MAX;
 int xnet_trace_msg;
 int xnet_disable_autoprog;
 int xnet_io_uring;
+size_t xnet_io_uring_rx_bufs = 256;
 int xnet_max_saved = 4;
 size_t xnet_max_inject = XNET_DEF_INJECT;
+size_t xnet_max_conns;
+int xnet_conn_idle_time = 100;
+int xnet_coalesce_time;
+int xnet_progress_shards = 1;
+char *xnet_progress_affinity;
 
 
 static void xnet_init_env(void)
@@ -166,6 +172,51 @@ static void xnet_init_env(void)
 			"Enable io_uring support if available (default: %d)", xnet_io_uring);
 	fi_param_get_bool(&xnet_prov, "io_uring",
 			 &xnet_io_uring);
+	fi_param_define(&xnet_prov, "io_uring_rx_bufs", FI_PARAM_SIZE_T,
+			"number of prefetch_rbuf_size buffers shared by all "
+			"connections of a domain for multishot io_uring "
+			"receives, rounded up to a power of 2.  Set to 0 to "
+			"receive from the socket directly when io_uring is "
+			"enabled (default: %zu)", xnet_io_uring_rx_bufs);
+	fi_param_get_size_t(&xnet_prov, "io_uring_rx_bufs",
+			    &xnet_io_uring_rx_bufs);
+
+	fi_param_define(&xnet_prov, "max_conns", FI_PARAM_SIZE_T,
+			"number of connections an rdm endpoint keeps open "
+			"before it starts closing idle ones, least recently "
+			"used first.  Closed connections are reopened on "
+			"next use.  Set to 0 for no limit (default: %zu)",
+			xnet_max_conns);
+	fi_param_get_size_t(&xnet_prov, "max_conns", &xnet_max_conns);
+	fi_param_define(&xnet_prov, "conn_idle_time", FI_PARAM_INT,
+			"time in milliseconds a connection must go unused "
+			"before it may be closed to stay under max_conns "
+			"(default: %d)", xnet_conn_idle_time);
+	fi_param_get_int(&xnet_prov, "conn_idle_time", &xnet_conn_idle_time);
+
+	fi_param_define(&xnet_prov, "coalesce_time", FI_PARAM_INT,
+			"small sends posted to a connection within this many "
+			"microseconds of the previous one are held in the "
+			"staging buffer and written to the socket together "
+			"the next time the endpoint is progressed, or sooner "
+			"if the buffer fills or a send is posted after the "
+			"oldest has waited this long.  Set to 0 to disable "
+			"(default: %d)", xnet_coalesce_time);
+	fi_param_get_int(&xnet_prov, "coalesce_time", &xnet_coalesce_time);
+
+	fi_param_define(&xnet_prov, "progress_shards", FI_PARAM_INT,
+			"number of progress instances, each with its own "
+			"thread, lock, and socket set, that the connections "
+			"of a msg domain are spread across.  Requires auto "
+			"progress (default: %d)", xnet_progress_shards);
+	fi_param_get_int(&xnet_prov, "progress_shards", &xnet_progress_shards);
+	fi_param_define(&xnet_prov, "progress_affinity", FI_PARAM_STRING,
+			"comma separated list of CPUs to bind the progress "
+			"threads of a sharded domain to, one per instance.  "
+			"Endpoints created by a thread running on one of "
+			"these CPUs are progressed by that CPU's instance");
+	fi_param_get_str(&xnet_prov, "progress_affinity",
+			 &xnet_progress_affinity);
 }
 
 static void xnet_fini(void)
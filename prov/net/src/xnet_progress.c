@@ -105,9 +105,9 @@ xnet_get_save_rx(struct xnet_ep *ep, uint64_t tag)
 		return NULL;
 
 	rx_entry->ctrl_flags = XNET_SAVED_XFER;
-	rx_entry->tag = tag;
-	rx_entry->ignore = 0;
-	rx_entry->src_addr = ep->peer->fi_addr;
+	rx_entry->match.tag = tag;
+	rx_entry->match.ignore = 0;
+	rx_entry->match.addr = ep->peer->fi_addr;
 	rx_entry->context = NULL;
 	rx_entry->user_buf = NULL;
 	rx_entry->iov_cnt = 1;
@@ -115,11 +115,8 @@ xnet_get_save_rx(struct xnet_ep *ep, uint64_t tag)
 	rx_entry->iov[0].iov_len = xnet_max_inject;
 
 	slist_insert_tail(&rx_entry->entry, &ep->saved_queue);
-	if (!ep->saved_cnt++) {
-		assert(dlist_empty(&ep->saved_entry));
-		dlist_insert_tail(&ep->saved_entry,
-				  &progress->saved_tag_list);
-	}
+	ep->saved_cnt++;
+	ofi_mq_insert(&ep->srx->saved_msgs, &rx_entry->match);
 
 	return rx_entry;
 }
@@ -137,8 +134,8 @@ void xnet_complete_saved(struct xnet_xfer_entry *saved_entry)
 	msg_len = (saved_entry->hdr.base_hdr.size -
 		   saved_entry->hdr.base_hdr.hdr_size);
 	FI_DBG(&xnet_prov, FI_LOG_EP_DATA, "Completing saved msg "
-	       "tag 0x%zx src %zu size %zu\n", saved_entry->tag,
-	       saved_entry->src_addr, msg_len);
+	       "tag 0x%zx src %zu size %zu\n", saved_entry->match.tag,
+	       saved_entry->match.addr, msg_len);
 
 	if (msg_len) {
 		copied = ofi_copy_iov_buf(saved_entry->iov,
@@ -171,7 +168,8 @@ void xnet_recv_saved(struct xnet_xfer_entry *saved_entry,
 	progress = xnet_ep2_progress(ep);
 	assert(xnet_progress_locked(progress));
 	FI_DBG(&xnet_prov, FI_LOG_EP_DATA, "recv matched saved msg "
-	       "tag 0x%zx src %zu\n", saved_entry->tag, saved_entry->src_addr);
+	       "tag 0x%zx src %zu\n", saved_entry->match.tag,
+	       saved_entry->match.addr);
 
 	saved_entry->ctrl_flags &= ~XNET_SAVED_XFER;
 	saved_entry->context = rx_entry->context;
@@ -184,12 +182,12 @@ void xnet_recv_saved(struct xnet_xfer_entry *saved_entry,
 		saved_entry->iov_cnt = rx_entry->iov_cnt;
 	}
 
+	/* io_uring receives land in provided buffers and are copied out
+	 * while parsing, so the active entry never has an async recv
+	 * targeting its buffers.
+	 */
 	if (saved_entry != ep->cur_rx.entry) {
 		xnet_complete_saved(saved_entry);
-	/* TODO: need io_uring async recv posted check
-	} else if (async recv posted using io_uring) {
-		saved_entry->ctrl_flags |= XNET_COPY_RECV;
-	*/
 	} else {
 		FI_DBG(&xnet_prov, FI_LOG_EP_DATA, "saved msg still active "
 		       "needs %zu bytes\n", ep->cur_rx.data_left);
@@ -218,6 +216,160 @@ void xnet_recv_saved(struct xnet_xfer_entry *saved_entry,
 	xnet_free_xfer(progress, rx_entry);
 }
 
+/* Arm a multishot receive.  If the provided buffers are exhausted or
+ * the SQ is full, the ep waits on the uring_rx_list for a retry.
+ */
+static void xnet_post_uring_rx(struct xnet_ep *ep)
+{
+	struct xnet_progress *progress;
+	ssize_t ret;
+
+	progress = xnet_ep2_progress(ep);
+	assert(xnet_progress_locked(progress));
+	if (ep->state != XNET_CONNECTED || !(ep->pollflags & POLLIN) ||
+	    ep->bsock.rx_sockctx.uring_sqe_inuse || ep->bsock.rx_eof ||
+	    !dlist_empty(&ep->uring_rx_entry))
+		return;
+
+	if (progress->rx_bufring.avail) {
+		ret = ofi_sockapi_recv_multishot_uring(&progress->sockapi,
+						       ep->bsock.sock,
+						       &progress->rx_bufring,
+						       0, &ep->bsock.rx_sockctx);
+		if (ret == -OFI_EINPROGRESS_URING) {
+			xnet_submit_uring(&progress->rx_uring);
+			return;
+		}
+	}
+
+	dlist_insert_tail(&ep->uring_rx_entry, &progress->uring_rx_list);
+}
+
+/* Each waiting ep needs at least one free buffer, so only as many eps as
+ * there are free buffers are retried.  An ep that goes back on the list
+ * means the buffers or the SQ ran out again, and the rest keep waiting.
+ */
+static void xnet_rearm_uring_rx(struct xnet_progress *progress)
+{
+	struct xnet_ep *ep;
+
+	assert(xnet_progress_locked(progress));
+	while (progress->rx_bufring.avail &&
+	       !dlist_empty(&progress->uring_rx_list)) {
+		dlist_pop_front(&progress->uring_rx_list, struct xnet_ep, ep,
+				uring_rx_entry);
+		dlist_init(&ep->uring_rx_entry);
+		xnet_post_uring_rx(ep);
+		if (!dlist_empty(&ep->uring_rx_entry))
+			break;
+	}
+}
+
+/* An ep that stops reading, such as one holding an unexpected message,
+ * copies out the data it already received.  Its provided buffers go back
+ * to the ring, which is shared with every other connection.
+ */
+static void xnet_stash_uring_rx(struct xnet_ep *ep)
+{
+	struct xnet_progress *progress;
+
+	progress = xnet_ep2_progress(ep);
+	assert(xnet_progress_locked(progress));
+	if (ofi_bsock_rxbuf_stash(&ep->bsock)) {
+		FI_WARN(&xnet_prov, FI_LOG_EP_DATA,
+			"unable to copy out received data, "
+			"provided buffers remain held\n");
+		return;
+	}
+
+	if (progress->rx_bufring.avail &&
+	    !dlist_empty(&progress->uring_rx_list))
+		xnet_rearm_uring_rx(progress);
+}
+
+/* Stopping the multishot receive is the io_uring equivalent of removing
+ * POLLIN.  Data already in flight still completes into the ep's buffers.
+ * If the SQ is full, submitting what is queued makes room for the cancel.
+ * Returns -FI_EOVERFLOW if the cancel could still not be queued.
+ */
+static ssize_t xnet_cancel_uring_rx(struct xnet_ep *ep)
+{
+	struct xnet_progress *progress;
+	ssize_t ret;
+
+	progress = xnet_ep2_progress(ep);
+	assert(xnet_progress_locked(progress));
+	dlist_remove_init(&ep->uring_rx_entry);
+	ret = ofi_sockapi_cancel_uring(&progress->sockapi.rx_uring,
+				       &ep->bsock.rx_sockctx);
+	if (ret == -FI_EOVERFLOW) {
+		xnet_submit_uring(&progress->rx_uring);
+		ret = ofi_sockapi_cancel_uring(&progress->sockapi.rx_uring,
+					       &ep->bsock.rx_sockctx);
+	}
+
+	if (ret == -OFI_EINPROGRESS_URING) {
+		xnet_submit_uring(&progress->rx_uring);
+		return 0;
+	}
+	if (ret) {
+		FI_WARN(&xnet_prov, FI_LOG_EP_DATA,
+			"unable to cancel multishot receive: %zd\n", ret);
+	}
+	return ret;
+}
+
+void xnet_start_uring_rx(struct xnet_ep *ep)
+{
+	struct xnet_progress *progress;
+
+	progress = xnet_ep2_progress(ep);
+	assert(xnet_progress_locked(progress));
+	if (!progress->rx_bufring.cnt)
+		return;
+
+	assert(!ofi_bsock_readable(&ep->bsock));
+	ep->bsock.bufring = &progress->rx_bufring;
+	ofi_dynpoll_mod(&progress->epoll_fd, ep->bsock.sock,
+			xnet_ep_events(ep), &ep->util_ep.ep_fid.fid);
+	xnet_post_uring_rx(ep);
+}
+
+static void xnet_progress_uring(struct xnet_progress *progress,
+				struct xnet_uring *uring);
+
+/* The multishot receive references the ep, so wait for its final
+ * completion before the ep can be freed.
+ */
+void xnet_stop_uring_rx(struct xnet_ep *ep)
+{
+	struct xnet_progress *progress;
+	ssize_t ret;
+
+	progress = xnet_ep2_progress(ep);
+	assert(xnet_progress_locked(progress));
+	if (!ep->bsock.bufring)
+		return;
+
+	ep->pollflags &= ~POLLIN;
+	ret = xnet_cancel_uring_rx(ep);
+	while (ep->bsock.rx_sockctx.uring_sqe_inuse) {
+		/* Reaping completions lets the kernel accept submissions
+		 * again, so retry a cancel that did not fit. */
+		if (ret) {
+			xnet_progress_uring(progress, &progress->rx_uring);
+			ret = xnet_cancel_uring_rx(ep);
+			continue;
+		}
+		if (ofi_uring_wait_cqe(&progress->rx_uring.ring))
+			break;
+		xnet_progress_uring(progress, &progress->rx_uring);
+	}
+
+	ofi_bsock_rxbuf_discard(&ep->bsock);
+	ep->bsock.bufring = NULL;
+}
+
 void xnet_update_pollflag(struct xnet_ep *ep, short pollflag, bool set)
 {
 	struct xnet_progress *progress;
@@ -236,12 +388,46 @@ void xnet_update_pollflag(struct xnet_ep *ep, short pollflag, bool set)
 		ep->pollflags &= ~pollflag;
 	}
 
+	if (ep->bsock.bufring && pollflag == POLLIN) {
+		if (set) {
+			xnet_post_uring_rx(ep);
+		} else {
+			xnet_cancel_uring_rx(ep);
+			xnet_stash_uring_rx(ep);
+		}
+		return;
+	}
+
 	ofi_dynpoll_mod(&progress->epoll_fd, ep->bsock.sock,
-			ep->pollflags, &ep->util_ep.ep_fid.fid);
+			xnet_ep_events(ep), &ep->util_ep.ep_fid.fid);
 	xnet_signal_progress(progress);
 }
 
-static ssize_t xnet_send_msg(struct xnet_ep *ep)
+/* Sends posted back to back are held in the staging buffer, so that a
+ * burst of small messages reaches the kernel in one write.  Holding arms
+ * POLLOUT, so the next progress call flushes the buffer.  Until then,
+ * the hold ends when the buffer fills, or when a send is posted after
+ * the oldest held send has waited the coalescing time; there is no timer.
+ */
+static bool xnet_hold_tx(struct xnet_ep *ep)
+{
+	uint64_t now, prev;
+
+	if (!xnet_coalesce_time || xnet_io_uring)
+		return false;
+
+	now = ofi_gettime_ns();
+	prev = ep->tx_post_time;
+	ep->tx_post_time = now;
+	if (now - prev >= (uint64_t) xnet_coalesce_time * 1000)
+		return false;
+
+	if (!ofi_bsock_tosend(&ep->bsock))
+		ep->tx_hold_time = now;
+	return now - ep->tx_hold_time < (uint64_t) xnet_coalesce_time * 1000;
+}
+
+static ssize_t xnet_send_msg(struct xnet_ep *ep, bool hold)
 {
 	struct xnet_xfer_entry *tx_entry;
 	ssize_t ret;
@@ -250,6 +436,13 @@ static ssize_t xnet_send_msg(struct xnet_ep *ep)
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
 	assert(ep->cur_tx.entry);
 	tx_entry = ep->cur_tx.entry;
+	if (hold && ep->cur_tx.data_left < ofi_byteq_writeable(&ep->bsock.sq)) {
+		ofi_byteq_writev(&ep->bsock.sq, tx_entry->iov,
+				 tx_entry->iov_cnt);
+		ep->cur_tx.data_left = 0;
+		return FI_SUCCESS;
+	}
+
 	ret = ofi_bsock_sendv(&ep->bsock, tx_entry->iov, tx_entry->iov_cnt,
 			      &len);
 	if (ret < 0 && ret != -OFI_EINPROGRESS_ASYNC)
@@ -353,13 +546,13 @@ static void xnet_complete_tx(struct xnet_ep *ep, ssize_t ret)
 	ep->hdr_bswap(ep, &ep->cur_tx.entry->hdr.base_hdr);
 }
 
-static void xnet_progress_tx(struct xnet_ep *ep)
+static void xnet_progress_tx(struct xnet_ep *ep, bool hold)
 {
 	ssize_t ret;
 
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
 	while (ep->cur_tx.entry) {
-		ret = xnet_send_msg(ep);
+		ret = xnet_send_msg(ep, hold);
 		if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret)) {
 			xnet_update_pollflag(ep, POLLOUT, true);
 			return;
@@ -373,17 +566,20 @@ static void xnet_progress_tx(struct xnet_ep *ep)
 
 	/* Buffered data is sent first by xnet_send_msg, but if we don't
 	 * have other data to send, we need to try flushing any buffered data.
+	 * Held data is flushed when POLLOUT next reports the socket writable.
 	 */
-	(void) ofi_bsock_flush(&ep->bsock);
+	if (!hold)
+		(void) ofi_bsock_flush(&ep->bsock);
 	xnet_update_pollflag(ep, POLLOUT, ofi_bsock_tosend(&ep->bsock));
 }
 
-static int xnet_queue_ack(struct xnet_xfer_entry *rx_entry)
+/* Queue a header only control message, such as an ack */
+int xnet_queue_ctrl(struct xnet_ep *ep, uint8_t op_data)
 {
 	struct xnet_xfer_entry *resp;
 
-	assert(xnet_progress_locked(xnet_ep2_progress(rx_entry->ep)));
-	resp = xnet_alloc_xfer(xnet_ep2_progress(rx_entry->ep));
+	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	resp = xnet_alloc_xfer(xnet_ep2_progress(ep));
 	if (!resp)
 		return -FI_ENOMEM;
 
@@ -392,16 +588,16 @@ static int xnet_queue_ack(struct xnet_xfer_entry *rx_entry)
 	resp->iov_cnt = 1;
 
 	resp->hdr.base_hdr.version = XNET_HDR_VERSION;
-	resp->hdr.base_hdr.op_data = XNET_OP_ACK;
+	resp->hdr.base_hdr.op_data = op_data;
 	resp->hdr.base_hdr.op = ofi_op_msg;
 	resp->hdr.base_hdr.size = sizeof(resp->hdr.base_hdr);
 	resp->hdr.base_hdr.hdr_size = (uint8_t) sizeof(resp->hdr.base_hdr);
 
 	resp->ctrl_flags = XNET_INTERNAL_XFER;
 	resp->context = NULL;
-	resp->ep = rx_entry->ep;
+	resp->ep = ep;
 
-	xnet_tx_queue_insert(rx_entry->ep, resp);
+	xnet_tx_queue_insert(ep, resp);
 	return FI_SUCCESS;
 }
 
@@ -423,7 +619,7 @@ static ssize_t xnet_process_recv(struct xnet_ep *ep)
 	}
 
 	if (rx_entry->hdr.base_hdr.flags & XNET_DELIVERY_COMPLETE) {
-		ret = xnet_queue_ack(rx_entry);
+		ret = xnet_queue_ctrl(rx_entry->ep, XNET_OP_ACK);
 		if (ret)
 			goto err;
 	}
@@ -490,7 +686,7 @@ static ssize_t xnet_process_remote_write(struct xnet_ep *ep)
 		if (rx_entry->hdr.base_hdr.flags & XNET_COMMIT_COMPLETE)
 			xnet_pmem_commit(rx_entry);
 
-		ret = xnet_queue_ack(rx_entry);
+		ret = xnet_queue_ctrl(rx_entry->ep, XNET_OP_ACK);
 		if (ret)
 			goto err;
 	}
@@ -626,6 +822,22 @@ static int xnet_handle_ack(struct xnet_ep *ep)
 	return FI_SUCCESS;
 }
 
+/* Only rdm conns exchange close messages */
+static int xnet_handle_close(struct xnet_ep *ep)
+{
+	uint8_t op_data;
+
+	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	if (!ep->peer || ep->cur_rx.hdr.base_hdr.size !=
+	    sizeof(ep->cur_rx.hdr.base_hdr))
+		return -FI_EIO;
+
+	op_data = ep->cur_rx.hdr.base_hdr.op_data;
+	xnet_reset_rx(ep);
+	xnet_recv_close(ep, op_data);
+	return FI_SUCCESS;
+}
+
 ssize_t xnet_start_recv(struct xnet_ep *ep, struct xnet_xfer_entry *rx_entry)
 {
 	struct xnet_active_rx *msg = &ep->cur_rx;
@@ -633,8 +845,9 @@ ssize_t xnet_start_recv(struct xnet_ep *ep, struct xnet_xfer_entry *rx_entry)
 	ssize_t ret;
 
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
-	if (!dlist_empty(&ep->unexp_entry)) {
+	if (xnet_is_unexp(ep)) {
 		dlist_remove_init(&ep->unexp_entry);
+		xnet_remove_unexp(ep);
 		xnet_update_pollflag(ep, POLLIN, true);
 	}
 
@@ -678,6 +891,9 @@ static ssize_t xnet_op_msg(struct xnet_ep *ep)
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
 	if (msg->hdr.base_hdr.op_data == XNET_OP_ACK)
 		return xnet_handle_ack(ep);
+	if (msg->hdr.base_hdr.op_data == XNET_OP_CLOSE_REQ ||
+	    msg->hdr.base_hdr.op_data == XNET_OP_CLOSE_DONE)
+		return xnet_handle_close(ep);
 
 	rx_entry = xnet_get_rx_entry(ep);
 	if (!rx_entry) {
@@ -704,16 +920,15 @@ static ssize_t xnet_op_tagged(struct xnet_ep *ep)
 	tag = (msg->hdr.base_hdr.flags & XNET_REMOTE_CQ_DATA) ?
 	      msg->hdr.tag_data_hdr.tag : msg->hdr.tag_hdr.tag;
 
-	rx_entry = ep->srx->match_tag_rx(ep->srx, ep, tag);
+	rx_entry = xnet_match_tag_rx(ep->srx, ep, tag);
 	if (!rx_entry) {
 		if (xnet_save_and_cont(ep)) {
 			rx_entry = xnet_get_save_rx(ep, tag);
 			if (rx_entry)
 				goto start;
 		}
-		if (dlist_empty(&ep->unexp_entry)) {
-			dlist_insert_tail(&ep->unexp_entry,
-					  &xnet_ep2_progress(ep)->unexp_tag_list);
+		if (!xnet_is_unexp(ep)) {
+			xnet_insert_unexp_tag(ep, tag);
 			xnet_update_pollflag(ep, POLLIN, false);
 		}
 		return -FI_EAGAIN;
@@ -880,6 +1095,9 @@ next_hdr:
 
 	ep->hdr_bswap(ep, &ep->cur_rx.hdr.base_hdr);
 	assert(ep->cur_rx.hdr.base_hdr.id == ep->rx_id++);
+	if (xnet_max_conns && ep->peer)
+		xnet_touch_rx_conn(ep);
+
 	if (ep->cur_rx.hdr.base_hdr.op >= ARRAY_SIZE(xnet_start_op)) {
 		FI_WARN(&xnet_prov, FI_LOG_EP_DATA,
 			"Received invalid opcode\n");
@@ -895,9 +1113,11 @@ next_hdr:
 
 void xnet_progress_rx(struct xnet_ep *ep)
 {
+	struct xnet_progress *progress;
 	ssize_t ret;
 
-	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	progress = xnet_ep2_progress(ep);
+	assert(xnet_progress_locked(progress));
 	do {
 		if (ep->cur_rx.hdr_done < ep->cur_rx.hdr_len) {
 			ret = xnet_recv_hdr(ep);
@@ -909,6 +1129,11 @@ void xnet_progress_rx(struct xnet_ep *ep)
 
 	if (ret && !OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
 		xnet_ep_disable(ep, 0, NULL, 0);
+
+	/* Consuming data may have returned provided buffers */
+	if (progress->rx_bufring.avail &&
+	    !dlist_empty(&progress->uring_rx_list))
+		xnet_rearm_uring_rx(progress);
 }
 
 void xnet_progress_async(struct xnet_ep *ep)
@@ -930,6 +1155,41 @@ void xnet_progress_async(struct xnet_ep *ep)
 	}
 }
 
+static void xnet_progress_rx_cqe(struct xnet_ep *ep,
+				 ofi_io_uring_cqe_t *cqe)
+{
+	int bid;
+
+	if (cqe->res > 0) {
+		bid = ofi_uring_cqe_bid(cqe);
+		assert(bid >= 0);
+		ofi_bsock_rxbuf_add(&ep->bsock, (uint16_t) bid,
+				    (size_t) cqe->res);
+	} else if (!cqe->res) {
+		ep->bsock.rx_eof = true;
+	}
+
+	if (!ofi_uring_cqe_more(cqe))
+		ep->bsock.rx_sockctx.uring_sqe_inuse = false;
+
+	if (ep->state != XNET_CONNECTED)
+		return;
+
+	/* -ENOBUFS ends the multishot recv until buffers are returned */
+	if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED &&
+	    !OFI_SOCK_TRY_SND_RCV_AGAIN(-cqe->res)) {
+		xnet_ep_disable(ep, 0, NULL, 0);
+		return;
+	}
+
+	if (ep->pollflags & POLLIN)
+		xnet_progress_rx(ep);
+	else
+		xnet_stash_uring_rx(ep);
+	if (!ep->bsock.rx_sockctx.uring_sqe_inuse)
+		xnet_post_uring_rx(ep);
+}
+
 static void xnet_progress_cqe(struct xnet_progress *progress,
 			      struct xnet_uring *uring,
 			      ofi_io_uring_cqe_t *cqe)
@@ -941,7 +1201,11 @@ static void xnet_progress_cqe(struct xnet_progress *progress,
 
 	assert(xnet_io_uring);
 	sockctx = (struct ofi_sockctx *) cqe->user_data;
-	assert(sockctx);
+	if (!sockctx) {
+		/* completion of a cancel request */
+		assert(&uring->ring == progress->sockapi.rx_uring.io_uring);
+		return;
+	}
 
 	bsock = (struct ofi_bsock *) sockctx->context;
 	assert(bsock);
@@ -949,6 +1213,12 @@ static void xnet_progress_cqe(struct xnet_progress *progress,
 	ep = container_of(bsock, struct xnet_ep, bsock);
 
 	assert(sockctx->uring_sqe_inuse);
+	if (bsock->bufring && sockctx == &bsock->rx_sockctx) {
+		assert(&uring->ring == progress->sockapi.rx_uring.io_uring);
+		xnet_progress_rx_cqe(ep, cqe);
+		return;
+	}
+
 	sockctx->uring_sqe_inuse = false;
 	if (&uring->ring == progress->sockapi.tx_uring.io_uring) {
 		tx_entry = ep->cur_tx.entry;
@@ -967,7 +1237,7 @@ static void xnet_progress_cqe(struct xnet_progress *progress,
 			else
 				xnet_complete_tx(ep, FI_SUCCESS);
 		}
-		xnet_progress_tx(ep);
+		xnet_progress_tx(ep, false);
 	} else {
 		assert(&uring->ring == progress->sockapi.rx_uring.io_uring);
 		progress->sockapi.rx_uring.credits++;
@@ -1008,7 +1278,7 @@ void xnet_tx_queue_insert(struct xnet_ep *ep,
 		ep->cur_tx.data_left = tx_entry->hdr.base_hdr.size;
 		OFI_DBG_SET(tx_entry->hdr.base_hdr.id, ep->tx_id++);
 		ep->hdr_bswap(ep, &tx_entry->hdr.base_hdr);
-		xnet_progress_tx(ep);
+		xnet_progress_tx(ep, xnet_hold_tx(ep));
 		if (xnet_io_uring)
 			xnet_progress_uring(progress, &progress->tx_uring);
 	} else if (tx_entry->ctrl_flags & XNET_INTERNAL_XFER) {
@@ -1036,7 +1306,7 @@ static void xnet_run_ep(struct xnet_ep *ep, bool pin, bool pout, bool perr)
 		if (pin)
 			xnet_progress_rx(ep);
 		if (pout)
-			xnet_progress_tx(ep);
+			xnet_progress_tx(ep, false);
 		break;
 	case XNET_CONNECTING:
 		xnet_connect_done(ep);
@@ -1089,24 +1359,15 @@ xnet_handle_events(struct xnet_progress *progress,
 	}
 
 	xnet_handle_event_list(progress);
+	if (!dlist_empty(&progress->close_list))
+		xnet_progress_close_list(progress);
+	if (progress->rx_bufring.avail &&
+	    !dlist_empty(&progress->uring_rx_list))
+		xnet_rearm_uring_rx(progress);
 	if (xnet_io_uring)
 		xnet_submit_uring(&progress->tx_uring);
 }
 
-void xnet_progress_unexp(struct xnet_progress *progress)
-{
-	struct dlist_entry *item, *tmp;
-	struct xnet_ep *ep;
-
-	assert(ofi_genlock_held(progress->active_lock));
-	dlist_foreach_safe(&progress->unexp_tag_list, item, tmp) {
-		ep = container_of(item, struct xnet_ep, unexp_entry);
-		assert(xnet_has_unexp(ep));
-		assert(ep->state == XNET_CONNECTED);
-		xnet_progress_rx(ep);
-	}
-}
-
 void xnet_run_progress(struct xnet_progress *progress, bool clear_signal)
 {
 	struct ofi_epollfds_event events[XNET_MAX_EVENTS];
@@ -1181,9 +1442,19 @@ int xnet_progress_wait(struct xnet_progress *progress, int timeout)
 static void *xnet_auto_progress(void *arg)
 {
 	struct xnet_progress *progress = arg;
+	char cpu[16];
 	int nfds;
 
 	FI_INFO(&xnet_prov, FI_LOG_DOMAIN, "progress thread starting\n");
+	if (progress->cpu >= 0) {
+		snprintf(cpu, sizeof(cpu), "%d", progress->cpu);
+		if (ofi_set_thread_affinity(cpu)) {
+			FI_WARN(&xnet_prov, FI_LOG_DOMAIN,
+				"unable to bind progress thread to cpu %d\n",
+				progress->cpu);
+		}
+	}
+
 	ofi_genlock_lock(progress->active_lock);
 	while (progress->auto_progress) {
 		ofi_genlock_unlock(progress->active_lock);
@@ -1361,10 +1632,12 @@ int xnet_init_progress(struct xnet_progress *progress, struct fi_info *info)
 
 	progress->fid.fclass = XNET_CLASS_PROGRESS;
 	progress->auto_progress = false;
+	progress->cpu = -1;
 	dlist_init(&progress->unexp_msg_list);
-	dlist_init(&progress->unexp_tag_list);
-	dlist_init(&progress->saved_tag_list);
+	dlist_init(&progress->uring_rx_list);
 	slist_init(&progress->event_list);
+	dlist_init(&progress->close_list);
+	memset(&progress->rx_bufring, 0, sizeof(progress->rx_bufring));
 
 	ret = fd_signal_init(&progress->signal);
 	if (ret)
@@ -1413,6 +1686,20 @@ int xnet_init_progress(struct xnet_progress *progress, struct fi_info *info)
 		progress->sockapi.rx_uring.io_uring = &progress->rx_uring.ring;
 		progress->sockapi.rx_uring.credits =
 			ofi_uring_sq_space_left(&progress->rx_uring.ring);
+
+		/* Only domains carry connected endpoints */
+		if (info && xnet_io_uring_rx_bufs && xnet_prefetch_rbuf_size > 0) {
+			ret = ofi_uring_bufring_init(&progress->rx_uring.ring,
+					&progress->rx_bufring,
+					roundup_power_of_two(xnet_io_uring_rx_bufs),
+					xnet_prefetch_rbuf_size, 0);
+			if (ret) {
+				FI_WARN(&xnet_prov, FI_LOG_DOMAIN,
+					"io_uring provided buffers unavailable "
+					"(%s), receiving from sockets\n",
+					fi_strerror(-ret));
+			}
+		}
 	} else {
 		progress->sockapi = xnet_sockapi_socket;
 	}
@@ -1437,11 +1724,12 @@ err1:
 void xnet_close_progress(struct xnet_progress *progress)
 {
 	assert(dlist_empty(&progress->unexp_msg_list));
-	assert(dlist_empty(&progress->unexp_tag_list));
-	assert(dlist_empty(&progress->saved_tag_list));
 	assert(slist_empty(&progress->event_list));
+	assert(dlist_empty(&progress->uring_rx_list));
 	xnet_stop_progress(progress);
 	if (xnet_io_uring) {
+		ofi_uring_bufring_destroy(&progress->rx_uring.ring,
+					  &progress->rx_bufring);
 		xnet_destroy_uring(&progress->rx_uring, &progress->epoll_fd);
 		xnet_destroy_uring(&progress->tx_uring, &progress->epoll_fd);
 	}
@@ -69,6 +69,9 @@ enum {
 enum {
 	/* backward compatible value */
 	XNET_OP_ACK = 2, /* indicates ack message - should be a flag */
+	/* rdm connection close handshake, header only */
+	XNET_OP_CLOSE_REQ = 3,
+	XNET_OP_CLOSE_DONE = 4,
 };
 
 /* Flags */
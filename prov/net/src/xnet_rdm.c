@@ -653,6 +653,18 @@ static int xnet_rdm_getopt(struct fid *fid, int level, int optname,
 		*((size_t *) optval) = rdm->srx->min_multi_recv_size;
 		*optlen = sizeof(size_t);
 		break;
+	case FI_OPT_CONN_STATS:
+		if (*optlen < sizeof(struct fi_conn_stats)) {
+			*optlen = sizeof(struct fi_conn_stats);
+			return -FI_ETOOSMALL;
+		}
+		ofi_genlock_lock(&xnet_rdm2_progress(rdm)->rdm_lock);
+		((struct fi_conn_stats *) optval)->evicted = rdm->evict_cnt;
+		((struct fi_conn_stats *) optval)->reconnected =
+			rdm->reconnect_cnt;
+		ofi_genlock_unlock(&xnet_rdm2_progress(rdm)->rdm_lock);
+		*optlen = sizeof(struct fi_conn_stats);
+		break;
 	default:
 		return -FI_ENOPROTOOPT;
 	}
@@ -663,6 +675,7 @@ static int xnet_rdm_setopt(struct fid *fid, int level, int optname,
 			   const void *optval, size_t optlen)
 {
 	struct xnet_rdm *rdm;
+	int ret;
 
 	rdm = container_of(fid, struct xnet_rdm, util_ep.ep_fid.fid);
 	if (level != FI_OPT_ENDPOINT)
@@ -678,6 +691,14 @@ static int xnet_rdm_setopt(struct fid *fid, int level, int optname,
 			"FI_OPT_MIN_MULTI_RECV set to %zu\n",
 			rdm->srx->min_multi_recv_size);
 		break;
+	case FI_OPT_PRECONNECT:
+		if (optlen != sizeof(struct fi_preconnect))
+			return -FI_EINVAL;
+
+		ofi_genlock_lock(&xnet_rdm2_progress(rdm)->rdm_lock);
+		ret = xnet_preconnect(rdm, optval);
+		ofi_genlock_unlock(&xnet_rdm2_progress(rdm)->rdm_lock);
+		return ret;
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -782,6 +803,11 @@ static int xnet_rdm_close(struct fid *fid)
 	xnet_freeall_conns(rdm);
 	ofi_genlock_unlock(&xnet_rdm2_progress(rdm)->rdm_lock);
 
+	if (xnet_max_conns)
+		FI_INFO(&xnet_prov, FI_LOG_EP_CTRL, "connection stats: "
+			"evictions %" PRIu64 ", reconnects %" PRIu64 "\n",
+			rdm->evict_cnt, rdm->reconnect_cnt);
+
 	ret = fi_close(&rdm->srx->rx_fid.fid);
 	if (ret) {
 		FI_WARN(&xnet_prov, FI_LOG_EP_CTRL, \
@@ -868,6 +894,8 @@ int xnet_rdm_ep(struct fid_domain *domain, struct fi_info *info,
 	if (!rdm)
 		return -FI_ENOMEM;
 
+	dlist_init(&rdm->conn_lru);
+
 	ret = ofi_endpoint_init(domain, &xnet_util_prov, info, &rdm->util_ep,
 				context, NULL);
 	if (ret)
@@ -43,14 +43,27 @@
  * return the version.  The returned version must be <= the requested
  * version, and is used by the active side to fallback to an older
  * protocol version.
+ *
+ * Older peers send zero flags and echo the connect flags back, so the
+ * accept side answers CLOSE_REQ with a different bit.
  */
 struct xnet_rdm_cm {
 	uint8_t version;
-	uint8_t resv;
+	uint8_t flags;
 	uint16_t port;
 	uint32_t pid;
 };
 
+enum {
+	XNET_RDM_CM_CLOSE_REQ = BIT(0),
+	XNET_RDM_CM_CLOSE_ACK = BIT(1),
+};
+
+#define XNET_PRECONNECT_ATTEMPTS	3
+
+static void xnet_progress_preconnect(struct xnet_rdm *rdm, int peer_index);
+static void xnet_free_preconnect(struct xnet_rdm *rdm);
+
 static int xnet_match_event(struct slist_entry *item, const void *arg)
 {
 	struct xnet_event *event;
@@ -95,6 +108,12 @@ static void xnet_close_conn(struct xnet_conn *conn)
 
 	fi_close(&conn->ep->util_ep.ep_fid.fid);
 	conn->ep = NULL;
+	conn->flags &= ~(XNET_CONN_CLOSING | XNET_CONN_REQ_SENT |
+			 XNET_CONN_REQ_RCVD | XNET_CONN_DONE_SENT |
+			 XNET_CONN_DONE_RCVD | XNET_CONN_PASSIVE |
+			 XNET_CONN_CAN_CLOSE);
+	dlist_remove_init(&conn->lru_entry);
+	conn->rdm->conn_cnt--;
 }
 
 /* MSG EPs under an RDM EP do not write events to the EQ. */
@@ -191,6 +210,13 @@ static int xnet_open_conn(struct xnet_conn *conn, struct fi_info *info)
 		goto err;
 	}
 
+	if (conn->flags & XNET_CONN_EVICTED) {
+		conn->flags &= ~XNET_CONN_EVICTED;
+		conn->rdm->reconnect_cnt++;
+	}
+	conn->last_use = ofi_gettime_ms();
+	dlist_insert_tail(&conn->lru_entry, &conn->rdm->conn_lru);
+	conn->rdm->conn_cnt++;
 	return 0;
 
 err:
@@ -222,7 +248,7 @@ static int xnet_rdm_connect(struct xnet_conn *conn)
 
 	msg.version = XNET_RDM_VERSION;
 	msg.pid = htonl((uint32_t) getpid());
-	msg.resv = 0;
+	msg.flags = XNET_RDM_CM_CLOSE_REQ;
 	msg.port = htons(ofi_addr_get_port(&conn->rdm->addr.sa));
 
 	ret = fi_connect(&conn->ep->util_ep.ep_fid, info->dest_addr,
@@ -262,6 +288,10 @@ void xnet_freeall_conns(struct xnet_rdm *rdm)
 	av = container_of(rdm->util_ep.av, struct rxm_av, util_av);
 	assert(xnet_progress_locked(xnet_rdm2_progress(rdm)));
 
+	/* An unfinished preconnect request is dropped without an event */
+	if (rdm->preconnect)
+		xnet_free_preconnect(rdm);
+
 	/* We can't have more connections than the current number of
 	 * possible peers.
 	 */
@@ -300,6 +330,7 @@ xnet_alloc_conn(struct xnet_rdm *rdm, struct util_peer_addr *peer)
 	conn->rdm = rdm;
 	conn->flags = 0;
 	conn->peer = peer;
+	dlist_init(&conn->lru_entry);
 	rxm_ref_peer(peer);
 
 	FI_DBG(&xnet_prov, FI_LOG_EP_CTRL, "allocated conn %p\n", conn);
@@ -330,6 +361,174 @@ xnet_add_conn(struct xnet_rdm *rdm, struct util_peer_addr *peer)
 	return conn;
 }
 
+/* Nothing queued or partially transferred in the send direction */
+static bool xnet_conn_tx_idle(struct xnet_ep *ep)
+{
+	return !ep->cur_tx.entry && slist_empty(&ep->tx_queue) &&
+	       slist_empty(&ep->priority_queue) &&
+	       slist_empty(&ep->need_ack_queue) &&
+	       slist_empty(&ep->async_queue) &&
+	       slist_empty(&ep->rma_read_queue) &&
+	       !ofi_bsock_tosend(&ep->bsock) &&
+	       !ep->bsock.tx_sockctx.uring_sqe_inuse;
+}
+
+/* Nothing queued or partially transferred in either direction.  Data
+ * that was received but not matched yet is still owned by the msg ep.
+ */
+static bool xnet_conn_busy(struct xnet_ep *ep)
+{
+	return !xnet_conn_tx_idle(ep) || ep->cur_rx.entry ||
+	       ep->cur_rx.hdr_done || ep->saved_cnt ||
+	       !slist_empty(&ep->rx_queue) || ofi_bsock_readable(&ep->bsock);
+}
+
+/* Idle, and no unread data waiting on the socket. */
+static bool xnet_conn_idle(struct xnet_conn *conn)
+{
+	struct xnet_ep *ep = conn->ep;
+	struct pollfd fds;
+
+	if ((conn->flags & (XNET_CONN_TX_LOOPBACK | XNET_CONN_RX_LOOPBACK)) ||
+	    ep->state != XNET_CONNECTED || xnet_conn_busy(ep))
+		return false;
+
+	fds.fd = ep->bsock.sock;
+	fds.events = POLLIN;
+	fds.revents = 0;
+	return poll(&fds, 1, 0) == 0;
+}
+
+/* Connections are closed with a handshake, so neither side fails or
+ * loses a transfer.  Each side sends CLOSE_REQ once its own sends have
+ * gone out, and stops taking new ones.  Once it has the peer's CLOSE_REQ,
+ * nothing new will arrive, and it sends CLOSE_DONE when it has finished
+ * with everything received.  A side that has sent and received
+ * CLOSE_DONE closes the socket; the peer is already done and treats the
+ * end of stream as the close.  Either side may start the handshake.
+ */
+static void xnet_progress_close(struct xnet_conn *conn)
+{
+	struct xnet_ep *ep = conn->ep;
+
+	assert(xnet_progress_locked(xnet_rdm2_progress(conn->rdm)));
+	assert(conn->flags & XNET_CONN_CLOSING);
+
+	/* a failed conn is closed by its shutdown event */
+	if (ep->state != XNET_CONNECTED)
+		return;
+
+	if (!(conn->flags & XNET_CONN_REQ_SENT)) {
+		if (!xnet_conn_tx_idle(ep) ||
+		    xnet_queue_ctrl(ep, XNET_OP_CLOSE_REQ))
+			return;
+		conn->flags |= XNET_CONN_REQ_SENT;
+	}
+
+	if (!(conn->flags & XNET_CONN_REQ_RCVD))
+		return;
+
+	if (!(conn->flags & XNET_CONN_DONE_SENT)) {
+		if (xnet_conn_busy(ep) ||
+		    xnet_queue_ctrl(ep, XNET_OP_CLOSE_DONE))
+			return;
+		conn->flags |= XNET_CONN_DONE_SENT;
+	}
+
+	if (!(conn->flags & XNET_CONN_DONE_RCVD) || !xnet_conn_tx_idle(ep))
+		return;
+
+	FI_INFO(&xnet_prov, FI_LOG_EP_CTRL, "closed conn %p\n", conn);
+	xnet_close_conn(conn);
+}
+
+void xnet_progress_close_list(struct xnet_progress *progress)
+{
+	struct xnet_conn *conn;
+	struct dlist_entry *tmp;
+
+	assert(xnet_progress_locked(progress));
+	dlist_foreach_container_safe(&progress->close_list, struct xnet_conn,
+				     conn, lru_entry, tmp) {
+		xnet_progress_close(conn);
+		/* closed without a CM event */
+		if (!conn->ep && conn->rdm->preconnect)
+			xnet_progress_preconnect(conn->rdm, conn->peer->index);
+	}
+}
+
+static void xnet_start_close(struct xnet_conn *conn)
+{
+	conn->flags |= XNET_CONN_CLOSING | XNET_CONN_EVICTED;
+	dlist_remove(&conn->lru_entry);
+	dlist_insert_tail(&conn->lru_entry,
+			  &xnet_rdm2_progress(conn->rdm)->close_list);
+}
+
+/* Called from the rx path, so the conn is only closed later by progress */
+void xnet_recv_close(struct xnet_ep *ep, uint8_t op_data)
+{
+	struct xnet_conn *conn = ep->util_ep.ep_fid.fid.context;
+
+	assert(xnet_progress_locked(xnet_rdm2_progress(conn->rdm)));
+	FI_DBG(&xnet_prov, FI_LOG_EP_CTRL, "close %s for conn %p\n",
+	       op_data == XNET_OP_CLOSE_REQ ? "req" : "done", conn);
+	if (!(conn->flags & XNET_CONN_CLOSING))
+		xnet_start_close(conn);
+
+	conn->flags |= (op_data == XNET_OP_CLOSE_REQ) ?
+		       XNET_CONN_REQ_RCVD : XNET_CONN_DONE_RCVD;
+}
+
+/* Start closing the least recently used idle connection to make room for
+ * a new one.  The conn stays indexed and reconnects on next use.
+ */
+static void xnet_evict_conn(struct xnet_rdm *rdm)
+{
+	struct xnet_conn *conn;
+	uint64_t now;
+
+	assert(xnet_progress_locked(xnet_rdm2_progress(rdm)));
+	now = ofi_gettime_ms();
+	dlist_foreach_container(&rdm->conn_lru, struct xnet_conn,
+				conn, lru_entry) {
+		if (now - conn->last_use < (uint64_t) xnet_conn_idle_time)
+			break;
+		/* peers without the close handshake keep their conns */
+		if (!(conn->flags & XNET_CONN_CAN_CLOSE) ||
+		    !xnet_conn_idle(conn))
+			continue;
+
+		FI_INFO(&xnet_prov, FI_LOG_EP_CTRL, "evicting conn %p\n", conn);
+		rdm->evict_cnt++;
+		xnet_start_close(conn);
+		xnet_progress_close(conn);
+		return;
+	}
+}
+
+static void xnet_check_conns(struct xnet_rdm *rdm)
+{
+	if (xnet_max_conns && rdm->conn_cnt >= xnet_max_conns)
+		xnet_evict_conn(rdm);
+}
+
+static void xnet_touch_conn(struct xnet_conn *conn)
+{
+	conn->last_use = ofi_gettime_ms();
+	if (conn->flags & XNET_CONN_CLOSING)
+		return;
+
+	dlist_remove(&conn->lru_entry);
+	dlist_insert_tail(&conn->lru_entry, &conn->rdm->conn_lru);
+}
+
+/* Received traffic keeps a connection from being evicted */
+void xnet_touch_rx_conn(struct xnet_ep *ep)
+{
+	xnet_touch_conn(ep->util_ep.ep_fid.fid.context);
+}
+
 /* The returned conn is only valid if the function returns success.
  * This is called from data transfer ops, which return ssize_t, so
  * we return that rather than int.
@@ -347,14 +546,186 @@ ssize_t xnet_get_conn(struct xnet_rdm *rdm, fi_addr_t addr,
 		return -FI_ENOMEM;
 
 	if (!(*conn)->ep) {
+		xnet_check_conns(rdm);
 		ret = xnet_rdm_connect(*conn);
 		if (ret)
 			return ret;
 	}
 
-	if ((*conn)->ep->state != XNET_CONNECTED)
+	if ((*conn)->ep->state != XNET_CONNECTED ||
+	    ((*conn)->flags & XNET_CONN_CLOSING))
 		return -FI_EAGAIN;
 
+	if (xnet_max_conns)
+		xnet_touch_conn(*conn);
+	return 0;
+}
+
+static void xnet_write_preconnect_event(struct xnet_rdm *rdm, void *context,
+					uint64_t data, int err)
+{
+	struct fi_eq_err_entry entry = { 0 };
+	size_t size;
+	ssize_t ret;
+	uint64_t flags;
+
+	entry.fid = &rdm->util_ep.ep_fid.fid;
+	entry.context = context;
+	entry.data = data;
+
+	if (err) {
+		entry.err = err;
+		size = sizeof(struct fi_eq_err_entry);
+		flags = UTIL_FLAG_ERROR;
+	} else {
+		size = sizeof(struct fi_eq_entry);
+		flags = 0;
+	}
+
+	ret = fi_eq_write(&rdm->util_ep.eq->eq_fid, FI_PRECONNECT_COMPLETE,
+			  &entry, size, flags);
+	if ((size_t) ret != size)
+		FI_WARN(&xnet_prov, FI_LOG_EP_CTRL, "error writing to EQ\n");
+}
+
+/* A conn that fails to connect is freed, and is retried from scratch.
+ * One replaced by a simultaneous connect from the peer is not.
+ */
+static ssize_t xnet_preconnect_addr(struct xnet_rdm *rdm, fi_addr_t addr,
+				    int *attempts)
+{
+	struct util_peer_addr **peer;
+	struct xnet_conn *conn;
+
+	/* checked on every event, the address may be removed meanwhile */
+	if (!ofi_av_addr_valid(rdm->util_ep.av, addr))
+		return -FI_EADDRNOTAVAIL;
+
+	peer = ofi_av_addr_context(rdm->util_ep.av, addr);
+	if (!*peer)
+		return -FI_EADDRNOTAVAIL;
+
+	conn = ofi_idm_lookup(&rdm->conn_idx_map, (*peer)->index);
+	if (!conn && (*attempts)++ == XNET_PRECONNECT_ATTEMPTS)
+		return -FI_ECONNREFUSED;
+
+	return xnet_get_conn(rdm, addr, &conn);
+}
+
+static void xnet_free_preconnect(struct xnet_rdm *rdm)
+{
+	ofi_idm_reset(&rdm->preconnect->peer_map, NULL);
+	free(rdm->preconnect);
+	rdm->preconnect = NULL;
+}
+
+/* Returns true once the entry is resolved and has been reported */
+static bool xnet_resolve_preconnect(struct xnet_rdm *rdm,
+				    struct xnet_preconnect_entry *entry)
+{
+	struct xnet_preconnect *req = rdm->preconnect;
+	ssize_t ret;
+
+	ret = xnet_preconnect_addr(rdm, entry->addr, &entry->attempts);
+	if (ret == -FI_EAGAIN)
+		return false;
+
+	if (ret)
+		xnet_write_preconnect_event(rdm, req->context, entry->index,
+					    (int) -ret);
+	else
+		req->connected++;
+	entry->addr = FI_ADDR_NOTAVAIL;
+	req->count--;
+	return true;
+}
+
+static void xnet_check_preconnect(struct xnet_rdm *rdm)
+{
+	struct xnet_preconnect *req = rdm->preconnect;
+
+	if (req->count)
+		return;
+
+	FI_INFO(&xnet_prov, FI_LOG_EP_CTRL, "preconnect done, %zu connected\n",
+		req->connected);
+	xnet_write_preconnect_event(rdm, req->context, req->connected, 0);
+	xnet_free_preconnect(rdm);
+}
+
+/* Advance the pending entries of the peer that a CM event refers to */
+static void xnet_progress_preconnect(struct xnet_rdm *rdm, int peer_index)
+{
+	struct xnet_preconnect *req = rdm->preconnect;
+	struct xnet_preconnect_entry *entry;
+	bool pending = false;
+
+	assert(xnet_progress_locked(xnet_rdm2_progress(rdm)));
+	entry = ofi_idm_lookup(&req->peer_map, peer_index);
+	if (!entry)
+		return;
+
+	for (; entry; entry = entry->next) {
+		if (entry->addr != FI_ADDR_NOTAVAIL &&
+		    !xnet_resolve_preconnect(rdm, entry))
+			pending = true;
+	}
+
+	if (!pending)
+		(void) ofi_idm_clear(&req->peer_map, peer_index);
+	xnet_check_preconnect(rdm);
+}
+
+/* All connection requests are sent up front.  Each entry then advances
+ * with the CM events of its peer.
+ */
+int xnet_preconnect(struct xnet_rdm *rdm, const struct fi_preconnect *req)
+{
+	struct xnet_preconnect *pending;
+	struct xnet_preconnect_entry *entry, *last;
+	struct util_peer_addr **peer;
+	size_t i;
+
+	assert(xnet_progress_locked(xnet_rdm2_progress(rdm)));
+	if (!rdm->util_ep.eq)
+		return -FI_ENOEQ;
+
+	if (rdm->pep->state != XNET_LISTENING)
+		return -FI_EOPBADSTATE;
+
+	if (rdm->preconnect)
+		return -FI_EBUSY;
+
+	pending = calloc(1, sizeof(*pending) +
+			 req->count * sizeof(pending->entry[0]));
+	if (!pending)
+		return -FI_ENOMEM;
+
+	pending->context = req->context;
+	pending->count = req->count;
+	rdm->preconnect = pending;
+	for (i = 0; i < req->count; i++) {
+		entry = &pending->entry[i];
+		entry->addr = req->addr[i];
+		entry->index = i;
+		if (xnet_resolve_preconnect(rdm, entry))
+			continue;
+
+		/* the same peer may be listed more than once */
+		peer = ofi_av_addr_context(rdm->util_ep.av, entry->addr);
+		last = ofi_idm_lookup(&pending->peer_map, (*peer)->index);
+		if (last) {
+			while (last->next)
+				last = last->next;
+			last->next = entry;
+		} else if (ofi_idm_set(&pending->peer_map, (*peer)->index,
+				       entry) < 0) {
+			xnet_free_preconnect(rdm);
+			return -FI_ENOMEM;
+		}
+	}
+
+	xnet_check_preconnect(rdm);
 	return 0;
 }
 
@@ -378,7 +749,8 @@ struct xnet_ep *xnet_get_rx_ep(struct xnet_rdm *rdm, fi_addr_t addr)
 	return NULL;
 }
 
-static void xnet_process_connreq(struct fi_eq_cm_entry *cm_entry)
+/* Returns the index of the requesting peer, or -1 if it is unknown */
+static int xnet_process_connreq(struct fi_eq_cm_entry *cm_entry)
 {
 	struct xnet_rdm *rdm;
 	struct xnet_rdm_cm *msg;
@@ -386,7 +758,7 @@ static void xnet_process_connreq(struct fi_eq_cm_entry *cm_entry)
 	struct util_peer_addr *peer;
 	struct xnet_conn *conn;
 	struct rxm_av *av;
-	int ret, cmp;
+	int ret, cmp, index = -1;
 
 	assert(cm_entry->fid->fclass == FI_CLASS_PEP);
 	rdm = cm_entry->fid->context;
@@ -404,6 +776,7 @@ static void xnet_process_connreq(struct fi_eq_cm_entry *cm_entry)
 		goto reject;
 	}
 
+	index = peer->index;
 	conn = xnet_add_conn(rdm, peer);
 	if (!conn)
 		goto put;
@@ -412,6 +785,13 @@ static void xnet_process_connreq(struct fi_eq_cm_entry *cm_entry)
 	if (!conn->ep)
 		goto accept;
 
+	/* The peer retries once we have closed our side as well */
+	if (conn->flags & XNET_CONN_CLOSING) {
+		FI_INFO(&xnet_prov, FI_LOG_EP_CTRL,
+			"closing, reject peer %p\n", conn);
+		goto put;
+	}
+
 	switch (conn->ep->state) {
 	case XNET_CONNECTING:
 	case XNET_REQ_SENT:
@@ -467,17 +847,25 @@ static void xnet_process_connreq(struct fi_eq_cm_entry *cm_entry)
 	}
 
 accept:
+	xnet_check_conns(rdm);
 	conn->remote_pid = ntohl(msg->pid);
 	ret = xnet_open_conn(conn, cm_entry->info);
 	if (ret)
 		goto free;
 
+	conn->flags |= XNET_CONN_PASSIVE;
+	if (msg->flags & XNET_RDM_CM_CLOSE_REQ) {
+		conn->flags |= XNET_CONN_CAN_CLOSE;
+		msg->flags = XNET_RDM_CM_CLOSE_ACK;
+	} else {
+		msg->flags = 0;
+	}
 	msg->pid = htonl((uint32_t) getpid());
 	ret = fi_accept(&conn->ep->util_ep.ep_fid, msg, sizeof(*msg));
 	if (ret)
 		goto close;
 
-	return;
+	return index;
 
 close:
 	xnet_close_conn(conn);
@@ -489,6 +877,7 @@ reject:
 	(void) fi_reject(&rdm->pep->util_pep.pep_fid, cm_entry->info->handle,
 			 msg, sizeof(*msg));
 	fi_freeinfo(cm_entry->info);
+	return index;
 }
 
 void xnet_handle_event_list(struct xnet_progress *progress)
@@ -497,6 +886,8 @@ void xnet_handle_event_list(struct xnet_progress *progress)
 	struct slist_entry *item;
 	struct xnet_rdm_cm *msg;
 	struct xnet_conn *conn;
+	struct xnet_rdm *rdm;
+	int index;
 
 	assert(ofi_genlock_held(&progress->rdm_lock));
 	while (!slist_empty(&progress->event_list)) {
@@ -508,22 +899,39 @@ void xnet_handle_event_list(struct xnet_progress *progress)
 
 		switch (event->event) {
 		case FI_CONNREQ:
-			xnet_process_connreq(&event->cm_entry);
+			index = xnet_process_connreq(&event->cm_entry);
 			break;
 		case FI_CONNECTED:
 			conn = event->cm_entry.fid->context;
+			index = conn->peer->index;
+			/* only the connect side gets the accept data */
+			if (conn->flags & XNET_CONN_PASSIVE)
+				break;
 			msg = (struct xnet_rdm_cm *) event->cm_entry.data;
 			conn->remote_pid = ntohl(msg->pid);
+			if (msg->flags & XNET_RDM_CM_CLOSE_ACK)
+				conn->flags |= XNET_CONN_CAN_CLOSE;
 			break;
 		case FI_SHUTDOWN:
 			conn = event->cm_entry.fid->context;
+			index = conn->peer->index;
+			/* the peer finished closing first, keep it indexed */
+			if (conn->flags & XNET_CONN_CLOSING) {
+				xnet_close_conn(conn);
+				break;
+			}
 			xnet_close_conn(conn);
 			xnet_free_conn(conn);
 			break;
 		default:
 			assert(0);
+			index = -1;
 			break;
 		}
+
+		rdm = event->rdm;
 		free(event);
+		if (rdm->preconnect && index >= 0)
+			xnet_progress_preconnect(rdm, index);
 	};
 }
@@ -39,10 +39,6 @@
 #include <ofi_iov.h>
 
 
-static struct xnet_xfer_entry *
-xnet_match_tag(struct xnet_srx *srx, struct xnet_ep *ep, uint64_t tag);
-
-
 /* The rdm ep calls directly through to the srx calls, so we need to use the
  * progress active_lock for protection.
  */
@@ -191,13 +187,14 @@ static int xnet_check_match(const union xnet_hdrs *hdr,
 	cur_tag = (hdr->base_hdr.flags & XNET_REMOTE_CQ_DATA) ?
 		  hdr->tag_data_hdr.tag : hdr->tag_hdr.tag;
 
-	return ofi_match_tag(recv_entry->tag, recv_entry->ignore, cur_tag);
+	return ofi_match_tag(recv_entry->match.tag, recv_entry->match.ignore,
+			     cur_tag);
 }
 
 static int xnet_match_msg(const void *claim_ctx, const union xnet_hdrs *hdr,
 			  const struct xnet_xfer_entry *recv_entry)
 {
-	if (recv_entry->tag & XNET_CLAIM_TAG_BIT) {
+	if (recv_entry->match.tag & XNET_CLAIM_TAG_BIT) {
 		return (recv_entry->context == claim_ctx) &&
 			xnet_check_match(hdr, recv_entry);
 	} else {
@@ -205,93 +202,165 @@ static int xnet_match_msg(const void *claim_ctx, const union xnet_hdrs *hdr,
 	}
 }
 
-static int xnet_match_unexp(struct dlist_entry *item, const void *arg)
+static bool xnet_match_unexp(struct ofi_mq_entry *item, void *arg)
 {
 	struct xnet_ep *ep;
-	ep = container_of(item, struct xnet_ep, unexp_entry);
+
+	ep = container_of(item, struct xnet_ep, unexp_match);
 	return xnet_match_msg(ep->cur_rx.claim_ctx, &ep->cur_rx.hdr, arg);
 }
 
+static bool xnet_match_saved_entry(struct ofi_mq_entry *item, void *arg)
+{
+	struct xnet_xfer_entry *saved_entry;
+
+	saved_entry = container_of(item, struct xnet_xfer_entry, match);
+	return xnet_match_msg(saved_entry->context, &saved_entry->hdr, arg);
+}
+
+void xnet_insert_unexp_tag(struct xnet_ep *ep, uint64_t tag)
+{
+	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	assert(dlist_empty(&ep->unexp_match.list_entry));
+
+	ep->unexp_match.addr = ep->peer->fi_addr;
+	ep->unexp_match.tag = tag;
+	ep->unexp_match.ignore = 0;
+	ofi_mq_insert(&ep->srx->unexp_eps, &ep->unexp_match);
+}
+
+void xnet_remove_unexp(struct xnet_ep *ep)
+{
+	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	if (!dlist_empty(&ep->unexp_match.list_entry))
+		ofi_mq_remove(&ep->srx->unexp_eps, &ep->unexp_match);
+}
+
+void xnet_remove_saved(struct xnet_ep *ep, struct xnet_xfer_entry *saved_entry)
+{
+	struct slist_entry *item, *prev;
+
+	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	assert(ep->saved_cnt);
+
+	slist_foreach(&ep->saved_queue, item, prev) {
+		if (item == &saved_entry->entry) {
+			slist_remove(&ep->saved_queue, item, prev);
+			break;
+		}
+	}
+
+	ofi_mq_remove(&ep->srx->saved_msgs, &saved_entry->match);
+	ep->saved_cnt--;
+}
+
+/* Peeking with FI_CLAIM marks the message by setting the claim bit in its
+ * tag.  Re-key the index so that only the claiming receive can find it.
+ */
+static void xnet_mark_claimed(struct ofi_mq *mq, struct ofi_mq_entry *item)
+{
+	ofi_mq_remove(mq, item);
+	item->tag |= XNET_CLAIM_TAG_BIT;
+	ofi_mq_insert(mq, item);
+}
+
 static struct xnet_xfer_entry *
 xnet_match_saved(struct xnet_ep *ep, struct xnet_xfer_entry *rx_entry,
 		 bool remove)
 {
 	struct xnet_xfer_entry *saved_entry;
-	struct slist_entry *item, *prev;
+	struct slist_entry *item;
 
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
 	assert(ep->saved_cnt);
 
-	slist_foreach(&ep->saved_queue, item, prev) {
+	for (item = ep->saved_queue.head; item; item = item->next) {
 		saved_entry = container_of(item, struct xnet_xfer_entry, entry);
 		if (xnet_match_msg(saved_entry->context, &saved_entry->hdr,
 				   rx_entry)) {
-			if (remove) {
-				slist_remove(&ep->saved_queue, item, prev);
-				if (!--ep->saved_cnt) {
-					assert(!dlist_empty(&ep->saved_entry));
-					dlist_remove_init(&ep->saved_entry);
-				}
-			}
+			if (remove)
+				xnet_remove_saved(ep, saved_entry);
 			return saved_entry;
 		}
 	}
 	return NULL;
 }
 
+/* Claimed messages are matched by context as well as tag, which the index
+ * can't do, so those fall back to walking the queue in arrival order.
+ */
 static struct xnet_xfer_entry *
-xnet_search_saved(struct xnet_progress *progress,
-		  struct xnet_xfer_entry *rx_entry, bool remove)
+xnet_search_saved(struct xnet_srx *srx, struct xnet_xfer_entry *rx_entry,
+		  bool remove)
 {
 	struct xnet_xfer_entry *saved_entry;
-	struct dlist_entry *item;
-	struct xnet_ep *ep;
+	struct ofi_mq_entry *item;
 
-	assert(ofi_genlock_held(progress->active_lock));
-	dlist_foreach(&progress->saved_tag_list, item) {
-		ep = container_of(item, struct xnet_ep, saved_entry);
-		assert(ep->saved_cnt);
-		assert(ep->state == XNET_CONNECTED);
+	assert(xnet_progress_locked(xnet_srx2_progress(srx)));
+	if (rx_entry->match.tag & XNET_CLAIM_TAG_BIT) {
+		item = ofi_mq_find(&srx->saved_msgs, xnet_match_saved_entry,
+				   rx_entry);
+	} else {
+		item = ofi_mq_match_recv(&srx->saved_msgs, rx_entry->match.addr,
+					 rx_entry->match.tag,
+					 rx_entry->match.ignore);
+	}
+	if (!item)
+		return NULL;
+
+	saved_entry = container_of(item, struct xnet_xfer_entry, match);
+	assert(saved_entry->ep->state == XNET_CONNECTED);
+	if (remove)
+		xnet_remove_saved(saved_entry->ep, saved_entry);
+	return saved_entry;
+}
 
-		saved_entry = xnet_match_saved(ep, rx_entry, remove);
-		if (saved_entry)
-			return saved_entry;
+static struct xnet_ep *
+xnet_search_unexp(struct xnet_srx *srx, struct xnet_xfer_entry *rx_entry)
+{
+	struct ofi_mq_entry *item;
+	struct xnet_ep *ep;
+
+	assert(xnet_progress_locked(xnet_srx2_progress(srx)));
+	if (ofi_mq_empty(&srx->unexp_eps))
+		return NULL;
 
+	if (rx_entry->match.tag & XNET_CLAIM_TAG_BIT) {
+		item = ofi_mq_find(&srx->unexp_eps, xnet_match_unexp, rx_entry);
+	} else {
+		item = ofi_mq_match_recv(&srx->unexp_eps, rx_entry->match.addr,
+					 rx_entry->match.tag,
+					 rx_entry->match.ignore);
 	}
-	return NULL;
+	if (!item)
+		return NULL;
+
+	ep = container_of(item, struct xnet_ep, unexp_match);
+	assert(xnet_has_unexp(ep));
+	assert(ep->state == XNET_CONNECTED);
+	return ep;
 }
 
 static struct xnet_ep *
 xnet_find_msg(struct xnet_srx *srx, struct xnet_xfer_entry *recv_entry,
 	      struct xnet_xfer_entry **saved_entry, bool remove)
 {
-	struct xnet_progress *progress;
-	struct dlist_entry *entry;
-	struct slist *queue;
 	struct xnet_ep *ep;
 
-	progress = xnet_srx2_progress(srx);
-	assert(xnet_progress_locked(progress));
+	assert(xnet_progress_locked(xnet_srx2_progress(srx)));
 
-	if ((srx->match_tag_rx == xnet_match_tag) ||
-	    (recv_entry->src_addr == FI_ADDR_UNSPEC)) {
-		*saved_entry = xnet_search_saved(progress, recv_entry, remove);
+	if (!xnet_srx_directed(srx) ||
+	    (recv_entry->match.addr == FI_ADDR_UNSPEC)) {
+		*saved_entry = xnet_search_saved(srx, recv_entry, remove);
 		if (*saved_entry)
 			return (*saved_entry)->ep;
 
-		entry = dlist_find_first_match(&progress->unexp_tag_list,
-					       xnet_match_unexp, recv_entry);
-		if (!entry)
+		ep = xnet_search_unexp(srx, recv_entry);
+		if (!ep)
 			return NULL;
-
-		ep = container_of(entry, struct xnet_ep, unexp_entry);
 	} else {
 		*saved_entry = NULL;
-		queue = ofi_array_at(&srx->src_tag_queues, recv_entry->src_addr);
-		if (!queue)
-			return NULL;
-
-		ep = xnet_get_rx_ep(srx->rdm, recv_entry->src_addr);
+		ep = xnet_get_rx_ep(srx->rdm, recv_entry->match.addr);
 		if (!ep)
 			return NULL;
 
@@ -306,7 +375,7 @@ xnet_find_msg(struct xnet_srx *srx, struct xnet_xfer_entry *recv_entry,
 		    		    &ep->cur_rx.hdr, recv_entry))
 			return NULL;
 	}
-	assert(!dlist_empty(&ep->unexp_entry));
+	assert(xnet_is_unexp(ep));
 
 	return ep;
 }
@@ -324,7 +393,7 @@ xnet_srx_claim(struct xnet_srx *srx, struct xnet_xfer_entry *recv_entry,
 	assert(xnet_progress_locked(xnet_srx2_progress(srx)));
 	assert(srx->rdm);
 
-	recv_entry->tag |= XNET_CLAIM_TAG_BIT;
+	recv_entry->match.tag |= XNET_CLAIM_TAG_BIT;
 	ep = xnet_find_msg(srx, recv_entry, &saved_entry, true);
 	if (!ep)
 		return -FI_ENOMSG;
@@ -386,10 +455,15 @@ xnet_srx_peek(struct xnet_srx *srx, struct xnet_xfer_entry *recv_entry,
 			hdr->tag_data_hdr.tag |= XNET_CLAIM_TAG_BIT;
 		else
 			hdr->tag_hdr.tag |= XNET_CLAIM_TAG_BIT;
-		if (saved_entry)
+		if (saved_entry) {
 			saved_entry->context = recv_entry->context;
-		else
+			xnet_mark_claimed(&srx->saved_msgs, &saved_entry->match);
+		} else {
 			ep->cur_rx.claim_ctx = recv_entry->context;
+			if (!dlist_empty(&ep->unexp_match.list_entry))
+				xnet_mark_claimed(&srx->unexp_eps,
+						  &ep->unexp_match);
+		}
 	}
 
 	if (flags & FI_DISCARD) {
@@ -407,7 +481,7 @@ nomatch:
 	memset(&err_entry, 0, sizeof(err_entry));
 	err_entry.op_context = recv_entry->context;
 	err_entry.flags = FI_RECV | FI_TAGGED;
-	err_entry.tag = recv_entry->tag;
+	err_entry.tag = recv_entry->match.tag;
 	err_entry.err = ret;
 	ofi_cq_write_error(&srx->cq->util_cq, &err_entry);
 	xnet_free_xfer(xnet_srx2_progress(srx), recv_entry);
@@ -426,39 +500,30 @@ nomatch:
 static ssize_t
 xnet_srx_tag(struct xnet_srx *srx, struct xnet_xfer_entry *recv_entry)
 {
-	struct xnet_progress *progress;
 	struct xnet_xfer_entry *saved_entry;
 	struct xnet_ep *ep;
-	struct slist *queue;
 
-	progress = xnet_srx2_progress(srx);
-	assert(xnet_progress_locked(progress));
+	assert(xnet_progress_locked(xnet_srx2_progress(srx)));
 	assert(srx->rdm);
 
-	/* Always set and bump the tag_seq_no to help debugging */
-	recv_entry->tag_seq_no = srx->tag_seq_no++;
-
-	if ((srx->match_tag_rx == xnet_match_tag) ||
-	    (recv_entry->src_addr == FI_ADDR_UNSPEC)) {
-		saved_entry = xnet_search_saved(progress, recv_entry, true);
+	if (!xnet_srx_directed(srx) ||
+	    (recv_entry->match.addr == FI_ADDR_UNSPEC)) {
+		saved_entry = xnet_search_saved(srx, recv_entry, true);
 		if (saved_entry) {
 			xnet_recv_saved(saved_entry, recv_entry);
 			return 0;
 		}
 
-		slist_insert_tail(&recv_entry->entry, &srx->tag_queue);
+		ofi_mq_insert(&srx->tag_queue, &recv_entry->match);
 
-		/* The message could match any endpoint waiting. */
-		if (!dlist_empty(&progress->unexp_tag_list))
-			xnet_progress_unexp(progress);
+		/* The message could be waiting on any endpoint. */
+		ep = xnet_search_unexp(srx, recv_entry);
+		if (ep)
+			xnet_progress_rx(ep);
 	} else {
-		queue = ofi_array_at(&srx->src_tag_queues, recv_entry->src_addr);
-		if (!queue)
-			return -FI_EAGAIN;
-
-		ep = xnet_get_rx_ep(srx->rdm, recv_entry->src_addr);
+		ep = xnet_get_rx_ep(srx->rdm, recv_entry->match.addr);
 		if (!ep) {
-			slist_insert_tail(&recv_entry->entry, queue);
+			ofi_mq_insert(&srx->tag_queue, &recv_entry->match);
 			return 0;
 		}
 
@@ -470,12 +535,10 @@ xnet_srx_tag(struct xnet_srx *srx, struct xnet_xfer_entry *recv_entry)
 			}
 		}
 
+		ofi_mq_insert(&srx->tag_queue, &recv_entry->match);
 		if (xnet_has_unexp(ep)) {
-			assert(!dlist_empty(&ep->unexp_entry));
-			slist_insert_tail(&recv_entry->entry, queue);
+			assert(xnet_is_unexp(ep));
 			xnet_progress_rx(ep);
-		} else {
-			slist_insert_tail(&recv_entry->entry, queue);
 		}
 	}
 
@@ -500,9 +563,9 @@ xnet_srx_trecvmsg(struct fid_ep *ep_fid, const struct fi_msg_tagged *msg,
 		goto unlock;
 	}
 
-	recv_entry->tag = msg->tag;
-	recv_entry->ignore = msg->ignore;
-	recv_entry->src_addr = msg->addr;
+	recv_entry->match.tag = msg->tag;
+	recv_entry->match.ignore = msg->ignore;
+	recv_entry->match.addr = msg->addr;
 	recv_entry->cq_flags = (flags & FI_COMPLETION) | FI_TAGGED | FI_RECV;
 	recv_entry->context = msg->context;
 	recv_entry->iov_cnt = msg->iov_count;
@@ -544,9 +607,9 @@ xnet_srx_trecv(struct fid_ep *ep_fid, void *buf, size_t len, void *desc,
 		goto unlock;
 	}
 
-	recv_entry->tag = tag;
-	recv_entry->ignore = ignore;
-	recv_entry->src_addr = src_addr;
+	recv_entry->match.tag = tag;
+	recv_entry->match.ignore = ignore;
+	recv_entry->match.addr = src_addr;
 	recv_entry->cq_flags = FI_TAGGED | FI_RECV;
 	recv_entry->cntr_inc = ofi_ep_rx_cntr_inc;
 	recv_entry->context = context;
@@ -582,9 +645,9 @@ xnet_srx_trecvv(struct fid_ep *ep_fid, const struct iovec *iov, void **desc,
 		goto unlock;
 	}
 
-	recv_entry->tag = tag;
-	recv_entry->ignore = ignore;
-	recv_entry->src_addr = src_addr;
+	recv_entry->match.tag = tag;
+	recv_entry->match.ignore = ignore;
+	recv_entry->match.addr = src_addr;
 	recv_entry->cq_flags = FI_TAGGED | FI_RECV;
 	recv_entry->cntr_inc = ofi_ep_rx_cntr_inc;
 	recv_entry->context = context;
@@ -616,69 +679,18 @@ static struct fi_ops_tagged xnet_srx_tag_ops = {
 	.injectdata = fi_no_tagged_injectdata,
 };
 
-static struct xnet_xfer_entry *
-xnet_match_tag(struct xnet_srx *srx, struct xnet_ep *ep, uint64_t tag)
-{
-	struct xnet_xfer_entry *rx_entry;
-	struct slist_entry *item, *prev;
-
-	assert(xnet_progress_locked(xnet_srx2_progress(srx)));
-	slist_foreach(&srx->tag_queue, item, prev) {
-		rx_entry = container_of(item, struct xnet_xfer_entry, entry);
-		if (ofi_match_tag(rx_entry->tag, rx_entry->ignore, tag)) {
-			slist_remove(&srx->tag_queue, item, prev);
-			return rx_entry;
-		}
-	}
-	return NULL;
-}
-
-/* A matching receive could be found on either the any source queue or the
- * source matched queue.  However, most apps going through this path will
- * use source matching, with the any source queue being empty.  We optimize
- * for this case.
- */
-static struct xnet_xfer_entry *
-xnet_match_tag_addr(struct xnet_srx *srx, struct xnet_ep *ep, uint64_t tag)
+struct xnet_xfer_entry *
+xnet_match_tag_rx(struct xnet_srx *srx, struct xnet_ep *ep, uint64_t tag)
 {
-	struct xnet_xfer_entry *rx_entry, *any_entry;
-	struct slist *queue;
-	struct slist_entry *any_item, *any_prev;
-	struct slist_entry *item, *prev;
+	struct ofi_mq_entry *item;
 
 	assert(xnet_progress_locked(xnet_srx2_progress(srx)));
-	queue = ofi_array_at(&srx->src_tag_queues, ep->peer->fi_addr);
-	if (!queue)
-		return xnet_match_tag(srx, ep, tag);
-
-	slist_foreach(queue, item, prev) {
-		rx_entry = container_of(item, struct xnet_xfer_entry, entry);
-		if (ofi_match_tag(rx_entry->tag, rx_entry->ignore, tag))
-			goto found;
-	}
-
-	return xnet_match_tag(srx, ep, tag);
-
-found:
-	/* We select from the any source queue if it matches and was posted
-	 * earlier than our source based match.
-	 */
-	slist_foreach(&srx->tag_queue, any_item, any_prev) {
-		any_entry = container_of(any_item, struct xnet_xfer_entry, entry);
-		if (any_entry->tag_seq_no > rx_entry->tag_seq_no)
-			break;
-
-		if (ofi_match_tag(any_entry->tag, any_entry->ignore, tag)) {
-			queue = &srx->tag_queue;
-			rx_entry = any_entry;
-			item = any_item;
-			prev = any_prev;
-			break;
-		}
-	}
+	item = ofi_mq_match_msg(&srx->tag_queue, ep->peer->fi_addr, tag);
+	if (!item)
+		return NULL;
 
-	slist_remove(queue, item, prev);
-	return rx_entry;
+	ofi_mq_remove(&srx->tag_queue, item);
+	return container_of(item, struct xnet_xfer_entry, match);
 }
 
 static bool
@@ -702,14 +714,28 @@ xnet_srx_cancel_rx(struct xnet_srx *srx, struct slist *queue, void *context)
 	return false;
 }
 
-static int
-xnet_srx_cancel_src(struct ofi_dyn_arr *arr, void *list, void *context)
+static bool xnet_match_context(struct ofi_mq_entry *item, void *context)
 {
-	struct xnet_srx *srx;
-	struct slist *queue = list;
+	return container_of(item, struct xnet_xfer_entry, match)->context ==
+	       context;
+}
 
-	srx = container_of(arr, struct xnet_srx, src_tag_queues);
-	return (int) xnet_srx_cancel_rx(srx, queue, context);
+static bool
+xnet_srx_cancel_tag(struct xnet_srx *srx, void *context)
+{
+	struct xnet_xfer_entry *xfer_entry;
+	struct ofi_mq_entry *item;
+
+	assert(xnet_progress_locked(xnet_srx2_progress(srx)));
+	item = ofi_mq_find(&srx->tag_queue, xnet_match_context, context);
+	if (!item)
+		return false;
+
+	ofi_mq_remove(&srx->tag_queue, item);
+	xfer_entry = container_of(item, struct xnet_xfer_entry, match);
+	xnet_cq_report_error(&srx->cq->util_cq, xfer_entry, FI_ECANCELED);
+	xnet_free_xfer(xnet_srx2_progress(srx), xfer_entry);
+	return true;
 }
 
 static ssize_t xnet_srx_cancel(fid_t fid, void *context)
@@ -719,14 +745,8 @@ static ssize_t xnet_srx_cancel(fid_t fid, void *context)
 	srx = container_of(fid, struct xnet_srx, rx_fid.fid);
 
 	ofi_genlock_lock(xnet_srx2_progress(srx)->active_lock);
-	if (xnet_srx_cancel_rx(srx, &srx->tag_queue, context))
-		goto unlock;
-
-	if (xnet_srx_cancel_rx(srx, &srx->rx_queue, context))
-		goto unlock;
-
-	ofi_array_iter(&srx->src_tag_queues, context, xnet_srx_cancel_src);
-unlock:
+	if (!xnet_srx_cancel_tag(srx, context))
+		xnet_srx_cancel_rx(srx, &srx->rx_queue, context);
 	ofi_genlock_unlock(xnet_srx2_progress(srx)->active_lock);
 
 	return 0;
@@ -786,15 +806,19 @@ static void xnet_srx_cleanup(struct xnet_srx *srx, struct slist *queue)
 	}
 }
 
-static int
-xnet_srx_cleanup_arr(struct ofi_dyn_arr *arr, void *list, void *context)
+static bool xnet_srx_cleanup_tag(struct ofi_mq_entry *item, void *arg)
 {
-	struct xnet_srx *srx = context;
-	struct slist *queue = list;
+	struct xnet_srx *srx = arg;
+	struct xnet_xfer_entry *xfer_entry;
 
-	if (!slist_empty(queue))
-		xnet_srx_cleanup(srx, queue);
-	return 0;
+	ofi_mq_remove(&srx->tag_queue, item);
+	xfer_entry = container_of(item, struct xnet_xfer_entry, match);
+	if (srx->cq) {
+		xnet_cq_report_error(&srx->cq->util_cq, xfer_entry,
+				      FI_ECANCELED);
+	}
+	xnet_free_xfer(xnet_srx2_progress(srx), xfer_entry);
+	return false;
 }
 
 static int xnet_srx_close(struct fid *fid)
@@ -805,11 +829,12 @@ static int xnet_srx_close(struct fid *fid)
 
 	ofi_genlock_lock(xnet_srx2_progress(srx)->active_lock);
 	xnet_srx_cleanup(srx, &srx->rx_queue);
-	xnet_srx_cleanup(srx, &srx->tag_queue);
-	ofi_array_iter(&srx->src_tag_queues, srx, xnet_srx_cleanup_arr);
+	(void) ofi_mq_find(&srx->tag_queue, xnet_srx_cleanup_tag, srx);
 	ofi_genlock_unlock(xnet_srx2_progress(srx)->active_lock);
 
-	ofi_array_destroy(&srx->src_tag_queues);
+	ofi_mq_cleanup(&srx->tag_queue);
+	ofi_mq_cleanup(&srx->saved_msgs);
+	ofi_mq_cleanup(&srx->unexp_eps);
 
 	if (srx->cq)
 		ofi_atomic_dec32(&srx->cq->util_cq.ref);
@@ -830,11 +855,25 @@ int xnet_srx_context(struct fid_domain *domain, struct fi_rx_attr *attr,
 		     struct fid_ep **rx_ep, void *context)
 {
 	struct xnet_srx *srx;
+	int ret;
 
 	srx = calloc(1, sizeof(*srx));
 	if (!srx)
 		return -FI_ENOMEM;
 
+	ret = ofi_mq_init(&srx->tag_queue, 0,
+			  (attr->caps & FI_DIRECTED_RECV) ? OFI_MQ_DIRECTED : 0);
+	if (ret)
+		goto free;
+
+	ret = ofi_mq_init(&srx->saved_msgs, 0, OFI_MQ_UNEXP);
+	if (ret)
+		goto cleanup_tag;
+
+	ret = ofi_mq_init(&srx->unexp_eps, 0, OFI_MQ_UNEXP);
+	if (ret)
+		goto cleanup_saved;
+
 	srx->rx_fid.fid.fclass = FI_CLASS_SRX_CTX;
 	srx->rx_fid.fid.context = context;
 	srx->rx_fid.fid.ops = &xnet_srx_fid_ops;
@@ -843,16 +882,20 @@ int xnet_srx_context(struct fid_domain *domain, struct fi_rx_attr *attr,
 	srx->rx_fid.msg = &xnet_srx_msg_ops;
 	srx->rx_fid.tagged = &xnet_srx_tag_ops;
 	slist_init(&srx->rx_queue);
-	slist_init(&srx->tag_queue);
-	ofi_array_init(&srx->src_tag_queues, sizeof(struct slist), NULL);
 
 	srx->domain = container_of(domain, struct xnet_domain,
 				   util_domain.domain_fid);
 	ofi_atomic_inc32(&srx->domain->util_domain.ref);
-	srx->match_tag_rx = (attr->caps & FI_DIRECTED_RECV) ?
-			    xnet_match_tag_addr : xnet_match_tag;
 	srx->op_flags = attr->op_flags & FI_MULTI_RECV;
 	srx->min_multi_recv_size = XNET_MIN_MULTI_RECV;
 	*rx_ep = &srx->rx_fid;
 	return FI_SUCCESS;
+
+cleanup_saved:
+	ofi_mq_cleanup(&srx->saved_msgs);
+cleanup_tag:
+	ofi_mq_cleanup(&srx->tag_queue);
+free:
+	free(srx);
+	return ret;
 }
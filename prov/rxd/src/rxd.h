@@ -60,7 +60,7 @@
 #ifndef _RXD_H_
 #define _RXD_H_
 
-#define RXD_PROTOCOL_VERSION 	(2)
+#define RXD_PROTOCOL_VERSION 	(3)
 
 #define RXD_MAX_MTU_SIZE	4096
 
@@ -76,6 +76,21 @@
 
 #define RXD_PKT_IN_USE		(1 << 0)
 #define RXD_PKT_ACKED		(1 << 1)
+#define RXD_PKT_SACKED		(1 << 2)
+#define RXD_PKT_RETRANS		(1 << 3)
+
+/* Retransmission timeout bounds (us) and fast retransmit trigger */
+#define RXD_INIT_RTO		1000
+#define RXD_MIN_RTO		500
+#define RXD_MAX_RTO		4000000
+#define RXD_DUP_ACK_THRESH	3
+#define RXD_RX_IDLE_TIME	100000	/* us without data before a sender
+					 * stops sharing the rx window */
+
+/* Congestion window (packets) and pacing burst allowance */
+#define RXD_INIT_CWND		16
+#define RXD_MIN_SSTHRESH	2
+#define RXD_TX_BURST		16
 
 #define RXD_REMOTE_CQ_DATA	(1 << 0)
 #define RXD_NO_TX_COMP		(1 << 1)
@@ -84,6 +99,11 @@
 #define RXD_TAG_HDR		(1 << 4)
 #define RXD_INLINE		(1 << 5)
 #define RXD_MULTI_RECV		(1 << 6)
+/* base_hdr only: the sender's window is full, ack without waiting, and
+ * the receiver got a duplicate since its last ack
+ */
+#define RXD_ACK_REQ		(1 << 15)
+#define RXD_ACK_DUP		(1 << 14)
 
 #define RXD_IDX_OFFSET(x)	(x + 1)	
 
@@ -92,6 +112,7 @@ struct rxd_env {
 	int retry;
 	int max_peers;
 	int max_unacked;
+	int drop_rate;
 };
 
 extern struct rxd_env rxd_env;
@@ -132,8 +153,42 @@ struct rxd_peer {
 	uint16_t tx_window;
 	int retry_cnt;
 
+	/* RTT estimate (us), srtt is 0 until the first sample */
+	uint64_t srtt;
+	uint64_t rttvar;
+	uint16_t dup_ack_cnt;
+	uint8_t backoff;
+
+	/* Congestion control: slow start below ssthresh, then AIMD.  No
+	 * further cut until recover_seq is acked, and the cut is undone once
+	 * the receiver has reported a duplicate for every resend of the
+	 * episode (undo_retrans).  Sends are paced at 2 * cwnd per srtt with
+	 * up to RXD_TX_BURST credits.
+	 */
+	uint16_t cwnd;
+	uint16_t ssthresh;
+	uint16_t prior_cwnd;
+	uint16_t prior_ssthresh;
+	uint16_t cwnd_cnt;
+	uint16_t tx_credit;
+	uint64_t credit_time;
+	uint64_t recover_seq;
+	uint64_t undo_seq;
+	uint16_t undo_retrans;
+	uint8_t paced;
+	uint8_t rx_dup;
+	uint64_t rx_dup_seq;
+
+	uint64_t retrans_cnt;
+	uint64_t loss_cnt;
+	uint64_t timeout_cnt;
+	uint64_t undo_cnt;
+
 	uint16_t unacked_cnt;
 	uint8_t active;
+	uint8_t rx_active;
+	uint64_t last_rx;
+	struct dlist_entry rx_entry;
 
 	uint16_t curr_rx_id;
 	uint16_t curr_tx_id;
@@ -144,6 +199,8 @@ struct rxd_peer {
 	struct dlist_entry rma_rx_list;
 	struct dlist_entry unacked;
 	struct dlist_entry buf_pkts;
+	/* out of order packets held for selective ack (retry mode) */
+	struct dlist_entry sack_pkts;
 };
 
 struct rxd_addr {
@@ -193,8 +250,10 @@ struct rxd_ep {
 	size_t rx_prefix_size;
 	size_t min_multi_recv_size;
 	int do_local_mr;
-	int next_retry;
+	int next_retry;		/* ms until the next retransmit check, or -1 */
 	int dg_cq_fd;
+	int active_cnt;		/* peers we send to */
+	int rx_active_cnt;	/* peers sending to us */
 	uint32_t tx_flags;
 	uint32_t rx_flags;
 
@@ -215,10 +274,17 @@ struct rxd_ep {
 	struct dlist_entry rx_list;
 	struct dlist_entry rx_tag_list;
 	struct dlist_entry active_peers;
+	struct dlist_entry rx_peers;	/* oldest rx first */
 	struct dlist_entry rts_sent_list;
 	struct dlist_entry ctrl_pkts;
 
 	struct index_map peers_idm;
+
+	uint64_t rx_seq_pkts;	/* for drop injection */
+	uint64_t retrans_cnt;
+	uint64_t loss_cnt;
+	uint64_t timeout_cnt;
+	uint64_t undo_cnt;
 };
 /* ensure ep lock is held before this function is called */
 static inline struct rxd_peer *rxd_peer(struct rxd_ep *ep, fi_addr_t rxd_addr)
@@ -474,8 +540,18 @@ struct rxd_x_entry *rxd_rx_entry_init(struct rxd_ep *ep,
 			uint32_t op, uint32_t flags);
 void rxd_tx_entry_free(struct rxd_ep *ep, struct rxd_x_entry *tx_entry);
 void rxd_rx_entry_free(struct rxd_ep *ep, struct rxd_x_entry *rx_entry);
-int rxd_get_timeout(int retry_cnt);
-uint64_t rxd_get_retry_time(uint64_t start, int retry_cnt);
+uint64_t rxd_peer_rto(struct rxd_peer *peer);
+void rxd_peer_rtt_sample(struct rxd_peer *peer, uint64_t rtt);
+int rxd_peer_tx_ready(struct rxd_peer *peer);
+void rxd_peer_cwnd_ack(struct rxd_peer *peer, int acked);
+void rxd_peer_cwnd_loss(struct rxd_ep *ep, struct rxd_peer *peer, int timeout);
+void rxd_peer_cwnd_undo(struct rxd_ep *ep, struct rxd_peer *peer,
+			uint64_t seq);
+
+static inline int rxd_peer_in_recovery(struct rxd_peer *peer)
+{
+	return ofi_before(peer->last_rx_ack, peer->recover_seq);
+}
 
 /* Generic message functions */
 ssize_t rxd_ep_generic_recvmsg(struct rxd_ep *rxd_ep, const struct iovec *iov,
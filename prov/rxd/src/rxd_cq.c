@@ -165,6 +165,42 @@ static int rxd_comp_pkt_seq_no(struct dlist_entry *item, const void *arg)
 	return new_hdr->seq_no > list_hdr->seq_no;
 }
 
+/*
+ * With retries enabled, hold a packet that arrived ahead of a gap instead
+ * of dropping it, so that the ACK can report it and the sender only has to
+ * resend the gap.  Held packets are replayed in order once the gap fills.
+ */
+static int rxd_sack_hold(struct rxd_peer *peer, struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_pkt_entry *held;
+	uint64_t seq = rxd_get_base_hdr(pkt_entry)->seq_no;
+
+	if (!ofi_before(peer->rx_seq_no, seq)) {
+		peer->rx_dup = 1;
+		peer->rx_dup_seq = seq;
+		return 0;
+	}
+	if (seq - peer->rx_seq_no > RXD_SACK_BITS)
+		return 0;
+
+	dlist_foreach_container(&peer->sack_pkts, struct rxd_pkt_entry,
+				held, d_entry) {
+		if (rxd_get_base_hdr(held)->seq_no == seq) {
+			peer->rx_dup = 1;
+			peer->rx_dup_seq = seq;
+			return 0;
+		}
+		if (ofi_before(seq, rxd_get_base_hdr(held)->seq_no)) {
+			dlist_insert_before(&pkt_entry->d_entry,
+					    &held->d_entry);
+			return 1;
+		}
+	}
+
+	dlist_insert_tail(&pkt_entry->d_entry, &peer->sack_pkts);
+	return 1;
+}
+
 void rxd_ep_recv_data(struct rxd_ep *ep, struct rxd_x_entry *x_entry,
 		      struct rxd_data_pkt *pkt, size_t size)
 {
@@ -190,7 +226,8 @@ void rxd_ep_recv_data(struct rxd_ep *ep, struct rxd_x_entry *x_entry,
 	x_entry->next_seg_no++;
 
 	if (x_entry->next_seg_no < x_entry->num_segs) {
-		if (!(rxd_peer(ep, pkt->base_hdr.peer)->rx_seq_no %
+		if (pkt->base_hdr.flags & RXD_ACK_REQ ||
+		    !(rxd_peer(ep, pkt->base_hdr.peer)->rx_seq_no %
 		    rxd_peer(ep, pkt->base_hdr.peer)->rx_window))
 			rxd_ep_send_ack(ep, pkt->base_hdr.peer);
 		return;
@@ -234,6 +271,7 @@ static void rxd_verify_active(struct rxd_ep *ep, fi_addr_t addr, fi_addr_t peer_
 				  &ep->active_peers);
 		rxd_peer(ep, addr)->retry_cnt = 0;
 		rxd_peer(ep, addr)->active = 1;
+		ep->active_cnt++;
 	}
 }
 
@@ -241,8 +279,7 @@ int rxd_start_xfer(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 {
 	struct rxd_base_hdr *hdr = rxd_get_base_hdr(tx_entry->pkt);
 
-	if (rxd_peer(ep, tx_entry->peer)->unacked_cnt >=
-	    rxd_peer(ep, tx_entry->peer)->tx_window)
+	if (!rxd_peer_tx_ready(rxd_peer(ep, tx_entry->peer)))
 		return 0;
 
 	tx_entry->start_seq = rxd_set_pkt_seq(rxd_peer(ep, tx_entry->peer),
@@ -264,7 +301,8 @@ int rxd_start_xfer(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 	}
 
 	return rxd_peer(ep, tx_entry->peer)->unacked_cnt <
-	       rxd_peer(ep,tx_entry->peer)->tx_window;
+	       MIN(rxd_peer(ep, tx_entry->peer)->tx_window,
+		   rxd_peer(ep, tx_entry->peer)->cwnd);
 }
 
 void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
@@ -284,6 +322,7 @@ void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
 	if (peer->peer_addr == RXD_ADDR_INVALID)
 		return;
 
+	peer->paced = 0;
 	dlist_foreach_container_safe(&peer->tx_list, struct rxd_x_entry,
 				tx_entry, entry, tmp_entry) {
 		if (tx_entry->pkt) {
@@ -305,9 +344,11 @@ void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
 			continue;
 		}
 
+		inc = 0;
 		if (tx_entry->op == RXD_DATA_READ && !tx_entry->bytes_done) {
 			if (rxd_peer(ep, tx_entry->peer)->unacked_cnt >=
-		    	    rxd_peer(ep, tx_entry->peer)->tx_window) {
+			    MIN(rxd_peer(ep, tx_entry->peer)->tx_window,
+				rxd_peer(ep, tx_entry->peer)->cwnd)) {
 				break;
 			}
 			tx_entry->start_seq = rxd_peer(ep,tx_entry->peer)->tx_seq_no;
@@ -317,12 +358,12 @@ void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
 		}
 
 		ret = rxd_ep_post_data_pkts(ep, tx_entry);
-		if (ret) {
-			if (ret == -FI_ENOMEM && inc)
-				rxd_peer(ep, tx_entry->peer)->tx_seq_no -=
-							  tx_entry->num_segs;
+		/* return the range if pacing or ENOMEM stopped the first packet */
+		if (inc && !tx_entry->bytes_done)
+			rxd_peer(ep, tx_entry->peer)->tx_seq_no -=
+						  tx_entry->num_segs;
+		if (ret)
 			break;
-		}
 	}
 
 	if (dlist_empty(&peer->tx_list))
@@ -966,6 +1007,7 @@ static void rxd_handle_data(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 	struct rxd_data_pkt *pkt = (struct rxd_data_pkt *) (pkt_entry->pkt);
 	struct rxd_x_entry *x_entry;
 	struct rxd_unexp_msg *unexp_msg;
+	int held;
 
 	if (pkt_entry->pkt_size < sizeof(*pkt) + ep->rx_prefix_size) {
 		FI_WARN(&rxd_prov, FI_LOG_CQ,
@@ -983,6 +1025,8 @@ static void rxd_handle_data(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 			if (pkt->ext_hdr.seg_no + 1 == unexp_msg->sar_hdr->num_segs - 1) {
 				rxd_peer(ep, pkt->base_hdr.peer)->curr_unexp = NULL;
 				rxd_ep_send_ack(ep, pkt->base_hdr.peer);
+			} else if (pkt->base_hdr.flags & RXD_ACK_REQ) {
+				rxd_ep_send_ack(ep, pkt->base_hdr.peer);
 			}
 			return;
 		}
@@ -998,7 +1042,11 @@ static void rxd_handle_data(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 		return;
 	} else if (rxd_peer(ep, pkt->base_hdr.peer)->peer_addr !=
 		   RXD_ADDR_INVALID) {
+		held = rxd_sack_hold(rxd_peer(ep, pkt->base_hdr.peer),
+				     pkt_entry);
 		rxd_ep_send_ack(ep, pkt->base_hdr.peer);
+		if (held)
+			return;
 	}
 free:
 	ofi_buf_free(pkt_entry);
@@ -1024,9 +1072,12 @@ static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 			return;
 		}
 
-		if (rxd_peer(ep, base_hdr->peer)->peer_addr != RXD_ADDR_INVALID)
+		if (rxd_peer(ep, base_hdr->peer)->peer_addr == RXD_ADDR_INVALID)
+			goto release;
+		if (!rxd_sack_hold(rxd_peer(ep, base_hdr->peer), pkt_entry))
 			goto ack;
-		goto release;
+		rxd_ep_send_ack(ep, base_hdr->peer);
+		return;
 	}
 
 	if (rxd_peer(ep, base_hdr->peer)->peer_addr == RXD_ADDR_INVALID)
@@ -1082,19 +1133,99 @@ static void rxd_handle_cts(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 	rxd_update_peer(ep, cts->rts_addr, cts->cts_addr);
 }
 
+/* Flag the unacked packets the receiver reports holding.  SACK is only
+ * advisory: a held packet may still be dropped, so packets stay on the
+ * unacked list until cumulatively acked and every ACK resets the flags.
+ */
+static void rxd_update_sacked(struct rxd_peer *peer, struct rxd_ack_pkt *ack)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	uint64_t off;
+
+	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		off = rxd_get_base_hdr(pkt_entry)->seq_no -
+		      ack->base_hdr.seq_no - 1;
+		if (off < RXD_SACK_BITS && (ack->sack & (1ULL << off)))
+			pkt_entry->flags |= RXD_PKT_SACKED;
+		else
+			pkt_entry->flags &= ~RXD_PKT_SACKED;
+	}
+}
+
+static int rxd_sack_cnt(uint64_t sack)
+{
+	int cnt;
+
+	for (cnt = 0; sack; cnt++)
+		sack &= sack - 1;
+	return cnt;
+}
+
+/*
+ * SACK loss recovery as in RFC 6675: an unacked packet is deemed lost once
+ * RXD_DUP_ACK_THRESH later packets are reported held, or, for the first
+ * unacked packet, on the RXD_DUP_ACK_THRESH'th duplicate ACK.  Each is
+ * resent once here; the retransmission timer covers resends lost again.
+ */
+static void rxd_sack_recover(struct rxd_ep *ep, struct rxd_peer *peer,
+			     struct rxd_ack_pkt *ack, int dup_thresh)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	uint64_t off;
+
+	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		if (pkt_entry->flags & (RXD_PKT_IN_USE | RXD_PKT_ACKED |
+					RXD_PKT_SACKED | RXD_PKT_RETRANS))
+			continue;
+
+		off = rxd_get_base_hdr(pkt_entry)->seq_no -
+		      ack->base_hdr.seq_no;
+		if (off >= RXD_SACK_BITS)
+			continue;
+		if (!(off == 0 && dup_thresh) &&
+		    rxd_sack_cnt(ack->sack >> off) < RXD_DUP_ACK_THRESH)
+			continue;
+
+		rxd_peer_cwnd_loss(ep, peer, 0);
+		rxd_get_base_hdr(pkt_entry)->flags |= RXD_ACK_REQ;
+		pkt_entry->flags |= RXD_PKT_RETRANS;
+		if (rxd_ep_send_pkt(ep, pkt_entry))
+			break;
+		peer->retrans_cnt++;
+		peer->undo_retrans++;
+		ep->retrans_cnt++;
+	}
+}
+
 static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 {
 	struct rxd_ack_pkt *ack = (struct rxd_ack_pkt *) (ack_entry->pkt);
 	struct rxd_pkt_entry *pkt_entry;
 	fi_addr_t peer = ack->base_hdr.peer;
 	struct rxd_base_hdr *hdr;
+	uint64_t sent = 0;
+	int retrans = 0, acked = 0;
 
 	rxd_peer(ep, peer)->tx_window = (uint16_t) ack->ext_hdr.rx_id;
+	if (ack->base_hdr.flags & RXD_ACK_DUP)
+		rxd_peer_cwnd_undo(ep, rxd_peer(ep, peer),
+				   ack->ext_hdr.seg_no);
 
-	if (rxd_peer(ep, peer)->last_rx_ack == ack->base_hdr.seq_no)
+	if (rxd_peer(ep, peer)->last_rx_ack == ack->base_hdr.seq_no) {
+		if (dlist_empty(&(rxd_peer(ep, peer)->unacked)))
+			return;
+
+		rxd_update_sacked(rxd_peer(ep, peer), ack);
+		rxd_sack_recover(ep, rxd_peer(ep, peer), ack,
+				 ++rxd_peer(ep, peer)->dup_ack_cnt ==
+				 RXD_DUP_ACK_THRESH);
 		return;
+	}
 
 	rxd_peer(ep, peer)->last_rx_ack = ack->base_hdr.seq_no;
+	rxd_peer(ep, peer)->dup_ack_cnt = 0;
 
 	if (dlist_empty(&(rxd_peer(ep, peer)->unacked)))
 		return;
@@ -1109,6 +1240,10 @@ static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 		if (ofi_after_eq(hdr->seq_no, ack->base_hdr.seq_no))
 			break;
 
+		retrans |= pkt_entry->flags & RXD_PKT_RETRANS;
+		sent = MAX(sent, pkt_entry->timestamp);
+		acked++;
+
 		if (pkt_entry->flags & RXD_PKT_IN_USE) {
 			pkt_entry->flags |= RXD_PKT_ACKED;
 			pkt_entry = container_of((&pkt_entry->d_entry)->next,
@@ -1123,6 +1258,20 @@ static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 					struct rxd_pkt_entry, d_entry);
 	}
 
+	/* Time the ACK against the newest packet it covers, which it cannot
+	 * have preceded, and skip it if any of them was resent (Karn).
+	 */
+	if (sent && !retrans)
+		rxd_peer_rtt_sample(rxd_peer(ep, peer),
+				    ofi_gettime_us() - sent);
+	else if (acked && rxd_peer(ep, peer)->srtt)
+		rxd_peer(ep, peer)->backoff = 0;
+	if (acked)
+		rxd_peer_cwnd_ack(rxd_peer(ep, peer), acked);
+
+	rxd_update_sacked(rxd_peer(ep, peer), ack);
+	if (ack->sack)
+		rxd_sack_recover(ep, rxd_peer(ep, peer), ack, 0);
 	rxd_progress_tx_list(ep, rxd_peer(ep, ack->base_hdr.peer));
 }
 
@@ -1153,10 +1302,50 @@ void rxd_handle_send_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 	}
 }
 
+/* Replay held packets through the normal handlers once they are in order */
+static void rxd_progress_sack_pkts(struct rxd_ep *ep, struct rxd_peer *peer)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	uint64_t seq;
+
+	while (!dlist_empty(&peer->sack_pkts)) {
+		pkt_entry = container_of(peer->sack_pkts.next,
+					 struct rxd_pkt_entry, d_entry);
+		seq = rxd_get_base_hdr(pkt_entry)->seq_no;
+		if (ofi_before(peer->rx_seq_no, seq))
+			return;
+
+		dlist_remove(&pkt_entry->d_entry);
+		if (seq != peer->rx_seq_no) {
+			ofi_buf_free(pkt_entry);
+			continue;
+		}
+
+		if (rxd_pkt_type(pkt_entry) == RXD_DATA ||
+		    rxd_pkt_type(pkt_entry) == RXD_DATA_READ)
+			rxd_handle_data(ep, pkt_entry);
+		else
+			rxd_handle_op(ep, pkt_entry);
+	}
+}
+
+static void rxd_peer_rx_touch(struct rxd_ep *ep, struct rxd_peer *peer)
+{
+	peer->last_rx = ofi_gettime_us();
+	if (peer->rx_active) {
+		dlist_remove(&peer->rx_entry);
+	} else {
+		peer->rx_active = 1;
+		ep->rx_active_cnt++;
+	}
+	dlist_insert_tail(&peer->rx_entry, &ep->rx_peers);
+}
+
 void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 {
 	struct rxd_pkt_entry *pkt_entry =
 		container_of(comp->op_context, struct rxd_pkt_entry, context);
+	struct rxd_peer *peer;
 
 	FI_DBG(&rxd_prov, FI_LOG_EP_DATA,
 	       "got recv completion (type: %s)\n",
@@ -1166,6 +1355,16 @@ void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 	rxd_remove_rx_pkt(ep, pkt_entry);
 
 	pkt_entry->pkt_size = comp->len;
+	if (rxd_env.drop_rate && rxd_pkt_type(pkt_entry) != RXD_RTS &&
+	    rxd_pkt_type(pkt_entry) != RXD_CTS &&
+	    rxd_pkt_type(pkt_entry) != RXD_ACK &&
+	    !(++ep->rx_seq_pkts % rxd_env.drop_rate)) {
+		FI_DBG(&rxd_prov, FI_LOG_EP_DATA, "dropping packet %" PRIu64
+		       "\n", rxd_get_base_hdr(pkt_entry)->seq_no);
+		ofi_buf_free(pkt_entry);
+		return;
+	}
+
 	switch (rxd_pkt_type(pkt_entry)) {
 	case RXD_RTS:
 		rxd_handle_rts(ep, pkt_entry);
@@ -1178,18 +1377,26 @@ void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 		break;
 	case RXD_DATA:
 	case RXD_DATA_READ:
+		peer = rxd_peer(ep, rxd_get_base_hdr(pkt_entry)->peer);
+		rxd_peer_rx_touch(ep, peer);
 		rxd_handle_data(ep, pkt_entry);
 		/* don't need to perform action below:
 		 * - release/repost RX packet */
-		return;
+		goto sack;
 	default:
+		peer = rxd_peer(ep, rxd_get_base_hdr(pkt_entry)->peer);
+		rxd_peer_rx_touch(ep, peer);
 		rxd_handle_op(ep, pkt_entry);
 		/* don't need to perform action below:
 		 * - release/repost RX packet */
-		return;
+		goto sack;
 	}
 
 	ofi_buf_free(pkt_entry);
+	return;
+sack:
+	if (peer && !dlist_empty(&peer->sack_pkts))
+		rxd_progress_sack_pkts(ep, peer);
 }
 
 void rxd_handle_error(struct rxd_ep *ep)
@@ -1270,7 +1477,7 @@ ssize_t rxd_cq_sreadfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 		ofi_mutex_unlock(&cq->ep_list_lock);
 
 		ret = fi_wait(&cq->wait->wait_fid, ep_retry == -1 ?
-			      timeout : rxd_get_timeout(ep_retry));
+			      timeout : ep_retry);
 
 		if (ep_retry != -1 && ret == -FI_ETIMEDOUT)
 			ret = 0;
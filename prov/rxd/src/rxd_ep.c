@@ -273,16 +273,135 @@ static int rxd_ep_enable(struct rxd_ep *ep)
 }
 
 /*
- * Exponential back-off starting at 1ms, max 4s.
+ * Retransmission timeout (us) from the peer's smoothed RTT as in RFC 6298,
+ * 1ms until the first sample, with exponential back-off up to 4s.  Until
+ * the first valid sample the back-off is kept across acks (Karn),
+ * otherwise an initial RTO below the RTT resends everything and never
+ * gets one.  After that, any ack that makes progress clears it.
  */
-int rxd_get_timeout(int retry_cnt)
+uint64_t rxd_peer_rto(struct rxd_peer *peer)
 {
-	return MIN(1 << retry_cnt, 4000);
+	uint64_t rto;
+
+	rto = peer->srtt ? MAX(peer->srtt + 4 * peer->rttvar, RXD_MIN_RTO) :
+	      RXD_INIT_RTO;
+	return MIN(rto << peer->backoff, RXD_MAX_RTO);
+}
+
+void rxd_peer_rtt_sample(struct rxd_peer *peer, uint64_t rtt)
+{
+	uint64_t delta;
+
+	peer->backoff = 0;
+
+	if (!peer->srtt) {
+		peer->srtt = MAX(rtt, 1);
+		peer->rttvar = rtt / 2;
+		return;
+	}
+
+	delta = rtt > peer->srtt ? rtt - peer->srtt : peer->srtt - rtt;
+	peer->rttvar = (3 * peer->rttvar + delta) / 4;
+	peer->srtt = MAX((7 * peer->srtt + rtt) / 8, 1);
 }
 
-uint64_t rxd_get_retry_time(uint64_t start, int retry_cnt)
+/*
+ * Window and pacing check before sending a new packet; consumes a credit.
+ * Once paced, nothing is sent until rxd_progress_tx_list() clears the flag
+ * so that packets keep their sequence order on the unacked list.
+ */
+int rxd_peer_tx_ready(struct rxd_peer *peer)
 {
-	return start + rxd_get_timeout(retry_cnt);
+	uint64_t now, credit;
+
+	if (peer->paced ||
+	    peer->unacked_cnt >= MIN(peer->tx_window, peer->cwnd))
+		return 0;
+
+	if (!rxd_env.retry || !peer->srtt)
+		return 1;
+
+	if (!peer->tx_credit) {
+		now = ofi_gettime_us();
+		credit = (now - peer->credit_time) * 2 * peer->cwnd / peer->srtt;
+		if (!credit) {
+			peer->paced = 1;
+			return 0;
+		}
+		peer->tx_credit = (uint16_t) MIN(credit, RXD_TX_BURST);
+		peer->credit_time = now;
+	}
+	peer->tx_credit--;
+	return 1;
+}
+
+void rxd_peer_cwnd_ack(struct rxd_peer *peer, int acked)
+{
+	if (peer->cwnd < peer->ssthresh) {
+		peer->cwnd += acked;
+	} else {
+		peer->cwnd_cnt += acked;
+		if (peer->cwnd_cnt >= peer->cwnd) {
+			peer->cwnd_cnt -= peer->cwnd;
+			peer->cwnd++;
+		}
+	}
+	peer->cwnd = MIN(peer->cwnd, (uint16_t) rxd_env.max_unacked);
+}
+
+/*
+ * Halve the window once per loss episode, and restart from one packet if
+ * the resend times out as well.  A timeout while recovering with acks
+ * still arriving (retry_cnt reset) continues the episode.  Timeouts before
+ * the first RTT sample only show that the initial guess was short.
+ */
+void rxd_peer_cwnd_loss(struct rxd_ep *ep, struct rxd_peer *peer, int timeout)
+{
+	if ((timeout && !peer->srtt) ||
+	    (rxd_peer_in_recovery(peer) && (!timeout || !peer->retry_cnt)))
+		return;
+
+	if (!rxd_peer_in_recovery(peer)) {
+		peer->prior_cwnd = peer->cwnd;
+		peer->prior_ssthresh = peer->ssthresh;
+		peer->undo_seq = peer->last_rx_ack;
+		peer->undo_retrans = 0;
+		peer->ssthresh = MAX(peer->cwnd / 2, RXD_MIN_SSTHRESH);
+		peer->loss_cnt++;
+		ep->loss_cnt++;
+	}
+	if (timeout) {
+		peer->timeout_cnt++;
+		ep->timeout_cnt++;
+	}
+	peer->cwnd = timeout && peer->retry_cnt ? 1 : peer->ssthresh;
+	peer->cwnd_cnt = 0;
+	peer->recover_seq = peer->tx_seq_no;
+
+	FI_DBG(&rxd_prov, FI_LOG_EP_DATA,
+	       "%s at seq %" PRIu64 ", cwnd %d ssthresh %d\n",
+	       timeout ? "timeout" : "loss", peer->last_rx_ack,
+	       peer->cwnd, peer->ssthresh);
+}
+
+/*
+ * The receiver got both the original and a resend of seq.  Once that holds
+ * for every resend of the current episode, the cut was spurious.  A
+ * duplicate from an older episode says nothing about this one.
+ */
+void rxd_peer_cwnd_undo(struct rxd_ep *ep, struct rxd_peer *peer,
+			uint64_t seq)
+{
+	if (!peer->prior_cwnd || ofi_before(seq, peer->undo_seq) ||
+	    !ofi_before(seq, peer->recover_seq) || !peer->undo_retrans ||
+	    --peer->undo_retrans)
+		return;
+
+	peer->cwnd = MAX(peer->cwnd, peer->prior_cwnd);
+	peer->ssthresh = MAX(peer->ssthresh, peer->prior_ssthresh);
+	peer->prior_cwnd = 0;
+	peer->undo_cnt++;
+	ep->undo_cnt++;
 }
 
 void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
@@ -385,8 +504,7 @@ ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 	struct rxd_data_pkt *data;
 
 	while (tx_entry->bytes_done != tx_entry->cq_entry.len) {
-		if (rxd_peer(ep, tx_entry->peer)->unacked_cnt >=
-		    rxd_peer(ep, tx_entry->peer)->tx_window)
+		if (!rxd_peer_tx_ready(rxd_peer(ep, tx_entry->peer)))
 			return 0;
 
 		pkt_entry = rxd_get_tx_pkt(ep);
@@ -400,20 +518,25 @@ ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 				        data->ext_hdr.seg_no;
 		if (data->base_hdr.type != RXD_DATA_READ)
 			data->base_hdr.seq_no++;
+		if (rxd_peer(ep, tx_entry->peer)->unacked_cnt + 1 >=
+		    MIN(rxd_peer(ep, tx_entry->peer)->tx_window,
+			rxd_peer(ep, tx_entry->peer)->cwnd))
+			data->base_hdr.flags |= RXD_ACK_REQ;
 
 		rxd_ep_send_pkt(ep, pkt_entry);
 		rxd_insert_unacked(ep, tx_entry->peer, pkt_entry);
 	}
 
 	return rxd_peer(ep, tx_entry->peer)->unacked_cnt >=
-	       rxd_peer(ep, tx_entry->peer)->tx_window;
+	       MIN(rxd_peer(ep, tx_entry->peer)->tx_window,
+		   rxd_peer(ep, tx_entry->peer)->cwnd);
 }
 
 ssize_t rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 {
 	ssize_t ret;
 	fi_addr_t dg_addr;
-	pkt_entry->timestamp = ofi_gettime_ms();
+	pkt_entry->timestamp = ofi_gettime_us();
 
 	dg_addr = (intptr_t) ofi_idx_lookup(&(rxd_ep_av(ep)->rxdaddr_dg_idx),
 					    (int)pkt_entry->peer);
@@ -557,6 +680,55 @@ size_t rxd_init_msg(void **ptr, const struct iovec *iov, size_t iov_count,
 	return done;
 }
 
+static uint64_t rxd_peer_sack(struct rxd_peer *peer)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	uint64_t sack = 0, seq;
+
+	dlist_foreach_container(&peer->sack_pkts, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		seq = rxd_get_base_hdr(pkt_entry)->seq_no;
+		if (ofi_before(peer->rx_seq_no, seq))
+			sack |= 1ULL << (seq - peer->rx_seq_no - 1);
+	}
+	return sack;
+}
+
+static void rxd_ep_expire_rx_peers(struct rxd_ep *ep)
+{
+	struct rxd_peer *peer;
+	uint64_t current;
+
+	current = ofi_gettime_us();
+	while (!dlist_empty(&ep->rx_peers)) {
+		peer = container_of(ep->rx_peers.next, struct rxd_peer,
+				    rx_entry);
+		if (current < peer->last_rx + RXD_RX_IDLE_TIME)
+			break;
+		dlist_remove_init(&peer->rx_entry);
+		peer->rx_active = 0;
+		ep->rx_active_cnt--;
+	}
+}
+
+/* Split the posted receive buffers between the peers that have sent to
+ * us recently so an incast cannot overrun them.
+ */
+static uint16_t rxd_ep_rx_window(struct rxd_ep *ep, struct rxd_peer *peer)
+{
+	size_t share;
+
+	if (!peer->rx_window || ep->rx_active_cnt <= 1)
+		return peer->rx_window;
+
+	rxd_ep_expire_rx_peers(ep);
+	if (ep->rx_active_cnt <= 1)
+		return peer->rx_window;
+
+	share = MAX(ep->rx_size / ep->rx_active_cnt, 1);
+	return (uint16_t) MIN(peer->rx_window, share);
+}
+
 void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
 {
 	struct rxd_pkt_entry *pkt_entry;
@@ -574,9 +746,13 @@ void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
 
 	ack->base_hdr.version = RXD_PROTOCOL_VERSION;
 	ack->base_hdr.type = RXD_ACK;
+	ack->base_hdr.flags = rxd_peer(rxd_ep, peer)->rx_dup ? RXD_ACK_DUP : 0;
+	ack->ext_hdr.seg_no = rxd_peer(rxd_ep, peer)->rx_dup_seq;
+	rxd_peer(rxd_ep, peer)->rx_dup = 0;
 	ack->base_hdr.peer = (uint32_t) rxd_peer(rxd_ep, peer)->peer_addr;
 	ack->base_hdr.seq_no = rxd_peer(rxd_ep, peer)->rx_seq_no;
-	ack->ext_hdr.rx_id = rxd_peer(rxd_ep, peer)->rx_window;
+	ack->ext_hdr.rx_id = rxd_ep_rx_window(rxd_ep, rxd_peer(rxd_ep, peer));
+	ack->sack = rxd_peer_sack(rxd_peer(rxd_ep, peer));
 	rxd_peer(rxd_ep, peer)->last_tx_ack = ack->base_hdr.seq_no;
 
 	dlist_insert_tail(&pkt_entry->d_entry, &rxd_ep->ctrl_pkts);
@@ -611,6 +787,12 @@ static void rxd_close_peer(struct rxd_ep *ep, struct rxd_peer *peer)
 		peer->unacked_cnt--;
 	}
 
+	while (!dlist_empty(&peer->sack_pkts)) {
+		dlist_pop_front(&peer->sack_pkts, struct rxd_pkt_entry,
+				pkt_entry, d_entry);
+		ofi_buf_free(pkt_entry);
+	}
+
 	while (!dlist_empty(&peer->tx_list)) {
 		dlist_pop_front(&peer->tx_list, struct rxd_x_entry,
 				x_entry, entry);
@@ -630,7 +812,15 @@ static void rxd_close_peer(struct rxd_ep *ep, struct rxd_peer *peer)
 	}
 
 	dlist_remove(&peer->entry);
+	if (peer->active)
+		ep->active_cnt--;
 	peer->active = 0;
+
+	if (peer->rx_active) {
+		dlist_remove_init(&peer->rx_entry);
+		ep->rx_active_cnt--;
+		peer->rx_active = 0;
+	}
 }
 
 void rxd_cleanup_unexp_msg(struct rxd_unexp_msg *unexp_msg)
@@ -666,8 +856,20 @@ static int rxd_ep_close(struct fid *fid)
 
 	ep = container_of(fid, struct rxd_ep, util_ep.ep_fid.fid);
 
-	dlist_foreach_container(&ep->active_peers, struct rxd_peer, peer, entry)
+	FI_INFO(&rxd_prov, FI_LOG_EP_CTRL, "congestion stats: "
+		"retransmits %" PRIu64 ", losses %" PRIu64 ", timeouts %" PRIu64
+		", undone %" PRIu64 "\n", ep->retrans_cnt, ep->loss_cnt,
+		ep->timeout_cnt, ep->undo_cnt);
+
+	dlist_foreach_container(&ep->active_peers, struct rxd_peer, peer, entry) {
+		FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "peer %" PRIu64 ": cwnd %d "
+		       "ssthresh %d srtt %" PRIu64 "us retransmits %" PRIu64
+		       " losses %" PRIu64 " timeouts %" PRIu64 " undone %"
+		       PRIu64 "\n", peer->peer_addr, peer->cwnd,
+		       peer->ssthresh, peer->srtt, peer->retrans_cnt,
+		       peer->loss_cnt, peer->timeout_cnt, peer->undo_cnt);
 		rxd_close_peer(ep, peer);
+	}
 	dlist_foreach_container(&ep->rts_sent_list, struct rxd_peer, peer, entry)
 		rxd_close_peer(ep, peer);
 	ofi_idm_reset(&(ep->peers_idm), free);
@@ -912,38 +1114,70 @@ static void rxd_peer_timeout(struct rxd_ep *rxd_ep, struct rxd_peer *peer)
 	}
 
 	dlist_remove(&peer->entry);
+	if (peer->active) {
+		rxd_ep->active_cnt--;
+		peer->active = 0;
+	}
 }
 
 static void rxd_progress_pkt_list(struct rxd_ep *ep, struct rxd_peer *peer)
 {
 	struct rxd_pkt_entry *pkt_entry;
-	uint64_t current;
+	uint64_t current, rto;
 	ssize_t ret;
-	int retry = 0;
+	int retry = 0, inflight = 0, timeout;
 
-	current = ofi_gettime_ms();
+	current = ofi_gettime_us();
 	if (peer->retry_cnt > RXD_MAX_PKT_RETRY) {
 		rxd_peer_timeout(ep, peer);
 		return;
 	}
 
+	/* Resends are limited to cwnd packets in flight.  Earlier resends
+	 * sit out of timestamp order, so skip over them to the expired
+	 * packets behind.  It only counts as a timeout if none of them is
+	 * still outstanding.
+	 */
+	rto = rxd_peer_rto(peer);
 	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
 				pkt_entry, d_entry) {
-		if (pkt_entry->flags & (RXD_PKT_IN_USE | RXD_PKT_ACKED) ||
-		    current < rxd_get_retry_time(pkt_entry->timestamp,
-						 (uint8_t) peer->retry_cnt))
+		if (pkt_entry->flags & (RXD_PKT_IN_USE | RXD_PKT_ACKED))
 			break;
-		retry = 1;
+		/* the receiver holds it, only the gaps need resending */
+		if (pkt_entry->flags & RXD_PKT_SACKED)
+			continue;
+		if (current < pkt_entry->timestamp + rto) {
+			if (!(pkt_entry->flags & RXD_PKT_RETRANS))
+				break;
+			inflight++;
+			continue;
+		}
+		if (!inflight && !retry) {
+			rxd_peer_cwnd_loss(ep, peer, 1);
+			retry = 1;
+		}
+		if (inflight >= peer->cwnd)
+			break;
+		rxd_get_base_hdr(pkt_entry)->flags |= RXD_ACK_REQ;
+		pkt_entry->flags |= RXD_PKT_RETRANS;
 		ret = rxd_ep_send_pkt(ep, pkt_entry);
 		if (ret)
 			break;
+		inflight++;
+		peer->retrans_cnt++;
+		peer->undo_retrans++;
+		ep->retrans_cnt++;
 	}
-	if (retry)
+	if (retry) {
 		peer->retry_cnt++;
+		peer->backoff = MIN(peer->backoff + 1, 12);
+	}
 
-	if (!dlist_empty(&peer->unacked))
-		ep->next_retry = ep->next_retry == -1 ? peer->retry_cnt :
-				 MIN(ep->next_retry, peer->retry_cnt);
+	if (!dlist_empty(&peer->unacked)) {
+		timeout = (int) ofi_div_ceil(rxd_peer_rto(peer), 1000);
+		ep->next_retry = ep->next_retry == -1 ? timeout :
+				 MIN(ep->next_retry, timeout);
+	}
 }
 
 void rxd_ep_progress(struct util_ep *util_ep)
@@ -987,8 +1221,10 @@ void rxd_ep_progress(struct util_ep *util_ep)
 	dlist_foreach_container_safe(&ep->active_peers, struct rxd_peer,
 				     peer, entry, tmp) {
 		rxd_progress_pkt_list(ep, peer);
-		if (dlist_empty(&peer->unacked))
+		if (dlist_empty(&peer->unacked) || peer->paced)
 			rxd_progress_tx_list(ep, peer);
+		if (peer->paced)
+			ep->next_retry = 1;
 	}
 
 out:
@@ -1133,6 +1369,7 @@ int rxd_ep_init_res(struct rxd_ep *ep, struct fi_info *fi_info)
 	dlist_init(&ep->rx_list);
 	dlist_init(&ep->rx_tag_list);
 	dlist_init(&ep->active_peers);
+	dlist_init(&ep->rx_peers);
 	dlist_init(&ep->rts_sent_list);
 	dlist_init(&ep->unexp_list);
 	dlist_init(&ep->unexp_tag_list);
@@ -1164,12 +1401,37 @@ int rxd_create_peer(struct rxd_ep *ep, uint64_t rxd_addr)
 	peer->tx_window = (uint16_t) rxd_env.max_unacked;
 	peer->unacked_cnt = 0;
 	peer->retry_cnt = 0;
+	peer->srtt = 0;
+	peer->rttvar = 0;
+	peer->dup_ack_cnt = 0;
+	peer->backoff = 0;
+	peer->cwnd = (uint16_t) MIN(RXD_INIT_CWND, rxd_env.max_unacked);
+	peer->ssthresh = (uint16_t) rxd_env.max_unacked;
+	peer->prior_cwnd = 0;
+	peer->prior_ssthresh = 0;
+	peer->cwnd_cnt = 0;
+	peer->tx_credit = RXD_TX_BURST;
+	peer->credit_time = 0;
+	peer->recover_seq = 0;
+	peer->paced = 0;
+	peer->rx_dup = 0;
+	peer->rx_dup_seq = 0;
+	peer->undo_seq = 0;
+	peer->undo_retrans = 0;
+	peer->retrans_cnt = 0;
+	peer->loss_cnt = 0;
+	peer->timeout_cnt = 0;
+	peer->undo_cnt = 0;
 	peer->active = 0;
+	peer->rx_active = 0;
+	peer->last_rx = 0;
+	dlist_init(&(peer->rx_entry));
 	dlist_init(&(peer->unacked));
 	dlist_init(&(peer->tx_list));
 	dlist_init(&(peer->rx_list));
 	dlist_init(&(peer->rma_rx_list));
 	dlist_init(&(peer->buf_pkts));
+	dlist_init(&(peer->sack_pkts));
 
 	if (ofi_idm_set(&(ep->peers_idm), (int) rxd_addr, peer) < 0)
 		goto err;
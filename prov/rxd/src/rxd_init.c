@@ -43,6 +43,7 @@ struct rxd_env rxd_env = {
 	.retry		= 1,
 	.max_peers	= 1024,
 	.max_unacked	= 128,
+	.drop_rate	= 0,
 };
 
 char *rxd_pkt_type_str[] = {
@@ -55,6 +56,7 @@ static void rxd_init_env(void)
 	fi_param_get_bool(&rxd_prov, "retry", &rxd_env.retry);
 	fi_param_get_int(&rxd_prov, "max_peers", &rxd_env.max_peers);
 	fi_param_get_int(&rxd_prov, "max_unacked", &rxd_env.max_unacked);
+	fi_param_get_int(&rxd_prov, "drop_rate", &rxd_env.drop_rate);
 }
 
 void rxd_info_to_core_mr_modes(uint32_t version, const struct fi_info *hints,
@@ -147,6 +149,9 @@ RXD_INI
 			"Maximum number of peers to track (default: 1024)");
 	fi_param_define(&rxd_prov, "max_unacked", FI_PARAM_INT,
 			"Maximum number of packets to send at once (default: 128)");
+	fi_param_define(&rxd_prov, "drop_rate", FI_PARAM_INT,
+			"Drop one in this many received data packets, for "
+			"testing loss recovery (default: 0, disabled)");
 
 	rxd_init_env();
 
@@ -42,6 +42,7 @@
 
 #define RXD_IOV_LIMIT		4
 #define RXD_NAME_LENGTH		64
+#define RXD_SACK_BITS		64
 
 /* Values below are part of the wire protocol
    Reserved values are unused but defined for compatibility */
@@ -120,11 +121,16 @@ struct rxd_cts_pkt {
 
 /*
  * ACK: to signal received packets and send tx/rx id info
+ * 	- base_hdr.seq_no: next sequence number expected in order; all
+ * 	  earlier packets have been received
+ * 	- ext_hdr.rx_id: receive window
+ * 	- sack: selective ack, bit i is set if packet seq_no + 1 + i has
+ * 	  been received out of order and is held by the receiver
  */
 struct rxd_ack_pkt {
 	struct rxd_base_hdr	base_hdr;
 	struct rxd_ext_hdr	ext_hdr;
-	//TODO fill in more fields? Selective ack?
+	uint64_t		sack;
 };
 
 /*
@@ -52,6 +52,7 @@
 #include <ofi_enosys.h>
 #include <ofi_util.h>
 #include <ofi_list.h>
+#include <ofi_match.h>
 #include <ofi_lock.h>
 #include <ofi_proto.h>
 #include <ofi_iov.h>
@@ -77,6 +78,11 @@ enum {
 	RXM_CM_FLOW_CTRL_PEER_OFF,
 };
 
+/* Older peers leave the features byte zero */
+enum {
+	RXM_CM_FEATURE_CLOSE = BIT(0),
+};
+
 union rxm_cm_data {
 	struct _connect {
 		uint8_t version;
@@ -85,7 +91,7 @@ union rxm_cm_data {
 		uint8_t op_version;
 		uint16_t port;
 		uint8_t flow_ctrl;
-		uint8_t padding;
+		uint8_t features;
 		uint32_t eager_limit;
 		uint32_t rx_size; /* used? */
 		uint64_t client_conn_id;
@@ -95,7 +101,8 @@ union rxm_cm_data {
 		uint64_t server_conn_id;
 		uint32_t rx_size; /* used? */
 		uint8_t flow_ctrl;
-		uint8_t align_pad[3];
+		uint8_t features;
+		uint8_t align_pad[2];
 	} accept;
 
 	struct _reject {
@@ -205,6 +212,8 @@ extern size_t rxm_cq_eq_fairness;
 extern int rxm_passthru;
 extern int force_auto_progress;
 extern int rxm_use_write_rndv;
+extern size_t rxm_max_conns;
+extern int rxm_conn_idle_time;
 extern enum fi_wait_obj def_wait_obj, def_tcp_wait_obj;
 
 struct rxm_ep;
@@ -220,6 +229,13 @@ enum rxm_cm_state {
 
 enum {
 	RXM_CONN_INDEXED = BIT(0),
+	RXM_CONN_EVICTED = BIT(1),
+	RXM_CONN_CLOSING = BIT(2),
+	RXM_CONN_REQ_SENT = BIT(3),
+	RXM_CONN_REQ_RCVD = BIT(4),
+	RXM_CONN_DONE_SENT = BIT(5),
+	RXM_CONN_DONE_RCVD = BIT(6),
+	RXM_CONN_CAN_CLOSE = BIT(7),
 };
 
 /* Each local rxm ep will have at most 1 connection to a single
@@ -248,10 +264,37 @@ struct rxm_conn {
 	struct dlist_entry deferred_sar_msgs;
 	struct dlist_entry deferred_sar_segments;
 	struct dlist_entry loopback_entry;
+
+	/* Connected conns, least recently used first.  Only maintained,
+	 * along with the rendezvous count, when max_conns is set.  A conn
+	 * that is closing sits on the ep conn_close_list instead.
+	 */
+	struct dlist_entry lru_entry;
+	uint64_t last_use;
+	int rndv_cnt;
 };
 
 void rxm_freeall_conns(struct rxm_ep *ep);
 
+/* An outstanding FI_OPT_PRECONNECT request.  Pending entries are linked
+ * by peer index, so a CM event only advances the entries of its peer.
+ * Resolved entries have their addr set to FI_ADDR_NOTAVAIL.
+ */
+struct rxm_preconnect_entry {
+	struct rxm_preconnect_entry *next;
+	fi_addr_t addr;
+	size_t index;
+	int attempts;
+};
+
+struct rxm_preconnect {
+	void *context;
+	size_t count;
+	size_t connected;
+	struct index_map peer_map;
+	struct rxm_preconnect_entry entry[];
+};
+
 struct rxm_fabric {
 	struct util_fabric util_fabric;
 	struct fid_fabric *msg_fabric;
@@ -395,7 +438,9 @@ enum {
 	rxm_ctrl_atomic_resp,
 	rxm_ctrl_credit,
 	rxm_ctrl_rndv_wr_data,
-	rxm_ctrl_rndv_wr_done
+	rxm_ctrl_rndv_wr_done,
+	rxm_ctrl_close_req,
+	rxm_ctrl_close_done
 };
 
 struct rxm_pkt {
@@ -434,10 +479,12 @@ struct rxm_recv_match_attr {
 	uint64_t ignore;
 };
 
+/* The entry links buffered SAR segments on rxm_conn::deferred_sar_segments.
+ * Unexpected messages are queued through match.
+ */
 struct rxm_unexp_msg {
 	struct dlist_entry entry;
-	fi_addr_t addr;
-	uint64_t tag;
+	struct ofi_mq_entry match;
 };
 
 struct rxm_iov {
@@ -595,13 +642,10 @@ struct rxm_deferred_tx_entry {
 };
 
 struct rxm_recv_entry {
-	struct dlist_entry entry;
+	struct ofi_mq_entry match;
 	struct rxm_iov rxm_iov;
-	fi_addr_t addr;
 	void *context;
 	uint64_t flags;
-	uint64_t tag;
-	uint64_t ignore;
 	uint64_t comp_flags;
 	size_t total_len;
 	struct rxm_recv_queue *recv_queue;
@@ -627,17 +671,75 @@ enum rxm_recv_queue_type {
 	RXM_RECV_QUEUE_TAGGED,
 };
 
+enum rxm_tag_matcher {
+	RXM_MATCH_LIST,
+	RXM_MATCH_HASH,
+};
+
+/* Posted receives and unexpected messages.  Untagged queues only match on
+ * source address and are always kept as ordered lists.  Tagged queues hash
+ * exact (source, tag) pairs unless the list matcher is selected.
+ */
 struct rxm_recv_queue {
 	struct rxm_ep		*rxm_ep;
 	enum rxm_recv_queue_type type;
 	struct rxm_recv_fs	*fs;
-	struct dlist_entry	recv_list;
-	struct dlist_entry	unexp_msg_list;
+	struct ofi_mq		recv_mq;
+	struct ofi_mq		unexp_mq;
 	size_t			dyn_rbuf_unexp_cnt;
-	dlist_func_t		*match_recv;
-	dlist_func_t		*match_unexp;
 };
 
+static inline void
+rxm_recv_queue_post(struct rxm_recv_queue *recv_queue,
+		    struct rxm_recv_entry *recv_entry)
+{
+	ofi_mq_insert(&recv_queue->recv_mq, &recv_entry->match);
+}
+
+static inline struct rxm_recv_entry *
+rxm_recv_queue_match(struct rxm_recv_queue *recv_queue,
+		     struct rxm_recv_match_attr *match_attr)
+{
+	struct ofi_mq_entry *entry;
+
+	entry = ofi_mq_match_msg(&recv_queue->recv_mq, match_attr->addr,
+				 match_attr->tag);
+	if (!entry)
+		return NULL;
+
+	ofi_mq_remove(&recv_queue->recv_mq, entry);
+	return container_of(entry, struct rxm_recv_entry, match);
+}
+
+static inline void
+rxm_unexp_queue_insert(struct rxm_recv_queue *recv_queue,
+		       struct rxm_rx_buf *rx_buf,
+		       struct rxm_recv_match_attr *match_attr)
+{
+	rx_buf->unexp_msg.match.addr = match_attr->addr;
+	rx_buf->unexp_msg.match.tag = match_attr->tag;
+	rx_buf->unexp_msg.match.ignore = 0;
+	ofi_mq_insert(&recv_queue->unexp_mq, &rx_buf->unexp_msg.match);
+}
+
+static inline void
+rxm_unexp_queue_remove(struct rxm_recv_queue *recv_queue,
+		       struct rxm_rx_buf *rx_buf)
+{
+	ofi_mq_remove(&recv_queue->unexp_mq, &rx_buf->unexp_msg.match);
+}
+
+static inline bool
+rxm_unexp_match(struct rxm_recv_queue *recv_queue, struct rxm_rx_buf *rx_buf,
+		struct rxm_recv_match_attr *match_attr)
+{
+	return ofi_mq_match_addr(&recv_queue->unexp_mq, match_attr->addr,
+				 ofi_mq_entry_addr(&recv_queue->unexp_mq,
+						   &rx_buf->unexp_msg.match)) &&
+	       ofi_match_tag(match_attr->tag, match_attr->ignore,
+			     rx_buf->unexp_msg.match.tag);
+}
+
 ssize_t rxm_get_dyn_rbuf(struct ofi_cq_rbuf_entry *entry, struct iovec *iov,
 			 size_t *count);
 
@@ -670,6 +772,13 @@ struct rxm_ep {
 	struct dlist_entry	loopback_list;
 	union ofi_sock_ip	addr;
 
+	struct dlist_entry	conn_lru;
+	struct dlist_entry	conn_close_list;
+	size_t			conn_cnt;
+	uint64_t		evict_cnt;
+	uint64_t		reconnect_cnt;
+	struct rxm_preconnect	*preconnect;
+
 	pthread_t		cm_thread;
 	struct fid_pep 		*msg_pep;
 	struct fid_eq 		*msg_eq;
@@ -712,6 +821,7 @@ struct rxm_ep {
 
 	struct rxm_recv_queue	recv_queue;
 	struct rxm_recv_queue	trecv_queue;
+	enum rxm_tag_matcher	tag_matcher;
 	struct ofi_bufpool	*multi_recv_pool;
 
 	struct rxm_eager_ops	*eager_ops;
@@ -721,6 +831,10 @@ struct rxm_ep {
 int rxm_start_listen(struct rxm_ep *ep);
 void rxm_stop_listen(struct rxm_ep *ep);
 void rxm_conn_progress(struct rxm_ep *ep);
+void rxm_touch_conn(struct rxm_conn *conn);
+void rxm_recv_close(struct rxm_conn *conn, uint8_t type);
+void rxm_progress_close_list(struct rxm_ep *ep);
+int rxm_preconnect(struct rxm_ep *ep, const struct fi_preconnect *req);
 
 
 extern struct fi_provider rxm_prov;
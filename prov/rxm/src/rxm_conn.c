@@ -44,6 +44,10 @@ static void *rxm_cm_progress(void *arg);
 static void *rxm_cm_atomic_progress(void *arg);
 static void rxm_flush_msg_cq(struct rxm_ep *rxm_ep);
 
+#define RXM_PRECONNECT_ATTEMPTS	3
+
+static void rxm_progress_preconnect(struct rxm_ep *ep, int peer_index);
+static void rxm_free_preconnect(struct rxm_ep *ep);
 
 /* castable to fi_eq_cm_entry - we can't use fi_eq_cm_entry directly
  * here because of a compiler error with a 0-sized array
@@ -82,13 +86,23 @@ static void rxm_close_conn(struct rxm_conn *conn)
 	while (!dlist_empty(&conn->deferred_sar_msgs)) {
 		rx_entry = container_of(conn->deferred_sar_msgs.next,
 					struct rxm_recv_entry, sar.entry);
-		dlist_remove(&rx_entry->entry);
+		dlist_remove(&rx_entry->sar.entry);
 		rxm_recv_entry_release(rx_entry);
 	}
 	fi_close(&conn->msg_ep->fid);
+	/* Completions still queued for the closed msg_ep must not repost
+	 * their buffers to it */
+	conn->msg_ep = NULL;
 	rxm_flush_msg_cq(conn->ep);
 	dlist_remove_init(&conn->loopback_entry);
-	conn->msg_ep = NULL;
+
+	if (!dlist_empty(&conn->lru_entry)) {
+		dlist_remove_init(&conn->lru_entry);
+		conn->ep->conn_cnt--;
+	}
+	conn->flags &= ~(RXM_CONN_CLOSING | RXM_CONN_REQ_SENT |
+			 RXM_CONN_REQ_RCVD | RXM_CONN_DONE_SENT |
+			 RXM_CONN_DONE_RCVD | RXM_CONN_CAN_CLOSE);
 
 	if (conn->state == RXM_CM_CONNECTING || conn->state == RXM_CM_ACCEPTING)
 		conn->ep->connecting_cnt--;
@@ -259,6 +273,7 @@ static int rxm_init_connect_data(struct rxm_conn *conn,
 	cm_data->connect.flow_ctrl = conn->flow_ctrl ?
 						RXM_CM_FLOW_CTRL_PEER_ON :
 						RXM_CM_FLOW_CTRL_PEER_OFF;
+	cm_data->connect.features = RXM_CM_FEATURE_CLOSE;
 
 	ret = fi_getopt(&conn->ep->msg_pep->fid, FI_OPT_ENDPOINT,
 			FI_OPT_CM_DATA_SIZE, &cm_data_size, &opt_size);
@@ -318,6 +333,160 @@ err:
 	return ret;
 }
 
+/* No rendezvous or segmented transfer outstanding and nothing deferred.
+ * The caller checks how long the conn has gone without traffic.
+ */
+static bool rxm_conn_idle(struct rxm_conn *conn)
+{
+	return conn->state == RXM_CM_CONNECTED && !conn->rndv_cnt &&
+	       dlist_empty(&conn->deferred_tx_queue) &&
+	       dlist_empty(&conn->deferred_sar_msgs) &&
+	       dlist_empty(&conn->deferred_sar_segments) &&
+	       dlist_empty(&conn->loopback_entry);
+}
+
+static ssize_t rxm_send_close(struct rxm_conn *conn, uint8_t type)
+{
+	struct rxm_tx_buf *tx_buf;
+	ssize_t ret;
+
+	tx_buf = ofi_buf_alloc(conn->ep->tx_pool);
+	if (!tx_buf)
+		return -FI_EAGAIN;
+
+	/* freed on completion, the same as a credit message */
+	tx_buf->hdr.state = RXM_CREDIT_TX;
+	rxm_ep_format_tx_buf_pkt(conn, 0, type, 0, 0, FI_SEND, &tx_buf->pkt);
+	tx_buf->pkt.ctrl_hdr.type = type;
+	tx_buf->pkt.ctrl_hdr.msg_id = ofi_buf_index(tx_buf);
+
+	ret = fi_send(conn->msg_ep, &tx_buf->pkt, sizeof(struct rxm_pkt),
+		      tx_buf->hdr.desc, 0, tx_buf);
+	if (ret)
+		ofi_buf_free(tx_buf);
+	return ret;
+}
+
+/* Connections are closed with a handshake, so neither side fails or
+ * loses a transfer.  Each side sends a close request behind everything
+ * it already queued, and stops taking new transfers.  Once it has the
+ * peer's request, nothing new will arrive, and it answers with close
+ * done when no rendezvous or deferred work is left.  A side that has
+ * sent and received close done shuts down the msg ep; the peer is
+ * already done and treats the shutdown as the close.
+ */
+static void rxm_progress_close(struct rxm_conn *conn)
+{
+	assert(ofi_ep_lock_held(&conn->ep->util_ep));
+	assert(conn->flags & RXM_CONN_CLOSING);
+
+	/* a failed conn is closed by its shutdown event */
+	if (conn->state != RXM_CM_CONNECTED)
+		return;
+
+	if (!(conn->flags & RXM_CONN_REQ_SENT)) {
+		if (!dlist_empty(&conn->deferred_tx_queue) ||
+		    rxm_send_close(conn, rxm_ctrl_close_req))
+			return;
+		conn->flags |= RXM_CONN_REQ_SENT;
+	}
+
+	if (!(conn->flags & RXM_CONN_REQ_RCVD))
+		return;
+
+	if (!(conn->flags & RXM_CONN_DONE_SENT)) {
+		if (!rxm_conn_idle(conn) ||
+		    rxm_send_close(conn, rxm_ctrl_close_done))
+			return;
+		conn->flags |= RXM_CONN_DONE_SENT;
+	}
+
+	if (!(conn->flags & RXM_CONN_DONE_RCVD))
+		return;
+
+	FI_INFO(&rxm_prov, FI_LOG_EP_CTRL, "closed conn %p\n", conn);
+	(void) fi_shutdown(conn->msg_ep, 0);
+	rxm_close_conn(conn);
+}
+
+void rxm_progress_close_list(struct rxm_ep *ep)
+{
+	struct rxm_conn *conn;
+	struct dlist_entry *tmp;
+
+	assert(ofi_ep_lock_held(&ep->util_ep));
+	dlist_foreach_container_safe(&ep->conn_close_list, struct rxm_conn,
+				     conn, lru_entry, tmp) {
+		rxm_progress_close(conn);
+		/* closed without a CM event */
+		if (!conn->msg_ep && ep->preconnect)
+			rxm_progress_preconnect(ep, conn->peer->index);
+	}
+}
+
+static void rxm_start_close(struct rxm_conn *conn)
+{
+	conn->flags |= RXM_CONN_CLOSING | RXM_CONN_EVICTED;
+	dlist_remove(&conn->lru_entry);
+	dlist_insert_tail(&conn->lru_entry, &conn->ep->conn_close_list);
+}
+
+void rxm_recv_close(struct rxm_conn *conn, uint8_t type)
+{
+	assert(ofi_ep_lock_held(&conn->ep->util_ep));
+	FI_DBG(&rxm_prov, FI_LOG_EP_CTRL, "close %s for conn %p\n",
+	       type == rxm_ctrl_close_req ? "req" : "done", conn);
+	/* msg_ep is cleared while a closed conn flushes its completions */
+	if (conn->state != RXM_CM_CONNECTED || !conn->msg_ep)
+		return;
+
+	if (!(conn->flags & RXM_CONN_CLOSING))
+		rxm_start_close(conn);
+
+	conn->flags |= (type == rxm_ctrl_close_req) ?
+		       RXM_CONN_REQ_RCVD : RXM_CONN_DONE_RCVD;
+}
+
+/* Start closing the least recently used idle connection to make room for
+ * a new one.  The conn stays indexed and reconnects on next use.
+ */
+static void rxm_evict_conn(struct rxm_ep *ep)
+{
+	struct rxm_conn *conn;
+	uint64_t now;
+
+	assert(ofi_ep_lock_held(&ep->util_ep));
+	if (!rxm_max_conns || ep->conn_cnt < rxm_max_conns)
+		return;
+
+	now = ofi_gettime_ms();
+	dlist_foreach_container(&ep->conn_lru, struct rxm_conn,
+				conn, lru_entry) {
+		if (now - conn->last_use < (uint64_t) rxm_conn_idle_time)
+			break;
+		/* peers without the close handshake keep their conns */
+		if (!(conn->flags & RXM_CONN_CAN_CLOSE) ||
+		    !rxm_conn_idle(conn))
+			continue;
+
+		FI_INFO(&rxm_prov, FI_LOG_EP_CTRL, "evicting conn %p\n", conn);
+		ep->evict_cnt++;
+		rxm_start_close(conn);
+		rxm_progress_close(conn);
+		return;
+	}
+}
+
+void rxm_touch_conn(struct rxm_conn *conn)
+{
+	conn->last_use = ofi_gettime_ms();
+	if (!dlist_empty(&conn->lru_entry) &&
+	    !(conn->flags & RXM_CONN_CLOSING)) {
+		dlist_remove(&conn->lru_entry);
+		dlist_insert_tail(&conn->lru_entry, &conn->ep->conn_lru);
+	}
+}
+
 static int rxm_connect(struct rxm_conn *conn)
 {
 	int ret;
@@ -326,6 +495,7 @@ static int rxm_connect(struct rxm_conn *conn)
 
 	switch (conn->state) {
 	case RXM_CM_IDLE:
+		rxm_evict_conn(conn->ep);
 		ret = rxm_send_connect(conn);
 		if (ret)
 			return ret;
@@ -369,6 +539,10 @@ void rxm_freeall_conns(struct rxm_ep *ep)
 	av = container_of(ep->util_ep.av, struct rxm_av, util_av);
 	ofi_ep_lock_acquire(&ep->util_ep);
 
+	/* An unfinished preconnect request is dropped without an event */
+	if (ep->preconnect)
+		rxm_free_preconnect(ep);
+
 	/* We can't have more connections than the current number of
 	 * possible peers.
 	 */
@@ -415,6 +589,8 @@ rxm_alloc_conn(struct rxm_ep *ep, struct util_peer_addr *peer)
 	dlist_init(&conn->deferred_sar_msgs);
 	dlist_init(&conn->deferred_sar_segments);
 	dlist_init(&conn->loopback_entry);
+	dlist_init(&conn->lru_entry);
+	conn->rndv_cnt = 0;
 
 	conn->peer = peer;
 	rxm_ref_peer(peer);
@@ -459,12 +635,21 @@ ssize_t rxm_get_conn(struct rxm_ep *ep, fi_addr_t addr, struct rxm_conn **conn)
 	if (!*conn)
 		return -FI_ENOMEM;
 
+	/* new transfers wait until a closing conn reconnects */
+	if ((*conn)->flags & RXM_CONN_CLOSING) {
+		rxm_ep_do_progress(&ep->util_ep);
+		if ((*conn)->flags & RXM_CONN_CLOSING)
+			return -FI_EAGAIN;
+	}
+
 	if ((*conn)->state == RXM_CM_CONNECTED) {
 		if (!dlist_empty(&(*conn)->deferred_tx_queue)) {
 			rxm_ep_do_progress(&ep->util_ep);
 			if (!dlist_empty(&(*conn)->deferred_tx_queue))
 				return -FI_EAGAIN;
 		}
+		if (rxm_max_conns)
+			rxm_touch_conn(*conn);
 		return 0;
 	}
 
@@ -479,6 +664,204 @@ ssize_t rxm_get_conn(struct rxm_ep *ep, fi_addr_t addr, struct rxm_conn **conn)
 	return ret;
 }
 
+static void rxm_write_preconnect_event(struct rxm_ep *ep, void *context,
+				       uint64_t data, int err)
+{
+	struct fi_eq_err_entry entry = { 0 };
+	size_t size;
+	ssize_t ret;
+	uint64_t flags;
+
+	entry.fid = &ep->util_ep.ep_fid.fid;
+	entry.context = context;
+	entry.data = data;
+
+	if (err) {
+		entry.err = err;
+		size = sizeof(struct fi_eq_err_entry);
+		flags = UTIL_FLAG_ERROR;
+	} else {
+		size = sizeof(struct fi_eq_entry);
+		flags = 0;
+	}
+
+	ret = fi_eq_write(&ep->util_ep.eq->eq_fid, FI_PRECONNECT_COMPLETE,
+			  &entry, size, flags);
+	if ((size_t) ret != size)
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL, "error writing to EQ\n");
+}
+
+/* A conn that is freed while connecting failed outright and is retried
+ * from scratch.  One left idle lost a simultaneous connect, and the
+ * peer's request will normally connect it.
+ */
+static int rxm_preconnect_addr(struct rxm_ep *ep, fi_addr_t addr,
+			       int *attempts)
+{
+	struct util_peer_addr **peer;
+	struct rxm_conn *conn;
+
+	/* checked on every event, the address may be removed meanwhile */
+	if (!ofi_av_addr_valid(ep->util_ep.av, addr))
+		return -FI_EADDRNOTAVAIL;
+
+	peer = ofi_av_addr_context(ep->util_ep.av, addr);
+	if (!*peer)
+		return -FI_EADDRNOTAVAIL;
+
+	conn = ofi_idm_lookup(&ep->conn_idx_map, (*peer)->index);
+	if (!conn) {
+		if ((*attempts)++ == RXM_PRECONNECT_ATTEMPTS)
+			return -FI_ECONNREFUSED;
+
+		conn = rxm_add_conn(ep, *peer);
+		if (!conn)
+			return -FI_ENOMEM;
+	}
+
+	return rxm_connect(conn);
+}
+
+static void rxm_free_preconnect(struct rxm_ep *ep)
+{
+	ofi_idm_reset(&ep->preconnect->peer_map, NULL);
+	free(ep->preconnect);
+	ep->preconnect = NULL;
+}
+
+static void rxm_report_preconnect(struct rxm_ep *ep,
+				  struct rxm_preconnect_entry *entry, int ret)
+{
+	struct rxm_preconnect *req = ep->preconnect;
+
+	if (ret)
+		rxm_write_preconnect_event(ep, req->context, entry->index, -ret);
+	else
+		req->connected++;
+	entry->addr = FI_ADDR_NOTAVAIL;
+	req->count--;
+}
+
+/* Returns true once the entry is resolved and has been reported */
+static bool rxm_resolve_preconnect(struct rxm_ep *ep,
+				   struct rxm_preconnect_entry *entry)
+{
+	int ret;
+
+	ret = rxm_preconnect_addr(ep, entry->addr, &entry->attempts);
+	if (ret == -FI_EAGAIN)
+		return false;
+
+	rxm_report_preconnect(ep, entry, ret);
+	return true;
+}
+
+static void rxm_check_preconnect(struct rxm_ep *ep)
+{
+	struct rxm_preconnect *req = ep->preconnect;
+
+	if (req->count)
+		return;
+
+	FI_INFO(&rxm_prov, FI_LOG_EP_CTRL, "preconnect done, %zu connected\n",
+		req->connected);
+	rxm_write_preconnect_event(ep, req->context, req->connected, 0);
+	rxm_free_preconnect(ep);
+}
+
+/* Advance the pending entries of the peer that a CM event refers to */
+static void rxm_progress_preconnect(struct rxm_ep *ep, int peer_index)
+{
+	struct rxm_preconnect *req = ep->preconnect;
+	struct rxm_preconnect_entry *entry;
+	bool pending = false;
+
+	assert(ofi_ep_lock_held(&ep->util_ep));
+	entry = ofi_idm_lookup(&req->peer_map, peer_index);
+	if (!entry)
+		return;
+
+	for (; entry; entry = entry->next) {
+		if (entry->addr != FI_ADDR_NOTAVAIL &&
+		    !rxm_resolve_preconnect(ep, entry))
+			pending = true;
+	}
+
+	if (!pending)
+		(void) ofi_idm_clear(&req->peer_map, peer_index);
+	rxm_check_preconnect(ep);
+}
+
+/* The AV entry is still valid while its remove handler runs */
+static void rxm_remove_preconnect(struct rxm_ep *ep, int peer_index)
+{
+	struct rxm_preconnect_entry *entry;
+
+	entry = ofi_idm_lookup(&ep->preconnect->peer_map, peer_index);
+	if (!entry)
+		return;
+
+	(void) ofi_idm_clear(&ep->preconnect->peer_map, peer_index);
+	for (; entry; entry = entry->next) {
+		if (entry->addr != FI_ADDR_NOTAVAIL)
+			rxm_report_preconnect(ep, entry, -FI_EADDRNOTAVAIL);
+	}
+	rxm_check_preconnect(ep);
+}
+
+/* All connection requests are sent up front.  Each entry then advances
+ * with the CM events of its peer.
+ */
+int rxm_preconnect(struct rxm_ep *ep, const struct fi_preconnect *req)
+{
+	struct rxm_preconnect *pending;
+	struct rxm_preconnect_entry *entry, *last;
+	struct util_peer_addr **peer;
+	size_t i;
+
+	assert(ofi_ep_lock_held(&ep->util_ep));
+	if (!ep->util_ep.eq)
+		return -FI_ENOEQ;
+
+	if (!ep->rx_pool)
+		return -FI_EOPBADSTATE;
+
+	if (ep->preconnect)
+		return -FI_EBUSY;
+
+	pending = calloc(1, sizeof(*pending) +
+			 req->count * sizeof(pending->entry[0]));
+	if (!pending)
+		return -FI_ENOMEM;
+
+	pending->context = req->context;
+	pending->count = req->count;
+	ep->preconnect = pending;
+	for (i = 0; i < req->count; i++) {
+		entry = &pending->entry[i];
+		entry->addr = req->addr[i];
+		entry->index = i;
+		if (rxm_resolve_preconnect(ep, entry))
+			continue;
+
+		/* the same peer may be listed more than once */
+		peer = ofi_av_addr_context(ep->util_ep.av, entry->addr);
+		last = ofi_idm_lookup(&pending->peer_map, (*peer)->index);
+		if (last) {
+			while (last->next)
+				last = last->next;
+			last->next = entry;
+		} else if (ofi_idm_set(&pending->peer_map, (*peer)->index,
+				       entry) < 0) {
+			rxm_free_preconnect(ep);
+			return -FI_ENOMEM;
+		}
+	}
+
+	rxm_check_preconnect(ep);
+	return 0;
+}
+
 static void rxm_set_peer_flow_ctrl(struct rxm_conn *conn, int cm_flow_ctrl_flag)
 {
 	switch (cm_flow_ctrl_flag) {
@@ -517,6 +900,8 @@ void rxm_process_connect(struct rxm_eq_cm_entry *cm_entry)
 		conn->remote_pid = rxm_peer_pid(cm_entry->data.accept.
 						server_conn_id);
 		rxm_set_peer_flow_ctrl(conn, cm_entry->data.accept.flow_ctrl);
+		if (cm_entry->data.accept.features & RXM_CM_FEATURE_CLOSE)
+			conn->flags |= RXM_CONN_CAN_CLOSE;
 	}
 
 	if (conn->flow_ctrl & conn->peer_flow_ctrl) {
@@ -529,6 +914,14 @@ void rxm_process_connect(struct rxm_eq_cm_entry *cm_entry)
 	conn->ep->connecting_cnt--;
 	assert(conn->ep->connecting_cnt >= 0);
 	conn->state = RXM_CM_CONNECTED;
+
+	if (conn->flags & RXM_CONN_EVICTED) {
+		conn->flags &= ~RXM_CONN_EVICTED;
+		conn->ep->reconnect_cnt++;
+	}
+	conn->last_use = ofi_gettime_ms();
+	dlist_insert_tail(&conn->lru_entry, &conn->ep->conn_lru);
+	conn->ep->conn_cnt++;
 }
 
 /* For simultaneous connection requests, if the peer won the coin
@@ -636,9 +1029,9 @@ rxm_accept_connreq(struct rxm_conn *conn, struct rxm_eq_cm_entry *cm_entry)
 	cm_data.accept.rx_size = (uint32_t) cm_entry->info->rx_attr->size;
 	cm_data.accept.flow_ctrl = conn->flow_ctrl ? RXM_CM_FLOW_CTRL_PEER_ON :
 						     RXM_CM_FLOW_CTRL_PEER_OFF;
+	cm_data.accept.features = RXM_CM_FEATURE_CLOSE;
 	cm_data.accept.align_pad[0] = 0;
 	cm_data.accept.align_pad[1] = 0;
-	cm_data.accept.align_pad[2] = 0;
 
 	ret = fi_accept(conn->msg_ep, &cm_data.accept, sizeof(cm_data.accept));
 	if (ret)
@@ -646,7 +1039,8 @@ rxm_accept_connreq(struct rxm_conn *conn, struct rxm_eq_cm_entry *cm_entry)
 	return ret;
 }
 
-static void
+/* Returns the index of the requesting peer, or -1 if it is unknown */
+static int
 rxm_process_connreq(struct rxm_ep *ep, struct rxm_eq_cm_entry *cm_entry)
 {
 	union ofi_sock_ip peer_addr;
@@ -654,7 +1048,7 @@ rxm_process_connreq(struct rxm_ep *ep, struct rxm_eq_cm_entry *cm_entry)
 	struct rxm_conn *conn;
 	struct rxm_av *av;
 	ssize_t ret;
-	int cmp;
+	int cmp, index = -1;
 
 	assert(ofi_ep_lock_held(&ep->util_ep));
 	if (rxm_verify_connreq(ep, &cm_entry->data))
@@ -671,11 +1065,20 @@ rxm_process_connreq(struct rxm_ep *ep, struct rxm_eq_cm_entry *cm_entry)
 		goto reject;
 	}
 
+	index = peer->index;
 	conn = rxm_add_conn(ep, peer);
 	if (!conn)
 		goto remove;
 
 	FI_INFO(&rxm_prov, FI_LOG_EP_CTRL, "connreq for %p\n", conn);
+	if (conn->flags & RXM_CONN_CLOSING) {
+		/* the peer retries once we finish closing */
+		FI_INFO(&rxm_prov, FI_LOG_EP_CTRL,
+			"closing, reject peer %p\n", conn);
+		rxm_reject_connreq(ep, cm_entry, RXM_REJECT_EALREADY);
+		goto put;
+	}
+
 	switch (conn->state) {
 	case RXM_CM_IDLE:
 		break;
@@ -727,6 +1130,7 @@ rxm_process_connreq(struct rxm_ep *ep, struct rxm_eq_cm_entry *cm_entry)
 		break;
 	}
 
+	rxm_evict_conn(ep);
 	conn->remote_pid = rxm_peer_pid(cm_entry->data.connect.client_conn_id);
 	conn->remote_index = rxm_peer_index(cm_entry->data.connect.client_conn_id);
 	ret = rxm_open_conn(conn, cm_entry->info);
@@ -734,6 +1138,8 @@ rxm_process_connreq(struct rxm_ep *ep, struct rxm_eq_cm_entry *cm_entry)
 		goto free;
 
 	rxm_set_peer_flow_ctrl(conn, cm_entry->data.connect.flow_ctrl);
+	if (cm_entry->data.connect.features & RXM_CM_FEATURE_CLOSE)
+		conn->flags |= RXM_CONN_CAN_CLOSE;
 
 	ret = rxm_accept_connreq(conn, cm_entry);
 	if (ret)
@@ -744,7 +1150,7 @@ rxm_process_connreq(struct rxm_ep *ep, struct rxm_eq_cm_entry *cm_entry)
 put:
 	util_put_peer(peer);
 	fi_freeinfo(cm_entry->info);
-	return;
+	return index;
 
 close:
 	rxm_close_conn(conn);
@@ -755,6 +1161,7 @@ remove:
 reject:
 	rxm_reject_connreq(ep, cm_entry, RXM_REJECT_ECONNREFUSED);
 	fi_freeinfo(cm_entry->info);
+	return index;
 }
 
 void rxm_process_shutdown(struct rxm_conn *conn)
@@ -770,6 +1177,11 @@ void rxm_process_shutdown(struct rxm_conn *conn)
 	case RXM_CM_CONNECTING:
 	case RXM_CM_ACCEPTING:
 	case RXM_CM_CONNECTED:
+		if (conn->flags & RXM_CONN_CLOSING) {
+			/* the peer finished closing first, keep it indexed */
+			rxm_close_conn(conn);
+			break;
+		}
 		rxm_close_conn(conn);
 		rxm_free_conn(conn);
 		break;
@@ -781,7 +1193,9 @@ void rxm_process_shutdown(struct rxm_conn *conn)
 static void rxm_handle_error(struct rxm_ep *ep)
 {
 	struct fi_eq_err_entry entry = {0};
+	struct rxm_conn *conn;
 	ssize_t ret;
+	int index;
 
 	assert(ofi_ep_lock_held(&ep->util_ep));
 	ret = fi_eq_readerr(ep->msg_eq, &entry, 0);
@@ -810,35 +1224,50 @@ static void rxm_handle_error(struct rxm_ep *ep)
 	if (!entry.fid || entry.fid->fclass != FI_CLASS_EP)
 		return;
 
+	conn = entry.fid->context;
+	index = conn->peer->index;
 	if (entry.err == ECONNREFUSED) {
-		rxm_process_reject(entry.fid->context, &entry);
+		rxm_process_reject(conn, &entry);
 	} else {
-		rxm_process_shutdown(entry.fid->context);
+		rxm_process_shutdown(conn);
 	}
+
+	if (ep->preconnect)
+		rxm_progress_preconnect(ep, index);
 }
 
 static void
 rxm_handle_event(struct rxm_ep *ep, uint32_t event,
 		 struct rxm_eq_cm_entry *cm_entry, size_t len)
 {
+	struct rxm_conn *conn;
+	int index = -1;
+
 	assert(ofi_ep_lock_held(&ep->util_ep));
 	switch (event) {
 	case FI_NOTIFY:
 		break;
 	case FI_CONNREQ:
-		rxm_process_connreq(ep, cm_entry);
+		index = rxm_process_connreq(ep, cm_entry);
 		break;
 	case FI_CONNECTED:
+		conn = cm_entry->fid->context;
+		index = conn->peer->index;
 		rxm_process_connect(cm_entry);
 		break;
 	case FI_SHUTDOWN:
-		rxm_process_shutdown(cm_entry->fid->context);
+		conn = cm_entry->fid->context;
+		index = conn->peer->index;
+		rxm_process_shutdown(conn);
 		break;
 	default:
 		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
 			"Unknown event: %u\n", event);
 		break;
 	}
+
+	if (ep->preconnect && index >= 0)
+		rxm_progress_preconnect(ep, index);
 }
 
 void rxm_conn_progress(struct rxm_ep *ep)
@@ -1069,5 +1498,7 @@ void rxm_av_remove_handler(struct util_ep *util_ep, struct util_peer_addr *peer)
 		rxm_close_conn(conn);
 		rxm_free_conn(conn);
 	}
+	if (ep->preconnect)
+		rxm_remove_preconnect(ep, peer->index);
 	ofi_ep_lock_release(&ep->util_ep);
 }
@@ -191,6 +191,24 @@ rxm_cq_write_tx_comp(struct rxm_ep *rxm_ep, uint64_t comp_flags,
 	}
 }
 
+/* Sends issued on behalf of the collective provider complete back to it */
+static void
+rxm_cq_write_send_comp(struct rxm_ep *rxm_ep, uint64_t tag,
+		       uint64_t comp_flags, void *app_context, uint64_t flags)
+{
+	if (rxm_ep->util_coll_ep && (tag & RXM_PEER_XFER_TAG_FLAG)) {
+		struct fi_cq_tagged_entry cqe = {
+			.tag = tag,
+			.op_context = app_context,
+		};
+		rxm_ep->util_coll_peer_xfer_ops->
+			complete(rxm_ep->util_coll_ep, &cqe, 0);
+		return;
+	}
+
+	rxm_cq_write_tx_comp(rxm_ep, comp_flags, app_context, flags);
+}
+
 static void rxm_finish_rma(struct rxm_ep *rxm_ep, struct rxm_tx_buf *rma_buf,
 			  uint64_t comp_flags)
 {
@@ -249,16 +267,17 @@ static void rxm_handle_sar_comp(struct rxm_ep *rxm_ep,
 				struct rxm_tx_buf *tx_buf)
 {
 	void *app_context;
-	uint64_t comp_flags, tx_flags;
+	uint64_t comp_flags, tx_flags, tag;
 
 	app_context = tx_buf->app_context;
 	comp_flags = ofi_tx_cq_flags(tx_buf->pkt.hdr.op);
 	tx_flags = tx_buf->flags;
+	tag = tx_buf->pkt.hdr.tag;
 
 	if (!rxm_complete_sar(rxm_ep, tx_buf))
 		return;
 
-	rxm_cq_write_tx_comp(rxm_ep, comp_flags, app_context, tx_flags);
+	rxm_cq_write_send_comp(rxm_ep, tag, comp_flags, app_context, tx_flags);
 	ofi_ep_tx_cntr_inc(&rxm_ep->util_ep);
 }
 
@@ -266,6 +285,9 @@ static void rxm_rndv_rx_finish(struct rxm_rx_buf *rx_buf)
 {
 	RXM_UPDATE_STATE(FI_LOG_CQ, rx_buf, RXM_RNDV_FINISH);
 
+	if (rxm_max_conns)
+		rx_buf->conn->rndv_cnt--;
+
 	if (rx_buf->recv_entry->rndv.tx_buf) {
 		ofi_buf_free(rx_buf->recv_entry->rndv.tx_buf);
 		rx_buf->recv_entry->rndv.tx_buf = NULL;
@@ -284,11 +306,14 @@ static void rxm_rndv_tx_finish(struct rxm_ep *rxm_ep,
 	assert(ofi_tx_cq_flags(tx_buf->pkt.hdr.op) & FI_SEND);
 
 	RXM_UPDATE_STATE(FI_LOG_CQ, tx_buf, RXM_RNDV_FINISH);
+	if (rxm_max_conns)
+		tx_buf->write_rndv.conn->rndv_cnt--;
 	if (!rxm_ep->rdm_mr_local)
 		rxm_msg_mr_closev(tx_buf->rma.mr, tx_buf->rma.count);
 
-	rxm_cq_write_tx_comp(rxm_ep, ofi_tx_cq_flags(tx_buf->pkt.hdr.op),
-			     tx_buf->app_context, tx_buf->flags);
+	rxm_cq_write_send_comp(rxm_ep, tx_buf->pkt.hdr.tag,
+			       ofi_tx_cq_flags(tx_buf->pkt.hdr.op),
+			       tx_buf->app_context, tx_buf->flags);
 
 	if (rxm_ep->rndv_ops == &rxm_rndv_ops_write &&
 	    tx_buf->write_rndv.done_buf) {
@@ -711,15 +736,15 @@ static void rxm_adjust_multi_recv(struct rxm_rx_buf *rx_buf)
 
 	recv_entry = rxm_multi_recv_entry_get(rx_buf->ep, &new_iov,
 					rx_buf->recv_entry->rxm_iov.desc, 1,
-					rx_buf->recv_entry->addr,
-					rx_buf->recv_entry->tag,
-					rx_buf->recv_entry->ignore,
+					rx_buf->recv_entry->match.addr,
+					rx_buf->recv_entry->match.tag,
+					rx_buf->recv_entry->match.ignore,
 					rx_buf->recv_entry->context,
 					rx_buf->recv_entry->flags);
 
 	rx_buf->recv_entry->flags &= ~FI_MULTI_RECV;
 
-	dlist_insert_head(&recv_entry->entry, &rx_buf->ep->recv_queue.recv_list);
+	ofi_mq_insert_head(&rx_buf->ep->recv_queue.recv_mq, &recv_entry->match);
 }
 
 static ssize_t
@@ -727,7 +752,7 @@ rxm_match_rx_buf(struct rxm_rx_buf *rx_buf,
 		 struct rxm_recv_queue *recv_queue,
 		 struct rxm_recv_match_attr *match_attr)
 {
-	struct dlist_entry *entry;
+	struct rxm_recv_entry *recv_entry;
 
 	/* Dynamic receive buffers may have already matched */
 	if (rx_buf->recv_entry) {
@@ -741,10 +766,9 @@ rxm_match_rx_buf(struct rxm_rx_buf *rx_buf,
 	if (recv_queue->dyn_rbuf_unexp_cnt)
 		recv_queue->dyn_rbuf_unexp_cnt--;
 
-	entry = dlist_remove_first_match(&recv_queue->recv_list,
-					 recv_queue->match_recv, match_attr);
-	if (entry) {
-		rx_buf->recv_entry = container_of(entry, struct rxm_recv_entry, entry);
+	recv_entry = rxm_recv_queue_match(recv_queue, match_attr);
+	if (recv_entry) {
+		rx_buf->recv_entry = recv_entry;
 
 		if (rx_buf->recv_entry->flags & FI_MULTI_RECV)
 			rxm_adjust_multi_recv(rx_buf);
@@ -755,11 +779,7 @@ rxm_match_rx_buf(struct rxm_rx_buf *rx_buf,
 	RXM_DBG_ADDR_TAG(FI_LOG_CQ, "No matching recv found for incoming msg",
 			 match_attr->addr, match_attr->tag);
 	FI_DBG(&rxm_prov, FI_LOG_CQ, "Enqueueing msg to unexpected msg queue\n");
-	rx_buf->unexp_msg.addr = match_attr->addr;
-	rx_buf->unexp_msg.tag = match_attr->tag;
-
-	dlist_insert_tail(&rx_buf->unexp_msg.entry,
-			  &recv_queue->unexp_msg_list);
+	rxm_unexp_queue_insert(recv_queue, rx_buf, match_attr);
 	rxm_replace_rx_buf(rx_buf);
 	return 0;
 }
@@ -1360,6 +1380,40 @@ void rxm_finish_coll_eager_send(struct rxm_ep *rxm_ep,
 	}
 }
 
+static struct rxm_conn *rxm_rx_buf_conn(struct rxm_rx_buf *rx_buf)
+{
+	return rx_buf->conn ? rx_buf->conn :
+	       ofi_idm_lookup(&rx_buf->ep->conn_idx_map,
+			      (int) rx_buf->pkt.ctrl_hdr.conn_id);
+}
+
+static ssize_t rxm_handle_close(struct rxm_rx_buf *rx_buf)
+{
+	struct rxm_conn *conn;
+
+	conn = rxm_rx_buf_conn(rx_buf);
+	if (conn)
+		rxm_recv_close(conn, rx_buf->pkt.ctrl_hdr.type);
+	rxm_free_rx_buf(rx_buf);
+	return FI_SUCCESS;
+}
+
+/* Received traffic keeps a connection from being evicted, and so does a
+ * rendezvous until the receive side finishes it.
+ */
+static void rxm_touch_rx_conn(struct rxm_rx_buf *rx_buf)
+{
+	struct rxm_conn *conn;
+
+	conn = rxm_rx_buf_conn(rx_buf);
+	if (!conn)
+		return;
+
+	rxm_touch_conn(conn);
+	if (rx_buf->pkt.ctrl_hdr.type == rxm_ctrl_rndv_req)
+		conn->rndv_cnt++;
+}
+
 ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp)
 {
 	struct rxm_rx_buf *rx_buf;
@@ -1396,6 +1450,9 @@ ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp)
 		assert((rx_buf->pkt.hdr.version == OFI_OP_VERSION) &&
 		       (rx_buf->pkt.ctrl_hdr.version == RXM_CTRL_VERSION));
 
+		if (rxm_max_conns)
+			rxm_touch_rx_conn(rx_buf);
+
 		switch (rx_buf->pkt.ctrl_hdr.type) {
 		case rxm_ctrl_eager:
 		case rxm_ctrl_rndv_req:
@@ -1415,6 +1472,9 @@ ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp)
 			return rxm_handle_atomic_resp(rxm_ep, rx_buf);
 		case rxm_ctrl_credit:
 			return rxm_handle_credit(rxm_ep, rx_buf);
+		case rxm_ctrl_close_req:
+		case rxm_ctrl_close_done:
+			return rxm_handle_close(rx_buf);
 		default:
 			FI_WARN(&rxm_prov, FI_LOG_CQ, "Unknown message type\n");
 			assert(0);
@@ -1501,7 +1561,6 @@ static void rxm_get_recv_entry(struct rxm_rx_buf *rx_buf,
 	struct rxm_recv_match_attr match_attr;
 	struct rxm_conn *conn;
 	struct rxm_recv_queue *recv_queue;
-	struct dlist_entry *entry;
 
 	assert(!rx_buf->recv_entry);
 	if (rx_buf->ep->rxm_info->caps & (FI_SOURCE | FI_DIRECTED_RECV)) {
@@ -1522,12 +1581,9 @@ static void rxm_get_recv_entry(struct rxm_rx_buf *rx_buf,
 
 	/* See comment with rxm_get_dyn_rbuf */
 	if (recv_queue->dyn_rbuf_unexp_cnt == 0) {
-		entry = dlist_remove_first_match(&recv_queue->recv_list,
-						 recv_queue->match_recv,
-						 &match_attr);
-		if (entry) {
-			rx_buf->recv_entry = container_of(entry,
-						struct rxm_recv_entry, entry);
+		rx_buf->recv_entry = rxm_recv_queue_match(recv_queue,
+							  &match_attr);
+		if (rx_buf->recv_entry) {
 			if (rx_buf->recv_entry->flags & FI_MULTI_RECV)
 				rxm_adjust_multi_recv(rx_buf);
 		} else {
@@ -1643,6 +1699,8 @@ ssize_t rxm_get_dyn_rbuf(struct ofi_cq_rbuf_entry *entry, struct iovec *iov,
 	case rxm_ctrl_rndv_wr_done:
 	case rxm_ctrl_rndv_rd_done:
 	case rxm_ctrl_credit:
+	case rxm_ctrl_close_req:
+	case rxm_ctrl_close_done:
 		*count = 1;
 		iov[0].iov_base = &rx_buf->pkt.data;
 		iov[0].iov_len = rxm_buffer_size;
@@ -2032,6 +2090,9 @@ void rxm_ep_do_progress(struct util_ep *util_ep)
 			rxm_ep_progress_deferred_queue(rxm_ep, rxm_conn);
 		}
 	}
+
+	if (!dlist_empty(&rxm_ep->conn_close_list))
+		rxm_progress_close_list(rxm_ep);
 }
 
 void rxm_ep_progress(struct util_ep *util_ep)
@@ -42,77 +42,23 @@
 
 #include "rxm.h"
 
-static int rxm_match_noop(struct dlist_entry *item, const void *arg)
-{
-	OFI_UNUSED(item);
-	OFI_UNUSED(arg);
-	return 1;
-}
-
-static int rxm_match_recv_entry(struct dlist_entry *item, const void *arg)
-{
-	struct rxm_recv_match_attr *attr = (struct rxm_recv_match_attr *) arg;
-	struct rxm_recv_entry *recv_entry =
-		container_of(item, struct rxm_recv_entry, entry);
-	return ofi_match_addr(recv_entry->addr, attr->addr);
-}
-
-static int rxm_match_recv_entry_tag(struct dlist_entry *item, const void *arg)
-{
-	struct rxm_recv_match_attr *attr = (struct rxm_recv_match_attr *) arg;
-	struct rxm_recv_entry *recv_entry =
-		container_of(item, struct rxm_recv_entry, entry);
-	return ofi_match_tag(recv_entry->tag, recv_entry->ignore, attr->tag);
-}
-
-static int rxm_match_recv_entry_tag_addr(struct dlist_entry *item, const void *arg)
-{
-	struct rxm_recv_match_attr *attr = (struct rxm_recv_match_attr *) arg;
-	struct rxm_recv_entry *recv_entry =
-		container_of(item, struct rxm_recv_entry, entry);
-	return ofi_match_addr(recv_entry->addr, attr->addr) &&
-		ofi_match_tag(recv_entry->tag, recv_entry->ignore, attr->tag);
-}
-
-static int rxm_match_recv_entry_context(struct dlist_entry *item, const void *context)
+static bool rxm_match_recv_entry_context(struct ofi_mq_entry *item,
+					 void *context)
 {
 	struct rxm_recv_entry *recv_entry =
-		container_of(item, struct rxm_recv_entry, entry);
+		container_of(item, struct rxm_recv_entry, match);
 	return recv_entry->context == context;
 }
 
-static fi_addr_t rxm_get_unexp_addr(struct rxm_unexp_msg *unexp_msg)
+/* A message that arrived before its sender was inserted into the AV is
+ * queued as FI_ADDR_NOTAVAIL.  The peer learns its fi_addr on insert.
+ */
+static fi_addr_t rxm_unexp_addr(struct ofi_mq_entry *entry)
 {
 	struct rxm_rx_buf *rx_buf;
 
-	rx_buf = container_of(unexp_msg, struct rxm_rx_buf, unexp_msg);
-	return (unexp_msg->addr != FI_ADDR_UNSPEC) ?
-		unexp_msg->addr : rx_buf->conn->peer->fi_addr;
-}
-
-static int rxm_match_unexp_msg(struct dlist_entry *item, const void *arg)
-{
-	struct rxm_recv_match_attr *attr = (struct rxm_recv_match_attr *)arg;
-	struct rxm_unexp_msg *unexp_msg =
-		container_of(item, struct rxm_unexp_msg, entry);
-	return ofi_match_addr(attr->addr, rxm_get_unexp_addr(unexp_msg));
-}
-
-static int rxm_match_unexp_msg_tag(struct dlist_entry *item, const void *arg)
-{
-	struct rxm_recv_match_attr *attr = (struct rxm_recv_match_attr *) arg;
-	struct rxm_unexp_msg *unexp_msg =
-		container_of(item, struct rxm_unexp_msg, entry);
-	return ofi_match_tag(attr->tag, attr->ignore, unexp_msg->tag);
-}
-
-static int rxm_match_unexp_msg_tag_addr(struct dlist_entry *item, const void *arg)
-{
-	struct rxm_recv_match_attr *attr = (struct rxm_recv_match_attr *) arg;
-	struct rxm_unexp_msg *unexp_msg =
-		container_of(item, struct rxm_unexp_msg, entry);
-	return ofi_match_addr(attr->addr, rxm_get_unexp_addr(unexp_msg)) &&
-		ofi_match_tag(attr->tag, attr->ignore, unexp_msg->tag);
+	rx_buf = container_of(entry, struct rxm_rx_buf, unexp_msg.match);
+	return rx_buf->conn ? rx_buf->conn->peer->fi_addr : FI_ADDR_NOTAVAIL;
 }
 
 static int rxm_buf_reg(struct ofi_bufpool_region *region)
@@ -209,6 +155,9 @@ static void rxm_recv_entry_init(struct rxm_recv_entry *entry, void *arg)
 static int rxm_recv_queue_init(struct rxm_ep *rxm_ep,  struct rxm_recv_queue *recv_queue,
 			       size_t size, enum rxm_recv_queue_type type)
 {
+	int flags = 0;
+	int ret;
+
 	recv_queue->rxm_ep = rxm_ep;
 	recv_queue->type = type;
 	recv_queue->fs = rxm_recv_fs_create(size, rxm_recv_entry_init,
@@ -216,37 +165,41 @@ static int rxm_recv_queue_init(struct rxm_ep *rxm_ep,  struct rxm_recv_queue *re
 	if (!recv_queue->fs)
 		return -FI_ENOMEM;
 
-	dlist_init(&recv_queue->recv_list);
-	dlist_init(&recv_queue->unexp_msg_list);
-	if (type == RXM_RECV_QUEUE_MSG) {
-		if (rxm_ep->rxm_info->caps & FI_DIRECTED_RECV) {
-			recv_queue->match_recv = rxm_match_recv_entry;
-			recv_queue->match_unexp = rxm_match_unexp_msg;
-		} else {
-			recv_queue->match_recv = rxm_match_noop;
-			recv_queue->match_unexp = rxm_match_noop;
-		}
-	} else {
-		if (rxm_ep->rxm_info->caps & FI_DIRECTED_RECV) {
-			recv_queue->match_recv = rxm_match_recv_entry_tag_addr;
-			recv_queue->match_unexp = rxm_match_unexp_msg_tag_addr;
-		} else {
-			recv_queue->match_recv = rxm_match_recv_entry_tag;
-			recv_queue->match_unexp = rxm_match_unexp_msg_tag;
-		}
-	}
+	if (rxm_ep->rxm_info->caps & FI_DIRECTED_RECV)
+		flags |= OFI_MQ_DIRECTED;
+	if (type == RXM_RECV_QUEUE_MSG ||
+	    rxm_ep->tag_matcher == RXM_MATCH_LIST)
+		flags |= OFI_MQ_LIST;
+
+	ret = ofi_mq_init(&recv_queue->recv_mq, size, flags);
+	if (ret)
+		goto err1;
+
+	ret = ofi_mq_init(&recv_queue->unexp_mq, size, flags | OFI_MQ_UNEXP);
+	if (ret)
+		goto err2;
+
+	if (flags & OFI_MQ_DIRECTED)
+		recv_queue->unexp_mq.resolve = rxm_unexp_addr;
 
 	return 0;
+err2:
+	ofi_mq_cleanup(&recv_queue->recv_mq);
+err1:
+	rxm_recv_fs_free(recv_queue->fs);
+	recv_queue->fs = NULL;
+	return ret;
 }
 
 static void rxm_recv_queue_close(struct rxm_recv_queue *recv_queue)
 {
 	/* It indicates that the recv_queue were allocated */
 	if (recv_queue->fs) {
+		ofi_mq_cleanup(&recv_queue->recv_mq);
+		ofi_mq_cleanup(&recv_queue->unexp_mq);
 		rxm_recv_fs_free(recv_queue->fs);
 		recv_queue->fs = NULL;
 	}
-	// TODO cleanup recv_list and unexp msg list
 }
 
 static int rxm_ep_create_pools(struct rxm_ep *rxm_ep)
@@ -421,21 +374,21 @@ static bool rxm_ep_cancel_recv(struct rxm_ep *rxm_ep,
 {
 	struct fi_cq_err_entry err_entry;
 	struct rxm_recv_entry *recv_entry;
-	struct dlist_entry *entry;
+	struct ofi_mq_entry *entry;
 	int ret;
 
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	entry = dlist_remove_first_match(&recv_queue->recv_list,
-					 rxm_match_recv_entry_context,
-					 context);
+	entry = ofi_mq_find(&recv_queue->recv_mq, rxm_match_recv_entry_context,
+			    context);
 	if (!entry)
 		goto unlock;
 
-	recv_entry = container_of(entry, struct rxm_recv_entry, entry);
+	ofi_mq_remove(&recv_queue->recv_mq, entry);
+	recv_entry = container_of(entry, struct rxm_recv_entry, match);
 	memset(&err_entry, 0, sizeof(err_entry));
 	err_entry.op_context = recv_entry->context;
 	err_entry.flags |= recv_entry->comp_flags;
-	err_entry.tag = recv_entry->tag;
+	err_entry.tag = recv_entry->match.tag;
 	err_entry.err = FI_ECANCELED;
 	err_entry.prov_errno = -FI_ECANCELED;
 	rxm_recv_entry_release(recv_entry);
@@ -490,6 +443,18 @@ static int rxm_ep_getopt(fid_t fid, int level, int optname, void *optval,
 		*(size_t *)optval = rxm_ep->buffered_limit;
 		*optlen = sizeof(size_t);
 		break;
+	case FI_OPT_CONN_STATS:
+		if (*optlen < sizeof(struct fi_conn_stats)) {
+			*optlen = sizeof(struct fi_conn_stats);
+			return -FI_ETOOSMALL;
+		}
+		ofi_ep_lock_acquire(&rxm_ep->util_ep);
+		((struct fi_conn_stats *) optval)->evicted = rxm_ep->evict_cnt;
+		((struct fi_conn_stats *) optval)->reconnected =
+			rxm_ep->reconnect_cnt;
+		ofi_ep_lock_release(&rxm_ep->util_ep);
+		*optlen = sizeof(struct fi_conn_stats);
+		break;
 	default:
 		return -FI_ENOPROTOOPT;
 	}
@@ -550,6 +515,14 @@ static int rxm_ep_setopt(fid_t fid, int level, int optname,
 				rxm_ep->buffered_limit);
 		}
 		break;
+	case FI_OPT_PRECONNECT:
+		if (optlen != sizeof(struct fi_preconnect))
+			return -FI_EINVAL;
+
+		ofi_ep_lock_acquire(&rxm_ep->util_ep);
+		ret = rxm_preconnect(rxm_ep, optval);
+		ofi_ep_lock_release(&rxm_ep->util_ep);
+		break;
 	default:
 		ret = -FI_ENOPROTOOPT;
 	}
@@ -573,25 +546,19 @@ struct rxm_rx_buf *
 rxm_get_unexp_msg(struct rxm_recv_queue *recv_queue, fi_addr_t addr,
 		  uint64_t tag, uint64_t ignore)
 {
-	struct rxm_recv_match_attr match_attr;
-	struct dlist_entry *entry;
+	struct ofi_mq_entry *entry;
 
-	if (dlist_empty(&recv_queue->unexp_msg_list))
+	if (ofi_mq_empty(&recv_queue->unexp_mq))
 		return NULL;
 
-	match_attr.addr = addr;
-	match_attr.tag = tag;
-	match_attr.ignore = ignore;
-
-	entry = dlist_find_first_match(&recv_queue->unexp_msg_list,
-				       recv_queue->match_unexp, &match_attr);
+	entry = ofi_mq_match_recv(&recv_queue->unexp_mq, addr, tag, ignore);
 	if (!entry)
 		return NULL;
 
 	RXM_DBG_ADDR_TAG(FI_LOG_EP_DATA, "Match for posted recv found in unexp"
-			 " msg list\n", match_attr.addr, match_attr.tag);
+			 " msg list\n", addr, tag);
 
-	return container_of(entry, struct rxm_rx_buf, unexp_msg.entry);
+	return container_of(entry, struct rxm_rx_buf, unexp_msg.match);
 }
 
 static void rxm_recv_entry_init_common(struct rxm_recv_entry *recv_entry,
@@ -604,11 +571,11 @@ static void rxm_recv_entry_init_common(struct rxm_recv_entry *recv_entry,
 
 	assert(!recv_entry->rndv.tx_buf);
 	recv_entry->rxm_iov.count = (uint8_t) count;
-	recv_entry->addr = src_addr;
+	recv_entry->match.addr = src_addr;
 	recv_entry->context = context;
 	recv_entry->flags = flags;
-	recv_entry->ignore = ignore;
-	recv_entry->tag = tag;
+	recv_entry->match.ignore = ignore;
+	recv_entry->match.tag = tag;
 
 	recv_entry->sar.msg_id = RXM_SAR_RX_INIT;
 	recv_entry->sar.total_recv_len = 0;
@@ -1141,18 +1108,102 @@ ssize_t rxm_ep_broadcast(struct fid_ep *ep, void *buf, size_t count,
 	return ret;
 }
 
+ssize_t rxm_ep_alltoall(struct fid_ep *ep, const void *buf, size_t count,
+			void *desc, void *result, void *result_desc,
+			fi_addr_t coll_addr, enum fi_datatype datatype,
+			uint64_t flags, void *context)
+{
+	struct rxm_ep *rxm_ep;
+	struct fid_ep *coll_ep;
+	struct rxm_coll_buf *req;
+	ssize_t ret;
+
+        rxm_ep = container_of(ep, struct rxm_ep, util_ep.ep_fid.fid);
+
+	ret = rxm_ep_init_coll_req(rxm_ep, FI_ALLTOALL, flags, context,
+				   &req, &coll_ep);
+	if (ret)
+		return ret;
+
+	flags &= ~FI_PEER_TRANSFER;
+
+	ret = fi_alltoall(coll_ep, buf, count, desc, result, result_desc,
+			  coll_addr, datatype, flags, req);
+	if (ret)
+		rxm_ep_free_coll_req(rxm_ep, req);
+
+	return ret;
+}
+
+ssize_t rxm_ep_reduce_scatter(struct fid_ep *ep, const void *buf,
+			      size_t count, void *desc, void *result,
+			      void *result_desc, fi_addr_t coll_addr,
+			      enum fi_datatype datatype, enum fi_op op,
+			      uint64_t flags, void *context)
+{
+	struct rxm_ep *rxm_ep;
+	struct fid_ep *coll_ep;
+	struct rxm_coll_buf *req;
+	ssize_t ret;
+
+        rxm_ep = container_of(ep, struct rxm_ep, util_ep.ep_fid.fid);
+
+	ret = rxm_ep_init_coll_req(rxm_ep, FI_REDUCE_SCATTER, flags, context,
+				   &req, &coll_ep);
+	if (ret)
+		return ret;
+
+	flags &= ~FI_PEER_TRANSFER;
+
+	ret = fi_reduce_scatter(coll_ep, buf, count, desc, result,
+				result_desc, coll_addr, datatype, op, flags,
+				req);
+	if (ret)
+		rxm_ep_free_coll_req(rxm_ep, req);
+
+	return ret;
+}
+
+ssize_t rxm_ep_gather(struct fid_ep *ep, const void *buf, size_t count,
+		      void *desc, void *result, void *result_desc,
+		      fi_addr_t coll_addr, fi_addr_t root_addr,
+		      enum fi_datatype datatype, uint64_t flags,
+		      void *context)
+{
+	struct rxm_ep *rxm_ep;
+	struct fid_ep *coll_ep;
+	struct rxm_coll_buf *req;
+	ssize_t ret;
+
+        rxm_ep = container_of(ep, struct rxm_ep, util_ep.ep_fid.fid);
+
+	ret = rxm_ep_init_coll_req(rxm_ep, FI_GATHER, flags, context,
+				   &req, &coll_ep);
+	if (ret)
+		return ret;
+
+	flags &= ~FI_PEER_TRANSFER;
+
+	ret = fi_gather(coll_ep, buf, count, desc, result, result_desc,
+			coll_addr, root_addr, datatype, flags, req);
+	if (ret)
+		rxm_ep_free_coll_req(rxm_ep, req);
+
+	return ret;
+}
+
 static struct fi_ops_collective rxm_ops_collective = {
 	.size = sizeof(struct fi_ops_collective),
 	.barrier = rxm_ep_barrier,
 	.barrier2 = rxm_ep_barrier2,
 	.broadcast = rxm_ep_broadcast,
-	.alltoall = fi_coll_no_alltoall,
+	.alltoall = rxm_ep_alltoall,
 	.allreduce = rxm_ep_allreduce,
 	.allgather = rxm_ep_allgather,
-	.reduce_scatter = fi_coll_no_reduce_scatter,
+	.reduce_scatter = rxm_ep_reduce_scatter,
 	.reduce = fi_coll_no_reduce,
 	.scatter = rxm_ep_scatter,
-	.gather = fi_coll_no_gather,
+	.gather = rxm_ep_gather,
 	.msg = fi_coll_no_msg,
 };
 
@@ -1213,6 +1264,11 @@ static int rxm_ep_close(struct fid *fid)
 	if (ret)
 		return ret;
 
+	if (rxm_max_conns)
+		FI_INFO(&rxm_prov, FI_LOG_EP_CTRL, "connection stats: "
+			"evictions %" PRIu64 ", reconnects %" PRIu64 "\n",
+			ep->evict_cnt, ep->reconnect_cnt);
+
 	rxm_ep_txrx_res_close(ep);
 	if (ep->srx_ctx) {
 		ret = fi_close(&ep->srx_ctx->fid);
@@ -1445,6 +1501,20 @@ static void rxm_config_direct_send(struct rxm_ep *ep)
 	ep->enable_direct_send = (ret != 0);
 }
 
+static void rxm_config_tag_matcher(struct rxm_ep *ep)
+{
+	char *str = NULL;
+
+	ep->tag_matcher = RXM_MATCH_HASH;
+	if (fi_param_get_str(&rxm_prov, "tag_matcher", &str) || !str)
+		return;
+
+	if (!strcasecmp(str, "list"))
+		ep->tag_matcher = RXM_MATCH_LIST;
+	else if (strcasecmp(str, "hash"))
+		FI_WARN(&rxm_prov, FI_LOG_CORE,
+			"unknown tag_matcher '%s', using hash\n", str);
+}
 
 static void rxm_ep_settings_init(struct rxm_ep *rxm_ep)
 {
@@ -1480,6 +1550,7 @@ static void rxm_ep_settings_init(struct rxm_ep *rxm_ep)
 	rxm_ep->buffered_limit = rxm_buffer_size;
 
 	rxm_config_direct_send(rxm_ep);
+	rxm_config_tag_matcher(rxm_ep);
 	rxm_ep_init_proto(rxm_ep);
 
  	FI_INFO(&rxm_prov, FI_LOG_CORE,
@@ -1963,6 +2034,8 @@ int rxm_endpoint(struct fid_domain *domain, struct fi_info *info,
 		(*ep_fid)->atomic = &rxm_ops_atomic;
 
 	dlist_init(&rxm_ep->loopback_list);
+	dlist_init(&rxm_ep->conn_lru);
+	dlist_init(&rxm_ep->conn_close_list);
 
 	return 0;
 err2:
@@ -58,6 +58,8 @@ size_t rxm_packet_size;
 int rxm_passthru = 0; /* disable by default, need to analyze performance */
 int force_auto_progress;
 int rxm_use_write_rndv;
+size_t rxm_max_conns;
+int rxm_conn_idle_time = 100;
 enum fi_wait_obj def_wait_obj = FI_WAIT_FD, def_tcp_wait_obj = FI_WAIT_UNSPEC;
 
 char *rxm_proto_state_str[] = {
@@ -715,6 +717,12 @@ RXM_INI
 			"feature targets small to medium size message "
 			"transfers over the tcp provider.  (default: true)");
 
+	fi_param_define(&rxm_prov, "tag_matcher", FI_PARAM_STRING,
+			"Selects how posted tagged receives and unexpected "
+			"tagged messages are matched.  'hash' indexes fully "
+			"specified tags, 'list' searches a single ordered "
+			"list.  (default: hash)");
+
 	fi_param_define(&rxm_prov, "enable_passthru", FI_PARAM_BOOL,
 			"Enable passthru optimization.  Pass thru allows "
 			"rxm to pass all data transfer calls directly to the "
@@ -723,6 +731,17 @@ RXM_INI
 			"to the tcp provider, depending on the capabilities "
 			"requested by the application.");
 
+	fi_param_define(&rxm_prov, "max_conns", FI_PARAM_SIZE_T,
+			"Number of connections an endpoint keeps open before "
+			"it starts closing idle ones, least recently used "
+			"first.  Closed connections are reopened on next use. "
+			"(default: 0, no limit)");
+
+	fi_param_define(&rxm_prov, "conn_idle_time", FI_PARAM_INT,
+			"Time in milliseconds a connection must go without "
+			"traffic in either direction before it may be closed "
+			"to stay under max_conns. (default: 100)");
+
 	/* passthru supported disabled - to re-enable would need to fix call to
 	 * fi_cq_read to pass in the correct data structure.  However, passthru
 	 * will not be needed at all with in-work tcp changes.
@@ -740,6 +759,8 @@ RXM_INI
 		rxm_cq_eq_fairness = 128;
 	fi_param_get_bool(&rxm_prov, "data_auto_progress", &force_auto_progress);
 	fi_param_get_bool(&rxm_prov, "use_rndv_write", &rxm_use_write_rndv);
+	fi_param_get_size_t(&rxm_prov, "max_conns", &rxm_max_conns);
+	fi_param_get_int(&rxm_prov, "conn_idle_time", &rxm_conn_idle_time);
 
 	rxm_get_def_wait();
 
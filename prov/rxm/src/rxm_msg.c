@@ -55,15 +55,14 @@ ssize_t rxm_handle_unexp_sar(struct rxm_recv_queue *recv_queue,
 	if (ret || last)
 		return ret;
 
-	match_attr.addr = recv_entry->addr;
-	match_attr.tag = recv_entry->tag;
-	match_attr.ignore = recv_entry->ignore;
+	match_attr.addr = recv_entry->match.addr;
+	match_attr.tag = recv_entry->match.tag;
+	match_attr.ignore = recv_entry->match.ignore;
 
-	dlist_foreach_container_safe(&recv_queue->unexp_msg_list,
+	dlist_foreach_container_safe(&recv_queue->unexp_mq.list,
 					struct rxm_rx_buf, rx_buf,
-					unexp_msg.entry, entry) {
-		if (!recv_queue->match_unexp(&rx_buf->unexp_msg.entry,
-						&match_attr))
+					unexp_msg.match.list_entry, entry) {
+		if (!rxm_unexp_match(recv_queue, rx_buf, &match_attr))
 			continue;
 		/* Handle unordered completions from MSG provider */
 		if ((rx_buf->pkt.ctrl_hdr.msg_id != recv_entry->sar.msg_id) ||
@@ -77,7 +76,7 @@ ssize_t rxm_handle_unexp_sar(struct rxm_recv_queue *recv_queue,
 		if (recv_entry->sar.conn != rx_buf->conn)
 			continue;
 		rx_buf->recv_entry = recv_entry;
-		dlist_remove(&rx_buf->unexp_msg.entry);
+		rxm_unexp_queue_remove(recv_queue, rx_buf);
 		last = rxm_sar_get_seg_type(&rx_buf->pkt.ctrl_hdr) ==
 		       RXM_SAR_SEG_LAST;
 		ret = rxm_handle_rx_buf(rx_buf);
@@ -114,14 +113,14 @@ rxm_post_mrecv(struct rxm_ep *ep, const struct iovec *iov,
 			break;
 		}
 
-		rx_buf = rxm_get_unexp_msg(&ep->recv_queue, recv_entry->addr, 0,  0);
+		rx_buf = rxm_get_unexp_msg(&ep->recv_queue,
+					   recv_entry->match.addr, 0,  0);
 		if (!rx_buf) {
-			dlist_insert_tail(&recv_entry->entry,
-					  &ep->recv_queue.recv_list);
+			rxm_recv_queue_post(&ep->recv_queue, recv_entry);
 			return 0;
 		}
 
-		dlist_remove(&rx_buf->unexp_msg.entry);
+		rxm_unexp_queue_remove(&ep->recv_queue, rx_buf);
 		rx_buf->recv_entry = recv_entry;
 		recv_entry->flags &= ~FI_MULTI_RECV;
 		recv_entry->total_len = MIN(cur_iov.iov_len, rx_buf->pkt.hdr.size);
@@ -173,15 +172,15 @@ rxm_recv_common(struct rxm_ep *rxm_ep, const struct iovec *iov,
 		goto release;
 	}
 
-	rx_buf = rxm_get_unexp_msg(&rxm_ep->recv_queue, recv_entry->addr, 0,  0);
+	rx_buf = rxm_get_unexp_msg(&rxm_ep->recv_queue,
+				   recv_entry->match.addr, 0,  0);
 	if (!rx_buf) {
-		dlist_insert_tail(&recv_entry->entry,
-				  &rxm_ep->recv_queue.recv_list);
+		rxm_recv_queue_post(&rxm_ep->recv_queue, recv_entry);
 		ret = FI_SUCCESS;
 		goto release;
 	}
 
-	dlist_remove(&rx_buf->unexp_msg.entry);
+	rxm_unexp_queue_remove(&rxm_ep->recv_queue, rx_buf);
 	rx_buf->recv_entry = recv_entry;
 
 	ret = (rx_buf->pkt.ctrl_hdr.type != rxm_ctrl_seg) ?
@@ -316,8 +315,8 @@ rxm_alloc_rndv_buf(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 		mr_iov = rxm_mr_msg_mr;
 	}
 
+	(*rndv_buf)->write_rndv.conn = rxm_conn;
 	if (rxm_ep->rndv_ops == &rxm_rndv_ops_write) {
-		(*rndv_buf)->write_rndv.conn = rxm_conn;
 		for (i = 0; i < count; i++) {
 			(*rndv_buf)->write_rndv.iov[i] = iov[i];
 			(*rndv_buf)->write_rndv.desc[i] = fi_mr_desc(mr_iov[i]);
@@ -369,6 +368,8 @@ rxm_send_rndv(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	if (ret)
 		goto err;
 
+	if (rxm_max_conns)
+		rxm_conn->rndv_cnt++;
 	return FI_SUCCESS;
 
 err:
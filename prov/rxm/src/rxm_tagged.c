@@ -48,7 +48,8 @@ rxm_discard_recv(struct rxm_ep *rxm_ep, struct rxm_rx_buf *rx_buf,
 		 void *context)
 {
 	RXM_DBG_ADDR_TAG(FI_LOG_EP_DATA, "Discarding message",
-			 rx_buf->unexp_msg.addr, rx_buf->unexp_msg.tag);
+			 rx_buf->unexp_msg.match.addr,
+			 rx_buf->unexp_msg.match.tag);
 
 	rxm_cq_write(rxm_ep->util_ep.rx_cq, context, FI_TAGGED | FI_RECV,
 		     0, NULL, rx_buf->pkt.hdr.data, rx_buf->pkt.hdr.tag);
@@ -83,7 +84,7 @@ rxm_peek_recv(struct rxm_ep *rxm_ep, fi_addr_t addr, uint64_t tag,
 	FI_DBG(&rxm_prov, FI_LOG_EP_DATA, "Message found\n");
 
 	if (flags & FI_DISCARD) {
-		dlist_remove(&rx_buf->unexp_msg.entry);
+		rxm_unexp_queue_remove(recv_queue, rx_buf);
 		rxm_discard_recv(rxm_ep, rx_buf, context);
 		return;
 	}
@@ -91,7 +92,7 @@ rxm_peek_recv(struct rxm_ep *rxm_ep, fi_addr_t addr, uint64_t tag,
 	if (flags & FI_CLAIM) {
 		FI_DBG(&rxm_prov, FI_LOG_EP_DATA, "Marking message for Claim\n");
 		((struct fi_context *)context)->internal[0] = rx_buf;
-		dlist_remove(&rx_buf->unexp_msg.entry);
+		rxm_unexp_queue_remove(recv_queue, rx_buf);
 	}
 
 	rxm_cq_write(rxm_ep->util_ep.rx_cq, context, FI_TAGGED | FI_RECV,
@@ -115,15 +116,15 @@ rxm_post_trecv(struct rxm_ep *rxm_ep, const struct iovec *iov,
 	if (!recv_entry)
 		return -FI_EAGAIN;
 
-	rx_buf = rxm_get_unexp_msg(&rxm_ep->trecv_queue, recv_entry->addr,
-				   recv_entry->tag, recv_entry->ignore);
+	rx_buf = rxm_get_unexp_msg(&rxm_ep->trecv_queue, recv_entry->match.addr,
+				   recv_entry->match.tag,
+				   recv_entry->match.ignore);
 	if (!rx_buf) {
-		dlist_insert_tail(&recv_entry->entry,
-				  &rxm_ep->trecv_queue.recv_list);
+		rxm_recv_queue_post(&rxm_ep->trecv_queue, recv_entry);
 		return FI_SUCCESS;
 	}
 
-	dlist_remove(&rx_buf->unexp_msg.entry);
+	rxm_unexp_queue_remove(&rxm_ep->trecv_queue, rx_buf);
 	rx_buf->recv_entry = recv_entry;
 
 	if (rx_buf->pkt.ctrl_hdr.type != rxm_ctrl_seg)
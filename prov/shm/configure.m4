@@ -12,6 +12,7 @@ AC_DEFUN([FI_SHM_CONFIGURE],[
 	shm_happy=0
 	cma_happy=0
 	dsa_happy=0
+	xpmem_happy=0
 	AS_IF([test x"$enable_shm" != x"no"],
 	      [
 	       # check if CMA support are present
@@ -81,6 +82,34 @@ AC_DEFUN([FI_SHM_CONFIGURE],[
 	      AC_DEFINE_UNQUOTED([SHM_HAVE_DSA],[$dsa_happy],
 				 [Whether DSA support is available])
 
+	      AC_ARG_WITH([xpmem],
+			  [AS_HELP_STRING([--with-xpmem=DIR],
+					  [Enable XPMEM for the shm attach protocol
+					   and fail if not found.
+					   Optional=<Path to where the XPMEM
+					   libraries and headers are installed.>])])
+
+	      AS_IF([test "x$with_xpmem" != "xno"],
+		    [FI_CHECK_PACKAGE([xpmem],
+				      [xpmem.h],
+				      [xpmem],
+				      [xpmem_make],
+				      [],
+				      [$with_xpmem],
+				      [],
+				      [xpmem_happy=1])])
+
+	      AS_IF([test "x$with_xpmem" != "xno" && test -n "$with_xpmem" && test $xpmem_happy -eq 0 ],
+		    [AC_MSG_ERROR([shm XPMEM support requested but XPMEM not available.])])
+
+	      AS_IF([test $xpmem_happy -eq 1 && test "x$with_xpmem" != "xyes"],
+		    [shm_CPPFLAGS="$shm_CPPFLAGS $xpmem_CPPFLAGS"
+		     shm_LDFLAGS="$shm_LDFLAGS $xpmem_LDFLAGS"])
+	      shm_LIBS="$shm_LIBS $xpmem_LIBS"
+
+	      AC_DEFINE_UNQUOTED([SHM_HAVE_XPMEM],[$xpmem_happy],
+				 [Whether XPMEM support is available])
+
 	      AC_SUBST(shm_CPPFLAGS)
 	      AC_SUBST(shm_LDFLAGS)
 	      AC_SUBST(shm_LIBS)
@@ -70,9 +70,14 @@
 #define _SMR_H_
 
 struct smr_env {
+	size_t inline_threshold;
+	size_t inject_threshold;
+	size_t cma_threshold;
 	size_t sar_threshold;
 	int disable_cma;
 	int use_dsa_sar;
+	int enable_direct_rma;
+	int disable_attach;
 };
 
 extern struct smr_env smr_env;
@@ -135,6 +140,7 @@ struct smr_tx_entry {
 	enum fi_hmem_iface	iface;
 	uint64_t		device;
 	int			fd;
+	struct ofi_mr_entry	*mr_entry;
 };
 
 struct smr_sar_entry {
@@ -216,9 +222,19 @@ struct smr_fabric {
 struct smr_domain {
 	struct util_domain	util_domain;
 	int			fast_rma;
+	/* atomics may use the non-atomic reduce kernels */
+	int			fast_atomic;
 	/* cache for use with hmem ipc */
 	struct ofi_mr_cache	*ipc_cache;
 	struct fid_peer_srx	*srx;
+	/* shared mapping registrations published to endpoint regions */
+	ofi_mutex_t		direct_lock;
+	struct dlist_entry	direct_ep_list;
+	struct smr_mr_entry	mr_table[SMR_MR_TABLE_SIZE];
+	/* send buffers the attach protocol can reference */
+	struct ofi_mr_cache	*attach_cache;
+	ofi_atomic64_t		attach_handle;
+	int64_t			xpmem_segid;
 };
 
 #define SMR_PREFIX	"fi_shm://"
@@ -266,7 +282,7 @@ struct smr_sock_info {
 	pthread_t		listener_thread;
 	int			*my_fds;
 	int			nfds;
-	struct smr_cmap_entry	peers[SMR_MAX_PEERS];
+	struct smr_cmap_entry	*peers;
 };
 
 struct smr_srx_ctx {
@@ -296,8 +312,11 @@ struct smr_ep {
 	uint64_t		msg_id;
 	struct smr_region	*volatile region;
 	//if double locking is needed, shm region lock must
-	//be acquired before any shm EP locks
+	//be acquired before tx_lock
 	ofi_spin_t		tx_lock;
+	//serializes the consumer side of the region's cmd queue,
+	//the region lock may be taken briefly while holding it
+	ofi_spin_t		rx_lock;
 
 	struct fid_ep		*srx;
 	struct smr_cmd_ctx_fs	*cmd_ctx_fs;
@@ -305,10 +324,16 @@ struct smr_ep {
 	struct smr_sar_fs	*sar_fs;
 
 	struct dlist_entry	sar_list;
+	/* attach receives waiting for the sender to resend through SAR */
+	struct dlist_entry	attach_list;
 
 	int			ep_idx;
 	struct smr_sock_info	*sock_info;
 	void			*dsa_context;
+
+	struct dlist_entry	direct_entry;
+	struct smr_direct_map	*direct_cache;
+	struct smr_attach_map	*attach_cache;
 };
 
 static inline struct smr_srx_ctx *smr_get_smr_srx(struct smr_ep *ep)
@@ -360,10 +385,30 @@ size_t smr_copy_from_sar(struct smr_freestack *sar_pool, struct smr_resp *resp,
 			 uint64_t device, const struct iovec *iov, size_t count,
 			 size_t *bytes_done, int *next);
 
-int smr_select_proto(bool use_ipc, bool cma_avail, enum fi_hmem_iface iface,
-		     uint32_t op, uint64_t total_len, uint64_t op_flags);
+int smr_select_proto(bool use_ipc, bool cma_avail, bool attach_avail,
+		     enum fi_hmem_iface iface, uint32_t op, uint64_t total_len,
+		     uint64_t op_flags);
+
+/* Protocols that draw from the peer's inject or SAR pools and so must be
+ * started under the peer region lock. IPC and attach may fall back to SAR. */
+static inline bool smr_proto_uses_pool(int proto)
+{
+	return proto == smr_src_inject || proto == smr_src_sar ||
+	       proto == smr_src_ipc || proto == smr_src_attach;
+}
+
+void smr_abort_cmds(struct smr_region *peer_smr, int64_t pos, int cnt);
+
+/* Split the SAR pool evenly, but always let each peer make progress */
+static inline void smr_set_sar_buf_per_peer(struct smr_region *smr,
+					    int num_peers)
+{
+	smr->max_sar_buf_per_peer = num_peers ?
+		MAX(1, SMR_SAR_BUF_CNT / num_peers) : SMR_BUF_BATCH_MAX;
+}
+
 typedef ssize_t (*smr_proto_func)(struct smr_ep *ep, struct smr_region *peer_smr,
-		int64_t id, int64_t peer_id, uint32_t op, uint64_t tag,
+		struct smr_cmd *cmd, int64_t id, int64_t peer_id, uint32_t op, uint64_t tag,
 		uint64_t data, uint64_t op_flags, enum fi_hmem_iface iface,
 		uint64_t device, const struct iovec *iov, size_t iov_count,
 		size_t total_len, void *context);
@@ -449,4 +494,48 @@ static inline int smr_cma_loop(pid_t pid, struct iovec *local,
 }
 
 int smr_unexp_start(struct fi_peer_rx_entry *rx_entry);
+
+void smr_direct_mr_publish(struct smr_domain *domain, struct ofi_mr *mr,
+			   const struct fi_mr_attr *attr);
+void smr_direct_ep_init(struct smr_ep *ep);
+void smr_direct_ep_cleanup(struct smr_ep *ep);
+ssize_t smr_direct_rma(struct smr_ep *ep, int64_t id, const struct iovec *iov,
+		       size_t iov_count, const struct fi_rma_iov *rma_iov,
+		       uint32_t op);
+ssize_t smr_direct_atomic(struct smr_ep *ep, int64_t id,
+			  const struct fi_rma_ioc *rma_ioc,
+			  enum fi_datatype datatype, enum fi_op atomic_op,
+			  uint32_t op, const void *buf, const void *compare,
+			  void *result);
+int smr_direct_find_file(const void *buf, size_t len,
+			 struct smr_mr_entry *entry);
+
+#define SMR_ATTACH_MIN_SIZE	SMR_SAR_SIZE
+
+/* The peer has not failed to map one of our buffers */
+static inline bool smr_attach_enabled(struct smr_ep *ep,
+				      struct smr_region *peer_smr,
+				      int64_t peer_id, size_t iov_count)
+{
+	struct smr_domain *domain;
+
+	domain = container_of(ep->util_ep.domain, struct smr_domain,
+			      util_domain);
+	return iov_count == 1 && domain->attach_cache &&
+	       !smr_peer_data(peer_smr)[peer_id].attach_failed;
+}
+
+void smr_init_thresholds(void);
+void smr_check_thresholds(void);
+
+void smr_attach_init(struct smr_domain *domain);
+void smr_attach_cleanup(struct smr_domain *domain);
+int smr_attach_get(struct smr_ep *ep, uint32_t op, const struct iovec *iov,
+		   struct smr_attach_info *info, struct ofi_mr_entry **entry);
+void smr_attach_put(struct smr_ep *ep, struct ofi_mr_entry *entry);
+int smr_attach_resend_sar(struct smr_ep *ep, struct smr_tx_entry *pending,
+			  struct smr_resp *resp);
+int smr_attach_copy(struct smr_ep *ep, struct smr_cmd *cmd,
+		    struct iovec *iov, size_t iov_count);
+void smr_attach_ep_cleanup(struct smr_ep *ep);
 #endif
@@ -65,21 +65,15 @@ static void smr_format_inline_atomic(struct smr_cmd *cmd,
 }
 
 static void smr_do_atomic_inline(struct smr_ep *ep, struct smr_region *peer_smr,
-			int64_t id, int64_t peer_id, uint32_t op,
-			uint64_t op_flags, enum fi_hmem_iface iface,
+			struct smr_cmd *cmd, int64_t id, int64_t peer_id,
+			uint32_t op, uint64_t op_flags, enum fi_hmem_iface iface,
 			uint64_t device, uint8_t datatype, uint8_t atomic_op,
 			const struct iovec *iov, size_t iov_count,
 			size_t total_len)
 {
-	struct smr_cmd *cmd;
-
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
 	smr_generic_format(cmd, peer_id, op, 0, 0, op_flags);
 	smr_generic_atomic_format(cmd, datatype, atomic_op);
 	smr_format_inline_atomic(cmd, iface, device, iov, iov_count);
-
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
 }
 
 static void smr_format_inject_atomic(struct smr_cmd *cmd,
@@ -124,20 +118,18 @@ static void smr_format_inject_atomic(struct smr_cmd *cmd,
 }
 
 static ssize_t smr_do_atomic_inject(struct smr_ep *ep, struct smr_region *peer_smr,
-			int64_t id, int64_t peer_id, uint32_t op,
-			uint64_t op_flags, enum fi_hmem_iface iface,
+			struct smr_cmd *cmd, int64_t id, int64_t peer_id,
+			uint32_t op, uint64_t op_flags, enum fi_hmem_iface iface,
 			uint64_t device, uint8_t datatype, uint8_t atomic_op,
 			const struct iovec *iov, size_t iov_count,
 			const struct iovec *resultv, size_t result_count,
 			const struct iovec *compv, size_t comp_count,
 			size_t total_len, void *context, uint16_t smr_flags)
 {
-	struct smr_cmd *cmd;
 	struct smr_inject_buf *tx_buf;
 	struct smr_tx_entry *pend;
 	struct smr_resp *resp;
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
 	tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
 
 	smr_generic_format(cmd, peer_id, op, 0, 0, op_flags);
@@ -147,21 +139,19 @@ static ssize_t smr_do_atomic_inject(struct smr_ep *ep, struct smr_region *peer_s
 				 peer_smr, tx_buf);
 
 	if (smr_flags & SMR_RMA_REQ || op_flags & FI_DELIVERY_COMPLETE) {
-		if (ofi_cirque_isfull(smr_resp_queue(ep->region))) {
+		if (smr_resp_queue_isfull(smr_resp_queue(ep->region))) {
 			smr_freestack_push(smr_inject_pool(peer_smr), tx_buf);
 			return -FI_EAGAIN;
 		}
-		resp = ofi_cirque_next(smr_resp_queue(ep->region));
+		resp = smr_resp_queue_next(smr_resp_queue(ep->region));
 		pend = ofi_freestack_pop(ep->pend_fs);
 		smr_format_pend_resp(pend, cmd, context, iface, device, resultv,
 				     result_count, op_flags, id, resp);
 		cmd->msg.hdr.data = smr_get_offset(ep->region, resp);
-		ofi_cirque_commit(smr_resp_queue(ep->region));
+		smr_resp_queue_advance(smr_resp_queue(ep->region));
 	}
 
 	cmd->msg.hdr.op_flags |= smr_flags;
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
 
 	return FI_SUCCESS;
 }
@@ -186,15 +176,16 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 			enum fi_op atomic_op, void *context, uint32_t op,
 			uint64_t op_flags)
 {
+	struct smr_domain *domain;
 	struct smr_cmd *cmd;
 	struct smr_region *peer_smr;
 	struct iovec iov[SMR_IOV_LIMIT];
 	struct iovec compare_iov[SMR_IOV_LIMIT];
 	struct iovec result_iov[SMR_IOV_LIMIT];
 	enum fi_hmem_iface iface;
-	uint64_t device;
+	uint64_t device, local_device;
 	uint16_t smr_flags = 0;
-	int64_t id, peer_id;
+	int64_t id, peer_id, pos;
 	int proto;
 	ssize_t ret = 0;
 	size_t total_len;
@@ -211,13 +202,6 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 	peer_id = smr_peer_data(ep->region)[id].addr.id;
 	peer_smr = smr_peer_region(ep->region, id);
 
-	pthread_spin_lock(&peer_smr->lock);
-	if (peer_smr->cmd_cnt < 2 || smr_peer_data(ep->region)[id].sar_status) {
-		ret = -FI_EAGAIN;
-		goto unlock_region;
-	}
-
-	ofi_spin_lock(&ep->tx_lock);
 	total_len = ofi_datatype_size(datatype) * ofi_total_ioc_cnt(ioc, count);
 
 	switch (op) {
@@ -247,20 +231,58 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 
 	iface = smr_get_mr_hmem_iface(ep->util_ep.domain, desc, &device);
 
+	domain = container_of(ep->util_ep.domain, struct smr_domain,
+			      util_domain);
+	if (domain->fast_rma && rma_count == 1 && count <= 1 &&
+	    compare_count <= 1 && result_count <= 1 &&
+	    iface == FI_HMEM_SYSTEM &&
+	    smr_get_mr_hmem_iface(ep->util_ep.domain, compare_desc,
+				  &local_device) == FI_HMEM_SYSTEM &&
+	    smr_get_mr_hmem_iface(ep->util_ep.domain, result_desc,
+				  &local_device) == FI_HMEM_SYSTEM) {
+		ofi_spin_lock(&ep->tx_lock);
+		if (!smr_direct_atomic(ep, id, rma_ioc, datatype, atomic_op, op,
+				       count ? ioc[0].addr : NULL,
+				       compare_count ? compare_ioc[0].addr : NULL,
+				       result_count ? result_ioc[0].addr : NULL)) {
+			ret = smr_complete_tx(ep, context, op, op_flags);
+			if (ret) {
+				FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+					"unable to process tx completion\n");
+			}
+			ofi_spin_unlock(&ep->tx_lock);
+			return ret;
+		}
+		ofi_spin_unlock(&ep->tx_lock);
+	}
+
 	proto = smr_select_atomic_proto(op, total_len, op_flags);
+	if (proto == smr_src_inject)
+		pthread_spin_lock(&peer_smr->lock);
+
+	ofi_spin_lock(&ep->tx_lock);
+	if (smr_peer_data(ep->region)[id].sar_status ||
+	    !smr_cmd_credit_get(peer_smr, 2)) {
+		ret = -FI_EAGAIN;
+		goto unlock;
+	}
 
+	pos = smr_cmd_queue_reserve(smr_cmd_queue(peer_smr), 2);
+	cmd = smr_cmd_queue_get(smr_cmd_queue(peer_smr), pos);
 	if (proto == smr_src_inline) {
-		smr_do_atomic_inline(ep, peer_smr, id, peer_id, ofi_op_atomic,
-			 	     op_flags, iface, device, datatype, atomic_op,
-				     iov, count, total_len);
+		smr_do_atomic_inline(ep, peer_smr, cmd, id, peer_id,
+				     ofi_op_atomic, op_flags, iface, device,
+				     datatype, atomic_op, iov, count, total_len);
 	} else {
-		ret = smr_do_atomic_inject(ep, peer_smr, id, peer_id, op,
+		ret = smr_do_atomic_inject(ep, peer_smr, cmd, id, peer_id, op,
 				op_flags, iface, device, datatype, atomic_op,
 				iov, count, result_iov, result_count,
 				compare_iov, compare_count, total_len, context,
 				smr_flags);
-		if (ret)
-			goto unlock_cq;
+		if (ret) {
+			smr_abort_cmds(peer_smr, pos, 2);
+			goto unlock;
+		}
 	}
 
 	if (!(smr_flags & SMR_RMA_REQ) && !(op_flags & FI_DELIVERY_COMPLETE)) {
@@ -271,15 +293,16 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 		}
 	}
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
-	smr_format_rma_ioc(cmd, rma_ioc, rma_count);
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	/* rma cmd goes first so the receiver sees the pair complete */
+	smr_format_rma_ioc(smr_cmd_queue_get(smr_cmd_queue(peer_smr), pos + 1),
+			   rma_ioc, rma_count);
+	smr_cmd_queue_commit(smr_cmd_queue(peer_smr), pos + 1);
+	smr_cmd_queue_commit(smr_cmd_queue(peer_smr), pos);
 	smr_signal(peer_smr);
-unlock_cq:
+unlock:
 	ofi_spin_unlock(&ep->tx_lock);
-unlock_region:
-	pthread_spin_unlock(&peer_smr->lock);
+	if (proto == smr_src_inject)
+		pthread_spin_unlock(&peer_smr->lock);
 	return ret;
 }
 
@@ -343,16 +366,20 @@ static ssize_t smr_atomic_inject(struct fid_ep *ep_fid, const void *buf,
 			size_t count, fi_addr_t dest_addr, uint64_t addr,
 			uint64_t key, enum fi_datatype datatype, enum fi_op op)
 {
+	struct smr_domain *domain;
 	struct smr_cmd *cmd;
 	struct smr_ep *ep;
 	struct smr_region *peer_smr;
 	struct iovec iov;
 	struct fi_rma_ioc rma_ioc;
-	int64_t id, peer_id;
+	int64_t id, peer_id, pos;
 	ssize_t ret = 0;
 	size_t total_len;
+	bool use_pool;
 
 	ep = container_of(ep_fid, struct smr_ep, util_ep.ep_fid.fid);
+	domain = container_of(ep->util_ep.domain, struct smr_domain,
+			      util_domain);
 
 	id = smr_verify_peer(ep, dest_addr);
 	if (id < 0)
@@ -361,44 +388,66 @@ static ssize_t smr_atomic_inject(struct fid_ep *ep_fid, const void *buf,
 	peer_id = smr_peer_data(ep->region)[id].addr.id;
 	peer_smr = smr_peer_region(ep->region, id);
 
-	pthread_spin_lock(&peer_smr->lock);
-	if (peer_smr->cmd_cnt < 2 || smr_peer_data(ep->region)[id].sar_status) {
-		ret = -FI_EAGAIN;
-		goto unlock_region;
-	}
-
 	total_len = count * ofi_datatype_size(datatype);
 	assert(total_len <= SMR_INJECT_SIZE);
 
-	iov.iov_base = (void *) buf;
-	iov.iov_len = total_len;
-
 	rma_ioc.addr = addr;
 	rma_ioc.count = count;
 	rma_ioc.key = key;
 
+	if (domain->fast_rma) {
+		ofi_spin_lock(&ep->tx_lock);
+		if (!smr_direct_atomic(ep, id, &rma_ioc, datatype, op,
+				       ofi_op_atomic, buf, NULL, NULL)) {
+			ofi_ep_tx_cntr_inc_func(&ep->util_ep, ofi_op_atomic);
+			ofi_spin_unlock(&ep->tx_lock);
+			return 0;
+		}
+		ofi_spin_unlock(&ep->tx_lock);
+	}
+
+	use_pool = total_len > SMR_MSG_DATA_LEN;
+	if (use_pool)
+		pthread_spin_lock(&peer_smr->lock);
+
+	ofi_spin_lock(&ep->tx_lock);
+	if (smr_peer_data(ep->region)[id].sar_status ||
+	    !smr_cmd_credit_get(peer_smr, 2)) {
+		ret = -FI_EAGAIN;
+		goto unlock;
+	}
+
+	iov.iov_base = (void *) buf;
+	iov.iov_len = total_len;
+
+	pos = smr_cmd_queue_reserve(smr_cmd_queue(peer_smr), 2);
+	cmd = smr_cmd_queue_get(smr_cmd_queue(peer_smr), pos);
 	if (total_len <= SMR_MSG_DATA_LEN) {
-		smr_do_atomic_inline(ep, peer_smr, id, peer_id, ofi_op_atomic,
-			 	     0, FI_HMEM_SYSTEM, 0, datatype, op,
-				     &iov, 1, total_len);
+		smr_do_atomic_inline(ep, peer_smr, cmd, id, peer_id,
+				     ofi_op_atomic, 0, FI_HMEM_SYSTEM, 0,
+				     datatype, op, &iov, 1, total_len);
 	} else if (total_len <= SMR_INJECT_SIZE) {
-		ret = smr_do_atomic_inject(ep, peer_smr, id, peer_id,
+		ret = smr_do_atomic_inject(ep, peer_smr, cmd, id, peer_id,
 				ofi_op_atomic, 0, FI_HMEM_SYSTEM, 0, datatype,
 				op, &iov, 1, NULL, 0, NULL, 0, total_len,
 				NULL, 0);
-		if (ret)
-			goto unlock_region;
+		if (ret) {
+			smr_abort_cmds(peer_smr, pos, 2);
+			goto unlock;
+		}
 	}
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
-	smr_format_rma_ioc(cmd, &rma_ioc, 1);
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_format_rma_ioc(smr_cmd_queue_get(smr_cmd_queue(peer_smr), pos + 1),
+			   &rma_ioc, 1);
+	smr_cmd_queue_commit(smr_cmd_queue(peer_smr), pos + 1);
+	smr_cmd_queue_commit(smr_cmd_queue(peer_smr), pos);
 	smr_signal(peer_smr);
 
 	ofi_ep_tx_cntr_inc_func(&ep->util_ep, ofi_op_atomic);
-unlock_region:
-	pthread_spin_unlock(&peer_smr->lock);
+unlock:
+	ofi_spin_unlock(&ep->tx_lock);
+	if (use_pool)
+		pthread_spin_unlock(&peer_smr->lock);
 	return ret;
 }
 
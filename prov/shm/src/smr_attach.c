@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Attach protocol.  A large send references a mapping of the sender's
+ * buffer instead of its address: the sender's address space exported
+ * with XPMEM, or otherwise the shared file backing the buffer.  The
+ * receiver maps it once and keeps the mapping, so later transfers from
+ * the same buffer are a single memcpy.
+ *
+ * Senders keep the mappings of their buffers in an MR cache, which the
+ * memory monitor invalidates when the buffer is unmapped.  Each cache
+ * entry gets a handle that the sender never reuses, and receivers key
+ * their mappings on it.  Receivers fall back to CMA when they cannot
+ * map the buffer, or without CMA ask the sender to resend through SAR.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "smr.h"
+
+#if SHM_HAVE_XPMEM
+#include <xpmem.h>
+#endif
+
+#define SMR_ATTACH_CACHE_SIZE	256
+
+/* Sender side, stored in the MR cache entry */
+struct smr_attach_region {
+	uint64_t	handle;
+	uint64_t	file_off;
+	uint64_t	dev;
+	uint64_t	ino;
+	int		fd;
+	int		writable;
+	int		type;
+};
+
+#define SMR_ATTACH_NONE	(-1)
+
+/* Receiver side mapping of a peer's handle */
+struct smr_attach_map {
+	struct smr_region	*peer_smr;
+	int			pid;
+	int			prot;
+	int			type;
+	uint64_t		handle;
+	uint64_t		len;
+	char			*base;
+	void			*map_addr;
+	size_t			map_len;
+	int64_t			apid;
+};
+
+static int smr_attach_add_region(struct ofi_mr_cache *cache,
+				 struct ofi_mr_entry *entry)
+{
+	struct smr_attach_region *region = (void *) entry->data;
+	struct smr_domain *domain;
+	struct smr_mr_entry file;
+	struct stat st;
+
+	domain = container_of(cache->domain, struct smr_domain, util_domain);
+	region->handle = ofi_atomic_inc64(&domain->attach_handle);
+	region->fd = -1;
+	region->writable = 0;
+
+	if (domain->xpmem_segid >= 0) {
+		region->type = SMR_ATTACH_XPMEM;
+		region->writable = 1;
+		return 0;
+	}
+
+	/* Buffers that cannot be attached are cached too, so that they are
+	 * not looked up again on every send.
+	 */
+	region->type = SMR_ATTACH_NONE;
+	if (smr_direct_find_file(entry->info.iov.iov_base,
+				 entry->info.iov.iov_len, &file))
+		return 0;
+
+	region->fd = open(file.path, O_RDWR | O_CLOEXEC);
+	if (region->fd >= 0) {
+		region->writable = 1;
+	} else {
+		region->fd = open(file.path, O_RDONLY | O_CLOEXEC);
+		if (region->fd < 0)
+			return 0;
+	}
+
+	if (fstat(region->fd, &st) || st.st_dev != file.dev ||
+	    st.st_ino != file.ino) {
+		close(region->fd);
+		region->fd = -1;
+		return 0;
+	}
+
+	region->type = SMR_ATTACH_FILE;
+	region->file_off = file.file_off;
+	region->dev = file.dev;
+	region->ino = file.ino;
+	return 0;
+}
+
+static void smr_attach_delete_region(struct ofi_mr_cache *cache,
+				     struct ofi_mr_entry *entry)
+{
+	struct smr_attach_region *region = (void *) entry->data;
+
+	if (region->fd >= 0)
+		close(region->fd);
+}
+
+void smr_attach_init(struct smr_domain *domain)
+{
+	struct ofi_mem_monitor *monitors[OFI_HMEM_MAX] = {0};
+	int ret;
+
+	ofi_atomic_initialize64(&domain->attach_handle, 0);
+	domain->xpmem_segid = -1;
+	domain->attach_cache = NULL;
+
+	if (smr_env.disable_attach || !default_monitor)
+		return;
+
+	domain->attach_cache = calloc(1, sizeof(*domain->attach_cache));
+	if (!domain->attach_cache)
+		return;
+
+#if SHM_HAVE_XPMEM
+	domain->xpmem_segid = xpmem_make(0, XPMEM_MAXADDR_SIZE,
+					 XPMEM_PERMIT_MODE, (void *) 0600);
+	if (domain->xpmem_segid < 0)
+		domain->xpmem_segid = -1;
+#endif
+
+	monitors[FI_HMEM_SYSTEM] = default_monitor;
+	domain->attach_cache->entry_data_size =
+		sizeof(struct smr_attach_region);
+	domain->attach_cache->add_region = smr_attach_add_region;
+	domain->attach_cache->delete_region = smr_attach_delete_region;
+	ret = ofi_mr_cache_init(&domain->util_domain, monitors,
+				domain->attach_cache);
+	if (ret) {
+		FI_INFO(&smr_prov, FI_LOG_DOMAIN,
+			"attach protocol disabled: %s\n", fi_strerror(-ret));
+		smr_attach_cleanup(domain);
+	}
+}
+
+void smr_attach_cleanup(struct smr_domain *domain)
+{
+	if (domain->attach_cache && domain->attach_cache->domain)
+		ofi_mr_cache_cleanup(domain->attach_cache);
+	free(domain->attach_cache);
+	domain->attach_cache = NULL;
+
+#if SHM_HAVE_XPMEM
+	if (domain->xpmem_segid >= 0)
+		xpmem_remove(domain->xpmem_segid);
+#endif
+	domain->xpmem_segid = -1;
+}
+
+int smr_attach_get(struct smr_ep *ep, uint32_t op, const struct iovec *iov,
+		   struct smr_attach_info *info, struct ofi_mr_entry **entry)
+{
+	struct smr_attach_region *region;
+	struct smr_domain *domain;
+	struct ofi_mr_info mr_info;
+	int ret;
+
+	domain = container_of(ep->util_ep.domain, struct smr_domain,
+			      util_domain);
+	if (!domain->attach_cache)
+		return -FI_ENOSYS;
+
+	memset(&mr_info, 0, sizeof(mr_info));
+	mr_info.iov = *iov;
+	mr_info.iface = FI_HMEM_SYSTEM;
+	ret = ofi_mr_cache_search(domain->attach_cache, &mr_info, entry);
+	if (ret)
+		return ret;
+
+	region = (void *) (*entry)->data;
+	if (region->type == SMR_ATTACH_NONE ||
+	    (op == ofi_op_read_req && !region->writable)) {
+		ofi_mr_cache_delete(domain->attach_cache, *entry);
+		return -FI_ENOENT;
+	}
+
+	info->type = region->type;
+	info->handle = region->handle;
+	info->addr = (uintptr_t) iov->iov_base;
+	info->map_len = (*entry)->info.iov.iov_len;
+	info->offset = (uintptr_t) iov->iov_base -
+		       (uintptr_t) (*entry)->info.iov.iov_base;
+	if (region->type == SMR_ATTACH_XPMEM) {
+		info->map_off = (uintptr_t) (*entry)->info.iov.iov_base;
+		info->segid = domain->xpmem_segid;
+	} else {
+		info->map_off = region->file_off;
+		info->dev = region->dev;
+		info->ino = region->ino;
+		info->fd = region->fd;
+	}
+	return 0;
+}
+
+void smr_attach_put(struct smr_ep *ep, struct ofi_mr_entry *entry)
+{
+	struct smr_domain *domain;
+
+	domain = container_of(ep->util_ep.domain, struct smr_domain,
+			      util_domain);
+	ofi_mr_cache_delete(domain->attach_cache, entry);
+}
+
+/* Duplicate the sender's descriptor, or open it again through /proc on
+ * kernels without pidfd_getfd.
+ */
+static int smr_attach_peer_fd(int pid, int fd)
+{
+	char path[32];
+	int ret;
+#if defined(SYS_pidfd_open) && defined(SYS_pidfd_getfd)
+	int pidfd;
+
+	pidfd = syscall(SYS_pidfd_open, pid, 0);
+	if (pidfd >= 0) {
+		ret = syscall(SYS_pidfd_getfd, pidfd, fd, 0);
+		close(pidfd);
+		if (ret >= 0)
+			return ret;
+	}
+#endif
+	snprintf(path, sizeof(path), "/proc/%d/fd/%d", pid, fd);
+	ret = open(path, O_RDWR | O_CLOEXEC);
+	if (ret < 0)
+		ret = open(path, O_RDONLY | O_CLOEXEC);
+	return ret < 0 ? -errno : ret;
+}
+
+static int smr_attach_map_file(struct smr_attach_map *map, int pid,
+			       const struct smr_attach_info *info)
+{
+	struct stat st;
+	size_t page_off;
+	int fd, ret = 0;
+
+	fd = smr_attach_peer_fd(pid, info->fd);
+	if (fd < 0)
+		return fd;
+
+	if (fstat(fd, &st) || st.st_dev != info->dev ||
+	    st.st_ino != info->ino) {
+		ret = -FI_EACCES;
+		goto out;
+	}
+
+	map->prot = PROT_READ;
+	if ((fcntl(fd, F_GETFL) & O_ACCMODE) == O_RDWR)
+		map->prot |= PROT_WRITE;
+
+	page_off = info->map_off % ofi_get_page_size();
+	map->map_len = info->map_len + page_off;
+	map->map_addr = mmap(NULL, map->map_len, map->prot, MAP_SHARED, fd,
+			     info->map_off - page_off);
+	if (map->map_addr == MAP_FAILED) {
+		map->map_addr = NULL;
+		ret = -errno;
+		goto out;
+	}
+	map->base = (char *) map->map_addr + page_off;
+out:
+	close(fd);
+	return ret;
+}
+
+static int smr_attach_map_xpmem(struct smr_attach_map *map,
+				const struct smr_attach_info *info)
+{
+#if SHM_HAVE_XPMEM
+	struct xpmem_addr addr;
+	size_t page_off;
+	void *ptr;
+
+	map->apid = xpmem_get(info->segid, XPMEM_RDWR, XPMEM_PERMIT_MODE,
+			      NULL);
+	if (map->apid < 0)
+		return -errno;
+
+	page_off = info->map_off % ofi_get_page_size();
+	addr.apid = map->apid;
+	addr.offset = info->map_off - page_off;
+	map->map_len = ofi_get_aligned_size(info->map_len + page_off,
+					    ofi_get_page_size());
+	ptr = xpmem_attach(addr, map->map_len, NULL);
+	if (ptr == (void *) -1) {
+		xpmem_release(map->apid);
+		return -errno;
+	}
+	map->map_addr = ptr;
+	map->base = (char *) ptr + page_off;
+	map->prot = PROT_READ | PROT_WRITE;
+	return 0;
+#else
+	return -FI_ENOSYS;
+#endif
+}
+
+static void smr_attach_unmap(struct smr_attach_map *map)
+{
+	if (map->map_addr) {
+#if SHM_HAVE_XPMEM
+		if (map->type == SMR_ATTACH_XPMEM) {
+			xpmem_detach(map->map_addr);
+			xpmem_release(map->apid);
+		} else
+#endif
+		munmap(map->map_addr, map->map_len);
+	}
+	memset(map, 0, sizeof(*map));
+}
+
+void smr_attach_ep_cleanup(struct smr_ep *ep)
+{
+	int i;
+
+	if (!ep->attach_cache)
+		return;
+
+	for (i = 0; i < SMR_ATTACH_CACHE_SIZE; i++)
+		smr_attach_unmap(&ep->attach_cache[i]);
+	free(ep->attach_cache);
+	ep->attach_cache = NULL;
+}
+
+static struct smr_attach_map *smr_attach_lookup(struct smr_ep *ep, int64_t id,
+					const struct smr_attach_info *info,
+					int prot)
+{
+	struct smr_region *peer_smr;
+	struct smr_attach_map *map;
+	int ret;
+
+	if (!ep->attach_cache) {
+		ep->attach_cache = calloc(SMR_ATTACH_CACHE_SIZE,
+					  sizeof(*ep->attach_cache));
+		if (!ep->attach_cache)
+			return NULL;
+	}
+
+	peer_smr = smr_peer_region(ep->region, id);
+	map = &ep->attach_cache[(info->handle ^ (id << 4)) &
+				(SMR_ATTACH_CACHE_SIZE - 1)];
+
+	if (map->map_addr && map->peer_smr == peer_smr &&
+	    map->pid == peer_smr->pid && map->handle == info->handle &&
+	    map->len == info->map_len && (map->prot & prot) == prot)
+		return map;
+
+	smr_attach_unmap(map);
+	if (info->type == SMR_ATTACH_XPMEM)
+		ret = smr_attach_map_xpmem(map, info);
+	else
+		ret = smr_attach_map_file(map, peer_smr->pid, info);
+	if (ret) {
+		FI_INFO(&smr_prov, FI_LOG_EP_DATA,
+			"unable to attach peer buffer: %s\n",
+			fi_strerror(-ret));
+		memset(map, 0, sizeof(*map));
+		return NULL;
+	}
+
+	if ((map->prot & prot) != prot) {
+		smr_attach_unmap(map);
+		return NULL;
+	}
+
+	map->peer_smr = peer_smr;
+	map->pid = peer_smr->pid;
+	map->type = info->type;
+	map->handle = info->handle;
+	map->len = info->map_len;
+	return map;
+}
+
+int smr_attach_copy(struct smr_ep *ep, struct smr_cmd *cmd,
+		    struct iovec *iov, size_t iov_count)
+{
+	struct smr_attach_info *info = &cmd->msg.data.attach;
+	struct smr_attach_map *map;
+	uint64_t size = cmd->msg.hdr.size;
+	size_t copied;
+	bool write = cmd->msg.hdr.op == ofi_op_read_req;
+
+	if (smr_env.disable_attach)
+		return -FI_ENOSYS;
+
+	if (info->offset > info->map_len || size > info->map_len - info->offset)
+		return -FI_EINVAL;
+
+	map = smr_attach_lookup(ep, cmd->msg.hdr.id, info,
+				write ? PROT_READ | PROT_WRITE : PROT_READ);
+	if (!map)
+		return -FI_ENOENT;
+
+	if (write)
+		copied = ofi_copy_from_iov(map->base + info->offset, size,
+					   iov, iov_count, 0);
+	else
+		copied = ofi_copy_to_iov(iov, iov_count, 0,
+					 map->base + info->offset, size);
+	return copied == size ? 0 : -FI_ETRUNC;
+}
@@ -74,7 +74,7 @@ static int smr_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 		FI_INFO(&smr_prov, FI_LOG_AV, "%s\n", (const char *) addr);
 
 		util_addr = FI_ADDR_NOTAVAIL;
-		if (smr_av->used < SMR_MAX_PEERS) {
+		if (smr_av->used < smr_av->smr_map->max_peers) {
 			ret = smr_map_add(&smr_prov, smr_av->smr_map,
 					  addr, &shm_id);
 			if (!ret) {
@@ -101,12 +101,15 @@ static int smr_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 				smr_map_del(smr_av->smr_map, shm_id);
 			continue;
 		} else {
-			assert(shm_id >= 0 && shm_id < SMR_MAX_PEERS);
+			assert(shm_id >= 0 &&
+			       shm_id < smr_av->smr_map->max_peers);
 			if (flags & FI_AV_USER_ID) {
 				assert(fi_addr);
-				smr_av->smr_map->peers[shm_id].fiaddr = fi_addr[i];
+				smr_map_peer(smr_av->smr_map, shm_id)->fiaddr =
+					fi_addr[i];
 			} else {
-				smr_av->smr_map->peers[shm_id].fiaddr = util_addr;
+				smr_map_peer(smr_av->smr_map, shm_id)->fiaddr =
+					util_addr;
 			}
 			succ_count++;
 			smr_av->used++;
@@ -118,8 +121,8 @@ static int smr_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 			util_ep = container_of(av_entry, struct util_ep, av_entry);
 			smr_ep = container_of(util_ep, struct smr_ep, util_ep);
 			smr_map_to_endpoint(smr_ep->region, shm_id);
-			smr_ep->region->max_sar_buf_per_peer =
-				SMR_MAX_PEERS / smr_av->smr_map->num_peers;
+			smr_set_sar_buf_per_peer(smr_ep->region,
+						 smr_av->smr_map->num_peers);
 		}
 	}
 
@@ -160,13 +163,8 @@ static int smr_av_remove(struct fid_av *av_fid, fi_addr_t *fi_addr, size_t count
 			util_ep = container_of(av_entry, struct util_ep, av_entry);
 			smr_ep = container_of(util_ep, struct smr_ep, util_ep);
 			smr_unmap_from_endpoint(smr_ep->region, id);
-			if (smr_av->smr_map->num_peers > 0)
-				smr_ep->region->max_sar_buf_per_peer =
-					SMR_MAX_PEERS /
-					smr_av->smr_map->num_peers;
-			else
-				smr_ep->region->max_sar_buf_per_peer =
-					SMR_BUF_BATCH_MAX;
+			smr_set_sar_buf_per_peer(smr_ep->region,
+						 smr_av->smr_map->num_peers);
 		}
 		smr_av->used--;
 	}
@@ -187,7 +185,7 @@ static int smr_av_lookup(struct fid_av *av, fi_addr_t fi_addr, void *addr,
 	smr_av = container_of(util_av, struct smr_av, util_av);
 
 	id = smr_addr_lookup(util_av, fi_addr);
-	name = smr_av->smr_map->peers[id].peer.name;
+	name = smr_map_peer(smr_av->smr_map, id)->peer.name;
 
 	strncpy((char *) addr, name, *addrlen);
 
@@ -271,7 +269,8 @@ int smr_av_open(struct fid_domain *domain, struct fi_av_attr *attr,
 	(*av)->fid.ops = &smr_av_fi_ops;
 	(*av)->ops = &smr_av_ops;
 
-	ret = smr_map_create(&smr_prov, SMR_MAX_PEERS, &smr_av->smr_map);
+	ret = smr_map_create(&smr_prov, MAX(attr->count, SMR_DEF_PEERS),
+			     &smr_av->smr_map);
 	if (ret)
 		goto close;
 
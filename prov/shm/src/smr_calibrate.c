@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Protocol switch points.  The sizes at which smr_select_proto moves from
+ * one protocol to the next default to the buffer sizes of the region.
+ * They can be measured on the running node instead, by timing the data
+ * movement of each protocol over a sweep of message sizes, and kept in a
+ * file for later runs.  Processes that start together take turns on a lock
+ * next to the file, so one measures while the others wait and load its
+ * result.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "smr.h"
+
+#define SMR_CALIB_MIN_SIZE	64
+#define SMR_CALIB_POINTS	17
+#define SMR_CALIB_MAX_SIZE	(SMR_CALIB_MIN_SIZE << (SMR_CALIB_POINTS - 1))
+#define SMR_CALIB_BYTES		(8 << 20)
+#define SMR_CALIB_RUNS		3
+
+enum {
+	SMR_CALIB_INJECT,
+	SMR_CALIB_SAR,
+	SMR_CALIB_CMA,
+	SMR_CALIB_MMAP,
+	SMR_CALIB_MAX,
+};
+
+struct smr_calib_buf {
+	char	*src;
+	char	*dst;
+	char	*bounce;
+};
+
+static struct {
+	const char	*name;
+	size_t		*value;
+} smr_thresholds[] = {
+	{ "inline_threshold", &smr_env.inline_threshold },
+	{ "inject_threshold", &smr_env.inject_threshold },
+	{ "cma_threshold", &smr_env.cma_threshold },
+	{ "sar_threshold", &smr_env.sar_threshold },
+};
+
+static int smr_calib_inject(struct smr_calib_buf *buf, size_t size)
+{
+	memcpy(buf->bounce, buf->src, size);
+	memcpy(buf->dst, buf->bounce, size);
+	return 0;
+}
+
+static int smr_calib_sar(struct smr_calib_buf *buf, size_t size)
+{
+	size_t off, len;
+
+	for (off = 0; off < size; off += len) {
+		len = MIN(size - off, SMR_SAR_SIZE);
+		memcpy(buf->bounce, buf->src + off, len);
+		memcpy(buf->dst + off, buf->bounce, len);
+	}
+	return 0;
+}
+
+static int smr_calib_cma(struct smr_calib_buf *buf, size_t size)
+{
+	struct iovec local = { .iov_base = buf->dst, .iov_len = size };
+	struct iovec remote = { .iov_base = buf->src, .iov_len = size };
+
+	return smr_cma_loop(getpid(), &local, 1, &remote, 1, 0, size, false);
+}
+
+static int smr_calib_mmap(struct smr_calib_buf *buf, size_t size)
+{
+	char name[SMR_NAME_MAX];
+	void *tx, *rx;
+	int fd, ret = -FI_EIO;
+
+	snprintf(name, sizeof(name), "fi_shm_calib_%d", getpid());
+	fd = shm_open(name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+	if (fd < 0)
+		return -errno;
+	if (ftruncate(fd, size))
+		goto unlink;
+
+	tx = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (tx == MAP_FAILED)
+		goto unlink;
+	memcpy(tx, buf->src, size);
+
+	rx = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (rx != MAP_FAILED) {
+		memcpy(buf->dst, rx, size);
+		munmap(rx, size);
+		ret = 0;
+	}
+	munmap(tx, size);
+unlink:
+	close(fd);
+	shm_unlink(name);
+	return ret;
+}
+
+static int (*smr_calib_ops[SMR_CALIB_MAX])(struct smr_calib_buf *buf,
+					    size_t size) = {
+	[SMR_CALIB_INJECT] = smr_calib_inject,
+	[SMR_CALIB_SAR] = smr_calib_sar,
+	[SMR_CALIB_CMA] = smr_calib_cma,
+	[SMR_CALIB_MMAP] = smr_calib_mmap,
+};
+
+/* Best time of a few runs, in ns per message, or 0 if the protocol
+ * cannot be used here. */
+static uint64_t smr_calib_time(int proto, struct smr_calib_buf *buf,
+			       size_t size)
+{
+	uint64_t start, best = UINT64_MAX;
+	size_t i, iters;
+	int run;
+
+	iters = MAX(SMR_CALIB_BYTES / size, 4);
+	if (smr_calib_ops[proto](buf, size))
+		return 0;
+
+	for (run = 0; run < SMR_CALIB_RUNS; run++) {
+		start = ofi_gettime_ns();
+		for (i = 0; i < iters; i++) {
+			if (smr_calib_ops[proto](buf, size))
+				return 0;
+		}
+		best = MIN(best, (ofi_gettime_ns() - start) / iters);
+	}
+	return best;
+}
+
+/* Size above which the protocol timed in hi should replace the one timed
+ * in lo.  The switch is placed where it minimizes the relative cost summed
+ * over the sweep, so that one noisy point does not move it.  Returns false
+ * if the two could not be compared.
+ */
+static bool smr_calib_switch(const uint64_t *lo, const uint64_t *hi,
+			     int count, size_t *threshold)
+{
+	double total, best = 0;
+	int i, k, best_k = 0;
+	bool valid = false;
+
+	for (k = 0; k <= count; k++) {
+		total = 0;
+		for (i = 0; i < count; i++) {
+			if (!lo[i] || !hi[i])
+				continue;
+			valid = true;
+			total += (double) (i < k ? lo[i] : hi[i]) /
+				 MIN(lo[i], hi[i]);
+		}
+		if (!k || total < best) {
+			best = total;
+			best_k = k;
+		}
+	}
+	if (!valid)
+		return false;
+
+	/* best_k points stay on lo */
+	if (best_k == count)
+		*threshold = SIZE_MAX;
+	else
+		*threshold = (SMR_CALIB_MIN_SIZE << best_k) >> 1;
+	return true;
+}
+
+static void smr_calibrate(void)
+{
+	uint64_t cost[SMR_CALIB_MAX][SMR_CALIB_POINTS], buffered[SMR_CALIB_POINTS];
+	struct smr_calib_buf buf;
+	size_t size, threshold;
+	int i;
+
+	buf.src = malloc(SMR_CALIB_MAX_SIZE);
+	buf.dst = malloc(SMR_CALIB_MAX_SIZE);
+	buf.bounce = malloc(MAX(SMR_SAR_SIZE, SMR_INJECT_SIZE));
+	if (!buf.src || !buf.dst || !buf.bounce) {
+		FI_WARN(&smr_prov, FI_LOG_CORE,
+			"unable to allocate calibration buffers\n");
+		goto out;
+	}
+	memset(buf.src, 0xa5, SMR_CALIB_MAX_SIZE);
+	memset(buf.dst, 0, SMR_CALIB_MAX_SIZE);
+
+	for (i = 0; i < SMR_CALIB_POINTS; i++) {
+		size = SMR_CALIB_MIN_SIZE << i;
+		cost[SMR_CALIB_INJECT][i] = size <= smr_env.inject_threshold ?
+			smr_calib_time(SMR_CALIB_INJECT, &buf, size) : 0;
+		cost[SMR_CALIB_SAR][i] = smr_calib_time(SMR_CALIB_SAR, &buf,
+							size);
+		cost[SMR_CALIB_CMA][i] = smr_env.disable_cma ? 0 :
+			smr_calib_time(SMR_CALIB_CMA, &buf, size);
+		cost[SMR_CALIB_MMAP][i] = size >= SMR_INJECT_SIZE ?
+			smr_calib_time(SMR_CALIB_MMAP, &buf, size) : 0;
+
+		FI_INFO(&smr_prov, FI_LOG_CORE,
+			"size %zu ns inject %" PRIu64 " sar %" PRIu64
+			" cma %" PRIu64 " mmap %" PRIu64 "\n", size,
+			cost[SMR_CALIB_INJECT][i], cost[SMR_CALIB_SAR][i],
+			cost[SMR_CALIB_CMA][i], cost[SMR_CALIB_MMAP][i]);
+
+		buffered[i] = cost[SMR_CALIB_INJECT][i] ?
+			      cost[SMR_CALIB_INJECT][i] : cost[SMR_CALIB_SAR][i];
+	}
+
+	if (smr_calib_switch(buffered, cost[SMR_CALIB_CMA], SMR_CALIB_POINTS,
+			     &threshold))
+		smr_env.cma_threshold = MAX(threshold,
+					    smr_env.inline_threshold);
+	if (smr_calib_switch(cost[SMR_CALIB_SAR], cost[SMR_CALIB_MMAP],
+			     SMR_CALIB_POINTS, &threshold))
+		smr_env.sar_threshold = threshold;
+out:
+	free(buf.src);
+	free(buf.dst);
+	free(buf.bounce);
+}
+
+static int smr_load_thresholds(const char *path)
+{
+	char name[64];
+	size_t value;
+	FILE *file;
+	int i;
+
+	file = fopen(path, "r");
+	if (!file)
+		return -errno;
+
+	while (fscanf(file, "%63s %zu", name, &value) == 2) {
+		for (i = 0; i < ARRAY_SIZE(smr_thresholds); i++) {
+			if (!strcmp(name, smr_thresholds[i].name))
+				*smr_thresholds[i].value = value;
+		}
+	}
+	fclose(file);
+	return 0;
+}
+
+static void smr_save_thresholds(const char *path)
+{
+	char tmp[PATH_MAX];
+	FILE *file;
+	int i;
+
+	/* Readers that do not take the lock see the old file or the new
+	 * one whole */
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+	file = fopen(tmp, "w");
+	if (!file)
+		goto err;
+
+	for (i = 0; i < ARRAY_SIZE(smr_thresholds); i++)
+		fprintf(file, "%s %zu\n", smr_thresholds[i].name,
+			*smr_thresholds[i].value);
+	if (fclose(file) || rename(tmp, path)) {
+		unlink(tmp);
+		goto err;
+	}
+	return;
+err:
+	FI_WARN(&smr_prov, FI_LOG_CORE, "unable to write %s: %s\n", path,
+		strerror(errno));
+}
+
+/* The file was written after the given time, by a process that held the
+ * lock while we waited for it */
+static bool smr_thresholds_newer(const char *path,
+				 const struct timespec *since)
+{
+	struct stat st;
+
+	if (stat(path, &st))
+		return false;
+
+	return st.st_mtim.tv_sec > since->tv_sec ||
+	       (st.st_mtim.tv_sec == since->tv_sec &&
+		st.st_mtim.tv_nsec >= since->tv_nsec);
+}
+
+/* Measure under a lock on <path>.lock.  The lock is released when its
+ * holder exits, so a process that dies while measuring does not block the
+ * others.
+ */
+static void smr_calibrate_file(const char *path, bool calibrate)
+{
+	char lock_path[PATH_MAX];
+	struct timespec start;
+	int fd;
+
+	clock_gettime(CLOCK_REALTIME, &start);
+	snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+	fd = open(lock_path, O_CREAT | O_RDWR | O_CLOEXEC,
+		  S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd < 0 || flock(fd, LOCK_EX)) {
+		FI_WARN(&smr_prov, FI_LOG_CORE,
+			"unable to lock %s: %s, using default thresholds\n",
+			lock_path, strerror(errno));
+		goto out;
+	}
+
+	/* Another process measured while we waited */
+	if ((!calibrate || smr_thresholds_newer(path, &start)) &&
+	    !smr_load_thresholds(path))
+		goto out;
+
+	smr_calibrate();
+	smr_save_thresholds(path);
+out:
+	if (fd >= 0)
+		close(fd);
+}
+
+void smr_init_thresholds(void)
+{
+	char *path = NULL;
+	int calibrate = 0;
+
+	fi_param_get_str(&smr_prov, "threshold_file", &path);
+	fi_param_get_bool(&smr_prov, "calibrate", &calibrate);
+
+	if (path) {
+		if (calibrate || smr_load_thresholds(path))
+			smr_calibrate_file(path, calibrate);
+	} else if (calibrate) {
+		smr_calibrate();
+	}
+}
+
+void smr_check_thresholds(void)
+{
+	int i;
+
+	smr_env.inline_threshold = MIN(smr_env.inline_threshold,
+				       SMR_MSG_DATA_LEN);
+	smr_env.inject_threshold = MIN(smr_env.inject_threshold,
+				       SMR_INJECT_SIZE);
+
+	for (i = 0; i < ARRAY_SIZE(smr_thresholds); i++)
+		FI_INFO(&smr_prov, FI_LOG_CORE, "%s: %zu\n",
+			smr_thresholds[i].name, *smr_thresholds[i].value);
+}
@@ -103,7 +103,7 @@ int smr_complete_rx(struct smr_ep *ep, void *context, uint32_t op,
 
 	cq = container_of(ep->util_ep.rx_cq, struct smr_cq, util_cq);
 	return ep->rx_comp(cq, context, flags, len, buf,
-			   ep->region->map->peers[id].fiaddr, tag, data);
+			   smr_map_peer(ep->region->map, id)->fiaddr, tag, data);
 }
 
 int smr_rx_comp(struct smr_cq *cq, void *context, uint64_t flags, size_t len,
@@ -0,0 +1,513 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Direct RMA and atomics.  A registration whose pages belong to a shared
+ * file mapping (shm_open, memfd, a file in /dev/shm) is published in the
+ * regions of the registering domain's endpoints.  Initiators map the same
+ * file and complete reads, writes and atomics to it themselves, without
+ * queueing a command or waiting for the target to progress.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "ofi_iov.h"
+#include "ofi_atomic.h"
+#include "smr.h"
+
+#define SMR_DIRECT_CACHE_SIZE	256
+
+/* Peer registration mapped into this process, or a negative entry (slot
+ * of -1) for a key that cannot be accessed directly.  gen holds the
+ * entry's gen, or for a negative entry the version of the peer's table.
+ */
+struct smr_direct_map {
+	struct smr_region	*peer_smr;
+	int			pid;
+	int			slot;
+	int64_t			gen;
+	uint64_t		key;
+	uint64_t		addr;
+	uint64_t		len;
+	uint64_t		access;
+	char			*base;
+	void			*map_addr;
+	size_t			map_len;
+};
+
+static inline void smr_direct_rmb(void)
+{
+#ifdef HAVE_BUILTIN_MM_ATOMICS
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+#else
+	__sync_synchronize();
+#endif
+}
+
+static int smr_direct_find_path(const char *file, struct smr_mr_entry *entry)
+{
+	char path[SMR_MR_PATH_MAX];
+	struct dirent *dent;
+	struct stat st;
+	DIR *dir;
+	int fd, ret = -FI_ENOENT;
+
+	if (file[0] == '/' && strlen(file) < SMR_MR_PATH_MAX &&
+	    !stat(file, &st) && st.st_dev == entry->dev &&
+	    st.st_ino == entry->ino) {
+		strcpy(entry->path, file);
+		return 0;
+	}
+
+	/* Deleted files and memfds are reached through an open descriptor */
+	dir = opendir("/proc/self/fd");
+	if (!dir)
+		return -errno;
+
+	while ((dent = readdir(dir))) {
+		if (dent->d_name[0] == '.')
+			continue;
+		fd = atoi(dent->d_name);
+		snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+		if (stat(path, &st) || st.st_dev != entry->dev ||
+		    st.st_ino != entry->ino)
+			continue;
+		snprintf(entry->path, SMR_MR_PATH_MAX, "/proc/%d/fd/%d",
+			 getpid(), fd);
+		ret = 0;
+		break;
+	}
+	closedir(dir);
+	return ret;
+}
+
+int smr_direct_find_file(const void *buf, size_t len,
+			 struct smr_mr_entry *entry)
+{
+	char line[PATH_MAX + 128], file[PATH_MAX], perms[8];
+	unsigned long start, end, off, ino;
+	unsigned int major, minor;
+	uintptr_t addr = (uintptr_t) buf;
+	FILE *maps;
+	int ret = -FI_ENOENT;
+
+	maps = fopen("/proc/self/maps", "r");
+	if (!maps)
+		return -errno;
+
+	while (fgets(line, sizeof(line), maps)) {
+		file[0] = '\0';
+		if (sscanf(line, "%lx-%lx %7s %lx %x:%x %lu %s", &start, &end,
+			   perms, &off, &major, &minor, &ino, file) < 7)
+			continue;
+		if (addr < start || addr >= end)
+			continue;
+
+		if (addr + len <= end && perms[3] == 's' && ino) {
+			entry->file_off = off + (addr - start);
+			entry->dev = makedev(major, minor);
+			entry->ino = ino;
+			ret = smr_direct_find_path(file, entry);
+		}
+		break;
+	}
+	fclose(maps);
+	return ret;
+}
+
+static void smr_direct_publish(struct smr_region *smr, int slot,
+			       struct smr_mr_entry *src)
+{
+	struct smr_mr_table *table = smr_mr_table(smr);
+	struct smr_mr_entry *dst = &table->entry[slot];
+
+	dst->key = src->key;
+	dst->addr = src->addr;
+	dst->len = src->len;
+	dst->access = src->access;
+	dst->file_off = src->file_off;
+	dst->dev = src->dev;
+	dst->ino = src->ino;
+	memcpy(dst->path, src->path, SMR_MR_PATH_MAX);
+
+	ofi_atomic_set64(&dst->gen, ofi_atomic_get64(&src->gen));
+	ofi_atomic_inc64(&table->version);
+}
+
+static int smr_direct_mr_close(struct fid *fid)
+{
+	struct smr_domain *domain;
+	struct ofi_mr *mr;
+	struct smr_ep *ep;
+	int64_t gen;
+	int slot;
+
+	mr = container_of(fid, struct ofi_mr, mr_fid.fid);
+	domain = container_of(mr->domain, struct smr_domain, util_domain);
+
+	ofi_mutex_lock(&domain->direct_lock);
+	for (slot = 0; slot < SMR_MR_TABLE_SIZE; slot++) {
+		gen = ofi_atomic_get64(&domain->mr_table[slot].gen);
+		if ((gen & 1) && domain->mr_table[slot].key == mr->key)
+			break;
+	}
+	if (slot < SMR_MR_TABLE_SIZE) {
+		ofi_atomic_set64(&domain->mr_table[slot].gen, gen + 1);
+		dlist_foreach_container(&domain->direct_ep_list, struct smr_ep,
+					ep, direct_entry)
+			ofi_atomic_set64(&smr_mr_table(ep->region)->entry[slot].gen,
+					 gen + 1);
+	}
+	ofi_mutex_unlock(&domain->direct_lock);
+
+	return ofi_mr_close(fid);
+}
+
+static struct fi_ops smr_direct_mr_fi_ops = {
+	.size = sizeof(struct fi_ops),
+	.close = smr_direct_mr_close,
+	.bind = fi_no_bind,
+	.control = fi_no_control,
+	.ops_open = fi_no_ops_open,
+};
+
+void smr_direct_mr_publish(struct smr_domain *domain, struct ofi_mr *mr,
+			   const struct fi_mr_attr *attr)
+{
+	struct smr_mr_entry *entry;
+	struct smr_ep *ep;
+	uintptr_t base;
+	uint64_t offset;
+	int slot;
+
+	if (!smr_env.enable_direct_rma || attr->iov_count != 1 ||
+	    mr->iface != FI_HMEM_SYSTEM || !attr->mr_iov[0].iov_len ||
+	    !(attr->access & (FI_REMOTE_READ | FI_REMOTE_WRITE)))
+		return;
+
+	ofi_mutex_lock(&domain->direct_lock);
+	for (slot = 0; slot < SMR_MR_TABLE_SIZE; slot++) {
+		if (!(ofi_atomic_get64(&domain->mr_table[slot].gen) & 1))
+			break;
+	}
+	if (slot == SMR_MR_TABLE_SIZE)
+		goto unlock;
+
+	entry = &domain->mr_table[slot];
+	base = (uintptr_t) attr->mr_iov[0].iov_base;
+	if (smr_direct_find_file((void *) base, attr->mr_iov[0].iov_len,
+				 entry))
+		goto unlock;
+
+	/* Match the address translation done by ofi_mr_map_verify */
+	offset = (domain->util_domain.mr_map.mode & FI_MR_VIRT_ADDR) ?
+		 attr->offset : base;
+	entry->key = mr->key;
+	entry->addr = base - offset;
+	entry->len = attr->mr_iov[0].iov_len;
+	entry->access = attr->access;
+	ofi_atomic_inc64(&entry->gen);
+
+	dlist_foreach_container(&domain->direct_ep_list, struct smr_ep, ep,
+				direct_entry)
+		smr_direct_publish(ep->region, slot, entry);
+
+	mr->mr_fid.fid.ops = &smr_direct_mr_fi_ops;
+unlock:
+	ofi_mutex_unlock(&domain->direct_lock);
+}
+
+void smr_direct_ep_init(struct smr_ep *ep)
+{
+	struct smr_domain *domain;
+	int slot;
+
+	domain = container_of(ep->util_ep.domain, struct smr_domain,
+			      util_domain);
+
+	/* Remote counters need the target to see each access, so those
+	 * endpoints keep using the command queue.
+	 */
+	if (!smr_env.enable_direct_rma || ep->util_ep.rem_rd_cntr ||
+	    ep->util_ep.rem_wr_cntr)
+		return;
+
+	ep->region->flags |= SMR_FLAG_DIRECT_RMA;
+#ifdef HAVE_BUILTIN_MM_ATOMICS
+	if (!domain->fast_atomic)
+		ep->region->flags |= SMR_FLAG_DIRECT_ATOMIC;
+#endif
+
+	ofi_mutex_lock(&domain->direct_lock);
+	for (slot = 0; slot < SMR_MR_TABLE_SIZE; slot++) {
+		if (ofi_atomic_get64(&domain->mr_table[slot].gen) & 1)
+			smr_direct_publish(ep->region, slot,
+					   &domain->mr_table[slot]);
+	}
+	dlist_insert_tail(&ep->direct_entry, &domain->direct_ep_list);
+	ofi_mutex_unlock(&domain->direct_lock);
+}
+
+static void smr_direct_unmap(struct smr_direct_map *map)
+{
+	if (map->map_addr)
+		munmap(map->map_addr, map->map_len);
+	memset(map, 0, sizeof(*map));
+}
+
+void smr_direct_ep_cleanup(struct smr_ep *ep)
+{
+	struct smr_domain *domain;
+	int i;
+
+	domain = container_of(ep->util_ep.domain, struct smr_domain,
+			      util_domain);
+
+	ofi_mutex_lock(&domain->direct_lock);
+	dlist_remove(&ep->direct_entry);
+	ofi_mutex_unlock(&domain->direct_lock);
+
+	if (!ep->direct_cache)
+		return;
+
+	for (i = 0; i < SMR_DIRECT_CACHE_SIZE; i++)
+		smr_direct_unmap(&ep->direct_cache[i]);
+	free(ep->direct_cache);
+}
+
+static int smr_direct_mmap(struct smr_direct_map *map,
+			   const struct smr_mr_entry *entry)
+{
+	struct stat st;
+	size_t page_off;
+	int fd, prot, ret = 0;
+
+	if (entry->access & FI_REMOTE_WRITE) {
+		fd = open(entry->path, O_RDWR);
+		prot = PROT_READ | PROT_WRITE;
+	} else {
+		fd = open(entry->path, O_RDONLY);
+		prot = PROT_READ;
+	}
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) || st.st_dev != entry->dev ||
+	    st.st_ino != entry->ino) {
+		ret = -FI_EACCES;
+		goto out;
+	}
+
+	page_off = entry->file_off % ofi_get_page_size();
+	map->map_len = entry->len + page_off;
+	map->map_addr = mmap(NULL, map->map_len, prot, MAP_SHARED, fd,
+			     entry->file_off - page_off);
+	if (map->map_addr == MAP_FAILED) {
+		map->map_addr = NULL;
+		ret = -errno;
+		goto out;
+	}
+	map->base = (char *) map->map_addr + page_off;
+out:
+	close(fd);
+	return ret;
+}
+
+static void smr_direct_map_key(struct smr_direct_map *map,
+			       struct smr_region *peer_smr, uint64_t key)
+{
+	struct smr_mr_table *table = smr_mr_table(peer_smr);
+	struct smr_mr_entry entry;
+	int64_t gen;
+	int slot, ret;
+
+	map->peer_smr = peer_smr;
+	map->pid = peer_smr->pid;
+	map->key = key;
+	map->slot = -1;
+	map->gen = ofi_atomic_get64(&table->version);
+
+	for (slot = 0; slot < SMR_MR_TABLE_SIZE; slot++) {
+		gen = ofi_atomic_get64(&table->entry[slot].gen);
+		if (!(gen & 1) || table->entry[slot].key != key)
+			continue;
+
+		memcpy(&entry, &table->entry[slot], sizeof(entry));
+		smr_direct_rmb();
+		if (ofi_atomic_get64(&table->entry[slot].gen) != gen ||
+		    entry.key != key)
+			continue;
+
+		entry.path[SMR_MR_PATH_MAX - 1] = '\0';
+		ret = smr_direct_mmap(map, &entry);
+		if (ret) {
+			FI_INFO(&smr_prov, FI_LOG_EP_DATA,
+				"unable to map %s for direct access: %s\n",
+				entry.path, fi_strerror(-ret));
+			return;
+		}
+
+		map->slot = slot;
+		map->gen = gen;
+		map->addr = entry.addr;
+		map->len = entry.len;
+		map->access = entry.access;
+		return;
+	}
+}
+
+static struct smr_direct_map *smr_direct_lookup(struct smr_ep *ep, int64_t id,
+						uint64_t key)
+{
+	struct smr_region *peer_smr;
+	struct smr_mr_table *table;
+	struct smr_direct_map *map;
+
+	if (!ep->direct_cache) {
+		ep->direct_cache = calloc(SMR_DIRECT_CACHE_SIZE,
+					  sizeof(*ep->direct_cache));
+		if (!ep->direct_cache)
+			return NULL;
+	}
+
+	peer_smr = smr_peer_region(ep->region, id);
+	table = smr_mr_table(peer_smr);
+	map = &ep->direct_cache[(key * SMR_MR_TABLE_SIZE + id) &
+				(SMR_DIRECT_CACHE_SIZE - 1)];
+
+	if (map->peer_smr == peer_smr && map->pid == peer_smr->pid &&
+	    map->key == key) {
+		if (map->slot < 0) {
+			if (ofi_atomic_get64(&table->version) == map->gen)
+				return NULL;
+		} else if (ofi_atomic_get64(&table->entry[map->slot].gen) ==
+			   map->gen) {
+			return map;
+		}
+	}
+
+	smr_direct_unmap(map);
+	smr_direct_map_key(map, peer_smr, key);
+	return map->slot < 0 ? NULL : map;
+}
+
+static void *smr_direct_addr(struct smr_direct_map *map, uint64_t addr,
+			     uint64_t len, uint64_t access)
+{
+	if ((map->access & access) != access || addr < map->addr ||
+	    len > map->len || addr - map->addr > map->len - len)
+		return NULL;
+
+	return map->base + (addr - map->addr);
+}
+
+ssize_t smr_direct_rma(struct smr_ep *ep, int64_t id, const struct iovec *iov,
+		       size_t iov_count, const struct fi_rma_iov *rma_iov,
+		       uint32_t op)
+{
+	struct smr_direct_map *map;
+	void *ptr;
+
+	if (!(smr_peer_region(ep->region, id)->flags & SMR_FLAG_DIRECT_RMA))
+		return -FI_ENOENT;
+
+	map = smr_direct_lookup(ep, id, rma_iov->key);
+	if (!map)
+		return -FI_ENOENT;
+
+	/* Out of range accesses take the queued path, which reports them */
+	ptr = smr_direct_addr(map, rma_iov->addr, rma_iov->len,
+			      ofi_rx_mr_reg_flags(op, 0));
+	if (!ptr)
+		return -FI_ENOENT;
+
+	if (op == ofi_op_write)
+		ofi_copy_from_iov(ptr, rma_iov->len, iov, iov_count, 0);
+	else
+		ofi_copy_to_iov(iov, iov_count, 0, ptr, rma_iov->len);
+	return 0;
+}
+
+ssize_t smr_direct_atomic(struct smr_ep *ep, int64_t id,
+			  const struct fi_rma_ioc *rma_ioc,
+			  enum fi_datatype datatype, enum fi_op atomic_op,
+			  uint32_t op, const void *buf, const void *compare,
+			  void *result)
+{
+#ifdef HAVE_BUILTIN_MM_ATOMICS
+	struct smr_direct_map *map;
+	size_t size;
+	void *ptr;
+
+	if (!(smr_peer_region(ep->region, id)->flags & SMR_FLAG_DIRECT_ATOMIC))
+		return -FI_ENOENT;
+
+	size = ofi_datatype_size(datatype);
+	if (size > sizeof(uint64_t))
+		return -FI_ENOENT;
+
+	map = smr_direct_lookup(ep, id, rma_ioc->key);
+	if (!map)
+		return -FI_ENOENT;
+
+	ptr = smr_direct_addr(map, rma_ioc->addr, rma_ioc->count * size,
+			      ofi_rx_mr_reg_flags(op, atomic_op));
+	if (!ptr || ((uintptr_t) ptr & (size - 1)))
+		return -FI_ENOENT;
+
+	if (ofi_atomic_isswap_op(atomic_op)) {
+		ofi_atomic_swap_handler(atomic_op, datatype, ptr, buf, compare,
+					result, rma_ioc->count);
+	} else if (op == ofi_op_atomic_fetch &&
+		   ofi_atomic_isreadwrite_op(atomic_op)) {
+		ofi_atomic_readwrite_handler(atomic_op, datatype, ptr, buf,
+					     result, rma_ioc->count);
+	} else if (ofi_atomic_iswrite_op(atomic_op)) {
+		ofi_atomic_write_handler(atomic_op, datatype, ptr, buf,
+					 rma_ioc->count);
+	} else {
+		return -FI_ENOENT;
+	}
+	return 0;
+#else
+	return -FI_ENOENT;
+#endif
+}
@@ -58,11 +58,13 @@ static int smr_domain_close(fid_t fid)
 
 	if (domain->ipc_cache)
 		ofi_ipc_cache_destroy(domain->ipc_cache);
+	smr_attach_cleanup(domain);
 
 	ret = ofi_domain_close(&domain->util_domain);
 	if (ret)
 		return ret;
 
+	ofi_mutex_destroy(&domain->direct_lock);
 	free(domain);
 	return 0;
 }
@@ -75,17 +77,64 @@ static struct fi_ops smr_domain_fi_ops = {
 	.ops_open = fi_no_ops_open,
 };
 
+static int smr_mr_regattr(struct fid *fid, const struct fi_mr_attr *attr,
+			  uint64_t flags, struct fid_mr **mr_fid)
+{
+	struct smr_domain *domain;
+	int ret;
+
+	ret = ofi_mr_regattr(fid, attr, flags, mr_fid);
+	if (ret)
+		return ret;
+
+	domain = container_of(fid, struct smr_domain, util_domain.domain_fid.fid);
+	smr_direct_mr_publish(domain, container_of(*mr_fid, struct ofi_mr,
+						   mr_fid), attr);
+	return 0;
+}
+
+static int smr_mr_regv(struct fid *fid, const struct iovec *iov,
+		       size_t count, uint64_t access, uint64_t offset,
+		       uint64_t requested_key, uint64_t flags,
+		       struct fid_mr **mr_fid, void *context)
+{
+	struct fi_mr_attr attr;
+
+	attr.mr_iov = iov;
+	attr.iov_count = count;
+	attr.access = access;
+	attr.offset = offset;
+	attr.requested_key = requested_key;
+	attr.context = context;
+	attr.iface = FI_HMEM_SYSTEM;
+	attr.device.reserved = 0;
+
+	return smr_mr_regattr(fid, &attr, flags, mr_fid);
+}
+
+static int smr_mr_reg(struct fid *fid, const void *buf, size_t len,
+		      uint64_t access, uint64_t offset, uint64_t requested_key,
+		      uint64_t flags, struct fid_mr **mr_fid, void *context)
+{
+	struct iovec iov;
+
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	return smr_mr_regv(fid, &iov, 1, access, offset, requested_key, flags,
+			   mr_fid, context);
+}
+
 static struct fi_ops_mr smr_mr_ops = {
 	.size = sizeof(struct fi_ops_mr),
-	.reg = ofi_mr_reg,
-	.regv = ofi_mr_regv,
-	.regattr = ofi_mr_regattr,
+	.reg = smr_mr_reg,
+	.regv = smr_mr_regv,
+	.regattr = smr_mr_regattr,
 };
 
 int smr_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 		struct fid_domain **domain, void *context)
 {
-	int ret;
+	int ret, i;
 	struct smr_domain *smr_domain;
 	struct smr_fabric *smr_fabric;
 
@@ -111,12 +160,27 @@ int smr_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 						    info->tx_attr->msg_order);
 	ofi_mutex_unlock(&smr_fabric->util_fabric.lock);
 
+	/* Atomics targeting this domain's memory are applied by the progress
+	 * of its endpoints.  When the app serializes all access to the domain,
+	 * those updates never race and can skip the atomic instructions.
+	 */
+	smr_domain->fast_atomic =
+		info->domain_attr->threading == FI_THREAD_DOMAIN;
+
+	ofi_mutex_init(&smr_domain->direct_lock);
+	dlist_init(&smr_domain->direct_ep_list);
+	for (i = 0; i < SMR_MR_TABLE_SIZE; i++)
+		ofi_atomic_initialize64(&smr_domain->mr_table[i].gen, 0);
+
 	ret = ofi_ipc_cache_open(&smr_domain->ipc_cache, &smr_domain->util_domain);
 	if (ret) {
+		ofi_mutex_destroy(&smr_domain->direct_lock);
 		free(smr_domain);
 		return ret;
 	}
 
+	smr_attach_init(smr_domain);
+
 	*domain = &smr_domain->util_domain.domain_fid;
 	(*domain)->fid.ops = &smr_domain_fi_ops;
 	(*domain)->ops = &smr_domain_ops;
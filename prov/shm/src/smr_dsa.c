@@ -740,7 +740,7 @@ void smr_dsa_progress(struct smr_ep *ep)
 	if (!dsa_is_work_in_progress(ep->dsa_context))
 		return;
 
-	pthread_spin_lock(&ep->region->lock);
+	ofi_spin_lock(&ep->rx_lock);
 	for (index = 0; index < CMD_CONTEXT_COUNT; index++) {
 		dsa_cmd_context = dsa_get_cmd_context(dsa_context, index);
 
@@ -756,7 +756,7 @@ void smr_dsa_progress(struct smr_ep *ep)
 	}
 	// Always signal the self to complete dsa, tx or rx.
 	smr_signal(ep->region);
-	pthread_spin_unlock(&ep->region->lock);
+	ofi_spin_unlock(&ep->rx_lock);
 }
 
 size_t smr_dsa_copy_to_sar(struct smr_ep *ep, struct smr_freestack *sar_pool,
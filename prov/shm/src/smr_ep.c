@@ -206,15 +206,18 @@ static void smr_send_name(struct smr_ep *ep, int64_t id)
 	struct smr_region *peer_smr;
 	struct smr_cmd *cmd;
 	struct smr_inject_buf *tx_buf;
+	int64_t pos;
 
 	peer_smr = smr_peer_region(ep->region, id);
 
 	pthread_spin_lock(&peer_smr->lock);
 
-	if (smr_peer_data(ep->region)[id].name_sent || !peer_smr->cmd_cnt)
+	if (smr_peer_data(ep->region)[id].name_sent ||
+	    !smr_cmd_credit_get(peer_smr, 1))
 		goto out;
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
+	pos = smr_cmd_queue_reserve(smr_cmd_queue(peer_smr), 1);
+	cmd = smr_cmd_queue_get(smr_cmd_queue(peer_smr), pos);
 
 	cmd->msg.hdr.op = SMR_OP_MAX + ofi_ctrl_connreq;
 	cmd->msg.hdr.id = id;
@@ -227,8 +230,7 @@ static void smr_send_name(struct smr_ep *ep, int64_t id)
 	memcpy(tx_buf->data, ep->name, cmd->msg.hdr.size);
 
 	smr_peer_data(ep->region)[id].name_sent = 1;
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_cmd_queue_commit(smr_cmd_queue(peer_smr), pos);
 	smr_signal(peer_smr);
 
 out:
@@ -241,13 +243,14 @@ int64_t smr_verify_peer(struct smr_ep *ep, fi_addr_t fi_addr)
 	int ret;
 
 	id = smr_addr_lookup(ep->util_ep.av, fi_addr);
-	assert(id < SMR_MAX_PEERS);
+	assert(id < ep->region->max_peers);
 
 	if (smr_peer_data(ep->region)[id].addr.id >= 0)
 		return id;
 
-	if (ep->region->map->peers[id].peer.id < 0) {
-		ret = smr_map_to_region(&smr_prov, &ep->region->map->peers[id]);
+	if (smr_map_peer(ep->region->map, id)->peer.id < 0) {
+		ret = smr_map_to_region(&smr_prov,
+					smr_map_peer(ep->region->map, id));
 		if (ret == -ENOENT)
 			return -1;
 
@@ -352,6 +355,24 @@ static void smr_format_iov(struct smr_cmd *cmd, const struct iovec *iov,
 	memcpy(cmd->msg.data.iov, iov, sizeof(*iov) * count);
 }
 
+static int smr_format_attach(struct smr_ep *ep, struct smr_cmd *cmd,
+		const struct iovec *iov, size_t total_len, struct smr_region *smr,
+		struct smr_resp *resp, struct smr_tx_entry *pend)
+{
+	int ret;
+
+	ret = smr_attach_get(ep, cmd->msg.hdr.op, iov, &cmd->msg.data.attach,
+			     &pend->mr_entry);
+	if (ret)
+		return ret;
+
+	cmd->msg.hdr.op_src = smr_src_attach;
+	cmd->msg.hdr.src_data = smr_get_offset(smr, resp);
+	cmd->msg.hdr.size = total_len;
+
+	return FI_SUCCESS;
+}
+
 static int smr_format_ze_ipc(struct smr_ep *ep, int64_t id, struct smr_cmd *cmd,
 		const struct iovec *iov, uint64_t device, size_t total_len,
 		struct smr_region *smr,	 struct smr_resp *resp,
@@ -615,12 +636,20 @@ static int smr_format_sar(struct smr_ep *ep, struct smr_cmd *cmd,
 	return 0;
 }
 
-int smr_select_proto(bool use_ipc, bool cma_avail, enum fi_hmem_iface iface,
-		     uint32_t op, uint64_t total_len, uint64_t op_flags)
+int smr_select_proto(bool use_ipc, bool cma_avail, bool attach_avail,
+		     enum fi_hmem_iface iface, uint32_t op, uint64_t total_len,
+		     uint64_t op_flags)
 {
+	/* Large transfers from a single host buffer first try to let the
+	 * peer map it, whether or not CMA is available */
+	attach_avail = attach_avail && iface == FI_HMEM_SYSTEM &&
+		       total_len >= SMR_ATTACH_MIN_SIZE;
+
 	if (op == ofi_op_read_req) {
 		if (use_ipc)
 			return smr_src_ipc;
+		if (attach_avail)
+			return smr_src_attach;
 		if (cma_avail && FI_HMEM_SYSTEM)
 			return smr_src_iov;
 		return smr_src_sar;
@@ -629,23 +658,27 @@ int smr_select_proto(bool use_ipc, bool cma_avail, enum fi_hmem_iface iface,
 	if (op_flags & FI_INJECT) {
 		if (op_flags & FI_DELIVERY_COMPLETE)
 			return smr_src_sar;
-		return total_len <= SMR_MSG_DATA_LEN ?
+		return total_len <= smr_env.inline_threshold ?
 				smr_src_inline : smr_src_inject;
 	}
 
 	if (use_ipc)
 		return smr_src_ipc;
 
-	if (total_len > SMR_INJECT_SIZE && iface == FI_HMEM_SYSTEM && cma_avail)
+	if (attach_avail)
+		return smr_src_attach;
+
+	if (total_len > smr_env.cma_threshold && iface == FI_HMEM_SYSTEM &&
+	    cma_avail)
 		return smr_src_iov;
 
 	if (op_flags & FI_DELIVERY_COMPLETE)
 		return smr_src_sar;
 
-	if (total_len <= SMR_MSG_DATA_LEN)
+	if (total_len <= smr_env.inline_threshold)
 		return smr_src_inline;
 
-	if (total_len <= SMR_INJECT_SIZE)
+	if (total_len <= smr_env.inject_threshold)
 		return smr_src_inject;
 
 	if (total_len <= smr_env.sar_threshold || iface != FI_HMEM_SYSTEM)
@@ -654,90 +687,76 @@ int smr_select_proto(bool use_ipc, bool cma_avail, enum fi_hmem_iface iface,
 	return smr_src_mmap;
 }
 
-static ssize_t smr_do_inline(struct smr_ep *ep, struct smr_region *peer_smr, int64_t id,
-			     int64_t peer_id, uint32_t op, uint64_t tag, uint64_t data,
+static ssize_t smr_do_inline(struct smr_ep *ep, struct smr_region *peer_smr,
+			     struct smr_cmd *cmd, int64_t id, int64_t peer_id,
+			     uint32_t op, uint64_t tag, uint64_t data,
 			     uint64_t op_flags, enum fi_hmem_iface iface, uint64_t device,
 			     const struct iovec *iov, size_t iov_count, size_t total_len,
 			     void *context)
 {
-	struct smr_cmd *cmd;
-
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
 	smr_generic_format(cmd, peer_id, op, tag, data, op_flags);
 	smr_format_inline(cmd, iface, device, iov, iov_count);
 
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
-
 	return FI_SUCCESS;
 }
 
-static ssize_t smr_do_inject(struct smr_ep *ep, struct smr_region *peer_smr, int64_t id,
-			     int64_t peer_id, uint32_t op, uint64_t tag, uint64_t data,
+static ssize_t smr_do_inject(struct smr_ep *ep, struct smr_region *peer_smr,
+			     struct smr_cmd *cmd, int64_t id, int64_t peer_id,
+			     uint32_t op, uint64_t tag, uint64_t data,
 			     uint64_t op_flags, enum fi_hmem_iface iface, uint64_t device,
 			     const struct iovec *iov, size_t iov_count, size_t total_len,
 			     void *context)
 {
-	struct smr_cmd *cmd;
 	struct smr_inject_buf *tx_buf;
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
 	tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
 
 	smr_generic_format(cmd, peer_id, op, tag, data, op_flags);
 	smr_format_inject(cmd, iface, device, iov, iov_count, peer_smr, tx_buf);
 
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
-
 	return FI_SUCCESS;
 }
 
-static ssize_t smr_do_iov(struct smr_ep *ep, struct smr_region *peer_smr, int64_t id,
-			  int64_t peer_id, uint32_t op, uint64_t tag, uint64_t data,
+static ssize_t smr_do_iov(struct smr_ep *ep, struct smr_region *peer_smr,
+			  struct smr_cmd *cmd, int64_t id, int64_t peer_id,
+			  uint32_t op, uint64_t tag, uint64_t data,
 			  uint64_t op_flags, enum fi_hmem_iface iface, uint64_t device,
 		          const struct iovec *iov, size_t iov_count, size_t total_len,
 		          void *context)
 {
-	struct smr_cmd *cmd;
 	struct smr_resp *resp;
 	struct smr_tx_entry *pend;
 
-	if (ofi_cirque_isfull(smr_resp_queue(ep->region)))
+	if (smr_resp_queue_isfull(smr_resp_queue(ep->region)))
 		return -FI_EAGAIN;
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
-	resp = ofi_cirque_next(smr_resp_queue(ep->region));
+	resp = smr_resp_queue_next(smr_resp_queue(ep->region));
 	pend = ofi_freestack_pop(ep->pend_fs);
 
 	smr_generic_format(cmd, peer_id, op, tag, data, op_flags);
 	smr_format_iov(cmd, iov, iov_count, total_len, ep->region, resp);
 	smr_format_pend_resp(pend, cmd, context, iface, device, iov,
 			     iov_count, op_flags, id, resp);
-	ofi_cirque_commit(smr_resp_queue(ep->region));
-
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_resp_queue_advance(smr_resp_queue(ep->region));
 
 	return FI_SUCCESS;
 }
 
-static ssize_t smr_do_sar(struct smr_ep *ep, struct smr_region *peer_smr, int64_t id,
-			  int64_t peer_id, uint32_t op, uint64_t tag, uint64_t data,
+static ssize_t smr_do_sar(struct smr_ep *ep, struct smr_region *peer_smr,
+			  struct smr_cmd *cmd, int64_t id, int64_t peer_id,
+			  uint32_t op, uint64_t tag, uint64_t data,
 			  uint64_t op_flags, enum fi_hmem_iface iface, uint64_t device,
 		          const struct iovec *iov, size_t iov_count, size_t total_len,
 		          void *context)
 {
-	struct smr_cmd *cmd;
 	struct smr_resp *resp;
 	struct smr_tx_entry *pend;
 	int ret;
 
-	if (ofi_cirque_isfull(smr_resp_queue(ep->region)))
+	if (smr_resp_queue_isfull(smr_resp_queue(ep->region)))
 		return -FI_EAGAIN;
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
-	resp = ofi_cirque_next(smr_resp_queue(ep->region));
+	resp = smr_resp_queue_next(smr_resp_queue(ep->region));
 	pend = ofi_freestack_pop(ep->pend_fs);
 
 	smr_generic_format(cmd, peer_id, op, tag, data, op_flags);
@@ -750,30 +769,108 @@ static ssize_t smr_do_sar(struct smr_ep *ep, struct smr_region *peer_smr, int64_
 
 	smr_format_pend_resp(pend, cmd, context, iface, device, iov,
 			     iov_count, op_flags, id, resp);
-	ofi_cirque_commit(smr_resp_queue(ep->region));
+	smr_resp_queue_advance(smr_resp_queue(ep->region));
 
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	return FI_SUCCESS;
+}
+
+/* Buffers that cannot be mapped take the protocol they would without
+ * attach, CMA or SAR */
+static ssize_t smr_do_attach(struct smr_ep *ep, struct smr_region *peer_smr,
+			     struct smr_cmd *cmd, int64_t id, int64_t peer_id,
+			     uint32_t op, uint64_t tag, uint64_t data,
+			     uint64_t op_flags, enum fi_hmem_iface iface, uint64_t device,
+			     const struct iovec *iov, size_t iov_count, size_t total_len,
+			     void *context)
+{
+	struct smr_resp *resp;
+	struct smr_tx_entry *pend;
+	int proto;
+
+	if (smr_resp_queue_isfull(smr_resp_queue(ep->region)))
+		return -FI_EAGAIN;
+
+	resp = smr_resp_queue_next(smr_resp_queue(ep->region));
+	pend = ofi_freestack_pop(ep->pend_fs);
+
+	smr_generic_format(cmd, peer_id, op, tag, data, op_flags);
+	if (smr_format_attach(ep, cmd, iov, total_len, ep->region, resp,
+			      pend)) {
+		ofi_freestack_push(ep->pend_fs, pend);
+		proto = smr_select_proto(false, smr_cma_enabled(ep, peer_smr),
+					 false, iface, op, total_len, op_flags);
+		return smr_proto_ops[proto](ep, peer_smr, cmd, id, peer_id,
+					    op, tag, data, op_flags, iface,
+					    device, iov, iov_count, total_len,
+					    context);
+	}
+
+	smr_format_pend_resp(pend, cmd, context, iface, device, iov,
+			     iov_count, op_flags, id, resp);
+	smr_resp_queue_advance(smr_resp_queue(ep->region));
 
 	return FI_SUCCESS;
 }
 
-static ssize_t smr_do_ipc(struct smr_ep *ep, struct smr_region *peer_smr, int64_t id,
-			  int64_t peer_id, uint32_t op, uint64_t tag, uint64_t data,
+/* The peer could not map the buffer of a pending attach.  Move the data
+ * through SAR with a command the peer matches to its waiting receive.
+ * Called with the tx lock held.
+ */
+int smr_attach_resend_sar(struct smr_ep *ep, struct smr_tx_entry *pending,
+			  struct smr_resp *resp)
+{
+	struct smr_region *peer_smr;
+	struct smr_cmd cmd;
+	int64_t pos;
+	int ret;
+
+	peer_smr = smr_peer_region(ep->region, pending->peer_id);
+	if (pthread_spin_trylock(&peer_smr->lock))
+		goto again;
+
+	/* The attach command's credit still covers this one */
+	cmd = pending->cmd;
+	cmd.msg.hdr.op_flags |= SMR_ATTACH_SAR;
+	ret = smr_format_sar(ep, &cmd, pending->iface, pending->device,
+			     pending->iov, pending->iov_count,
+			     pending->cmd.msg.hdr.size, ep->region, peer_smr,
+			     pending->peer_id, pending, resp);
+	if (ret) {
+		pthread_spin_unlock(&peer_smr->lock);
+		goto again;
+	}
+
+	smr_attach_put(ep, pending->mr_entry);
+	pending->mr_entry = NULL;
+	pending->cmd = cmd;
+
+	pos = smr_cmd_queue_reserve(smr_cmd_queue(peer_smr), 1);
+	*smr_cmd_queue_get(smr_cmd_queue(peer_smr), pos) = cmd;
+	smr_cmd_queue_commit(smr_cmd_queue(peer_smr), pos);
+	pthread_spin_unlock(&peer_smr->lock);
+	smr_signal(peer_smr);
+	return -FI_EAGAIN;
+
+again:
+	smr_signal(ep->region);
+	return -FI_EAGAIN;
+}
+
+static ssize_t smr_do_ipc(struct smr_ep *ep, struct smr_region *peer_smr,
+			  struct smr_cmd *cmd, int64_t id, int64_t peer_id,
+			  uint32_t op, uint64_t tag, uint64_t data,
 			  uint64_t op_flags, enum fi_hmem_iface iface, uint64_t device,
 		          const struct iovec *iov, size_t iov_count, size_t total_len,
 		          void *context)
 {
-	struct smr_cmd *cmd;
 	struct smr_resp *resp;
 	struct smr_tx_entry *pend;
 	int ret = -FI_EAGAIN;
 
-	if (ofi_cirque_isfull(smr_resp_queue(ep->region)))
+	if (smr_resp_queue_isfull(smr_resp_queue(ep->region)))
 		return -FI_EAGAIN;
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
-	resp = ofi_cirque_next(smr_resp_queue(ep->region));
+	resp = smr_resp_queue_next(smr_resp_queue(ep->region));
 	pend = ofi_freestack_pop(ep->pend_fs);
 
 	smr_generic_format(cmd, peer_id, op, tag, data, op_flags);
@@ -790,37 +887,33 @@ static ssize_t smr_do_ipc(struct smr_ep *ep, struct smr_region *peer_smr, int64_
 		FI_WARN_ONCE(&smr_prov, FI_LOG_EP_CTRL,
 			     "unable to use IPC for msg, fallback to using SAR\n");
 		ofi_freestack_push(ep->pend_fs, pend);
-		return smr_do_sar(ep, peer_smr, id, peer_id, op, tag, data,
+		return smr_do_sar(ep, peer_smr, cmd, id, peer_id, op, tag, data,
 				  op_flags, iface, device, iov, iov_count,
 				  total_len, context);
 	}
 
 	smr_format_pend_resp(pend, cmd, context, iface, device, iov,
 			     iov_count, op_flags, id, resp);
-	ofi_cirque_commit(smr_resp_queue(ep->region));
-
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_resp_queue_advance(smr_resp_queue(ep->region));
 
 	return FI_SUCCESS;
 }
 
-static ssize_t smr_do_mmap(struct smr_ep *ep, struct smr_region *peer_smr, int64_t id,
-			   int64_t peer_id, uint32_t op, uint64_t tag, uint64_t data,
+static ssize_t smr_do_mmap(struct smr_ep *ep, struct smr_region *peer_smr,
+			   struct smr_cmd *cmd, int64_t id, int64_t peer_id,
+			   uint32_t op, uint64_t tag, uint64_t data,
 			   uint64_t op_flags, enum fi_hmem_iface iface, uint64_t device,
 		           const struct iovec *iov, size_t iov_count, size_t total_len,
 		           void *context)
 {
-	struct smr_cmd *cmd;
 	struct smr_resp *resp;
 	struct smr_tx_entry *pend;
 	int ret;
 
-	if (ofi_cirque_isfull(smr_resp_queue(ep->region)))
+	if (smr_resp_queue_isfull(smr_resp_queue(ep->region)))
 		return -FI_EAGAIN;
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
-	resp = ofi_cirque_next(smr_resp_queue(ep->region));
+	resp = smr_resp_queue_next(smr_resp_queue(ep->region));
 	pend = ofi_freestack_pop(ep->pend_fs);
 
 	smr_generic_format(cmd, peer_id, op, tag, data, op_flags);
@@ -832,14 +925,26 @@ static ssize_t smr_do_mmap(struct smr_ep *ep, struct smr_region *peer_smr, int64
 
 	smr_format_pend_resp(pend, cmd, context, iface, device, iov,
 			     iov_count, op_flags, id, resp);
-	ofi_cirque_commit(smr_resp_queue(ep->region));
-
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_resp_queue_advance(smr_resp_queue(ep->region));
 
 	return FI_SUCCESS;
 }
 
+void smr_abort_cmds(struct smr_region *peer_smr, int64_t pos, int cnt)
+{
+	struct smr_cmd *cmd;
+	int i;
+
+	/* Reserved slots must still be published; turn them into no-ops
+	 * that the receiver discards.  The receiver returns their credits
+	 * once the slots are drained. */
+	for (i = cnt - 1; i >= 0; i--) {
+		cmd = smr_cmd_queue_get(smr_cmd_queue(peer_smr), pos + i);
+		cmd->msg.hdr.op = SMR_OP_MAX + ofi_ctrl_discard;
+		smr_cmd_queue_commit(smr_cmd_queue(peer_smr), pos + i);
+	}
+}
+
 smr_proto_func smr_proto_ops[smr_src_max] = {
 	[smr_src_inline] = &smr_do_inline,
 	[smr_src_inject] = &smr_do_inject,
@@ -847,6 +952,7 @@ smr_proto_func smr_proto_ops[smr_src_max] = {
 	[smr_src_mmap] = &smr_do_mmap,
 	[smr_src_sar] = &smr_do_sar,
 	[smr_src_ipc] = &smr_do_ipc,
+	[smr_src_attach] = &smr_do_attach,
 };
 
 static void smr_cleanup_epoll(struct smr_sock_info *sock_info)
@@ -944,9 +1050,12 @@ static int smr_ep_close(struct fid *fid)
 		close(ep->sock_info->listen_sock);
 		unlink(ep->sock_info->name);
 		smr_cleanup_epoll(ep->sock_info);
+		free(ep->sock_info->peers);
 		free(ep->sock_info);
 	}
 
+	smr_direct_ep_cleanup(ep);
+	smr_attach_ep_cleanup(ep);
 	ofi_endpoint_close(&ep->util_ep);
 
 	if (ep->region)
@@ -958,6 +1067,7 @@ static int smr_ep_close(struct fid *fid)
 	smr_cmd_ctx_fs_free(ep->cmd_ctx_fs);
 	smr_pend_fs_free(ep->pend_fs);
 	smr_sar_fs_free(ep->sar_fs);
+	ofi_spin_destroy(&ep->rx_lock);
 	ofi_spin_destroy(&ep->tx_lock);
 
 	free((void *)ep->name);
@@ -1148,7 +1258,7 @@ static void *smr_start_listener(void *args)
 {
 	struct smr_ep *ep = (struct smr_ep *) args;
 	struct sockaddr_un sockaddr;
-	struct ofi_epollfds_event events[SMR_MAX_PEERS + 1];
+	struct ofi_epollfds_event events[SMR_DEF_PEERS + 1];
 	int i, ret, poll_fds, sock = -1;
 	int peer_fds[ZE_MAX_DEVICES];
 	socklen_t len = sizeof(sockaddr);
@@ -1157,7 +1267,7 @@ static void *smr_start_listener(void *args)
 	ep->region->flags |= SMR_FLAG_IPC_SOCK;
 	while (1) {
 		poll_fds = ofi_epoll_wait(ep->sock_info->epollfd, events,
-					  SMR_MAX_PEERS + 1, -1);
+					  SMR_DEF_PEERS + 1, -1);
 
 		if (poll_fds < 0) {
 			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
@@ -1320,6 +1430,11 @@ static void smr_init_ipc_socket(struct smr_ep *ep)
 	if (!ep->sock_info)
 		goto err_out;
 
+	ep->sock_info->peers = calloc(ep->region->max_peers,
+				      sizeof(*ep->sock_info->peers));
+	if (!ep->sock_info->peers)
+		goto free;
+
 	ep->sock_info->listen_sock = socket(AF_UNIX, SOCK_STREAM, 0);
 	if (ep->sock_info->listen_sock < 0)
 		goto free;
@@ -1336,7 +1451,7 @@ static void smr_init_ipc_socket(struct smr_ep *ep)
 	if (ret)
 		goto close;
 
-	ret = listen(ep->sock_info->listen_sock, SMR_MAX_PEERS);
+	ret = listen(ep->sock_info->listen_sock, SMR_DEF_PEERS);
 	if (ret)
 		goto close;
 
@@ -1378,6 +1493,7 @@ close:
 	close(ep->sock_info->listen_sock);
 	unlink(sockaddr.sun_path);
 free:
+	free(ep->sock_info->peers);
 	free(ep->sock_info);
 	ep->sock_info = NULL;
 err_out:
@@ -1680,6 +1796,7 @@ static int smr_ep_ctrl(struct fid *fid, int command, void *arg)
 		attr.name = smr_no_prefix(ep->name);
 		attr.rx_count = ep->rx_size;
 		attr.tx_count = ep->tx_size;
+		attr.peer_count = av->smr_map->max_peers;
 
 		ret = smr_create(&smr_prov, av->smr_map, &attr, &ep->region);
 		if (ret)
@@ -1711,6 +1828,7 @@ static int smr_ep_ctrl(struct fid *fid, int command, void *arg)
 			ep->util_ep.ep_fid.msg = &smr_no_recv_msg_ops;
 			ep->util_ep.ep_fid.tagged = &smr_no_recv_tag_ops;
 		}
+		smr_direct_ep_init(ep);
 		smr_exchange_all_peers(ep->region);
 
 		if (smr_env.use_dsa_sar)
@@ -1796,12 +1914,16 @@ int smr_endpoint(struct fid_domain *domain, struct fi_info *info,
 	if (ret)
 		goto name;
 
+	ret = ofi_spin_init(&ep->rx_lock);
+	if (ret)
+		goto tx_lock;
+
 	ep->rx_size = info->rx_attr->size;
 	ep->tx_size = info->tx_attr->size;
 	ret = ofi_endpoint_init(domain, &smr_util_prov, info, &ep->util_ep, context,
 				smr_ep_progress);
 	if (ret)
-		goto lock;
+		goto rx_lock;
 
 	ep->util_ep.ep_fid.msg = &smr_msg_ops;
 	ep->util_ep.ep_fid.tagged = &smr_tag_ops;
@@ -1811,6 +1933,8 @@ int smr_endpoint(struct fid_domain *domain, struct fi_info *info,
 	ep->sar_fs = smr_sar_fs_create(info->rx_attr->size, NULL, NULL);
 
 	dlist_init(&ep->sar_list);
+	dlist_init(&ep->attach_list);
+	dlist_init(&ep->direct_entry);
 
 	ep->util_ep.ep_fid.fid.ops = &smr_ep_fi_ops;
 	ep->util_ep.ep_fid.ops = &smr_ep_ops;
@@ -1821,7 +1945,9 @@ int smr_endpoint(struct fid_domain *domain, struct fi_info *info,
 	*ep_fid = &ep->util_ep.ep_fid;
 	return 0;
 
-lock:
+rx_lock:
+	ofi_spin_destroy(&ep->rx_lock);
+tx_lock:
 	ofi_spin_destroy(&ep->tx_lock);
 name:
 	free((void *)ep->name);
@@ -41,18 +41,35 @@
 struct sigaction *old_action = NULL;
 
 struct smr_env smr_env = {
+	.inline_threshold = SMR_MSG_DATA_LEN,
+	.inject_threshold = SMR_INJECT_SIZE,
+	.cma_threshold = SMR_INJECT_SIZE,
 	.sar_threshold = SIZE_MAX,
 	.disable_cma = false,
 	.use_dsa_sar = false,
+	.enable_direct_rma = false,
+	.disable_attach = false,
 };
 
 static void smr_init_env(void)
 {
-	fi_param_get_size_t(&smr_prov, "sar_threshold", &smr_env.sar_threshold);
 	fi_param_get_size_t(&smr_prov, "tx_size", &smr_info.tx_attr->size);
 	fi_param_get_size_t(&smr_prov, "rx_size", &smr_info.rx_attr->size);
 	fi_param_get_bool(&smr_prov, "disable_cma", &smr_env.disable_cma);
 	fi_param_get_bool(&smr_prov, "use_dsa_sar", &smr_env.use_dsa_sar);
+	fi_param_get_bool(&smr_prov, "enable_direct_rma",
+			  &smr_env.enable_direct_rma);
+	fi_param_get_bool(&smr_prov, "disable_attach", &smr_env.disable_attach);
+
+	/* Explicit thresholds override the file or calibration */
+	smr_init_thresholds();
+	fi_param_get_size_t(&smr_prov, "inline_threshold",
+			    &smr_env.inline_threshold);
+	fi_param_get_size_t(&smr_prov, "inject_threshold",
+			    &smr_env.inject_threshold);
+	fi_param_get_size_t(&smr_prov, "cma_threshold", &smr_env.cma_threshold);
+	fi_param_get_size_t(&smr_prov, "sar_threshold", &smr_env.sar_threshold);
+	smr_check_thresholds();
 }
 
 static void smr_resolve_addr(const char *node, const char *service,
@@ -84,7 +101,7 @@ static void smr_resolve_addr(const char *node, const char *service,
 /*
  * The smr_shm_space_check is to check if there's enough shm space we
  * need under /dev/shm.
- * Here we use #core instead of SMR_MAX_PEERS, as it is the most likely
+ * Here we use #core instead of the peer count, as it is the most likely
  * value and has less possibility of failing fi_getinfo calls that are
  * currently passing, and breaking currently working app
  */
@@ -104,9 +121,10 @@ static int smr_shm_space_check(size_t tx_count, size_t rx_count)
 	}
 	shm_size_needed = num_of_core *
 			  smr_calculate_size_offsets(tx_count, rx_count,
+						     SMR_DEF_PEERS,
 						     NULL, NULL, NULL,
 						     NULL, NULL, NULL,
-						     NULL);
+						     NULL, NULL);
 	err = statvfs(shm_fs, &stat);
 	if (err) {
 		FI_WARN(&smr_prov, FI_LOG_CORE,
@@ -205,6 +223,22 @@ SHM_INI
 			"Max size to use for alternate SAR protocol if CMA \
 			 is not available before switching to mmap protocol \
 			 Default: SIZE_MAX (18446744073709551615)");
+	fi_param_define(&smr_prov, "inline_threshold", FI_PARAM_SIZE_T,
+			"Max size to send inline in the command. \
+			 Default: 192, also the maximum");
+	fi_param_define(&smr_prov, "inject_threshold", FI_PARAM_SIZE_T,
+			"Max size to send through inject buffers. \
+			 Default: 4096, also the maximum");
+	fi_param_define(&smr_prov, "cma_threshold", FI_PARAM_SIZE_T,
+			"Messages larger than this use CMA when it is \
+			 available. Default: 4096");
+	fi_param_define(&smr_prov, "calibrate", FI_PARAM_BOOL,
+			"Measure the protocol thresholds at startup. \
+			 Default: false");
+	fi_param_define(&smr_prov, "threshold_file", FI_PARAM_STRING,
+			"File holding the protocol thresholds. Measured \
+			 and written by one process if it does not exist. \
+			 Default: none");
 	fi_param_define(&smr_prov, "tx_size", FI_PARAM_SIZE_T,
 			"Max number of outstanding tx operations \
 			 Default: 1024");
@@ -219,6 +253,14 @@ SHM_INI
 			"Enable CPU touching of memory pages in DSA command \
 			 descriptor when page fault is reported. \
 			 Default: false");
+	fi_param_define(&smr_prov, "enable_direct_rma", FI_PARAM_BOOL,
+			"Enable direct RMA and atomics to registrations \
+			 backed by shared file mappings. Registrations \
+			 with remote access then look up their backing \
+			 file in /proc/self/maps. Default: false");
+	fi_param_define(&smr_prov, "disable_attach", FI_PARAM_BOOL,
+			"Disable mapping of large send buffers by the \
+			 receiver. Default: false");
 
 	smr_init_env();
 
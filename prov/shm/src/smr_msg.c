@@ -288,12 +288,13 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 				   uint32_t op, uint64_t op_flags)
 {
 	struct smr_region *peer_smr;
+	struct smr_cmd *cmd;
 	enum fi_hmem_iface iface;
 	uint64_t device;
-	int64_t id, peer_id;
+	int64_t id, peer_id, pos;
 	ssize_t ret = 0;
 	size_t total_len;
-	bool use_ipc;
+	bool use_ipc, use_pool;
 	int proto;
 
 	assert(iov_count <= SMR_IOV_LIMIT);
@@ -305,13 +306,6 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 	peer_id = smr_peer_data(ep->region)[id].addr.id;
 	peer_smr = smr_peer_region(ep->region, id);
 
-	pthread_spin_lock(&peer_smr->lock);
-	if (!peer_smr->cmd_cnt || smr_peer_data(ep->region)[id].sar_status) {
-		ret = -FI_EAGAIN;
-		goto unlock_region;
-	}
-
-	ofi_spin_lock(&ep->tx_lock);
 	iface = smr_get_mr_hmem_iface(ep->util_ep.domain, desc, &device);
 
 	total_len = ofi_total_iov_len(iov, iov_count);
@@ -323,30 +317,50 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 		  desc && (smr_get_mr_flags(desc) & FI_HMEM_DEVICE_ONLY) &&
 		  !(op_flags & FI_INJECT);
 
-	proto = smr_select_proto(use_ipc, smr_cma_enabled(ep, peer_smr), iface,
-				 op, total_len, op_flags);
+	proto = smr_select_proto(use_ipc, smr_cma_enabled(ep, peer_smr),
+				 smr_attach_enabled(ep, peer_smr, peer_id, iov_count),
+				 iface, op, total_len, op_flags);
+
+	/* Only protocols that draw from the peer's buffer pools need the
+	 * peer lock, the cmd queue itself is lock-free */
+	use_pool = smr_proto_uses_pool(proto);
+	if (use_pool)
+		pthread_spin_lock(&peer_smr->lock);
 
-	ret = smr_proto_ops[proto](ep, peer_smr, id, peer_id, op, tag, data, op_flags,
-				   iface, device, iov, iov_count, total_len, context);
-	if (ret)
-		goto unlock_cq;
+	ofi_spin_lock(&ep->tx_lock);
+	if (smr_peer_data(ep->region)[id].sar_status ||
+	    !smr_cmd_credit_get(peer_smr, 1)) {
+		ret = -FI_EAGAIN;
+		goto unlock;
+	}
+
+	pos = smr_cmd_queue_reserve(smr_cmd_queue(peer_smr), 1);
+	cmd = smr_cmd_queue_get(smr_cmd_queue(peer_smr), pos);
+	ret = smr_proto_ops[proto](ep, peer_smr, cmd, id, peer_id, op, tag,
+				   data, op_flags, iface, device, iov,
+				   iov_count, total_len, context);
+	if (ret) {
+		smr_abort_cmds(peer_smr, pos, 1);
+		goto unlock;
+	}
+	smr_cmd_queue_commit(smr_cmd_queue(peer_smr), pos);
 
 	smr_signal(peer_smr);
 
 	if (proto != smr_src_inline && proto != smr_src_inject)
-		goto unlock_cq;
+		goto unlock;
 
 	ret = smr_complete_tx(ep, context, op, op_flags);
 	if (ret) {
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 			"unable to process tx completion\n");
-		goto unlock_cq;
+		goto unlock;
 	}
 
-unlock_cq:
+unlock:
 	ofi_spin_unlock(&ep->tx_lock);
-unlock_region:
-	pthread_spin_unlock(&peer_smr->lock);
+	if (use_pool)
+		pthread_spin_unlock(&peer_smr->lock);
 	return ret;
 }
 
@@ -394,7 +408,8 @@ static ssize_t smr_generic_inject(struct fid_ep *ep_fid, const void *buf,
 {
 	struct smr_ep *ep;
 	struct smr_region *peer_smr;
-	int64_t id, peer_id;
+	struct smr_cmd *cmd;
+	int64_t id, peer_id, pos;
 	ssize_t ret = 0;
 	struct iovec msg_iov;
 	int proto;
@@ -413,22 +428,33 @@ static ssize_t smr_generic_inject(struct fid_ep *ep_fid, const void *buf,
 	peer_id = smr_peer_data(ep->region)[id].addr.id;
 	peer_smr = smr_peer_region(ep->region, id);
 
-	pthread_spin_lock(&peer_smr->lock);
-	if (!peer_smr->cmd_cnt || smr_peer_data(ep->region)[id].sar_status) {
+	proto = len <= smr_env.inline_threshold ? smr_src_inline :
+						  smr_src_inject;
+	if (proto == smr_src_inject)
+		pthread_spin_lock(&peer_smr->lock);
+
+	ofi_spin_lock(&ep->tx_lock);
+	if (smr_peer_data(ep->region)[id].sar_status ||
+	    !smr_cmd_credit_get(peer_smr, 1)) {
 		ret = -FI_EAGAIN;
 		goto unlock;
 	}
 
-	proto = len <= SMR_MSG_DATA_LEN ? smr_src_inline : smr_src_inject;
-	ret = smr_proto_ops[proto](ep, peer_smr, id, peer_id, op, tag, data,
-			op_flags, FI_HMEM_SYSTEM, 0, &msg_iov, 1, len, NULL);
+	pos = smr_cmd_queue_reserve(smr_cmd_queue(peer_smr), 1);
+	cmd = smr_cmd_queue_get(smr_cmd_queue(peer_smr), pos);
+	ret = smr_proto_ops[proto](ep, peer_smr, cmd, id, peer_id, op, tag,
+			data, op_flags, FI_HMEM_SYSTEM, 0, &msg_iov, 1, len,
+			NULL);
 
 	assert(!ret);
+	smr_cmd_queue_commit(smr_cmd_queue(peer_smr), pos);
 	ofi_ep_tx_cntr_inc_func(&ep->util_ep, op);
 
 	smr_signal(peer_smr);
 unlock:
-	pthread_spin_unlock(&peer_smr->lock);
+	ofi_spin_unlock(&ep->tx_lock);
+	if (proto == smr_src_inject)
+		pthread_spin_unlock(&peer_smr->lock);
 
 	return ret;
 }
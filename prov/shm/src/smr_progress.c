@@ -81,6 +81,16 @@ smr_try_progress_from_sar(struct smr_ep *ep, struct smr_region *smr,
 	smr_signal(smr);
 }
 
+/* Senders pop the inject pool under the region lock, so returning a
+ * buffer to our own pool must take it as well. */
+static void smr_release_inject_buf(struct smr_region *smr,
+				   struct smr_inject_buf *tx_buf)
+{
+	pthread_spin_lock(&smr->lock);
+	smr_freestack_push(smr_inject_pool(smr), tx_buf);
+	pthread_spin_unlock(&smr->lock);
+}
+
 static int smr_progress_resp_entry(struct smr_ep *ep, struct smr_resp *resp,
 				   struct smr_tx_entry *pending, uint64_t *err)
 {
@@ -97,6 +107,11 @@ static int smr_progress_resp_entry(struct smr_ep *ep, struct smr_resp *resp,
 	switch (pending->cmd.msg.hdr.op_src) {
 	case smr_src_iov:
 		break;
+	case smr_src_attach:
+		if (resp->status == SMR_STATUS_ATTACH_SAR)
+			return smr_attach_resend_sar(ep, pending, resp);
+		smr_attach_put(ep, pending->mr_entry);
+		break;
 	case smr_src_ipc:
 		if (pending->iface == FI_HMEM_ZE)
 			close(pending->fd);
@@ -194,16 +209,12 @@ static int smr_progress_resp_entry(struct smr_ep *ep, struct smr_resp *resp,
 			"unidentified operation type\n");
 	}
 
-	//Skip locking on transfers from self since we already have
-	//the ep->region->lock
-	if (peer_smr != ep->region) {
-		if (pthread_spin_trylock(&peer_smr->lock)) {
-			smr_signal(ep->region);
-			return -FI_EAGAIN;
-		}
+	if (pthread_spin_trylock(&peer_smr->lock)) {
+		smr_signal(ep->region);
+		return -FI_EAGAIN;
 	}
 
-	peer_smr->cmd_cnt++;
+	smr_cmd_credit_put(peer_smr, 1);
 	if (tx_buf) {
 		smr_freestack_push(smr_inject_pool(peer_smr), tx_buf);
 	} else if (sar_buf) {
@@ -215,8 +226,7 @@ static int smr_progress_resp_entry(struct smr_ep *ep, struct smr_resp *resp,
 		smr_peer_data(ep->region)[pending->peer_id].sar_status = 0;
 	}
 
-	if (peer_smr != ep->region)
-		pthread_spin_unlock(&peer_smr->lock);
+	pthread_spin_unlock(&peer_smr->lock);
 
 	return FI_SUCCESS;
 }
@@ -227,10 +237,8 @@ static void smr_progress_resp(struct smr_ep *ep)
 	struct smr_tx_entry *pending;
 	int ret;
 
-	pthread_spin_lock(&ep->region->lock);
 	ofi_spin_lock(&ep->tx_lock);
-	while (!ofi_cirque_isempty(smr_resp_queue(ep->region))) {
-		resp = ofi_cirque_head(smr_resp_queue(ep->region));
+	while ((resp = smr_resp_queue_head(smr_resp_queue(ep->region)))) {
 		if (resp->status == FI_EBUSY)
 			break;
 
@@ -252,10 +260,9 @@ static void smr_progress_resp(struct smr_ep *ep)
 			break;
 		}
 		ofi_freestack_push(ep->pend_fs, pending);
-		ofi_cirque_discard(smr_resp_queue(ep->region));
+		smr_resp_queue_discard(smr_resp_queue(ep->region));
 	}
 	ofi_spin_unlock(&ep->tx_lock);
-	pthread_spin_unlock(&ep->region->lock);
 }
 
 static int smr_progress_inline(struct smr_cmd *cmd, enum fi_hmem_iface iface,
@@ -295,7 +302,7 @@ static int smr_progress_inject(struct smr_cmd *cmd, enum fi_hmem_iface iface,
 	tx_buf = smr_get_ptr(ep->region, inj_offset);
 
 	if (err) {
-		smr_freestack_push(smr_inject_pool(ep->region), tx_buf);
+		smr_release_inject_buf(ep->region, tx_buf);
 		return err;
 	}
 
@@ -308,7 +315,7 @@ static int smr_progress_inject(struct smr_cmd *cmd, enum fi_hmem_iface iface,
 		hmem_copy_ret = ofi_copy_to_hmem_iov(iface, device, iov,
 						     iov_count, 0, tx_buf->data,
 						     cmd->msg.hdr.size);
-		smr_freestack_push(smr_inject_pool(ep->region), tx_buf);
+		smr_release_inject_buf(ep->region, tx_buf);
 	}
 
 	if (hmem_copy_ret < 0) {
@@ -357,6 +364,65 @@ out:
 	return -ret;
 }
 
+/* Without CMA, a buffer the receiver cannot map is sent again through SAR.
+ * The receive waits on attach_list until that command arrives, and *parked
+ * is set.
+ */
+static int smr_progress_attach(struct smr_cmd *cmd,
+			       struct fi_peer_rx_entry *rx_entry,
+			       enum fi_hmem_iface iface, uint64_t device,
+			       struct iovec *iov, size_t iov_count,
+			       size_t *total_len, struct smr_ep *ep, int err,
+			       struct smr_sar_entry **parked)
+{
+	struct smr_region *peer_smr;
+	struct smr_sar_entry *entry;
+	struct smr_resp *resp;
+	struct iovec peer_iov;
+	int ret;
+
+	peer_smr = smr_peer_region(ep->region, cmd->msg.hdr.id);
+	resp = smr_get_ptr(peer_smr, cmd->msg.hdr.src_data);
+
+	if (err) {
+		ret = -err;
+		goto out;
+	}
+
+	ret = smr_attach_copy(ep, cmd, iov, iov_count);
+	if (ret && smr_cma_enabled(ep, peer_smr)) {
+		peer_iov.iov_base = (void *) (uintptr_t) cmd->msg.data.attach.addr;
+		peer_iov.iov_len = cmd->msg.hdr.size;
+		ret = smr_cma_loop(peer_smr->pid, iov, iov_count, &peer_iov, 1,
+				   0, cmd->msg.hdr.size,
+				   cmd->msg.hdr.op == ofi_op_read_req);
+	} else if (ret && !ofi_freestack_isempty(ep->sar_fs)) {
+		/* Later sends from this peer skip the attach */
+		smr_peer_data(ep->region)[cmd->msg.hdr.id].attach_failed = 1;
+
+		entry = ofi_freestack_pop(ep->sar_fs);
+		entry->cmd = *cmd;
+		entry->rx_entry = rx_entry;
+		memcpy(entry->iov, iov, sizeof(*iov) * iov_count);
+		entry->iov_count = iov_count;
+		entry->iface = iface;
+		entry->device = device;
+		dlist_insert_tail(&entry->entry, &ep->attach_list);
+		*parked = entry;
+		ret = SMR_STATUS_ATTACH_SAR;
+		goto out;
+	}
+	if (!ret)
+		*total_len = cmd->msg.hdr.size;
+
+out:
+	//Status must be set last (signals peer: op done, valid resp entry)
+	resp->status = ret;
+	smr_signal(peer_smr);
+
+	return ret == SMR_STATUS_ATTACH_SAR ? 0 : -ret;
+}
+
 static int smr_mmap_peer_copy(struct smr_ep *ep, struct smr_cmd *cmd,
 			      enum fi_hmem_iface iface, uint64_t device,
 			      struct iovec *iov, size_t iov_count,
@@ -369,7 +435,8 @@ static int smr_mmap_peer_copy(struct smr_ep *ep, struct smr_cmd *cmd,
 	ssize_t hmem_copy_ret;
 
 	num = smr_mmap_name(shm_name,
-			ep->region->map->peers[cmd->msg.hdr.id].peer.name,
+			smr_map_peer(ep->region->map,
+				     cmd->msg.hdr.id)->peer.name,
 			cmd->msg.hdr.msg_id);
 	if (num < 0) {
 		FI_WARN(&smr_prov, FI_LOG_AV, "generating shm file name failed\n");
@@ -569,7 +636,8 @@ out:
 }
 
 static void smr_do_atomic(void *src, void *dst, void *cmp, enum fi_datatype datatype,
-			  enum fi_op op, size_t cnt, uint16_t flags)
+			  enum fi_op op, size_t cnt, uint16_t flags,
+			  int fast_atomic)
 {
 	char tmp_result[SMR_INJECT_SIZE];
 
@@ -580,7 +648,10 @@ static void smr_do_atomic(void *src, void *dst, void *cmp, enum fi_datatype data
 		ofi_atomic_readwrite_handler(op, datatype, dst, src,
 					     tmp_result, cnt);
 	} else if (ofi_atomic_iswrite_op(op)) {
-		ofi_atomic_write_handler(op, datatype, dst, src, cnt);
+		if (fast_atomic)
+			ofi_reduce_handler(op, datatype, dst, src, cnt);
+		else
+			ofi_atomic_write_handler(op, datatype, dst, src, cnt);
 	} else {
 		FI_WARN(&smr_prov, FI_LOG_EP_DATA,
 			"invalid atomic operation\n");
@@ -592,7 +663,7 @@ static void smr_do_atomic(void *src, void *dst, void *cmp, enum fi_datatype data
 }
 
 static int smr_progress_inline_atomic(struct smr_cmd *cmd, struct fi_ioc *ioc,
-			       size_t ioc_count, size_t *len)
+			       size_t ioc_count, size_t *len, int fast_atomic)
 {
 	int i;
 	uint8_t *src = cmd->msg.data.msg;
@@ -602,7 +673,7 @@ static int smr_progress_inline_atomic(struct smr_cmd *cmd, struct fi_ioc *ioc,
 	for (i = *len = 0; i < ioc_count && *len < cmd->msg.hdr.size; i++) {
 		smr_do_atomic(&src[*len], ioc[i].addr, NULL,
 			      cmd->msg.hdr.datatype, cmd->msg.hdr.atomic_op,
-			      ioc[i].count, cmd->msg.hdr.op_flags);
+			      ioc[i].count, cmd->msg.hdr.op_flags, fast_atomic);
 		*len += ioc[i].count * ofi_datatype_size(cmd->msg.hdr.datatype);
 	}
 
@@ -616,7 +687,7 @@ static int smr_progress_inline_atomic(struct smr_cmd *cmd, struct fi_ioc *ioc,
 
 static int smr_progress_inject_atomic(struct smr_cmd *cmd, struct fi_ioc *ioc,
 			       size_t ioc_count, size_t *len,
-			       struct smr_ep *ep, int err)
+			       struct smr_ep *ep, int err, int fast_atomic)
 {
 	struct smr_inject_buf *tx_buf;
 	size_t inj_offset;
@@ -642,7 +713,7 @@ static int smr_progress_inject_atomic(struct smr_cmd *cmd, struct fi_ioc *ioc,
 	for (i = *len = 0; i < ioc_count && *len < cmd->msg.hdr.size; i++) {
 		smr_do_atomic(&src[*len], ioc[i].addr, comp ? &comp[*len] : NULL,
 			      cmd->msg.hdr.datatype, cmd->msg.hdr.atomic_op,
-			      ioc[i].count, cmd->msg.hdr.op_flags);
+			      ioc[i].count, cmd->msg.hdr.op_flags, fast_atomic);
 		*len += ioc[i].count * ofi_datatype_size(cmd->msg.hdr.datatype);
 	}
 
@@ -654,7 +725,7 @@ static int smr_progress_inject_atomic(struct smr_cmd *cmd, struct fi_ioc *ioc,
 
 out:
 	if (!(cmd->msg.hdr.op_flags & SMR_RMA_REQ))
-		smr_freestack_push(smr_inject_pool(ep->region), tx_buf);
+		smr_release_inject_buf(ep->region, tx_buf);
 
 	return err;
 }
@@ -678,18 +749,23 @@ static int smr_start_common(struct smr_ep *ep, struct smr_cmd *cmd,
 		err = smr_progress_inline(cmd, iface, device,
 					  rx_entry->iov, rx_entry->count,
 					  &total_len);
-		ep->region->cmd_cnt++;
+		smr_cmd_credit_put(ep->region, 1);
 		break;
 	case smr_src_inject:
 		err = smr_progress_inject(cmd, iface, device,
 					  rx_entry->iov, rx_entry->count,
 					  &total_len, ep, 0);
-		ep->region->cmd_cnt++;
+		smr_cmd_credit_put(ep->region, 1);
 		break;
 	case smr_src_iov:
 		err = smr_progress_iov(cmd, rx_entry->iov, rx_entry->count,
 				       &total_len, ep, 0);
 		break;
+	case smr_src_attach:
+		err = smr_progress_attach(cmd, rx_entry, iface, device,
+					  rx_entry->iov, rx_entry->count,
+					  &total_len, ep, 0, &sar);
+		break;
 	case smr_src_mmap:
 		err = smr_progress_mmap(cmd, iface, device,
 					rx_entry->iov, rx_entry->count,
@@ -743,10 +819,10 @@ int smr_unexp_start(struct fi_peer_rx_entry *rx_entry)
 	struct smr_cmd_ctx *cmd_ctx = rx_entry->peer_context;
 	int ret;
 
-	pthread_spin_lock(&cmd_ctx->ep->region->lock);
+	ofi_spin_lock(&cmd_ctx->ep->rx_lock);
 	ret = smr_start_common(cmd_ctx->ep, &cmd_ctx->cmd, rx_entry);
 	ofi_freestack_push(cmd_ctx->ep->cmd_ctx_fs, cmd_ctx);
-	pthread_spin_unlock(&cmd_ctx->ep->region->lock);
+	ofi_spin_unlock(&cmd_ctx->ep->rx_lock);
 
 	return ret;
 }
@@ -764,9 +840,11 @@ static void smr_progress_connreq(struct smr_ep *ep, struct smr_cmd *cmd)
 
 	ret = smr_map_add(&smr_prov, ep->region->map,
 			  (char *) tx_buf->data, &idx);
-	if (ret)
+	if (ret || idx < 0) {
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 			"Error processing mapping request\n");
+		goto out;
+	}
 
 	peer_smr = smr_peer_region(ep->region, idx);
 
@@ -774,18 +852,21 @@ static void smr_progress_connreq(struct smr_ep *ep, struct smr_cmd *cmd)
 		//TODO track and update/complete in error any transfers
 		//to or from old mapping
 		munmap(peer_smr, peer_smr->total_size);
-		smr_map_to_region(&smr_prov, &ep->region->map->peers[idx]);
+		smr_map_to_region(&smr_prov,
+				  smr_map_peer(ep->region->map, idx));
 		peer_smr = smr_peer_region(ep->region, idx);
 	}
+	assert(cmd->msg.hdr.id < peer_smr->max_peers);
 	smr_peer_data(peer_smr)[cmd->msg.hdr.id].addr.id = idx;
 	smr_peer_data(ep->region)[idx].addr.id = cmd->msg.hdr.id;
+	smr_peer_data(ep->region)[idx].attach_failed = 0;
 
-	smr_freestack_push(smr_inject_pool(ep->region), tx_buf);
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
-	ep->region->cmd_cnt++;
 	assert(ep->region->map->num_peers > 0);
-	ep->region->max_sar_buf_per_peer = SMR_MAX_PEERS /
-		ep->region->map->num_peers;
+	smr_set_sar_buf_per_peer(ep->region, ep->region->map->num_peers);
+out:
+	smr_release_inject_buf(ep->region, tx_buf);
+	smr_cmd_queue_discard(smr_cmd_queue(ep->region));
+	smr_cmd_credit_put(ep->region, 1);
 }
 
 static int smr_alloc_cmd_ctx(struct smr_ep *ep,
@@ -805,6 +886,64 @@ static int smr_alloc_cmd_ctx(struct smr_ep *ep,
 	return FI_SUCCESS;
 }
 
+static int smr_progress_attach_sar(struct smr_ep *ep, struct smr_cmd *cmd)
+{
+	struct smr_sar_entry *parked, *sar_entry;
+	struct smr_cmd sar_cmd = *cmd;
+	size_t total_len = 0;
+	uint64_t comp_flags;
+	void *comp_ctx;
+	int ret;
+
+	smr_cmd_queue_discard(smr_cmd_queue(ep->region));
+
+	parked = NULL;
+	dlist_foreach_container(&ep->attach_list, struct smr_sar_entry,
+				sar_entry, entry) {
+		if (sar_entry->cmd.msg.hdr.id == sar_cmd.msg.hdr.id &&
+		    sar_entry->cmd.msg.hdr.src_data == sar_cmd.msg.hdr.src_data) {
+			parked = sar_entry;
+			break;
+		}
+	}
+	if (!parked) {
+		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+			"no receive waiting for attach resend\n");
+		return -FI_EINVAL;
+	}
+	dlist_remove(&parked->entry);
+
+	sar_entry = smr_progress_sar(&sar_cmd, parked->rx_entry, parked->iface,
+				     parked->device, parked->iov,
+				     parked->iov_count, &total_len, ep);
+	if (!sar_entry) {
+		if (parked->rx_entry) {
+			comp_ctx = parked->rx_entry->context;
+			comp_flags = smr_rx_cq_flags(sar_cmd.msg.hdr.op,
+					parked->rx_entry->flags,
+					sar_cmd.msg.hdr.op_flags);
+		} else {
+			comp_ctx = NULL;
+			comp_flags = smr_rx_cq_flags(sar_cmd.msg.hdr.op, 0,
+					sar_cmd.msg.hdr.op_flags);
+		}
+		ret = smr_complete_rx(ep, comp_ctx, sar_cmd.msg.hdr.op,
+				      comp_flags, total_len,
+				      parked->iov[0].iov_base,
+				      sar_cmd.msg.hdr.id, sar_cmd.msg.hdr.tag,
+				      sar_cmd.msg.hdr.data);
+		if (ret) {
+			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+				"unable to process rx completion\n");
+		}
+		if (parked->rx_entry)
+			smr_get_peer_srx(ep)->owner_ops->free_entry(parked->rx_entry);
+	}
+	ofi_freestack_push(ep->sar_fs, parked);
+
+	return 0;
+}
+
 static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
 {
 	struct fid_peer_srx *peer_srx = smr_get_peer_srx(ep);
@@ -812,7 +951,10 @@ static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
 	fi_addr_t addr;
 	int ret;
 
-	addr = ep->region->map->peers[cmd->msg.hdr.id].fiaddr;
+	if (cmd->msg.hdr.op_flags & SMR_ATTACH_SAR)
+		return smr_progress_attach_sar(ep, cmd);
+
+	addr = smr_map_peer(ep->region->map, cmd->msg.hdr.id)->fiaddr;
 	if (cmd->msg.hdr.op == ofi_op_tagged) {
 		ret = peer_srx->owner_ops->get_tag(peer_srx, addr,
 				cmd->msg.hdr.tag, &rx_entry);
@@ -843,7 +985,7 @@ static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
 	ret = smr_start_common(ep, cmd, rx_entry);
 
 out:
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
+	smr_cmd_queue_discard(smr_cmd_queue(ep->region));
 	return ret < 0 ? ret : 0;
 }
 
@@ -853,6 +995,7 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
 	struct smr_domain *domain;
 	struct smr_cmd *rma_cmd;
 	struct smr_resp *resp;
+	struct smr_sar_entry *sar_entry = NULL;
 	struct iovec iov[SMR_IOV_LIMIT];
 	size_t iov_count;
 	size_t total_len = 0;
@@ -861,12 +1004,16 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
 	enum fi_hmem_iface iface = FI_HMEM_SYSTEM;
 	uint64_t device = 0;
 
+	if (cmd->msg.hdr.op_flags & SMR_ATTACH_SAR)
+		return smr_progress_attach_sar(ep, cmd);
+
 	domain = container_of(ep->util_ep.domain, struct smr_domain,
 			      util_domain);
 
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
-	ep->region->cmd_cnt++;
-	rma_cmd = ofi_cirque_head(smr_cmd_queue(ep->region));
+	smr_cmd_queue_discard(smr_cmd_queue(ep->region));
+	smr_cmd_credit_put(ep->region, 1);
+	rma_cmd = smr_cmd_queue_head(smr_cmd_queue(ep->region));
+	assert(rma_cmd);
 
 	ofi_genlock_lock(&domain->util_domain.lock);
 	for (iov_count = 0; iov_count < rma_cmd->rma.rma_count; iov_count++) {
@@ -890,9 +1037,9 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
 	}
 	ofi_genlock_unlock(&domain->util_domain.lock);
 
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
+	smr_cmd_queue_discard(smr_cmd_queue(ep->region));
 	if (ret) {
-		ep->region->cmd_cnt++;
+		smr_cmd_credit_put(ep->region, 1);
 		return ret;
 	}
 
@@ -900,7 +1047,7 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
 	case smr_src_inline:
 		err = smr_progress_inline(cmd, iface, device, iov, iov_count,
 					  &total_len);
-		ep->region->cmd_cnt++;
+		smr_cmd_credit_put(ep->region, 1);
 		break;
 	case smr_src_inject:
 		err = smr_progress_inject(cmd, iface, device, iov, iov_count,
@@ -911,12 +1058,19 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
 			resp->status = -err;
 			smr_signal(peer_smr);
 		} else {
-			ep->region->cmd_cnt++;
+			smr_cmd_credit_put(ep->region, 1);
 		}
 		break;
 	case smr_src_iov:
 		err = smr_progress_iov(cmd, iov, iov_count, &total_len, ep, ret);
 		break;
+	case smr_src_attach:
+		err = smr_progress_attach(cmd, NULL, iface, device, iov,
+					  iov_count, &total_len, ep, ret,
+					  &sar_entry);
+		if (sar_entry)
+			return ret;
+		break;
 	case smr_src_mmap:
 		err = smr_progress_mmap(cmd, iface, device, iov,
 					iov_count, &total_len, ep);
@@ -971,9 +1125,10 @@ static int smr_progress_cmd_atomic(struct smr_ep *ep, struct smr_cmd *cmd)
 	domain = container_of(ep->util_ep.domain, struct smr_domain,
 			      util_domain);
 
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
-	ep->region->cmd_cnt++;
-	rma_cmd = ofi_cirque_head(smr_cmd_queue(ep->region));
+	smr_cmd_queue_discard(smr_cmd_queue(ep->region));
+	smr_cmd_credit_put(ep->region, 1);
+	rma_cmd = smr_cmd_queue_head(smr_cmd_queue(ep->region));
+	assert(rma_cmd);
 
 	for (ioc_count = 0; ioc_count < rma_cmd->rma.rma_count; ioc_count++) {
 		ret = ofi_mr_verify(&domain->util_domain.mr_map,
@@ -989,18 +1144,20 @@ static int smr_progress_cmd_atomic(struct smr_ep *ep, struct smr_cmd *cmd)
 		ioc[ioc_count].addr = (void *) rma_cmd->rma.rma_ioc[ioc_count].addr;
 		ioc[ioc_count].count = rma_cmd->rma.rma_ioc[ioc_count].count;
 	}
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
+	smr_cmd_queue_discard(smr_cmd_queue(ep->region));
 	if (ret) {
-		ep->region->cmd_cnt++;
+		smr_cmd_credit_put(ep->region, 1);
 		return ret;
 	}
 
 	switch (cmd->msg.hdr.op_src) {
 	case smr_src_inline:
-		err = smr_progress_inline_atomic(cmd, ioc, ioc_count, &total_len);
+		err = smr_progress_inline_atomic(cmd, ioc, ioc_count, &total_len,
+						 domain->fast_atomic);
 		break;
 	case smr_src_inject:
-		err = smr_progress_inject_atomic(cmd, ioc, ioc_count, &total_len, ep, ret);
+		err = smr_progress_inject_atomic(cmd, ioc, ioc_count, &total_len,
+						 ep, ret, domain->fast_atomic);
 		break;
 	default:
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
@@ -1013,7 +1170,7 @@ static int smr_progress_cmd_atomic(struct smr_ep *ep, struct smr_cmd *cmd)
 		resp->status = -err;
 		smr_signal(peer_smr);
 	} else {
-		ep->region->cmd_cnt++;
+		smr_cmd_credit_put(ep->region, 1);
 	}
 
 	if (err) {
@@ -1038,15 +1195,14 @@ static int smr_progress_cmd_atomic(struct smr_ep *ep, struct smr_cmd *cmd)
 	return err;
 }
 
+/* The SAR resend of an attach the receive could not map */
 static void smr_progress_cmd(struct smr_ep *ep)
 {
 	struct smr_cmd *cmd;
 	int ret = 0;
 
-	pthread_spin_lock(&ep->region->lock);
-	while (!ofi_cirque_isempty(smr_cmd_queue(ep->region))) {
-		cmd = ofi_cirque_head(smr_cmd_queue(ep->region));
-
+	ofi_spin_lock(&ep->rx_lock);
+	while ((cmd = smr_cmd_queue_head(smr_cmd_queue(ep->region)))) {
 		switch (cmd->msg.hdr.op) {
 		case ofi_op_msg:
 		case ofi_op_tagged:
@@ -1060,8 +1216,8 @@ static void smr_progress_cmd(struct smr_ep *ep)
 		case ofi_op_read_async:
 			ofi_ep_rx_cntr_inc_func(&ep->util_ep,
 						cmd->msg.hdr.op);
-			ofi_cirque_discard(smr_cmd_queue(ep->region));
-			ep->region->cmd_cnt++;
+			smr_cmd_queue_discard(smr_cmd_queue(ep->region));
+			smr_cmd_credit_put(ep->region, 1);
 			break;
 		case ofi_op_atomic:
 		case ofi_op_atomic_fetch:
@@ -1071,6 +1227,11 @@ static void smr_progress_cmd(struct smr_ep *ep)
 		case SMR_OP_MAX + ofi_ctrl_connreq:
 			smr_progress_connreq(ep, cmd);
 			break;
+		case SMR_OP_MAX + ofi_ctrl_discard:
+			/* aborted send */
+			smr_cmd_queue_discard(smr_cmd_queue(ep->region));
+			smr_cmd_credit_put(ep->region, 1);
+			break;
 		default:
 			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 				"unidentified operation type\n");
@@ -1085,7 +1246,7 @@ static void smr_progress_cmd(struct smr_ep *ep)
 			break;
 		}
 	}
-	pthread_spin_unlock(&ep->region->lock);
+	ofi_spin_unlock(&ep->rx_lock);
 }
 
 static void smr_progress_sar_list(struct smr_ep *ep)
@@ -1098,7 +1259,7 @@ static void smr_progress_sar_list(struct smr_ep *ep)
 	uint64_t comp_flags;
 	int ret;
 
-	pthread_spin_lock(&ep->region->lock);
+	ofi_spin_lock(&ep->rx_lock);
 	dlist_foreach_container_safe(&ep->sar_list, struct smr_sar_entry,
 				     sar_entry, entry, tmp) {
 		peer_smr = smr_peer_region(ep->region, sar_entry->cmd.msg.hdr.id);
@@ -1144,7 +1305,7 @@ static void smr_progress_sar_list(struct smr_ep *ep)
 			ofi_freestack_push(ep->sar_fs, sar_entry);
 		}
 	}
-	pthread_spin_unlock(&ep->region->lock);
+	ofi_spin_unlock(&ep->rx_lock);
 }
 
 void smr_ep_progress(struct util_ep *util_ep)
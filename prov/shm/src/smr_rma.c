@@ -39,18 +39,17 @@
 #include "smr.h"
 
 
-static void smr_add_rma_cmd(struct smr_region *peer_smr,
+static void smr_add_rma_cmd(struct smr_region *peer_smr, int64_t pos,
 		const struct fi_rma_iov *rma_iov, size_t iov_count)
 {
 	struct smr_cmd *cmd;
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
+	cmd = smr_cmd_queue_get(smr_cmd_queue(peer_smr), pos);
 
 	cmd->rma.rma_count = iov_count;
 	memcpy(cmd->rma.rma_iov, rma_iov, sizeof(*rma_iov) * iov_count);
 
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_cmd_queue_commit(smr_cmd_queue(peer_smr), pos);
 }
 
 static void smr_format_rma_resp(struct smr_cmd *cmd, fi_addr_t peer_id,
@@ -69,6 +68,7 @@ static ssize_t smr_rma_fast(struct smr_region *peer_smr, const struct iovec *iov
 	struct iovec cma_iovec[SMR_IOV_LIMIT], rma_iovec[SMR_IOV_LIMIT];
 	struct smr_cmd *cmd;
 	size_t total_len;
+	int64_t pos;
 	int ret, i;
 
 	memcpy(cma_iovec, iov, sizeof(*iov) * iov_count);
@@ -85,12 +85,12 @@ static ssize_t smr_rma_fast(struct smr_region *peer_smr, const struct iovec *iov
 	if (ret)
 		return ret;
 
-	cmd = ofi_cirque_next(smr_cmd_queue(peer_smr));
+	pos = smr_cmd_queue_reserve(smr_cmd_queue(peer_smr), 1);
+	cmd = smr_cmd_queue_get(smr_cmd_queue(peer_smr), pos);
 	smr_format_rma_resp(cmd, peer_id, rma_iov, rma_count, total_len,
 			    (op == ofi_op_write) ? ofi_op_write_async :
 			    ofi_op_read_async, op_flags);
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_cmd_queue_commit(smr_cmd_queue(peer_smr), pos);
 
 	return 0;
 }
@@ -102,13 +102,14 @@ static ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 {
 	struct smr_domain *domain;
 	struct smr_region *peer_smr;
+	struct smr_cmd *cmd;
 	enum fi_hmem_iface iface;
 	uint64_t device;
-	int64_t id, peer_id;
+	int64_t id, peer_id, pos;
 	int cmds, err = 0, proto = smr_src_inline;
 	ssize_t ret = 0;
 	size_t total_len;
-	bool use_ipc;
+	bool use_ipc, use_pool = false;
 
 	assert(iov_count <= SMR_IOV_LIMIT);
 	assert(rma_count <= SMR_IOV_LIMIT);
@@ -124,26 +125,41 @@ static ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 	peer_id = smr_peer_data(ep->region)[id].addr.id;
 	peer_smr = smr_peer_region(ep->region, id);
 
-	cmds = 1 + !(domain->fast_rma && !(op_flags &
-		    (FI_REMOTE_CQ_DATA | FI_DELIVERY_COMPLETE)) &&
-		     rma_count == 1 && smr_cma_enabled(ep, peer_smr));
+	iface = smr_get_mr_hmem_iface(ep->util_ep.domain, desc, &device);
 
-	pthread_spin_lock(&peer_smr->lock);
-	if (peer_smr->cmd_cnt < cmds ||
-	    smr_peer_data(ep->region)[id].sar_status) {
-		ret = -FI_EAGAIN;
-		goto unlock_region;
+	if (domain->fast_rma && !(op_flags & FI_REMOTE_CQ_DATA) &&
+	    rma_count == 1 && iface == FI_HMEM_SYSTEM) {
+		ofi_spin_lock(&ep->tx_lock);
+		if (!smr_direct_rma(ep, id, iov, iov_count, rma_iov, op)) {
+			ret = smr_complete_tx(ep, context, op, op_flags);
+			if (ret) {
+				FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+					"unable to process tx completion\n");
+			}
+			goto unlock;
+		}
+		ofi_spin_unlock(&ep->tx_lock);
 	}
 
-	ofi_spin_lock(&ep->tx_lock);
+	cmds = 1 + !(domain->fast_rma && !(op_flags &
+		    (FI_REMOTE_CQ_DATA | FI_DELIVERY_COMPLETE)) &&
+		     rma_count == 1 && smr_cma_enabled(ep, peer_smr));
 
 	if (cmds == 1) {
+		ofi_spin_lock(&ep->tx_lock);
+		if (smr_peer_data(ep->region)[id].sar_status ||
+		    !smr_cmd_credit_get(peer_smr, 1)) {
+			ret = -FI_EAGAIN;
+			goto unlock;
+		}
+
 		err = smr_rma_fast(peer_smr, iov, iov_count, rma_iov,
 				   rma_count, desc, peer_id,  context, op,
 				   op_flags);
 		if (err) {
 			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 				"error doing fast RMA\n");
+			smr_cmd_credit_put(peer_smr, 1);
 			ret = smr_write_err_comp(ep->util_ep.rx_cq, NULL,
 						op_flags, 0, err);
 		} else {
@@ -157,8 +173,6 @@ static ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 		goto signal;
 	}
 
-	iface = smr_get_mr_hmem_iface(ep->util_ep.domain, desc, &device);
-
 	total_len = ofi_total_iov_len(iov, iov_count);
 	assert(!(op_flags & FI_INJECT) || total_len <= SMR_INJECT_SIZE);
 
@@ -168,15 +182,35 @@ static ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 		  desc && (smr_get_mr_flags(desc) & FI_HMEM_DEVICE_ONLY) &&
 		  !(op_flags & FI_INJECT);
 
-	proto = smr_select_proto(use_ipc, smr_cma_enabled(ep, peer_smr), iface,
-				 op, total_len, op_flags);
+	proto = smr_select_proto(use_ipc, smr_cma_enabled(ep, peer_smr),
+				 smr_attach_enabled(ep, peer_smr, peer_id, iov_count),
+				 iface, op, total_len, op_flags);
 
-	ret = smr_proto_ops[proto](ep, peer_smr, id, peer_id, op, 0, data, op_flags,
-				   iface, device, iov, iov_count, total_len, context);
-	if (ret)
-		goto unlock_cq;
+	use_pool = smr_proto_uses_pool(proto);
+	if (use_pool)
+		pthread_spin_lock(&peer_smr->lock);
 
-	smr_add_rma_cmd(peer_smr, rma_iov, rma_count);
+	ofi_spin_lock(&ep->tx_lock);
+	if (smr_peer_data(ep->region)[id].sar_status ||
+	    !smr_cmd_credit_get(peer_smr, cmds)) {
+		ret = -FI_EAGAIN;
+		goto unlock;
+	}
+
+	/* The op and its rma cmd must occupy consecutive slots; publish the
+	 * rma cmd first so the receiver never sees the op without it. */
+	pos = smr_cmd_queue_reserve(smr_cmd_queue(peer_smr), cmds);
+	cmd = smr_cmd_queue_get(smr_cmd_queue(peer_smr), pos);
+	ret = smr_proto_ops[proto](ep, peer_smr, cmd, id, peer_id, op, 0, data,
+				   op_flags, iface, device, iov, iov_count,
+				   total_len, context);
+	if (ret) {
+		smr_abort_cmds(peer_smr, pos, cmds);
+		goto unlock;
+	}
+
+	smr_add_rma_cmd(peer_smr, pos + 1, rma_iov, rma_count);
+	smr_cmd_queue_commit(smr_cmd_queue(peer_smr), pos);
 
 	if (proto != smr_src_inline && proto != smr_src_inject)
 		goto signal;
@@ -189,10 +223,10 @@ static ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 
 signal:
 	smr_signal(peer_smr);
-unlock_cq:
+unlock:
 	ofi_spin_unlock(&ep->tx_lock);
-unlock_region:
-	pthread_spin_unlock(&peer_smr->lock);
+	if (use_pool)
+		pthread_spin_unlock(&peer_smr->lock);
 	return ret;
 }
 
@@ -310,9 +344,10 @@ static ssize_t smr_generic_rma_inject(struct fid_ep *ep_fid, const void *buf,
 	struct smr_ep *ep;
 	struct smr_domain *domain;
 	struct smr_region *peer_smr;
+	struct smr_cmd *cmd;
 	struct iovec iov;
 	struct fi_rma_iov rma_iov;
-	int64_t id, peer_id;
+	int64_t id, peer_id, pos;
 	int cmds, proto = smr_src_inline;
 	ssize_t ret = 0;
 
@@ -327,41 +362,61 @@ static ssize_t smr_generic_rma_inject(struct fid_ep *ep_fid, const void *buf,
 	peer_id = smr_peer_data(ep->region)[id].addr.id;
 	peer_smr = smr_peer_region(ep->region, id);
 
-	cmds = 1 + !(domain->fast_rma && !(flags & FI_REMOTE_CQ_DATA) &&
-		     smr_cma_enabled(ep, peer_smr));
-
-	pthread_spin_lock(&peer_smr->lock);
-	if (peer_smr->cmd_cnt < cmds ||
-	    smr_peer_data(ep->region)[id].sar_status) {
-		ret = -FI_EAGAIN;
-		goto unlock_region;
-	}
-
 	iov.iov_base = (void *) buf;
 	iov.iov_len = len;
 	rma_iov.addr = addr;
 	rma_iov.len = len;
 	rma_iov.key = key;
 
+	if (domain->fast_rma && !(flags & FI_REMOTE_CQ_DATA)) {
+		ofi_spin_lock(&ep->tx_lock);
+		if (!smr_direct_rma(ep, id, &iov, 1, &rma_iov, ofi_op_write)) {
+			ofi_ep_tx_cntr_inc_func(&ep->util_ep, ofi_op_write);
+			goto unlock;
+		}
+		ofi_spin_unlock(&ep->tx_lock);
+	}
+
+	cmds = 1 + !(domain->fast_rma && !(flags & FI_REMOTE_CQ_DATA) &&
+		     smr_cma_enabled(ep, peer_smr));
+	if (cmds > 1 && len > SMR_MSG_DATA_LEN)
+		proto = smr_src_inject;
+
+	if (proto == smr_src_inject)
+		pthread_spin_lock(&peer_smr->lock);
+
+	ofi_spin_lock(&ep->tx_lock);
+	if (smr_peer_data(ep->region)[id].sar_status ||
+	    !smr_cmd_credit_get(peer_smr, cmds)) {
+		ret = -FI_EAGAIN;
+		goto unlock;
+	}
+
 	if (cmds == 1) {
 		ret = smr_rma_fast(peer_smr, &iov, 1, &rma_iov, 1, NULL,
 				   peer_id, NULL, ofi_op_write, flags);
-		if (ret)
-			goto unlock_region;
+		if (ret) {
+			smr_cmd_credit_put(peer_smr, 1);
+			goto unlock;
+		}
 		goto signal;
 	}
 
-	proto = len <= SMR_MSG_DATA_LEN ? smr_src_inline : smr_src_inject;
-	ret = smr_proto_ops[proto](ep, peer_smr, id, peer_id, ofi_op_write, 0,
-			data, flags, FI_HMEM_SYSTEM, 0, &iov, 1, len, NULL);
+	pos = smr_cmd_queue_reserve(smr_cmd_queue(peer_smr), cmds);
+	cmd = smr_cmd_queue_get(smr_cmd_queue(peer_smr), pos);
+	ret = smr_proto_ops[proto](ep, peer_smr, cmd, id, peer_id, ofi_op_write,
+			0, data, flags, FI_HMEM_SYSTEM, 0, &iov, 1, len, NULL);
 
 	assert(!ret);
-	smr_add_rma_cmd(peer_smr, &rma_iov, 1);
+	smr_add_rma_cmd(peer_smr, pos + 1, &rma_iov, 1);
+	smr_cmd_queue_commit(smr_cmd_queue(peer_smr), pos);
 signal:
 	smr_signal(peer_smr);
 	ofi_ep_tx_cntr_inc_func(&ep->util_ep, ofi_op_write);
-unlock_region:
-	pthread_spin_unlock(&peer_smr->lock);
+unlock:
+	ofi_spin_unlock(&ep->tx_lock);
+	if (proto == smr_src_inject)
+		pthread_spin_unlock(&peer_smr->lock);
 	return ret;
 }
 
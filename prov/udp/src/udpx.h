@@ -41,6 +41,9 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#ifdef __linux__
+#include <netinet/udp.h>
+#endif
 
 #include <rdma/fabric.h>
 #include <rdma/fi_atomic.h>
@@ -55,6 +58,7 @@
 
 #include <ofi.h>
 #include <ofi_enosys.h>
+#include <ofi_iov.h>
 #include <ofi_rbuf.h>
 #include <ofi_list.h>
 #include <ofi_signal.h>
@@ -68,6 +72,14 @@ extern struct fi_provider udpx_prov;
 extern struct util_prov udpx_util_prov;
 extern struct fi_info udpx_info;
 
+struct udpx_env {
+	size_t	batch_size;
+	int	gso;
+	int	gro;
+};
+
+extern struct udpx_env udpx_env;
+
 
 int udpx_fabric(struct fi_fabric_attr *attr, struct fid_fabric **fabric,
 		void *context);
@@ -90,6 +102,49 @@ struct udpx_ep_entry {
 
 OFI_DECLARE_CIRQUE(struct udpx_ep_entry, udpx_rx_cirq);
 
+/*
+ * With a batch size above one, sends are queued and flushed with a single
+ * sendmmsg when the queue fills or the endpoint is progressed, and receives
+ * are reaped with recvmmsg.  Runs of sends to the same address with the
+ * same length go out as one UDP GSO message where supported.
+ */
+#define UDPX_MAX_BATCH		64
+#define UDPX_GSO_MAX_SEGS	64
+#define UDPX_GSO_MAX_SIZE	(65535 - sizeof(struct ip) - 8)
+
+struct udpx_tx_entry {
+	void			*context;
+	struct iovec		iov[UDPX_IOV_LIMIT];
+	uint8_t			iov_count;
+	uint8_t			resv[sizeof(size_t) - 1];
+	size_t			len;
+	socklen_t		addrlen;
+	union {
+		struct sockaddr		sa;
+		struct sockaddr_in	sin;
+		struct sockaddr_in6	sin6;
+	} addr;
+};
+
+OFI_DECLARE_CIRQUE(struct udpx_tx_entry, udpx_tx_cirq);
+
+struct udpx_batch {
+	struct mmsghdr		*msg;
+	struct iovec		*iov;
+	struct sockaddr_in6	*addr;
+	char			*ctrl;
+	size_t			*cnt;
+};
+
+/* GRO receives land here and are split into the posted buffers */
+struct udpx_gro {
+	char			*buf;
+	size_t			len;
+	size_t			off;
+	size_t			seg;
+	struct sockaddr_in6	addr;
+};
+
 struct udpx_ep;
 typedef void (*udpx_rx_comp_func)(struct udpx_ep *ep, void *context,
 		uint64_t flags, size_t len, void *buf, void *addr);
@@ -100,6 +155,12 @@ struct udpx_ep {
 	udpx_rx_comp_func	rx_comp;
 	udpx_tx_comp_func	tx_comp;
 	struct udpx_rx_cirq	*rxq;    /* protected by rx_cq lock */
+	struct udpx_tx_cirq	*txq;    /* protected by tx_cq lock */
+	struct udpx_batch	rx_batch;
+	struct udpx_batch	tx_batch;
+	struct udpx_gro		gro;
+	size_t			batch_size;
+	int			gso;
 	SOCKET			sock;
 	int			is_bound;
 	ofi_atomic32_t		ref;
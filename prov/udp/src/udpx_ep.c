@@ -217,15 +217,7 @@ static struct fi_ops_ep udpx_ep_ops = {
 
 static void udpx_tx_comp(struct udpx_ep *ep, void *context)
 {
-	struct fi_cq_tagged_entry *comp;
-
-	comp = ofi_cirque_next(ep->util_ep.tx_cq->cirq);
-	comp->op_context = context;
-	comp->flags = FI_SEND;
-	comp->len = 0;
-	comp->buf = NULL;
-	comp->data = 0;
-	ofi_cirque_commit(ep->util_ep.tx_cq->cirq);
+	ofi_cq_write_entry(ep->util_ep.tx_cq, context, FI_SEND, 0, NULL, 0, 0);
 }
 
 static void udpx_tx_comp_signal(struct udpx_ep *ep, void *context)
@@ -237,15 +229,8 @@ static void udpx_tx_comp_signal(struct udpx_ep *ep, void *context)
 static void udpx_rx_comp(struct udpx_ep *ep, void *context, uint64_t flags,
 			 size_t len, void *buf, void *addr)
 {
-	struct fi_cq_tagged_entry *comp;
-
-	comp = ofi_cirque_next(ep->util_ep.rx_cq->cirq);
-	comp->op_context = context;
-	comp->flags = FI_RECV | flags;
-	comp->len = len;
-	comp->buf = buf;
-	comp->data = 0;
-	ofi_cirque_commit(ep->util_ep.rx_cq->cirq);
+	ofi_cq_write_entry(ep->util_ep.rx_cq, context, FI_RECV | flags, len,
+			   buf, 0, 0);
 }
 
 static void udpx_rx_src_comp(struct udpx_ep *ep, void *context, uint64_t flags,
@@ -270,34 +255,254 @@ static void udpx_rx_src_comp_signal(struct udpx_ep *ep, void *context,
 	ep->util_ep.rx_cq->wait->signal(ep->util_ep.rx_cq->wait);
 }
 
-static void udpx_ep_progress(struct util_ep *util_ep)
+static void udpx_tx_complete(struct udpx_ep *ep, size_t cnt, int err)
 {
-	struct udpx_ep *ep;
-	struct udpx_ep_entry *entry;
+	struct util_cq *cq = ep->util_ep.tx_cq;
+	struct udpx_tx_entry *entry;
+	struct fi_cq_err_entry err_entry;
+
+	for (; cnt; cnt--) {
+		entry = ofi_cirque_head(ep->txq);
+		if (err) {
+			memset(&err_entry, 0, sizeof(err_entry));
+			err_entry.op_context = entry->context;
+			err_entry.flags = FI_SEND;
+			err_entry.err = err;
+			err_entry.prov_errno = err;
+			ofi_cq_insert_error(cq, &err_entry);
+			if (cq->wait)
+				cq->wait->signal(cq->wait);
+		} else if (ofi_cirque_freecnt(cq->cirq) > 1) {
+			ep->tx_comp(ep, entry->context);
+		} else {
+			ofi_cq_write_overflow(cq, entry->context, FI_SEND, 0,
+					      NULL, 0, 0, FI_ADDR_NOTAVAIL);
+		}
+		ofi_cirque_discard(ep->txq);
+	}
+}
+
+static inline struct udpx_tx_entry *
+udpx_tx_entry(struct udpx_ep *ep, size_t i)
+{
+	return &ep->txq->buf[(ep->txq->rcnt + i) & ep->txq->size_mask];
+}
+
+static int udpx_gso_match(struct udpx_tx_entry *first,
+			  struct udpx_tx_entry *last,
+			  struct udpx_tx_entry *next, size_t segs, size_t bytes)
+{
+	return last->len == first->len && next->len &&
+	       next->len <= first->len && segs < UDPX_GSO_MAX_SEGS &&
+	       bytes + next->len <= UDPX_GSO_MAX_SIZE &&
+	       next->addrlen == first->addrlen &&
+	       !memcmp(&next->addr, &first->addr, first->addrlen);
+}
+
+static void udpx_set_gso(struct msghdr *hdr, char *ctrl, size_t seg)
+{
+#ifdef UDP_SEGMENT
+	struct cmsghdr *cmsg;
+	uint16_t gso_size = (uint16_t) seg;
+
+	hdr->msg_control = ctrl;
+	hdr->msg_controllen = CMSG_SPACE(sizeof(gso_size));
+	cmsg = CMSG_FIRSTHDR(hdr);
+	cmsg->cmsg_level = SOL_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(gso_size));
+	memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+#endif
+}
+
+/* Fill tx_batch from the head of txq, returns the number of messages */
+static unsigned int udpx_tx_build(struct udpx_ep *ep)
+{
+	struct udpx_batch *batch = &ep->tx_batch;
+	struct udpx_tx_entry *first, *entry;
+	struct msghdr *hdr;
+	size_t i = 0, iov = 0, bytes, cnt;
+	unsigned int n;
+
+	cnt = ofi_cirque_usedcnt(ep->txq);
+	for (n = 0; i < cnt && n < ep->batch_size; n++) {
+		first = udpx_tx_entry(ep, i);
+		hdr = &batch->msg[n].msg_hdr;
+		hdr->msg_name = &first->addr;
+		hdr->msg_namelen = first->addrlen;
+		hdr->msg_iov = &batch->iov[iov];
+		hdr->msg_control = NULL;
+		hdr->msg_controllen = 0;
+		hdr->msg_flags = 0;
+		batch->cnt[n] = 0;
+		bytes = 0;
+		do {
+			entry = udpx_tx_entry(ep, i++);
+			memcpy(&batch->iov[iov], entry->iov,
+			       entry->iov_count * sizeof(*entry->iov));
+			iov += entry->iov_count;
+			bytes += entry->len;
+			batch->cnt[n]++;
+		} while (ep->gso && i < cnt &&
+			 udpx_gso_match(first, entry, udpx_tx_entry(ep, i),
+					batch->cnt[n], bytes));
+
+		hdr->msg_iovlen = &batch->iov[iov] - hdr->msg_iov;
+		if (batch->cnt[n] > 1)
+			udpx_set_gso(hdr, batch->ctrl +
+				     n * CMSG_SPACE(sizeof(uint16_t)),
+				     first->len);
+	}
+	return n;
+}
+
+/* Called with the tx_cq lock held */
+static void udpx_tx_flush(struct udpx_ep *ep)
+{
+	unsigned int i, n;
+	int ret;
+
+	while (!ofi_cirque_isempty(ep->txq)) {
+		n = udpx_tx_build(ep);
+		ret = ofi_sendmmsg_udp(ep->sock, ep->tx_batch.msg, n, 0);
+		if (ret < 0) {
+			if (OFI_SOCK_TRY_SND_RCV_AGAIN(errno))
+				break;
+			if (ep->tx_batch.cnt[0] > 1 &&
+			    (errno == EIO || errno == EINVAL)) {
+				FI_INFO(&udpx_prov, FI_LOG_EP_DATA,
+					"UDP GSO send failed (%s), disabling\n",
+					strerror(errno));
+				ep->gso = 0;
+				continue;
+			}
+			udpx_tx_complete(ep, ep->tx_batch.cnt[0], errno);
+			continue;
+		}
+
+		for (i = 0; i < (unsigned int) ret; i++)
+			udpx_tx_complete(ep, ep->tx_batch.cnt[i], 0);
+	}
+}
+
+static void udpx_tx_drain(struct udpx_ep *ep)
+{
+	ofi_genlock_lock(&ep->util_ep.tx_cq->cq_lock);
+	udpx_tx_flush(ep);
+	ofi_genlock_unlock(&ep->util_ep.tx_cq->cq_lock);
+}
+
+#ifdef UDP_GRO
+static int udpx_gro_recv(struct udpx_ep *ep)
+{
+	char ctrl[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr *cmsg;
 	struct msghdr hdr;
-	struct sockaddr_in6 addr;
+	struct iovec iov;
 	ssize_t ret;
+	int seg;
+
+	iov.iov_base = ep->gro.buf;
+	iov.iov_len = UINT16_MAX;
+	hdr.msg_name = &ep->gro.addr;
+	hdr.msg_namelen = sizeof(ep->gro.addr);
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	hdr.msg_control = ctrl;
+	hdr.msg_controllen = sizeof(ctrl);
+	hdr.msg_flags = 0;
+
+	ret = ofi_recvmsg_udp(ep->sock, &hdr, 0);
+	if (ret < 0)
+		return -errno;
+
+	ep->gro.len = ret;
+	ep->gro.off = 0;
+	ep->gro.seg = ret;
+	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+		if (cmsg->cmsg_level == SOL_UDP &&
+		    cmsg->cmsg_type == UDP_GRO) {
+			memcpy(&seg, CMSG_DATA(cmsg), sizeof(seg));
+			ep->gro.seg = seg;
+		}
+	}
+	return 0;
+}
+#endif
+
+/* Split coalesced datagrams into the posted buffers, one per segment */
+static void udpx_rx_gro(struct udpx_ep *ep)
+{
+#ifdef UDP_GRO
+	struct udpx_ep_entry *entry;
+	size_t len;
+
+	while (!ofi_cirque_isempty(ep->rxq)) {
+		if (ep->gro.off == ep->gro.len && udpx_gro_recv(ep))
+			break;
+
+		len = MIN(ep->gro.seg, ep->gro.len - ep->gro.off);
+		entry = ofi_cirque_head(ep->rxq);
+		ep->rx_comp(ep, entry->context, 0,
+			    ofi_copy_to_iov(entry->iov, entry->iov_count, 0,
+					    ep->gro.buf + ep->gro.off, len),
+			    NULL, &ep->gro.addr);
+		ofi_cirque_discard(ep->rxq);
+		ep->gro.off += len;
+	}
+#endif
+}
+
+static void udpx_rx_batch(struct udpx_ep *ep)
+{
+	struct udpx_batch *batch = &ep->rx_batch;
+	struct udpx_ep_entry *entry;
+	struct msghdr *hdr;
+	size_t i, cnt;
+	int ret;
+
+	cnt = MIN(ofi_cirque_usedcnt(ep->rxq), ep->batch_size);
+	for (i = 0; i < cnt; i++) {
+		entry = &ep->rxq->buf[(ep->rxq->rcnt + i) &
+				      ep->rxq->size_mask];
+		hdr = &batch->msg[i].msg_hdr;
+		hdr->msg_name = &batch->addr[i];
+		hdr->msg_namelen = sizeof(batch->addr[i]);
+		hdr->msg_iov = entry->iov;
+		hdr->msg_iovlen = entry->iov_count;
+		hdr->msg_control = NULL;
+		hdr->msg_controllen = 0;
+		hdr->msg_flags = 0;
+	}
+
+	ret = ofi_recvmmsg_udp(ep->sock, batch->msg, (unsigned int) cnt, 0);
+	for (i = 0; ret > 0 && i < (size_t) ret; i++) {
+		entry = ofi_cirque_head(ep->rxq);
+		ep->rx_comp(ep, entry->context, 0, batch->msg[i].msg_len,
+			    NULL, &batch->addr[i]);
+		ofi_cirque_discard(ep->rxq);
+	}
+}
+
+static void udpx_ep_progress(struct util_ep *util_ep)
+{
+	struct udpx_ep *ep;
 
 	ep = container_of(util_ep, struct udpx_ep, util_ep);
-	hdr.msg_name = &addr;
-	hdr.msg_namelen = sizeof(addr);
-	hdr.msg_control = NULL;
-	hdr.msg_controllen = 0;
-	hdr.msg_flags = 0;
+	if (ep->txq && ep->util_ep.tx_cq)
+		udpx_tx_drain(ep);
+
+	if (!ep->util_ep.rx_cq)
+		return;
 
 	ofi_genlock_lock(&ep->util_ep.rx_cq->cq_lock);
 	if (ofi_cirque_isempty(ep->rxq))
 		goto out;
 
-	entry = ofi_cirque_head(ep->rxq);
-	hdr.msg_iov = entry->iov;
-	hdr.msg_iovlen = entry->iov_count;
-
-	ret = ofi_recvmsg_udp(ep->sock, &hdr, 0);
-	if (ret >= 0) {
-		ep->rx_comp(ep, entry->context, 0, ret, NULL, &addr);
-		ofi_cirque_discard(ep->rxq);
-	}
+	if (ep->gro.buf)
+		udpx_rx_gro(ep);
+	else
+		udpx_rx_batch(ep);
 out:
 	ofi_genlock_unlock(&ep->util_ep.rx_cq->cq_lock);
 }
@@ -387,9 +592,43 @@ udpx_dest_addrlen(struct udpx_ep *ep, fi_addr_t addr, uint64_t flags)
 		ep->util_ep.av->addrlen;
 }
 
+/* Called with the tx_cq lock held.  Only the iovecs are copied, so
+ * FI_INJECT sends must bypass the queue.
+ */
+static ssize_t udpx_queue_send(struct udpx_ep *ep, const struct iovec *iov,
+			       size_t iov_count, const void *addr,
+			       size_t addrlen, void *context)
+{
+	struct udpx_tx_entry *entry;
+	size_t i;
+
+	if (ofi_cirque_isfull(ep->txq)) {
+		udpx_tx_flush(ep);
+		if (ofi_cirque_isfull(ep->txq))
+			return -FI_EAGAIN;
+	}
+
+	entry = ofi_cirque_next(ep->txq);
+	entry->context = context;
+	entry->len = 0;
+	for (i = 0; i < iov_count; i++) {
+		entry->iov[i] = iov[i];
+		entry->len += iov[i].iov_len;
+	}
+	entry->iov_count = (uint8_t) iov_count;
+	entry->addrlen = (socklen_t) addrlen;
+	memcpy(&entry->addr, addr, addrlen);
+	ofi_cirque_commit(ep->txq);
+
+	if (ofi_cirque_usedcnt(ep->txq) >= ep->batch_size)
+		udpx_tx_flush(ep);
+	return 0;
+}
+
 static ssize_t udpx_sendto(struct udpx_ep *ep, const void *buf, size_t len,
 			   const void *addr, size_t addrlen, void *context)
 {
+	struct iovec iov;
 	ssize_t ret;
 
 	ofi_genlock_lock(&ep->util_ep.tx_cq->cq_lock);
@@ -398,6 +637,17 @@ static ssize_t udpx_sendto(struct udpx_ep *ep, const void *buf, size_t len,
 		goto out;
 	}
 
+	if (ep->txq) {
+		if (!(ep->util_ep.tx_op_flags & FI_INJECT)) {
+			iov.iov_base = (void *) buf;
+			iov.iov_len = len;
+			ret = udpx_queue_send(ep, &iov, 1, addr, addrlen,
+					      context);
+			goto out;
+		}
+		udpx_tx_flush(ep);
+	}
+
 	ret = ofi_sendto_socket(ep->sock, buf, len, 0,
 				addr, (socklen_t)addrlen);
 	if (ret == (ssize_t)len) {
@@ -454,6 +704,16 @@ static ssize_t udpx_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 		goto out;
 	}
 
+	if (ep->txq) {
+		if (!((flags | ep->util_ep.tx_op_flags) & FI_INJECT)) {
+			ret = udpx_queue_send(ep, msg->msg_iov, msg->iov_count,
+					      hdr.msg_name, hdr.msg_namelen,
+					      msg->context);
+			goto out;
+		}
+		udpx_tx_flush(ep);
+	}
+
 	ret = ofi_sendmsg_udp(ep->sock, &hdr, 0);
 	if (ret >= 0) {
 		ep->tx_comp(ep, msg->context);
@@ -501,6 +761,8 @@ static ssize_t udpx_inject(struct fid_ep *ep_fid, const void *buf, size_t len,
 	ssize_t ret;
 
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
+	if (ep->txq)
+		udpx_tx_drain(ep);
 	ret = ofi_sendto_socket(ep->sock, buf, len, 0,
 				ofi_ip_av_get_addr(ep->util_ep.av, (int)dest_addr),
 				(socklen_t)ep->util_ep.av->addrlen);
@@ -514,6 +776,8 @@ static ssize_t udpx_inject_mc(struct fid_ep *ep_fid, const void *buf,
 	ssize_t ret;
 
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
+	if (ep->txq)
+		udpx_tx_drain(ep);
 	ret = ofi_sendto_socket(ep->sock, buf, len, 0,
 				(const void *)(uintptr_t)dest_addr,
 				(socklen_t)ofi_sizeofaddr((const void *)(uintptr_t)dest_addr));
@@ -546,6 +810,19 @@ static struct fi_ops_msg udpx_msg_mcast_ops = {
 	.injectdata = fi_no_msg_injectdata,
 };
 
+static void udpx_batch_free(struct udpx_ep *ep)
+{
+	free(ep->rx_batch.msg);
+	free(ep->rx_batch.addr);
+	free(ep->tx_batch.msg);
+	free(ep->tx_batch.iov);
+	free(ep->tx_batch.ctrl);
+	free(ep->tx_batch.cnt);
+	free(ep->gro.buf);
+	if (ep->txq)
+		udpx_tx_cirq_free(ep->txq);
+}
+
 static int udpx_ep_close(struct fid *fid)
 {
 	struct udpx_ep *ep;
@@ -557,6 +834,13 @@ static int udpx_ep_close(struct fid *fid)
 		return -FI_EBUSY;
 	}
 
+	if (ep->txq && ep->util_ep.tx_cq) {
+		udpx_tx_drain(ep);
+		fid_list_remove(&ep->util_ep.tx_cq->ep_list,
+				&ep->util_ep.tx_cq->ep_list_lock,
+				&ep->util_ep.ep_fid.fid);
+	}
+
 	if (ep->util_ep.rx_cq) {
 		if (ep->util_ep.rx_cq->wait) {
 			wait = container_of(ep->util_ep.rx_cq->wait,
@@ -568,6 +852,7 @@ static int udpx_ep_close(struct fid *fid)
 				&ep->util_ep.ep_fid.fid);
 	}
 
+	udpx_batch_free(ep);
 	udpx_rx_cirq_free(ep->rxq);
 	ofi_close_socket(ep->sock);
 	ofi_endpoint_close(&ep->util_ep);
@@ -590,6 +875,14 @@ static int udpx_ep_bind_cq(struct udpx_ep *ep, struct util_cq *cq,
 		ofi_atomic_inc32(&cq->ref);
 		ep->tx_comp = cq->wait ? udpx_tx_comp_signal :
 					 udpx_tx_comp;
+
+		/* queued sends are flushed when this CQ is progressed */
+		if (ep->txq) {
+			ret = fid_list_insert(&cq->ep_list, &cq->ep_list_lock,
+					      &ep->util_ep.ep_fid.fid);
+			if (ret)
+				return ret;
+		}
 	}
 
 	if (flags & FI_RECV) {
@@ -721,6 +1014,65 @@ static struct fi_ops udpx_ep_fi_ops = {
 	.ops_open = fi_no_ops_open,
 };
 
+static int udpx_batch_init(struct udpx_ep *ep)
+{
+	ep->batch_size = udpx_env.batch_size;
+	ep->rx_batch.msg = calloc(ep->batch_size, sizeof(*ep->rx_batch.msg));
+	ep->rx_batch.addr = calloc(ep->batch_size,
+				   sizeof(*ep->rx_batch.addr));
+	if (!ep->rx_batch.msg || !ep->rx_batch.addr)
+		return -FI_ENOMEM;
+
+	if (ep->batch_size == 1)
+		return 0;
+
+	ep->txq = udpx_tx_cirq_create(ep->batch_size);
+	if (!ep->txq)
+		return -FI_ENOMEM;
+
+	ep->tx_batch.msg = calloc(ep->batch_size, sizeof(*ep->tx_batch.msg));
+	ep->tx_batch.cnt = calloc(ep->batch_size, sizeof(*ep->tx_batch.cnt));
+	ep->tx_batch.ctrl = calloc(ep->batch_size,
+				   CMSG_SPACE(sizeof(uint16_t)));
+	ep->tx_batch.iov = calloc(ep->txq->size * UDPX_IOV_LIMIT,
+				  sizeof(*ep->tx_batch.iov));
+	if (!ep->tx_batch.msg || !ep->tx_batch.cnt || !ep->tx_batch.ctrl ||
+	    !ep->tx_batch.iov)
+		return -FI_ENOMEM;
+
+	return 0;
+}
+
+/* GSO and GRO are best effort, the endpoint works without them */
+static void udpx_offload_init(struct udpx_ep *ep)
+{
+#if defined(UDP_SEGMENT) && defined(UDP_GRO)
+	socklen_t len;
+	int val;
+
+	len = sizeof(val);
+	ep->gso = ep->txq && udpx_env.gso &&
+		  !getsockopt(ep->sock, SOL_UDP, UDP_SEGMENT, &val, &len);
+
+	if (!udpx_env.gro)
+		return;
+
+	val = 1;
+	if (setsockopt(ep->sock, SOL_UDP, UDP_GRO, &val, sizeof(val))) {
+		FI_INFO(&udpx_prov, FI_LOG_EP_CTRL,
+			"UDP GRO not supported: %s\n", strerror(errno));
+		return;
+	}
+
+	ep->gro.buf = malloc(UINT16_MAX);
+	if (!ep->gro.buf) {
+		val = 0;
+		(void) setsockopt(ep->sock, SOL_UDP, UDP_GRO, &val,
+				  sizeof(val));
+	}
+#endif
+}
+
 static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 {
 	int family;
@@ -733,6 +1085,10 @@ static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 		return ret;
 	}
 
+	ret = udpx_batch_init(ep);
+	if (ret)
+		goto err1;
+
 	family = info->src_addr ?
 		 ((struct sockaddr *) info->src_addr)->sa_family : AF_INET;
 	ep->sock = socket(family, SOCK_DGRAM, IPPROTO_UDP);
@@ -752,10 +1108,12 @@ static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 	if (ret)
 		goto err2;
 
+	udpx_offload_init(ep);
 	return 0;
 err2:
 	ofi_close_socket(ep->sock);
 err1:
+	udpx_batch_free(ep);
 	udpx_rx_cirq_free(ep->rxq);
 	return ret;
 }
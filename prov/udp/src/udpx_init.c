@@ -38,6 +38,12 @@
 #include <sys/types.h>
 
 
+struct udpx_env udpx_env = {
+	.batch_size = 16,
+	.gso = 1,
+	.gro = 0,
+};
+
 static int udpx_getinfo(uint32_t version, const char *node, const char *service,
 			uint64_t flags, const struct fi_info *hints,
 			struct fi_info **info)
@@ -64,6 +70,21 @@ UDP_INI
 {
 	fi_param_define(&udpx_prov, "iface", FI_PARAM_STRING,
 			"Specify interface name");
+	fi_param_define(&udpx_prov, "batch_size", FI_PARAM_SIZE_T,
+			"Number of datagrams sent or received per system call. "
+			"1 sends each datagram when it is posted "
+			"(default: 16, max: 64)");
+	fi_param_define(&udpx_prov, "gso", FI_PARAM_BOOL,
+			"Send queued datagrams of the same size to the same "
+			"peer as one UDP GSO message (default: true)");
+	fi_param_define(&udpx_prov, "gro", FI_PARAM_BOOL,
+			"Enable UDP GRO on receive.  Coalesced datagrams are "
+			"copied into the posted buffers (default: false)");
+
+	fi_param_get_size_t(&udpx_prov, "batch_size", &udpx_env.batch_size);
+	fi_param_get_bool(&udpx_prov, "gso", &udpx_env.gso);
+	fi_param_get_bool(&udpx_prov, "gro", &udpx_env.gro);
+	udpx_env.batch_size = MIN(MAX(udpx_env.batch_size, 1), UDPX_MAX_BATCH);
 
 	return &udpx_prov;
 }
@@ -256,6 +256,29 @@ void *ofi_av_addr_context(struct util_av *av, fi_addr_t fi_addr)
 	return (char *) addr + av->context_offset;
 }
 
+/* A removed entry leaves the hash but keeps its data, so an fi_addr is
+ * valid only if its entry is the one hashed under that data.  The region
+ * use count checked by ofi_bufpool_get_ibuf() may be 0 here.
+ */
+bool ofi_av_addr_valid(struct util_av *av, fi_addr_t fi_addr)
+{
+	struct ofi_bufpool *pool = av->av_entry_pool;
+	struct util_av_entry *entry, *found = NULL;
+
+	ofi_mutex_lock(&av->lock);
+	if (fi_addr < pool->entry_cnt) {
+		entry = (struct util_av_entry *)
+			(pool->region_table[fi_addr / pool->attr.chunk_cnt]->
+			 mem_region +
+			 (fi_addr % pool->attr.chunk_cnt) * pool->entry_size);
+		HASH_FIND(hh, av->hash, entry->data, av->addrlen, found);
+		if (found != entry)
+			found = NULL;
+	}
+	ofi_mutex_unlock(&av->lock);
+	return found != NULL;
+}
+
 int ofi_verify_av_insert(struct util_av *av, uint64_t flags, void *context)
 {
 	if (av->flags & FI_EVENT) {
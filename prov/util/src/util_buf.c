@@ -59,6 +59,9 @@ static int ofi_bufpool_region_alloc(struct ofi_bufpool_region *buf_region)
 			ret = ofi_alloc_hugepage_buf((void **) &buf_region->alloc_region,
 					     alloc_size);
 			if (!ret) {
+				if (pool->attr.flags & OFI_BUFPOOL_THREAD_SAFE)
+					(void) ofi_mbind_local(buf_region->alloc_region,
+							       alloc_size);
 				buf_region->flags = OFI_BUFPOOL_HUGEPAGES | OFI_BUFPOOL_NONSHARED;
 				pool->alloc_size = alloc_size;
 				pool->region_size = pool->alloc_size - pool->entry_size;
@@ -81,6 +84,9 @@ static int ofi_bufpool_region_alloc(struct ofi_bufpool_region *buf_region)
 		ret = ofi_mmap_anon_pages((void **) &buf_region->alloc_region,
 					     pool->alloc_size, 0);
 		if (!ret) {
+			if (pool->attr.flags & OFI_BUFPOOL_THREAD_SAFE)
+				(void) ofi_mbind_local(buf_region->alloc_region,
+						       pool->alloc_size);
 			buf_region->flags = OFI_BUFPOOL_NONSHARED;
 			pool->region_size = pool->alloc_size - pool->entry_size;
 			return 0;
@@ -209,17 +215,182 @@ err1:
 	return ret;
 }
 
+/* Move up to cnt buffers from the head of src onto dst */
+static size_t ofi_bufpool_move(struct slist *dst, struct slist *src, size_t cnt)
+{
+	size_t i;
+
+	for (i = 0; i < cnt && !slist_empty(src); i++)
+		slist_insert_head(slist_remove_head(src), dst);
+	return i;
+}
+
+/* Keep the first (most recently freed) keep buffers of the magazine and
+ * splice the rest onto the depot.
+ */
+static void ofi_bufpool_mag_drain(struct ofi_bufpool *pool,
+				  union ofi_bufpool_mag *mag, size_t keep)
+{
+	struct slist_entry *last, *cold;
+	size_t i;
+
+	for (i = 1, last = mag->bufs.head; i < keep; i++)
+		last = last->next;
+	cold = last->next;
+
+	ofi_mutex_lock(&pool->lock);
+	mag->bufs.tail->next = pool->free_list.entries.head;
+	if (slist_empty(&pool->free_list.entries))
+		pool->free_list.entries.tail = mag->bufs.tail;
+	pool->free_list.entries.head = cold;
+	ofi_mutex_unlock(&pool->lock);
+
+	last->next = NULL;
+	mag->bufs.tail = last;
+	mag->cnt = keep;
+}
+
+/* Pool is capped: take what other threads have cached rather than fail */
+static size_t ofi_bufpool_mag_steal(struct ofi_bufpool *pool,
+				    union ofi_bufpool_mag *mag)
+{
+	union ofi_bufpool_mag *victim;
+	size_t i, cnt;
+
+	for (i = 0; i < OFI_BUFPOOL_MAG_CNT; i++) {
+		victim = &pool->mags[i];
+		if (victim == mag || ofi_mutex_trylock(&victim->lock))
+			continue;
+
+		cnt = ofi_bufpool_move(&mag->bufs, &victim->bufs,
+				       OFI_BUFPOOL_MAG_SIZE);
+		victim->cnt -= cnt;
+		ofi_mutex_unlock(&victim->lock);
+		if (cnt) {
+			mag->cnt += cnt;
+			return cnt;
+		}
+	}
+	return 0;
+}
+
+static int ofi_bufpool_mag_fill(struct ofi_bufpool *pool,
+				union ofi_bufpool_mag *mag)
+{
+	int ret = 0;
+
+	ofi_mutex_lock(&pool->lock);
+	if (ofi_bufpool_empty(pool))
+		ret = ofi_bufpool_grow(pool);
+	if (!ret)
+		mag->cnt += ofi_bufpool_move(&mag->bufs,
+					     &pool->free_list.entries,
+					     OFI_BUFPOOL_MAG_SIZE);
+	ofi_mutex_unlock(&pool->lock);
+
+	if (ret && ofi_bufpool_mag_steal(pool, mag))
+		ret = 0;
+	return ret;
+}
+
+void *ofi_bufpool_mag_alloc(struct ofi_bufpool *pool)
+{
+	union ofi_bufpool_mag *mag;
+	struct ofi_bufpool_hdr *buf_hdr;
+
+	mag = &pool->mags[ofi_thread_slot(OFI_BUFPOOL_MAG_SHIFT)];
+	ofi_mutex_lock(&mag->lock);
+	if (slist_empty(&mag->bufs) && ofi_bufpool_mag_fill(pool, mag)) {
+		ofi_mutex_unlock(&mag->lock);
+		return NULL;
+	}
+
+	slist_remove_head_container(&mag->bufs, struct ofi_bufpool_hdr,
+				    buf_hdr, entry.slist);
+	mag->cnt--;
+	ofi_mutex_unlock(&mag->lock);
+
+	assert(ofi_atomic_inc32(&buf_hdr->region->use_cnt));
+	return ofi_buf_data(buf_hdr);
+}
+
+void ofi_bufpool_mag_free(struct ofi_bufpool *pool,
+			  struct ofi_bufpool_hdr *buf_hdr)
+{
+	union ofi_bufpool_mag *mag;
+
+	mag = &pool->mags[ofi_thread_slot(OFI_BUFPOOL_MAG_SHIFT)];
+	ofi_mutex_lock(&mag->lock);
+	slist_insert_head(&buf_hdr->entry.slist, &mag->bufs);
+	if (++mag->cnt >= 2 * OFI_BUFPOOL_MAG_SIZE)
+		ofi_bufpool_mag_drain(pool, mag, OFI_BUFPOOL_MAG_SIZE);
+	ofi_mutex_unlock(&mag->lock);
+}
+
+static int ofi_bufpool_mags_init(struct ofi_bufpool *pool)
+{
+	int i, ret;
+
+	pool->mags = calloc(OFI_BUFPOOL_MAG_CNT, sizeof(*pool->mags));
+	if (!pool->mags)
+		return -FI_ENOMEM;
+
+	ret = ofi_mutex_init(&pool->lock);
+	if (ret)
+		goto err1;
+
+	for (i = 0; i < OFI_BUFPOOL_MAG_CNT; i++) {
+		ret = ofi_mutex_init(&pool->mags[i].lock);
+		if (ret)
+			goto err2;
+		slist_init(&pool->mags[i].bufs);
+	}
+	return 0;
+
+err2:
+	while (i--)
+		ofi_mutex_destroy(&pool->mags[i].lock);
+	ofi_mutex_destroy(&pool->lock);
+err1:
+	free(pool->mags);
+	return -ret;
+}
+
+static void ofi_bufpool_mags_cleanup(struct ofi_bufpool *pool)
+{
+	int i;
+
+	for (i = 0; i < OFI_BUFPOOL_MAG_CNT; i++)
+		ofi_mutex_destroy(&pool->mags[i].lock);
+	ofi_mutex_destroy(&pool->lock);
+	free(pool->mags);
+}
+
 int ofi_bufpool_create_attr(struct ofi_bufpool_attr *attr,
 			      struct ofi_bufpool **buf_pool)
 {
 	struct ofi_bufpool *pool;
 	size_t entry_sz;
+	int ret;
+
+	if ((attr->flags & OFI_BUFPOOL_THREAD_SAFE) &&
+	    (attr->flags & OFI_BUFPOOL_INDEXED))
+		return -FI_EINVAL;
 
 	pool = calloc(1, sizeof(**buf_pool));
 	if (!pool)
 		return -FI_ENOMEM;
 
 	pool->attr = *attr;
+	if (pool->attr.flags & OFI_BUFPOOL_THREAD_SAFE) {
+		ret = ofi_bufpool_mags_init(pool);
+		if (ret) {
+			free(pool);
+			return ret;
+		}
+		/* Regions must be whole pages to bind them */
+		pool->attr.flags |= OFI_BUFPOOL_NONSHARED;
+	}
 
 	entry_sz = (attr->size + sizeof(struct ofi_bufpool_hdr));
 	OFI_DBG_ADD(entry_sz, sizeof(struct ofi_bufpool_ftr));
@@ -261,6 +432,8 @@ void ofi_bufpool_destroy(struct ofi_bufpool *pool)
 		free(buf_region);
 	}
 	free(pool->region_table);
+	if (pool->attr.flags & OFI_BUFPOOL_THREAD_SAFE)
+		ofi_bufpool_mags_cleanup(pool);
 	free(pool);
 }
 
@@ -45,12 +45,11 @@
 static void ofi_cq_insert_aux(struct util_cq *cq,
 			      struct util_cq_aux_entry *entry)
 {
-	assert(ofi_genlock_held(&cq->cq_lock));
+	assert(ofi_cq_lock_held(cq));
 	if (!ofi_cirque_isfull(cq->cirq))
 		ofi_cirque_commit(cq->cirq);
 
-	entry->cq_slot = ofi_cirque_tail(cq->cirq);
-	entry->cq_slot->flags = UTIL_FLAG_AUX;
+	entry->cq_slot = util_comp_cirq_tail(cq->cirq);
 	slist_insert_tail(&entry->list_entry, &cq->aux_queue);
 }
 
@@ -60,7 +59,7 @@ int ofi_cq_write_overflow(struct util_cq *cq, void *context, uint64_t flags,
 {
 	struct util_cq_aux_entry *entry;
 
-	assert(ofi_genlock_held(&cq->cq_lock));
+	assert(ofi_cq_lock_held(cq));
 	FI_DBG(cq->domain->prov, FI_LOG_CQ, "writing to CQ overflow list\n");
 	assert(ofi_cirque_freecnt(cq->cirq) <= 1);
 
@@ -86,7 +85,7 @@ int ofi_cq_insert_error(struct util_cq *cq,
 {
 	struct util_cq_aux_entry *entry;
 
-	assert(ofi_genlock_held(&cq->cq_lock));
+	assert(ofi_cq_lock_held(cq));
 	assert(err_entry->err);
 	entry = calloc(1, sizeof(*entry));
 	if (!entry)
@@ -100,9 +99,9 @@ int ofi_cq_insert_error(struct util_cq *cq,
 int ofi_cq_write_error(struct util_cq *cq,
 		       const struct fi_cq_err_entry *err_entry)
 {
-	ofi_genlock_lock(&cq->cq_lock);
+	ofi_cq_lock(cq);
 	ofi_cq_insert_error(cq, err_entry);
-	ofi_genlock_unlock(&cq->cq_lock);
+	ofi_cq_unlock(cq);
 
 	if (cq->wait)
 		cq->wait->signal(cq->wait);
@@ -189,42 +188,54 @@ int ofi_check_cq_attr(const struct fi_provider *prov,
 	return 0;
 }
 
-static void util_cq_read_ctx(void **dst, void *src)
+static struct util_cq_aux_entry *util_cq_head_aux(struct util_cq *cq)
 {
-	*(struct fi_cq_entry *) *dst = *(struct fi_cq_entry *) src;
-	*(char**)dst += sizeof(struct fi_cq_entry);
-}
+	struct util_cq_aux_entry *aux_entry;
 
-static void util_cq_read_msg(void **dst, void *src)
-{
-	*(struct fi_cq_msg_entry *) *dst = *(struct fi_cq_msg_entry *) src;
-	*(char**)dst += sizeof(struct fi_cq_msg_entry);
-}
+	if (slist_empty(&cq->aux_queue))
+		return NULL;
 
-static void util_cq_read_data(void **dst, void *src)
-{
-	*(struct fi_cq_data_entry *) *dst = *(struct fi_cq_data_entry *) src;
-	*(char**)dst += sizeof(struct fi_cq_data_entry);
+	aux_entry = container_of(cq->aux_queue.head, struct util_cq_aux_entry,
+				 list_entry);
+	return aux_entry->cq_slot == util_comp_cirq_head(cq->cirq) ?
+	       aux_entry : NULL;
 }
 
-static void util_cq_read_tagged(void **dst, void *src)
+size_t ofi_cq_peek(struct util_cq *cq, void **comp, size_t count)
 {
-	*(struct fi_cq_tagged_entry *) *dst = *(struct fi_cq_tagged_entry *) src;
-	*(char **)dst += sizeof(struct fi_cq_tagged_entry);
+	struct util_cq_aux_entry *aux_entry;
+	size_t rindex, aux_index;
+
+	rindex = ofi_cirque_rindex(cq->cirq);
+	count = MIN(count, ofi_cirque_usedcnt(cq->cirq));
+	count = MIN(count, cq->cirq->size - rindex);
+
+	if (!slist_empty(&cq->aux_queue)) {
+		aux_entry = container_of(cq->aux_queue.head,
+					 struct util_cq_aux_entry, list_entry);
+		aux_index = ((uint8_t *) aux_entry->cq_slot - cq->cirq->buf) /
+			    cq->cirq->entry_size;
+		if (aux_index >= rindex && aux_index - rindex < count)
+			count = aux_index - rindex;
+	}
+
+	*comp = util_comp_cirq_head(cq->cirq);
+	return count;
 }
 
 ssize_t ofi_cq_readfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 			fi_addr_t *src_addr)
 {
-	struct fi_cq_tagged_entry *entry;
 	struct util_cq_aux_entry *aux_entry;
 	struct util_cq *cq;
+	void *comp;
+	size_t n;
 	ssize_t i;
 
 	cq = container_of(cq_fid, struct util_cq, cq_fid);
 
 	cq->progress(cq);
-	ofi_genlock_lock(&cq->cq_lock);
+	ofi_cq_lock(cq);
 	if (ofi_cirque_isempty(cq->cirq)) {
 		i = -FI_EAGAIN;
 		goto out;
@@ -233,44 +244,42 @@ ssize_t ofi_cq_readfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 	if (count > ofi_cirque_usedcnt(cq->cirq))
 		count = ofi_cirque_usedcnt(cq->cirq);
 
-	for (i = 0; i < (ssize_t) count; i++) {
-		entry = ofi_cirque_head(cq->cirq);
-		if (!(entry->flags & UTIL_FLAG_AUX)) {
-			if (src_addr && cq->src)
-				src_addr[i] = cq->src[ofi_cirque_rindex(cq->cirq)];
-			cq->read_entry(&buf, entry);
-			ofi_cirque_discard(cq->cirq);
-		} else {
-			assert(!slist_empty(&cq->aux_queue));
-			aux_entry = container_of(cq->aux_queue.head,
-						 struct util_cq_aux_entry,
-						 list_entry);
-			assert(aux_entry->cq_slot == entry);
-			if (aux_entry->comp.err) {
-				if (!i)
-					i = -FI_EAVAIL;
-				break;
+	for (i = 0; i < (ssize_t) count; ) {
+		n = ofi_cq_peek(cq, &comp, count - i);
+		if (n) {
+			if (src_addr && cq->src) {
+				memcpy(&src_addr[i],
+				       &cq->src[ofi_cirque_rindex(cq->cirq)],
+				       n * sizeof(*src_addr));
 			}
+			memcpy(buf, comp, n * cq->cirq->entry_size);
+			buf = (char *) buf + n * cq->cirq->entry_size;
+			ofi_cq_consume(cq, n);
+			i += n;
+			continue;
+		}
 
-			if (src_addr && cq->src)
-				src_addr[i] = aux_entry->src;
-			cq->read_entry(&buf, &aux_entry->comp);
-			slist_remove_head(&cq->aux_queue);
-			free(aux_entry);
-
-			if (slist_empty(&cq->aux_queue)) {
-				ofi_cirque_discard(cq->cirq);
-			} else {
-				aux_entry = container_of(cq->aux_queue.head,
-							struct util_cq_aux_entry,
-							list_entry);
-				if (aux_entry->cq_slot != ofi_cirque_head(cq->cirq))
-					ofi_cirque_discard(cq->cirq);
-			}
+		aux_entry = util_cq_head_aux(cq);
+		assert(aux_entry);
+		if (aux_entry->comp.err) {
+			if (!i)
+				i = -FI_EAVAIL;
+			break;
 		}
+
+		if (src_addr && cq->src)
+			src_addr[i] = aux_entry->src;
+		memcpy(buf, &aux_entry->comp, cq->cirq->entry_size);
+		buf = (char *) buf + cq->cirq->entry_size;
+		i++;
+		slist_remove_head(&cq->aux_queue);
+		free(aux_entry);
+
+		if (!util_cq_head_aux(cq))
+			ofi_cirque_discard(cq->cirq);
 	}
 out:
-	ofi_genlock_unlock(&cq->cq_lock);
+	ofi_cq_unlock(cq);
 	return i;
 }
 
@@ -292,19 +301,9 @@ ssize_t ofi_cq_readerr(struct fid_cq *cq_fid, struct fi_cq_err_entry *buf,
 	cq = container_of(cq_fid, struct util_cq, cq_fid);
 	api_version = cq->domain->fabric->fabric_fid.api_version;
 
-	ofi_genlock_lock(&cq->cq_lock);
-	if (ofi_cirque_isempty(cq->cirq) ||
-	    !(ofi_cirque_head(cq->cirq)->flags & UTIL_FLAG_AUX)) {
-		ret = -FI_EAGAIN;
-		goto unlock;
-	}
-
-	assert(!slist_empty(&cq->aux_queue));
-	aux_entry = container_of(cq->aux_queue.head,
-				 struct util_cq_aux_entry, list_entry);
-	assert(aux_entry->cq_slot == ofi_cirque_head(cq->cirq));
-
-	if (!aux_entry->comp.err) {
+	ofi_cq_lock(cq);
+	aux_entry = ofi_cirque_isempty(cq->cirq) ? NULL : util_cq_head_aux(cq);
+	if (!aux_entry || !aux_entry->comp.err) {
 		ret = -FI_EAGAIN;
 		goto unlock;
 	}
@@ -326,18 +325,12 @@ ssize_t ofi_cq_readerr(struct fid_cq *cq_fid, struct fi_cq_err_entry *buf,
 
 	slist_remove_head(&cq->aux_queue);
 	free(aux_entry);
-	if (slist_empty(&cq->aux_queue)) {
+	if (!util_cq_head_aux(cq))
 		ofi_cirque_discard(cq->cirq);
-	} else {
-		aux_entry = container_of(cq->aux_queue.head,
-					 struct util_cq_aux_entry, list_entry);
-		if (aux_entry->cq_slot != ofi_cirque_head(cq->cirq))
-			ofi_cirque_discard(cq->cirq);
-	}
 
 	ret = 1;
 unlock:
-	ofi_genlock_unlock(&cq->cq_lock);
+	ofi_cq_unlock(cq);
 	return ret;
 }
 
@@ -426,7 +419,7 @@ int ofi_cq_cleanup(struct util_cq *cq)
 	}
 
 	ofi_atomic_dec32(&cq->domain->ref);
-	util_comp_cirq_free(cq->cirq);
+	free(cq->cirq);
 	ofi_genlock_destroy(&cq->cq_lock);
 	ofi_mutex_destroy(&cq->ep_list_lock);
 	free(cq->src);
@@ -472,8 +465,7 @@ static struct fi_ops util_cq_fi_ops = {
 };
 
 static int fi_cq_init(struct fid_domain *domain, struct fi_cq_attr *attr,
-		      fi_cq_read_func read_entry, struct util_cq *cq,
-		      void *context)
+		      struct util_cq *cq, void *context)
 {
 	struct fi_wait_attr wait_attr;
 	enum ofi_lock_type lock_type;
@@ -497,7 +489,6 @@ static int fi_cq_init(struct fid_domain *domain, struct fi_cq_attr *attr,
 		return ret;
 
 	cq->flags = attr->flags;
-	cq->read_entry = read_entry;
 	cq->cq_fid.fid.fclass = FI_CLASS_CQ;
 	cq->cq_fid.fid.context = context;
 
@@ -574,7 +565,7 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 		 struct fi_cq_attr *attr, struct util_cq *cq,
 		 ofi_cq_progress_func progress, void *context)
 {
-	fi_cq_read_func read_func;
+	size_t entry_size, size;
 	int ret;
 
 	assert(progress);
@@ -589,23 +580,23 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 	switch (attr->format) {
 	case FI_CQ_FORMAT_UNSPEC:
 	case FI_CQ_FORMAT_CONTEXT:
-		read_func = util_cq_read_ctx;
+		entry_size = sizeof(struct fi_cq_entry);
 		break;
 	case FI_CQ_FORMAT_MSG:
-		read_func = util_cq_read_msg;
+		entry_size = sizeof(struct fi_cq_msg_entry);
 		break;
 	case FI_CQ_FORMAT_DATA:
-		read_func = util_cq_read_data;
+		entry_size = sizeof(struct fi_cq_data_entry);
 		break;
 	case FI_CQ_FORMAT_TAGGED:
-		read_func = util_cq_read_tagged;
+		entry_size = sizeof(struct fi_cq_tagged_entry);
 		break;
 	default:
 		assert(0);
 		return -FI_EINVAL;
 	}
 
-	ret = fi_cq_init(domain, attr, read_func, cq, context);
+	ret = fi_cq_init(domain, attr, cq, context);
 	if (ret)
 		return ret;
 
@@ -617,11 +608,15 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 			goto cleanup;
 	}
 
-	cq->cirq = util_comp_cirq_create(attr->size == 0 ? UTIL_DEF_CQ_SIZE : attr->size);
+	size = roundup_power_of_two(attr->size ? attr->size : UTIL_DEF_CQ_SIZE);
+	cq->cirq = calloc(1, sizeof(*cq->cirq) + size * entry_size);
 	if (!cq->cirq) {
 		ret = -FI_ENOMEM;
 		goto cleanup;
 	}
+	cq->cirq->size = size;
+	cq->cirq->size_mask = size - 1;
+	cq->cirq->entry_size = entry_size;
 
 	if (cq->domain->info_domain_caps & FI_SOURCE) {
 		cq->src = calloc(cq->cirq->size, sizeof *cq->src);
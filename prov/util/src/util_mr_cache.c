@@ -44,6 +44,13 @@
 #include <ofi_enosys.h>
 
 
+/* LRU states of an entry, see struct ofi_mr_cache */
+enum {
+	UTIL_MR_LRU_NONE,
+	UTIL_MR_LRU_QUEUED,
+	UTIL_MR_LRU_REUSED,
+};
+
 struct ofi_mr_cache_params cache_params = {
 	.max_cnt = 1024,
 	.cuda_monitor_enabled = true,
@@ -77,6 +84,32 @@ static int util_mr_find_overlap(struct ofi_rbmap *map, void *key, void *data)
 	return 0;
 }
 
+static inline union ofi_mr_cache_stripe *
+util_mr_cache_rdlock(struct ofi_mr_cache *cache)
+{
+	union ofi_mr_cache_stripe *stripe;
+
+	stripe = &cache->stripes[ofi_thread_slot(OFI_MR_CACHE_STRIPE_SHIFT)];
+	pthread_rwlock_rdlock(&stripe->lock);
+	return stripe;
+}
+
+static void util_mr_cache_wrlock(struct ofi_mr_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < OFI_MR_CACHE_STRIPES; i++)
+		pthread_rwlock_wrlock(&cache->stripes[i].lock);
+}
+
+static void util_mr_cache_wrunlock(struct ofi_mr_cache *cache)
+{
+	int i;
+
+	for (i = OFI_MR_CACHE_STRIPES - 1; i >= 0; i--)
+		pthread_rwlock_unlock(&cache->stripes[i].lock);
+}
+
 static struct ofi_mr_entry *util_mr_entry_alloc(struct ofi_mr_cache *cache)
 {
 	struct ofi_mr_entry *entry;
@@ -133,12 +166,18 @@ static void util_mr_uncache_entry(struct ofi_mr_cache *cache,
 {
 	util_mr_uncache_entry_storage(cache, entry);
 
-	if (entry->use_cnt == 0) {
-		dlist_remove(&entry->list_entry);
+	/* An entry that was found again after being released may still
+	 * sit on the LRU list.
+	 */
+	dlist_remove_init(&entry->list_entry);
+	ofi_atomic_set32(&entry->lru_state, UTIL_MR_LRU_NONE);
+	if (ofi_atomic_get32(&entry->use_cnt) == 0) {
 		dlist_insert_tail(&entry->list_entry, &cache->dead_region_list);
 	} else {
+		pthread_mutex_lock(&cache->lock);
 		cache->uncached_cnt++;
 		cache->uncached_size += entry->info.iov.iov_len;
+		pthread_mutex_unlock(&cache->lock);
 	}
 }
 
@@ -173,6 +212,7 @@ void ofi_mr_cache_notify(struct ofi_mr_cache *cache, const void *addr, size_t le
 	struct ofi_mr_entry *entry;
 	struct iovec iov;
 
+	util_mr_cache_wrlock(cache);
 	cache->notify_cnt++;
 	iov.iov_base = (void *) addr;
 	iov.iov_len = len;
@@ -180,6 +220,7 @@ void ofi_mr_cache_notify(struct ofi_mr_cache *cache, const void *addr, size_t le
 	for (entry = ofi_mr_rbt_overlap(&cache->tree, &iov); entry;
 	     entry = ofi_mr_rbt_overlap(&cache->tree, &iov))
 		util_mr_uncache_entry(cache, entry);
+	util_mr_cache_wrunlock(cache);
 }
 
 /* Function to remove dead regions and prune MR cache size.
@@ -193,7 +234,7 @@ bool ofi_mr_cache_flush(struct ofi_mr_cache *cache, bool flush_lru)
 
 	dlist_init(&free_list);
 
-	pthread_mutex_lock(&mm_lock);
+	util_mr_cache_wrlock(cache);
 
 	dlist_splice_tail(&free_list, &cache->dead_region_list);
 
@@ -201,13 +242,24 @@ bool ofi_mr_cache_flush(struct ofi_mr_cache *cache, bool flush_lru)
 		dlist_pop_front(&cache->lru_list, struct ofi_mr_entry,
 				entry, list_entry);
 		dlist_init(&entry->list_entry);
+		if (ofi_atomic_get32(&entry->use_cnt)) {
+			ofi_atomic_set32(&entry->lru_state, UTIL_MR_LRU_NONE);
+			continue;
+		}
+
+		if (ofi_atomic_get32(&entry->lru_state) == UTIL_MR_LRU_REUSED) {
+			ofi_atomic_set32(&entry->lru_state, UTIL_MR_LRU_QUEUED);
+			dlist_insert_tail(&entry->list_entry, &cache->lru_list);
+			continue;
+		}
+
 		util_mr_uncache_entry_storage(cache, entry);
 		dlist_insert_tail(&entry->list_entry, &free_list);
 
 		flush_lru = ofi_mr_cache_full(cache);
 	}
 
-	pthread_mutex_unlock(&mm_lock);
+	util_mr_cache_wrunlock(cache);
 
 	entries_freed = !dlist_empty(&free_list);
 
@@ -227,20 +279,34 @@ void ofi_mr_cache_delete(struct ofi_mr_cache *cache, struct ofi_mr_entry *entry)
 	FI_DBG(cache->domain->prov, FI_LOG_MR, "delete %p (len: %zu)\n",
 	       entry->info.iov.iov_base, entry->info.iov.iov_len);
 
-	pthread_mutex_lock(&mm_lock);
-	cache->delete_cnt++;
-
-	if (--entry->use_cnt == 0) {
-		if (!entry->node) {
-			cache->uncached_cnt--;
-			cache->uncached_size -= entry->info.iov.iov_len;
-			pthread_mutex_unlock(&mm_lock);
-			util_mr_free_entry(cache, entry);
-			return;
-		}
+	union ofi_mr_cache_stripe *stripe;
+
+	stripe = util_mr_cache_rdlock(cache);
+	ofi_atomic_inc64(&stripe->delete_cnt);
+
+	if (ofi_atomic_dec32(&entry->use_cnt))
+		goto unlock;
+
+	if (!entry->node) {
+		pthread_mutex_lock(&cache->lock);
+		cache->uncached_cnt--;
+		cache->uncached_size -= entry->info.iov.iov_len;
+		pthread_mutex_unlock(&cache->lock);
+		pthread_rwlock_unlock(&stripe->lock);
+		util_mr_free_entry(cache, entry);
+		return;
+	}
+
+	if (ofi_atomic_cas_bool32(&entry->lru_state, UTIL_MR_LRU_NONE,
+				  UTIL_MR_LRU_QUEUED)) {
+		pthread_mutex_lock(&cache->lock);
 		dlist_insert_tail(&entry->list_entry, &cache->lru_list);
+		pthread_mutex_unlock(&cache->lock);
+	} else {
+		ofi_atomic_set32(&entry->lru_state, UTIL_MR_LRU_REUSED);
 	}
-	pthread_mutex_unlock(&mm_lock);
+unlock:
+	pthread_rwlock_unlock(&stripe->lock);
 }
 
 /*
@@ -272,13 +338,16 @@ util_mr_cache_create(struct ofi_mr_cache *cache, const struct ofi_mr_info *info,
 
 	(*entry)->node = NULL;
 	(*entry)->info = *info;
-	(*entry)->use_cnt = 1;
+	ofi_atomic_initialize32(&(*entry)->use_cnt, 1);
+	ofi_atomic_initialize32(&(*entry)->lru_state, UTIL_MR_LRU_NONE);
+	dlist_init(&(*entry)->list_entry);
 
 	ret = cache->add_region(cache, *entry);
 	if (ret)
 		goto free;
 
 	pthread_mutex_lock(&mm_lock);
+	util_mr_cache_wrlock(cache);
 	cur = ofi_mr_rbt_find(&cache->tree, info);
 	if (cur) {
 		ret = -FI_EAGAIN;
@@ -286,8 +355,10 @@ util_mr_cache_create(struct ofi_mr_cache *cache, const struct ofi_mr_info *info,
 	}
 
 	if (ofi_mr_cache_full(cache)) {
+		pthread_mutex_lock(&cache->lock);
 		cache->uncached_cnt++;
 		cache->uncached_size += info->iov.iov_len;
+		pthread_mutex_unlock(&cache->lock);
 	} else {
 		if (ofi_rbmap_insert(&cache->tree, (void *) &(*entry)->info,
 				     (void *) *entry, &(*entry)->node)) {
@@ -302,14 +373,18 @@ util_mr_cache_create(struct ofi_mr_cache *cache, const struct ofi_mr_info *info,
 					    &(*entry)->hmem_info);
 		if (ret) {
 			util_mr_uncache_entry_storage(cache, *entry);
+			pthread_mutex_lock(&cache->lock);
 			cache->uncached_cnt++;
 			cache->uncached_size += (*entry)->info.iov.iov_len;
+			pthread_mutex_unlock(&cache->lock);
 		}
 	}
+	util_mr_cache_wrunlock(cache);
 	pthread_mutex_unlock(&mm_lock);
 	return 0;
 
 unlock:
+	util_mr_cache_wrunlock(cache);
 	pthread_mutex_unlock(&mm_lock);
 free:
 	util_mr_free_entry(cache, *entry);
@@ -319,6 +394,7 @@ free:
 int ofi_mr_cache_search(struct ofi_mr_cache *cache, const struct ofi_mr_info *info,
 			struct ofi_mr_entry **entry)
 {
+	union ofi_mr_cache_stripe *stripe;
 	struct ofi_mem_monitor *monitor;
 	bool flush_lru;
 	int ret;
@@ -335,15 +411,15 @@ int ofi_mr_cache_search(struct ofi_mr_cache *cache, const struct ofi_mr_info *in
 	       info->iov.iov_base, info->iov.iov_len);
 
 	do {
-		pthread_mutex_lock(&mm_lock);
+		stripe = util_mr_cache_rdlock(cache);
 		flush_lru = ofi_mr_cache_full(cache);
 		if (flush_lru || !dlist_empty(&cache->dead_region_list)) {
-			pthread_mutex_unlock(&mm_lock);
+			pthread_rwlock_unlock(&stripe->lock);
 			ofi_mr_cache_flush(cache, flush_lru);
-			pthread_mutex_lock(&mm_lock);
+			pthread_rwlock_rdlock(&stripe->lock);
 		}
 
-		cache->search_cnt++;
+		ofi_atomic_inc64(&stripe->search_cnt);
 		*entry = ofi_mr_rbt_find(&cache->tree, info);
 
 		if (*entry &&
@@ -351,12 +427,15 @@ int ofi_mr_cache_search(struct ofi_mr_cache *cache, const struct ofi_mr_info *in
 		    monitor->valid(monitor, info, *entry))
 			goto hit;
 
+		pthread_rwlock_unlock(&stripe->lock);
+
 		/* Purge regions that overlap with new region */
-		while (*entry) {
-			util_mr_uncache_entry(cache, *entry);
-			*entry = ofi_mr_rbt_find(&cache->tree, info);
+		if (*entry) {
+			util_mr_cache_wrlock(cache);
+			while ((*entry = ofi_mr_rbt_find(&cache->tree, info)))
+				util_mr_uncache_entry(cache, *entry);
+			util_mr_cache_wrunlock(cache);
 		}
-		pthread_mutex_unlock(&mm_lock);
 
 		ret = util_mr_cache_create(cache, info, entry);
 		if (ret && ret != -FI_EAGAIN) {
@@ -368,16 +447,16 @@ int ofi_mr_cache_search(struct ofi_mr_cache *cache, const struct ofi_mr_info *in
 	return ret;
 
 hit:
-	cache->hit_cnt++;
-	if ((*entry)->use_cnt++ == 0)
-		dlist_remove_init(&(*entry)->list_entry);
-	pthread_mutex_unlock(&mm_lock);
+	ofi_atomic_inc64(&stripe->hit_cnt);
+	ofi_atomic_inc32(&(*entry)->use_cnt);
+	pthread_rwlock_unlock(&stripe->lock);
 	return 0;
 }
 
 struct ofi_mr_entry *ofi_mr_cache_find(struct ofi_mr_cache *cache,
 				       const struct fi_mr_attr *attr)
 {
+	union ofi_mr_cache_stripe *stripe;
 	struct ofi_mr_info info;
 	struct ofi_mr_entry *entry;
 
@@ -385,8 +464,8 @@ struct ofi_mr_entry *ofi_mr_cache_find(struct ofi_mr_cache *cache,
 	FI_DBG(cache->domain->prov, FI_LOG_MR, "find %p (len: %zu)\n",
 	       attr->mr_iov->iov_base, attr->mr_iov->iov_len);
 
-	pthread_mutex_lock(&mm_lock);
-	cache->search_cnt++;
+	stripe = util_mr_cache_rdlock(cache);
+	ofi_atomic_inc64(&stripe->search_cnt);
 
 	info.iov = *attr->mr_iov;
 	entry = ofi_mr_rbt_find(&cache->tree, &info);
@@ -399,12 +478,11 @@ struct ofi_mr_entry *ofi_mr_cache_find(struct ofi_mr_cache *cache,
 		goto unlock;
 	}
 
-	cache->hit_cnt++;
-	if ((entry)->use_cnt++ == 0)
-		dlist_remove_init(&(entry)->list_entry);
+	ofi_atomic_inc64(&stripe->hit_cnt);
+	ofi_atomic_inc32(&entry->use_cnt);
 
 unlock:
-	pthread_mutex_unlock(&mm_lock);
+	pthread_rwlock_unlock(&stripe->lock);
 	return entry;
 }
 
@@ -421,13 +499,15 @@ int ofi_mr_cache_reg(struct ofi_mr_cache *cache, const struct fi_mr_attr *attr,
 	if (!*entry)
 		return -FI_ENOMEM;
 
-	pthread_mutex_lock(&mm_lock);
+	pthread_mutex_lock(&cache->lock);
 	cache->uncached_cnt++;
 	cache->uncached_size += attr->mr_iov->iov_len;
-	pthread_mutex_unlock(&mm_lock);
+	pthread_mutex_unlock(&cache->lock);
 
 	(*entry)->info.iov = *attr->mr_iov;
-	(*entry)->use_cnt = 1;
+	ofi_atomic_initialize32(&(*entry)->use_cnt, 1);
+	ofi_atomic_initialize32(&(*entry)->lru_state, UTIL_MR_LRU_NONE);
+	dlist_init(&(*entry)->list_entry);
 	(*entry)->node = NULL;
 
 	ret = cache->add_region(cache, *entry);
@@ -438,27 +518,56 @@ int ofi_mr_cache_reg(struct ofi_mr_cache *cache, const struct fi_mr_attr *attr,
 
 buf_free:
 	util_mr_entry_free(cache, *entry);
-	pthread_mutex_lock(&mm_lock);
+	pthread_mutex_lock(&cache->lock);
 	cache->uncached_cnt--;
 	cache->uncached_size -= attr->mr_iov->iov_len;
-	pthread_mutex_unlock(&mm_lock);
+	pthread_mutex_unlock(&cache->lock);
 	return ret;
 }
 
+static void util_mr_cache_init_stripes(struct ofi_mr_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < OFI_MR_CACHE_STRIPES; i++) {
+		pthread_rwlock_init(&cache->stripes[i].lock, NULL);
+		ofi_atomic_initialize64(&cache->stripes[i].search_cnt, 0);
+		ofi_atomic_initialize64(&cache->stripes[i].hit_cnt, 0);
+		ofi_atomic_initialize64(&cache->stripes[i].delete_cnt, 0);
+	}
+}
+
+static void util_mr_cache_destroy_stripes(struct ofi_mr_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < OFI_MR_CACHE_STRIPES; i++)
+		pthread_rwlock_destroy(&cache->stripes[i].lock);
+}
+
 void ofi_mr_cache_cleanup(struct ofi_mr_cache *cache)
 {
+	size_t search_cnt = 0, delete_cnt = 0, hit_cnt = 0;
+	int i;
+
 	/* If we don't have a domain, initialization failed */
 	if (!cache->domain)
 		return;
 
+	for (i = 0; i < OFI_MR_CACHE_STRIPES; i++) {
+		search_cnt += ofi_atomic_get64(&cache->stripes[i].search_cnt);
+		delete_cnt += ofi_atomic_get64(&cache->stripes[i].delete_cnt);
+		hit_cnt += ofi_atomic_get64(&cache->stripes[i].hit_cnt);
+	}
+
 	FI_INFO(cache->domain->prov, FI_LOG_MR, "MR cache stats: "
 		"searches %zu, deletes %zu, hits %zu notify %zu\n",
-		cache->search_cnt, cache->delete_cnt, cache->hit_cnt,
-		cache->notify_cnt);
+		search_cnt, delete_cnt, hit_cnt, cache->notify_cnt);
 
 	while (ofi_mr_cache_flush(cache, true))
 		;
 
+	util_mr_cache_destroy_stripes(cache);
 	pthread_mutex_destroy(&cache->lock);
 	ofi_monitors_del_cache(cache);
 	ofi_rbmap_cleanup(&cache->tree);
@@ -488,10 +597,8 @@ int ofi_mr_cache_init(struct util_domain *domain,
 	cache->cached_size = 0;
 	cache->uncached_cnt = 0;
 	cache->uncached_size = 0;
-	cache->search_cnt = 0;
-	cache->delete_cnt = 0;
-	cache->hit_cnt = 0;
 	cache->notify_cnt = 0;
+	util_mr_cache_init_stripes(cache);
 	cache->domain = domain;
 	ofi_atomic_inc32(&domain->ref);
 
@@ -513,6 +620,7 @@ del:
 destroy:
 	ofi_rbmap_cleanup(&cache->tree);
 	ofi_atomic_dec32(&cache->domain->ref);
+	util_mr_cache_destroy_stripes(cache);
 	pthread_mutex_destroy(&cache->lock);
 	cache->domain = NULL;
 	return ret;
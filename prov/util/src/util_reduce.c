@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2024 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ofi_atomic.h"
+
+/*
+ * Non-atomic reduction kernels
+ *
+ * Each kernel reduces element by element until dst reaches an
+ * OFI_REDUCE_ALIGN boundary, then works on whole blocks with a fixed trip
+ * count the compiler can vectorize without alias checks or peeling, and
+ * finishes the remainder element by element.  On x86_64 the kernels are
+ * built again for AVX2 and AVX-512 and the widest set the CPU supports is
+ * selected by ofi_reduce_init().
+ */
+#define OFI_REDUCE_ALIGN	64
+#define OFI_REDUCE_BLOCK(type)	(OFI_REDUCE_ALIGN / sizeof(type))
+
+#if defined(__GNUC__) && defined(HAVE_CPUID) && \
+    (defined(__x86_64__) || defined(__amd64__))
+#define OFI_REDUCE_X86 1
+#else
+#define OFI_REDUCE_X86 0
+#endif
+
+#define OFI_REDUCE_TARGET_base
+#define OFI_REDUCE_TARGET_avx2		__attribute__((target("avx2")))
+#define OFI_REDUCE_TARGET_avx512	\
+		__attribute__((target("avx512f,avx512bw")))
+
+#define OFI_RED_MIN(dst,src)	(dst) = (src) < (dst) ? (src) : (dst)
+#define OFI_RED_MAX(dst,src)	(dst) = (src) > (dst) ? (src) : (dst)
+#define OFI_RED_SUM(dst,src)	(dst) += (src)
+#define OFI_RED_PROD(dst,src)	(dst) *= (src)
+#define OFI_RED_LOR(dst,src)	(dst) = (dst) || (src)
+#define OFI_RED_LAND(dst,src)	(dst) = (dst) && (src)
+#define OFI_RED_BOR(dst,src)	(dst) |= (src)
+#define OFI_RED_BAND(dst,src)	(dst) &= (src)
+#define OFI_RED_LXOR(dst,src)	(dst) = !(dst) != !(src)
+#define OFI_RED_BXOR(dst,src)	(dst) ^= (src)
+#define OFI_RED_WRITE(dst,src)	(dst) = (src)
+
+typedef void (*ofi_reduce_fn)(void *dst, const void *src, size_t cnt);
+
+#define OFI_DEF_REDUCE_FUNC(op, type, isa)				\
+	OFI_REDUCE_TARGET_##isa static void				\
+	ofi_reduce_## op ##_## type ##_## isa				\
+		(void *__restrict dst, const void *__restrict src,	\
+		 size_t cnt)						\
+	{								\
+		type *d = dst;						\
+		const type *s = src;					\
+		size_t i, j, head;					\
+									\
+		head = ((OFI_REDUCE_ALIGN - ((uintptr_t) d &		\
+			 (OFI_REDUCE_ALIGN - 1))) &			\
+			(OFI_REDUCE_ALIGN - 1)) / sizeof(type);		\
+		head = MIN(head, cnt);					\
+		for (i = 0; i < head; i++)				\
+			OFI_RED_##op(d[i], s[i]);			\
+									\
+		for (; i + OFI_REDUCE_BLOCK(type) <= cnt;		\
+		     i += OFI_REDUCE_BLOCK(type)) {			\
+			for (j = 0; j < OFI_REDUCE_BLOCK(type); j++)	\
+				OFI_RED_##op(d[i + j], s[i + j]);	\
+		}							\
+									\
+		for (; i < cnt; i++)					\
+			OFI_RED_##op(d[i], s[i]);			\
+	}
+
+#define OFI_DEF_REDUCE_INT(op, isa)					\
+	OFI_DEF_REDUCE_FUNC(op, int8_t, isa)				\
+	OFI_DEF_REDUCE_FUNC(op, uint8_t, isa)				\
+	OFI_DEF_REDUCE_FUNC(op, int16_t, isa)				\
+	OFI_DEF_REDUCE_FUNC(op, uint16_t, isa)				\
+	OFI_DEF_REDUCE_FUNC(op, int32_t, isa)				\
+	OFI_DEF_REDUCE_FUNC(op, uint32_t, isa)				\
+	OFI_DEF_REDUCE_FUNC(op, int64_t, isa)				\
+	OFI_DEF_REDUCE_FUNC(op, uint64_t, isa)
+
+#define OFI_DEF_REDUCE_REAL(op, isa)					\
+	OFI_DEF_REDUCE_INT(op, isa)					\
+	OFI_DEF_REDUCE_FUNC(op, float, isa)				\
+	OFI_DEF_REDUCE_FUNC(op, double, isa)
+
+#define OFI_REDUCE_INT_ROW(op, isa)					\
+	[FI_INT8]   = ofi_reduce_## op ##_int8_t_## isa,		\
+	[FI_UINT8]  = ofi_reduce_## op ##_uint8_t_## isa,		\
+	[FI_INT16]  = ofi_reduce_## op ##_int16_t_## isa,		\
+	[FI_UINT16] = ofi_reduce_## op ##_uint16_t_## isa,		\
+	[FI_INT32]  = ofi_reduce_## op ##_int32_t_## isa,		\
+	[FI_UINT32] = ofi_reduce_## op ##_uint32_t_## isa,		\
+	[FI_INT64]  = ofi_reduce_## op ##_int64_t_## isa,		\
+	[FI_UINT64] = ofi_reduce_## op ##_uint64_t_## isa
+
+#define OFI_REDUCE_REAL_ROW(op, isa)					\
+	OFI_REDUCE_INT_ROW(op, isa),					\
+	[FI_FLOAT]  = ofi_reduce_## op ##_float_## isa,			\
+	[FI_DOUBLE] = ofi_reduce_## op ##_double_## isa
+
+/* Table is indexed by op directly, as OFI_WRITE_OP_START is FI_MIN */
+#define OFI_DEFINE_REDUCE_HANDLERS(isa)					\
+	OFI_DEF_REDUCE_REAL(MIN, isa)					\
+	OFI_DEF_REDUCE_REAL(MAX, isa)					\
+	OFI_DEF_REDUCE_REAL(SUM, isa)					\
+	OFI_DEF_REDUCE_REAL(PROD, isa)					\
+	OFI_DEF_REDUCE_REAL(LOR, isa)					\
+	OFI_DEF_REDUCE_REAL(LAND, isa)					\
+	OFI_DEF_REDUCE_INT(BOR, isa)					\
+	OFI_DEF_REDUCE_INT(BAND, isa)					\
+	OFI_DEF_REDUCE_REAL(LXOR, isa)					\
+	OFI_DEF_REDUCE_INT(BXOR, isa)					\
+	OFI_DEF_REDUCE_REAL(WRITE, isa)					\
+									\
+	static const ofi_reduce_fn					\
+	ofi_reduce_table_## isa[OFI_WRITE_OP_CNT][OFI_DATATYPE_CNT] = {	\
+		[FI_MIN]	  = { OFI_REDUCE_REAL_ROW(MIN, isa) },	\
+		[FI_MAX]	  = { OFI_REDUCE_REAL_ROW(MAX, isa) },	\
+		[FI_SUM]	  = { OFI_REDUCE_REAL_ROW(SUM, isa) },	\
+		[FI_PROD]	  = { OFI_REDUCE_REAL_ROW(PROD, isa) },	\
+		[FI_LOR]	  = { OFI_REDUCE_REAL_ROW(LOR, isa) },	\
+		[FI_LAND]	  = { OFI_REDUCE_REAL_ROW(LAND, isa) },	\
+		[FI_BOR]	  = { OFI_REDUCE_INT_ROW(BOR, isa) },	\
+		[FI_BAND]	  = { OFI_REDUCE_INT_ROW(BAND, isa) },	\
+		[FI_LXOR]	  = { OFI_REDUCE_REAL_ROW(LXOR, isa) },	\
+		[FI_BXOR]	  = { OFI_REDUCE_INT_ROW(BXOR, isa) },	\
+		[FI_ATOMIC_WRITE] = { OFI_REDUCE_REAL_ROW(WRITE, isa) },	\
+	};
+
+OFI_DEFINE_REDUCE_HANDLERS(base)
+
+#if OFI_REDUCE_X86
+OFI_DEFINE_REDUCE_HANDLERS(avx2)
+OFI_DEFINE_REDUCE_HANDLERS(avx512)
+
+/* The CPUID feature bits only say the unit exists, XCR0 says whether the
+ * OS saves its register state.
+ */
+static uint64_t ofi_reduce_xgetbv(void)
+{
+	uint32_t lo, hi;
+
+	asm volatile("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+	return ((uint64_t) hi << 32) | lo;
+}
+
+#define OFI_XCR0_AVX	0x06	/* XMM, YMM */
+#define OFI_XCR0_AVX512	0xe6	/* XMM, YMM, opmask, ZMM */
+
+static const ofi_reduce_fn (*ofi_reduce_select(void))[OFI_DATATYPE_CNT]
+{
+	uint64_t xcr0;
+
+	if (!ofi_cpu_supports(0x1, OFI_OSXSAVE_REG, OFI_OSXSAVE_BIT))
+		return ofi_reduce_table_base;
+
+	xcr0 = ofi_reduce_xgetbv();
+	if ((xcr0 & OFI_XCR0_AVX512) == OFI_XCR0_AVX512 &&
+	    ofi_cpu_supports(0x7, OFI_AVX512F_REG, OFI_AVX512F_BIT) &&
+	    ofi_cpu_supports(0x7, OFI_AVX512BW_REG, OFI_AVX512BW_BIT))
+		return ofi_reduce_table_avx512;
+
+	if ((xcr0 & OFI_XCR0_AVX) == OFI_XCR0_AVX &&
+	    ofi_cpu_supports(0x7, OFI_AVX2_REG, OFI_AVX2_BIT))
+		return ofi_reduce_table_avx2;
+
+	return ofi_reduce_table_base;
+}
+#else
+static const ofi_reduce_fn (*ofi_reduce_select(void))[OFI_DATATYPE_CNT]
+{
+	return ofi_reduce_table_base;
+}
+#endif /* OFI_REDUCE_X86 */
+
+void (*ofi_reduce_handlers[OFI_WRITE_OP_CNT][OFI_DATATYPE_CNT])
+	(void *dst, const void *src, size_t cnt);
+
+void ofi_reduce_init(void)
+{
+	const ofi_reduce_fn (*table)[OFI_DATATYPE_CNT];
+	int op, datatype;
+
+	table = ofi_reduce_select();
+	for (op = 0; op < OFI_WRITE_OP_CNT; op++) {
+		for (datatype = 0; datatype < OFI_DATATYPE_CNT; datatype++) {
+			ofi_reduce_handlers[op][datatype] =
+				table[op][datatype] ? table[op][datatype] :
+				ofi_atomic_write_handlers[op][datatype];
+		}
+	}
+}
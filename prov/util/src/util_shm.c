@@ -32,6 +32,7 @@
 
 #include "config.h"
 
+#include <inttypes.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -94,32 +95,37 @@ void smr_cma_check(struct smr_region *smr, struct smr_region *peer_smr)
 }
 
 size_t smr_calculate_size_offsets(size_t tx_count, size_t rx_count,
-				  size_t *cmd_offset, size_t *resp_offset,
+				  size_t peer_count, size_t *cmd_offset, size_t *resp_offset,
 				  size_t *inject_offset, size_t *sar_offset,
 				  size_t *peer_offset, size_t *name_offset,
-				  size_t *sock_offset)
+				  size_t *sock_offset, size_t *mr_offset)
 {
 	size_t cmd_queue_offset, resp_queue_offset, inject_pool_offset;
 	size_t sar_pool_offset, peer_data_offset, ep_name_offset;
 	size_t tx_size, rx_size, total_size, sock_name_offset;
+	size_t mr_table_offset;
 
 	tx_size = roundup_power_of_two(tx_count);
 	rx_size = roundup_power_of_two(rx_count);
 
-	/* Align cmd_queue offset to 128-bit boundary. */
-	cmd_queue_offset = ofi_get_aligned_size(sizeof(struct smr_region), 16);
+	/* Align queues to cache lines to keep producers and consumer apart. */
+	cmd_queue_offset = ofi_get_aligned_size(sizeof(struct smr_region),
+						SMR_CACHE_LINE_SIZE);
 	resp_queue_offset = cmd_queue_offset + sizeof(struct smr_cmd_queue) +
-			    sizeof(struct smr_cmd) * rx_size;
+			    sizeof(struct smr_cmd_queue_entry) * rx_size;
 	inject_pool_offset = resp_queue_offset + sizeof(struct smr_resp_queue) +
-			     sizeof(struct smr_resp) * tx_size;
+			     sizeof(struct smr_resp_queue_entry) * tx_size;
 	sar_pool_offset = inject_pool_offset +
 		freestack_size(sizeof(struct smr_inject_buf), rx_size);
 	peer_data_offset = sar_pool_offset +
-		freestack_size(sizeof(struct smr_sar_buf), SMR_MAX_PEERS);
+		freestack_size(sizeof(struct smr_sar_buf), SMR_SAR_BUF_CNT);
 	ep_name_offset = peer_data_offset + sizeof(struct smr_peer_data) *
-		SMR_MAX_PEERS;
+		peer_count;
 
 	sock_name_offset = ep_name_offset + SMR_NAME_MAX;
+	mr_table_offset = ofi_get_aligned_size(sock_name_offset +
+					       SMR_SOCK_NAME_MAX,
+					       SMR_CACHE_LINE_SIZE);
 
 	if (cmd_offset)
 		*cmd_offset = cmd_queue_offset;
@@ -135,8 +141,10 @@ size_t smr_calculate_size_offsets(size_t tx_count, size_t rx_count,
 		*name_offset = ep_name_offset;
 	if (sock_offset)
 		*sock_offset = sock_name_offset;
+	if (mr_offset)
+		*mr_offset = mr_table_offset;
 
-	total_size = sock_name_offset + SMR_SOCK_NAME_MAX;
+	total_size = mr_table_offset + sizeof(struct smr_mr_table);
 
 	/*
  	 * Revisit later to see if we really need the size adjustment, or
@@ -198,17 +206,20 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 	struct smr_ep_name *ep_name;
 	size_t total_size, cmd_queue_offset, peer_data_offset;
 	size_t resp_queue_offset, inject_pool_offset, name_offset;
-	size_t sar_pool_offset, sock_name_offset;
+	size_t sar_pool_offset, sock_name_offset, mr_table_offset;
 	int fd, ret, i;
 	void *mapped_addr;
 	size_t tx_size, rx_size;
 
+	assert(attr->peer_count <= SMR_MAX_PEERS);
 	tx_size = roundup_power_of_two(attr->tx_count);
 	rx_size = roundup_power_of_two(attr->rx_count);
-	total_size = smr_calculate_size_offsets(tx_size, rx_size, &cmd_queue_offset,
+	total_size = smr_calculate_size_offsets(tx_size, rx_size,
+					attr->peer_count, &cmd_queue_offset,
 					&resp_queue_offset, &inject_pool_offset,
 					&sar_pool_offset, &peer_data_offset,
-					&name_offset, &sock_name_offset);
+					&name_offset, &sock_name_offset,
+					&mr_table_offset);
 
 	fd = shm_open(attr->name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
 	if (fd < 0) {
@@ -271,6 +282,7 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 	(*smr)->cma_cap_peer = SMR_CMA_CAP_NA;
 	(*smr)->cma_cap_self = SMR_CMA_CAP_NA;
 	(*smr)->base_addr = *smr;
+	(*smr)->max_peers = attr->peer_count;
 
 	(*smr)->total_size = total_size;
 	(*smr)->cmd_queue_offset = cmd_queue_offset;
@@ -280,25 +292,32 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 	(*smr)->peer_data_offset = peer_data_offset;
 	(*smr)->name_offset = name_offset;
 	(*smr)->sock_name_offset = sock_name_offset;
-	(*smr)->cmd_cnt = rx_size;
+	(*smr)->mr_table_offset = mr_table_offset;
+	ofi_atomic_initialize64(&(*smr)->cmd_cnt, rx_size);
 	/* Limit of 1 outstanding SAR message per peer */
-	(*smr)->sar_cnt = SMR_MAX_PEERS;
+	(*smr)->sar_cnt = SMR_SAR_BUF_CNT;
 	(*smr)->max_sar_buf_per_peer = SMR_BUF_BATCH_MAX;
 
 	smr_cmd_queue_init(smr_cmd_queue(*smr), rx_size);
 	smr_resp_queue_init(smr_resp_queue(*smr), tx_size);
 	smr_freestack_init(smr_inject_pool(*smr), rx_size,
 			sizeof(struct smr_inject_buf));
-	smr_freestack_init(smr_sar_pool(*smr), SMR_MAX_PEERS,
+	smr_freestack_init(smr_sar_pool(*smr), SMR_SAR_BUF_CNT,
 			sizeof(struct smr_sar_buf));
-	for (i = 0; i < SMR_MAX_PEERS; i++) {
+	for (i = 0; i < attr->peer_count; i++) {
 		smr_peer_addr_init(&smr_peer_data(*smr)[i].addr);
 		smr_peer_data(*smr)[i].sar_status = 0;
 		smr_peer_data(*smr)[i].name_sent = 0;
+		smr_peer_data(*smr)[i].attach_failed = 0;
 	}
 
 	strncpy((char *) smr_name(*smr), attr->name, total_size - name_offset);
 
+	/* Follows the name, whose copy clears the rest of the region */
+	ofi_atomic_initialize64(&smr_mr_table(*smr)->version, 0);
+	for (i = 0; i < SMR_MR_TABLE_SIZE; i++)
+		ofi_atomic_initialize64(&smr_mr_table(*smr)->entry[i].gen, 0);
+
 	/* Must be set last to signal full initialization to peers */
 	(*smr)->pid = getpid();
 	return 0;
@@ -325,14 +344,14 @@ static int smr_name_compare(struct ofi_rbmap *map, void *key, void *data)
 
 	smr_map = container_of(map, struct smr_map, rbmap);
 
-	return strncmp(smr_map->peers[(uintptr_t) data].peer.name,
+	return strncmp(smr_map_peer(smr_map, (uintptr_t) data)->peer.name,
 		       (char *) key, SMR_NAME_MAX);
 }
 
 int smr_map_create(const struct fi_provider *prov, int peer_count,
 		   struct smr_map **map)
 {
-	int i;
+	assert(peer_count > 0 && peer_count <= SMR_MAX_PEERS);
 
 	(*map) = calloc(1, sizeof(struct smr_map));
 	if (!*map) {
@@ -340,11 +359,7 @@ int smr_map_create(const struct fi_provider *prov, int peer_count,
 		return -FI_ENOMEM;
 	}
 
-	for (i = 0; i < peer_count; i++) {
-		smr_peer_addr_init(&(*map)->peers[i].peer);
-		(*map)->peers[i].fiaddr = FI_ADDR_UNSPEC;
-	}
-
+	(*map)->max_peers = peer_count;
 	ofi_rbmap_init(&(*map)->rbmap, smr_name_compare);
 	ofi_spin_init(&(*map)->lock);
 
@@ -424,21 +439,53 @@ out:
 	return ret;
 }
 
+static struct smr_peer *smr_map_lookup(struct smr_map *map, int64_t id)
+{
+	if (id < 0 || id >= map->max_peers ||
+	    !map->peers[id >> SMR_PEER_CHUNK_BITS])
+		return NULL;
+
+	return smr_map_peer(map, id);
+}
+
+static int smr_map_alloc_chunk(struct smr_map *map, int64_t id)
+{
+	struct smr_peer *chunk;
+	int i;
+
+	if (map->peers[id >> SMR_PEER_CHUNK_BITS])
+		return 0;
+
+	chunk = calloc(SMR_PEER_CHUNK_SIZE, sizeof(*chunk));
+	if (!chunk)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < SMR_PEER_CHUNK_SIZE; i++) {
+		smr_peer_addr_init(&chunk[i].peer);
+		chunk[i].fiaddr = FI_ADDR_UNSPEC;
+	}
+
+	map->peers[id >> SMR_PEER_CHUNK_BITS] = chunk;
+	return 0;
+}
+
 void smr_map_to_endpoint(struct smr_region *region, int64_t id)
 {
 	struct smr_region *peer_smr;
 	struct smr_peer_data *local_peers;
+	struct smr_peer *peer;
 
-	if (region->map->peers[id].peer.id < 0)
+	peer = smr_map_lookup(region->map, id);
+	if (!peer || peer->peer.id < 0)
 		return;
 
+	assert(id < region->max_peers);
 	local_peers = smr_peer_data(region);
 
-	strncpy(local_peers[id].addr.name,
-		region->map->peers[id].peer.name, SMR_NAME_MAX - 1);
+	strncpy(local_peers[id].addr.name, peer->peer.name, SMR_NAME_MAX - 1);
 	local_peers[id].addr.name[SMR_NAME_MAX - 1] = '\0';
 
-	peer_smr = smr_peer_region(region, id);
+	peer_smr = peer->region;
 
 	if ((region != peer_smr && region->cma_cap_peer == SMR_CMA_CAP_NA) ||
 	    (region == peer_smr && region->cma_cap_self == SMR_CMA_CAP_NA))
@@ -454,7 +501,7 @@ void smr_unmap_from_endpoint(struct smr_region *region, int64_t id)
 	local_peers = smr_peer_data(region);
 
 	memset(local_peers[id].addr.name, 0, SMR_NAME_MAX);
-	peer_id = region->map->peers[id].peer.id;
+	peer_id = smr_map_peer(region->map, id)->peer.id;
 	if (peer_id < 0)
 		return;
 
@@ -468,14 +515,21 @@ void smr_unmap_from_endpoint(struct smr_region *region, int64_t id)
 void smr_exchange_all_peers(struct smr_region *region)
 {
 	int64_t i;
-	for (i = 0; i < SMR_MAX_PEERS; i++)
+
+	for (i = 0; i < region->map->max_peers; i++) {
+		if (!region->map->peers[i >> SMR_PEER_CHUNK_BITS]) {
+			i |= SMR_PEER_CHUNK_SIZE - 1;
+			continue;
+		}
 		smr_map_to_endpoint(region, i);
+	}
 }
 
 int smr_map_add(const struct fi_provider *prov, struct smr_map *map,
 		const char *name, int64_t *id)
 {
 	struct ofi_rbnode *node;
+	struct smr_peer *peer;
 	int tries = 0, ret = 0;
 
 	ofi_spin_lock(&map->lock);
@@ -488,50 +542,69 @@ int smr_map_add(const struct fi_provider *prov, struct smr_map *map,
 		return 0;
 	}
 
-	while (map->peers[map->cur_id].peer.id != -1 &&
-	       tries < SMR_MAX_PEERS) {
-		if (++map->cur_id == SMR_MAX_PEERS)
+	while ((peer = smr_map_lookup(map, map->cur_id)) &&
+	       peer->peer.id != -1 && tries < map->max_peers) {
+		if (++map->cur_id == map->max_peers)
 			map->cur_id = 0;
 		tries++;
 	}
 
-	assert(map->cur_id < SMR_MAX_PEERS && tries < SMR_MAX_PEERS);
+	if (tries == map->max_peers) {
+		FI_WARN(prov, FI_LOG_AV,
+			"peer map full (%" PRId64 " entries)\n",
+			map->max_peers);
+		ret = -FI_ENOMEM;
+		goto err;
+	}
+
+	ret = smr_map_alloc_chunk(map, map->cur_id);
+	if (ret)
+		goto err;
+
 	*id = map->cur_id;
 	node->data = (void *) (intptr_t) *id;
-	strncpy(map->peers[*id].peer.name, name, SMR_NAME_MAX);
-	map->peers[*id].peer.name[SMR_NAME_MAX - 1] = '\0';
-	map->peers[*id].region = NULL;
+	peer = smr_map_peer(map, *id);
+	strncpy(peer->peer.name, name, SMR_NAME_MAX);
+	peer->peer.name[SMR_NAME_MAX - 1] = '\0';
+	peer->region = NULL;
 
-	ret = smr_map_to_region(prov, &map->peers[*id]);
+	ret = smr_map_to_region(prov, peer);
 	if (!ret)
-		map->peers[*id].peer.id = *id;
+		peer->peer.id = *id;
 
 	map->num_peers++;
 	ofi_spin_unlock(&map->lock);
 	return ret == -ENOENT ? 0 : ret;
+
+err:
+	ofi_rbmap_delete(&map->rbmap, node);
+	ofi_spin_unlock(&map->lock);
+	*id = -1;
+	return ret;
 }
 
 void smr_map_del(struct smr_map *map, int64_t id)
 {
 	struct dlist_entry *entry;
+	struct smr_peer *peer;
 
-	if (id >= SMR_MAX_PEERS || id < 0 || map->peers[id].peer.id < 0)
+	peer = smr_map_lookup(map, id);
+	if (!peer || peer->peer.id < 0)
 		return;
 
 	pthread_mutex_lock(&ep_list_lock);
 	entry = dlist_find_first_match(&ep_name_list, smr_match_name,
-				       smr_no_prefix(map->peers[id].peer.name));
+				       smr_no_prefix(peer->peer.name));
 	pthread_mutex_unlock(&ep_list_lock);
 
 	ofi_spin_lock(&map->lock);
 	if (!entry)
-		munmap(map->peers[id].region, map->peers[id].region->total_size);
+		munmap(peer->region, peer->region->total_size);
 
-	(void) ofi_rbmap_find_delete(&map->rbmap,
-				     (void *) map->peers[id].peer.name);
+	(void) ofi_rbmap_find_delete(&map->rbmap, (void *) peer->peer.name);
 
-	map->peers[id].fiaddr = FI_ADDR_UNSPEC;
-	map->peers[id].peer.id = -1;
+	peer->fiaddr = FI_ADDR_UNSPEC;
+	peer->peer.id = -1;
 	map->num_peers--;
 
 	ofi_spin_unlock(&map->lock);
@@ -541,17 +614,20 @@ void smr_map_free(struct smr_map *map)
 {
 	int64_t i;
 
-	for (i = 0; i < SMR_MAX_PEERS; i++)
+	for (i = 0; i < map->max_peers; i++)
 		smr_map_del(map, i);
 
+	for (i = 0; i < SMR_PEER_MAX_CHUNKS; i++)
+		free(map->peers[i]);
+
 	ofi_rbmap_cleanup(&map->rbmap);
 	free(map);
 }
 
 struct smr_region *smr_map_get(struct smr_map *map, int64_t id)
 {
-	if (id < 0 || id >= SMR_MAX_PEERS)
-		return NULL;
+	struct smr_peer *peer;
 
-	return map->peers[id].region;
+	peer = smr_map_lookup(map, id);
+	return peer ? peer->region : NULL;
 }
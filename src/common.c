@@ -1300,8 +1300,148 @@ ssize_t ofi_bsock_sendv(struct ofi_bsock *bsock, const struct iovec *iov,
 	return ret;
 }
 
+void ofi_bsock_rxbuf_add(struct ofi_bsock *bsock, uint16_t bid, size_t len)
+{
+	struct ofi_uring_bufring *bufring = bsock->bufring;
+
+	assert(bufring && bid < bufring->cnt && bufring->avail);
+	assert(len && len <= bufring->buf_size);
+	bufring->avail--;
+	bufring->len[bid] = (uint32_t) len;
+	bufring->next[bid] = OFI_URING_BUF_NONE;
+	if (bsock->rxbuf_tail == OFI_URING_BUF_NONE)
+		bsock->rxbuf_head = bid;
+	else
+		bufring->next[bsock->rxbuf_tail] = bid;
+	bsock->rxbuf_tail = bid;
+	bsock->rxbuf_bytes += len;
+}
+
+static void ofi_bsock_rxbuf_pop(struct ofi_bsock *bsock)
+{
+	struct ofi_uring_bufring *bufring = bsock->bufring;
+	uint16_t bid;
+
+	bid = bsock->rxbuf_head;
+	bsock->rxbuf_head = bufring->next[bid];
+	if (bsock->rxbuf_head == OFI_URING_BUF_NONE)
+		bsock->rxbuf_tail = OFI_URING_BUF_NONE;
+	bsock->rxbuf_off = 0;
+	ofi_uring_bufring_put(bufring, bid);
+}
+
+static void ofi_bsock_rxstash_free(struct ofi_bsock *bsock)
+{
+	free(bsock->rxstash);
+	bsock->rxstash = NULL;
+	bsock->rxstash_len = 0;
+	bsock->rxstash_off = 0;
+}
+
+void ofi_bsock_rxbuf_discard(struct ofi_bsock *bsock)
+{
+	while (bsock->rxbuf_head != OFI_URING_BUF_NONE)
+		ofi_bsock_rxbuf_pop(bsock);
+	ofi_bsock_rxstash_free(bsock);
+	bsock->rxbuf_bytes = 0;
+}
+
+/* Copy from the filled provided buffers, returning each buffer to the
+ * kernel once it has been fully consumed.  Stashed data comes first.
+ */
+static size_t ofi_bsock_rxbuf_readv(struct ofi_bsock *bsock,
+				    const struct iovec *iov, size_t cnt,
+				    size_t offset, size_t len)
+{
+	struct ofi_uring_bufring *bufring = bsock->bufring;
+	size_t bytes = 0, copied;
+	uint16_t bid;
+
+	if (bsock->rxstash) {
+		bytes = ofi_copy_to_iov(iov, cnt, offset,
+				bsock->rxstash + bsock->rxstash_off,
+				MIN(len, bsock->rxstash_len -
+					 bsock->rxstash_off));
+		bsock->rxstash_off += bytes;
+		if (bsock->rxstash_off == bsock->rxstash_len)
+			ofi_bsock_rxstash_free(bsock);
+	}
+
+	while (bytes < len && bsock->rxbuf_head != OFI_URING_BUF_NONE) {
+		bid = bsock->rxbuf_head;
+		copied = ofi_copy_to_iov(iov, cnt, offset + bytes,
+				(char *) ofi_uring_bufring_buf(bufring, bid) +
+				bsock->rxbuf_off,
+				MIN(len - bytes,
+				    bufring->len[bid] - bsock->rxbuf_off));
+		bytes += copied;
+		bsock->rxbuf_off += (uint32_t) copied;
+		if (bsock->rxbuf_off == bufring->len[bid])
+			ofi_bsock_rxbuf_pop(bsock);
+	}
+
+	bsock->rxbuf_bytes -= bytes;
+	return bytes;
+}
+
+/* Move the data held in provided buffers into memory owned by the
+ * socket and return the buffers to the kernel.  Used when the data will
+ * not be read soon, so that it does not hold buffers other sockets need.
+ */
+int ofi_bsock_rxbuf_stash(struct ofi_bsock *bsock)
+{
+	struct ofi_uring_bufring *bufring = bsock->bufring;
+	size_t stashed, len;
+	uint8_t *stash;
+	uint16_t bid;
+
+	stashed = bsock->rxstash_len - bsock->rxstash_off;
+	len = bsock->rxbuf_bytes - stashed;
+	if (!len)
+		return 0;
+
+	if (bsock->rxstash_off) {
+		memmove(bsock->rxstash, bsock->rxstash + bsock->rxstash_off,
+			stashed);
+		bsock->rxstash_len = stashed;
+		bsock->rxstash_off = 0;
+	}
+
+	stash = realloc(bsock->rxstash, stashed + len);
+	if (!stash)
+		return -FI_ENOMEM;
+
+	bsock->rxstash = stash;
+	while (bsock->rxbuf_head != OFI_URING_BUF_NONE) {
+		bid = bsock->rxbuf_head;
+		memcpy(stash + bsock->rxstash_len,
+		       (uint8_t *) ofi_uring_bufring_buf(bufring, bid) +
+		       bsock->rxbuf_off,
+		       bufring->len[bid] - bsock->rxbuf_off);
+		bsock->rxstash_len += bufring->len[bid] - bsock->rxbuf_off;
+		ofi_bsock_rxbuf_pop(bsock);
+	}
+	assert(bsock->rxstash_len == stashed + len);
+	return 0;
+}
+
+/* With multishot receives the kernel owns reading from the socket, so
+ * data is only taken from the provided buffers.  rx_eof is set once the
+ * peer's FIN has been seen, and reported after all data is consumed.
+ */
+static ssize_t ofi_bsock_recvv_bufring(struct ofi_bsock *bsock,
+				       const struct iovec *iov, size_t cnt,
+				       size_t offset, size_t len)
+{
+	offset += ofi_bsock_rxbuf_readv(bsock, iov, cnt, offset, len);
+	if (offset)
+		return offset;
+	return bsock->rx_eof ? -FI_ENOTCONN : -FI_EAGAIN;
+}
+
 ssize_t ofi_bsock_recv(struct ofi_bsock *bsock, void *buf, size_t len)
 {
+	struct iovec iov;
 	size_t bytes, avail;
 	ssize_t ret;
 
@@ -1314,6 +1454,15 @@ ssize_t ofi_bsock_recv(struct ofi_bsock *bsock, void *buf, size_t len)
 		len -= bytes;
 	}
 
+	if (bsock->bufring) {
+		iov.iov_base = buf;
+		iov.iov_len = len;
+		ret = ofi_bsock_recvv_bufring(bsock, &iov, 1, 0, len);
+		if (ret < 0)
+			return bytes ? (ssize_t) bytes : ret;
+		return bytes + ret;
+	}
+
 	assert(!ofi_bsock_readable(bsock));
 	if (len < (bsock->rq.size >> 1)) {
 		avail = ofi_byteq_writeable(&bsock->rq);
@@ -1361,6 +1510,9 @@ ssize_t ofi_bsock_recvv(struct ofi_bsock *bsock, struct iovec *iov, size_t cnt)
 		bytes = 0;
 	}
 
+	if (bsock->bufring)
+		return ofi_bsock_recvv_bufring(bsock, iov, cnt, bytes, len);
+
 	assert(!ofi_bsock_readable(bsock));
 	if (len < (bsock->rq.size >> 1)) {
 		avail = ofi_byteq_writeable(&bsock->rq);
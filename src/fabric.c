@@ -49,6 +49,7 @@
 #include "ofi_prov.h"
 #include "ofi_perf.h"
 #include "ofi_hmem.h"
+#include "ofi_atomic.h"
 #include "rdma/fi_ext.h"
 
 #ifdef HAVE_LIBDL
@@ -801,6 +802,7 @@ void fi_ini(void)
 	ofi_osd_init();
 	ofi_mem_init();
 	ofi_pmem_init();
+	ofi_reduce_init();
 	ofi_perf_init();
 	ofi_hook_init();
 	ofi_hmem_init();
@@ -718,6 +718,7 @@ static void ofi_tostr_eq_event(char *buf, size_t len, int type)
 	CASEENUMSTRN(FI_MR_COMPLETE, len);
 	CASEENUMSTRN(FI_AV_COMPLETE, len);
 	CASEENUMSTRN(FI_JOIN_COMPLETE, len);
+	CASEENUMSTRN(FI_PRECONNECT_COMPLETE, len);
 	default:
 		ofi_strncatf(buf, len, "Unknown");
 		break;
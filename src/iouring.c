@@ -36,6 +36,7 @@
 #include <liburing.h>
 
 #include <ofi_net.h>
+#include <ofi_mem.h>
 
 ssize_t ofi_sockapi_send_uring(struct ofi_sockapi *sockapi, SOCKET sock,
 			       const void *buf,  size_t len, int flags,
@@ -131,6 +132,152 @@ ssize_t ofi_sockapi_recvv_uring(struct ofi_sockapi *sockapi, SOCKET sock,
 	return -OFI_EINPROGRESS_URING;
 }
 
+#if HAVE_DECL_IO_URING_SETUP_BUF_RING && HAVE_DECL_IO_URING_PREP_RECV_MULTISHOT
+/* A multishot receive stays armed for the life of the connection, so it
+ * does not hold a credit.  Its completions are bounded by the number of
+ * provided buffers.
+ */
+ssize_t ofi_sockapi_recv_multishot_uring(struct ofi_sockapi *sockapi,
+					 SOCKET sock,
+					 struct ofi_uring_bufring *bufring,
+					 int flags, struct ofi_sockctx *ctx)
+{
+	struct io_uring_sqe *sqe;
+
+	if (ctx->uring_sqe_inuse)
+		return -FI_EAGAIN;
+
+	sqe = io_uring_get_sqe(sockapi->rx_uring.io_uring);
+	if (!sqe)
+		return -FI_EOVERFLOW;
+
+	io_uring_prep_recv_multishot(sqe, sock, NULL, 0, flags);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = bufring->bgid;
+	io_uring_sqe_set_data(sqe, ctx);
+	ctx->uring_sqe_inuse = true;
+	return -OFI_EINPROGRESS_URING;
+}
+
+int ofi_uring_bufring_init(ofi_io_uring_t *io_uring,
+			   struct ofi_uring_bufring *bufring,
+			   size_t cnt, size_t buf_size, uint16_t bgid)
+{
+	uint16_t bid;
+	int ret;
+
+	memset(bufring, 0, sizeof(*bufring));
+	if (!cnt || cnt > 32768 || (cnt & (cnt - 1)) || !buf_size)
+		return -FI_EINVAL;
+
+	ret = ofi_memalign((void **) &bufring->bufs, ofi_get_page_size(),
+			   cnt * buf_size);
+	if (ret)
+		return -FI_ENOMEM;
+
+	bufring->next = calloc(cnt, sizeof(*bufring->next));
+	bufring->len = calloc(cnt, sizeof(*bufring->len));
+	if (!bufring->next || !bufring->len) {
+		ret = -FI_ENOMEM;
+		goto err;
+	}
+
+	bufring->ring = io_uring_setup_buf_ring(io_uring, (unsigned int) cnt,
+						bgid, 0, &ret);
+	if (!bufring->ring)
+		goto err;
+
+	bufring->buf_size = buf_size;
+	bufring->cnt = (uint16_t) cnt;
+	bufring->bgid = bgid;
+	for (bid = 0; bid < bufring->cnt; bid++)
+		ofi_uring_bufring_put(bufring, bid);
+	return 0;
+
+err:
+	free(bufring->len);
+	free(bufring->next);
+	ofi_freealign(bufring->bufs);
+	memset(bufring, 0, sizeof(*bufring));
+	return ret;
+}
+
+void ofi_uring_bufring_destroy(ofi_io_uring_t *io_uring,
+			       struct ofi_uring_bufring *bufring)
+{
+	if (!bufring->ring)
+		return;
+
+	(void) io_uring_free_buf_ring(io_uring, bufring->ring, bufring->cnt,
+				      bufring->bgid);
+	free(bufring->len);
+	free(bufring->next);
+	ofi_freealign(bufring->bufs);
+	memset(bufring, 0, sizeof(*bufring));
+}
+
+void ofi_uring_bufring_put(struct ofi_uring_bufring *bufring, uint16_t bid)
+{
+	assert(bufring->avail < bufring->cnt);
+	io_uring_buf_ring_add(bufring->ring, ofi_uring_bufring_buf(bufring, bid),
+			      (unsigned int) bufring->buf_size, bid,
+			      io_uring_buf_ring_mask(bufring->cnt), 0);
+	io_uring_buf_ring_advance(bufring->ring, 1);
+	bufring->avail++;
+}
+#else
+ssize_t ofi_sockapi_recv_multishot_uring(struct ofi_sockapi *sockapi,
+					 SOCKET sock,
+					 struct ofi_uring_bufring *bufring,
+					 int flags, struct ofi_sockctx *ctx)
+{
+	return -FI_ENOSYS;
+}
+
+int ofi_uring_bufring_init(ofi_io_uring_t *io_uring,
+			   struct ofi_uring_bufring *bufring,
+			   size_t cnt, size_t buf_size, uint16_t bgid)
+{
+	memset(bufring, 0, sizeof(*bufring));
+	return -FI_ENOSYS;
+}
+
+void ofi_uring_bufring_destroy(ofi_io_uring_t *io_uring,
+			       struct ofi_uring_bufring *bufring)
+{
+}
+
+void ofi_uring_bufring_put(struct ofi_uring_bufring *bufring, uint16_t bid)
+{
+	assert(0);
+}
+#endif
+
+/* The cancel completes with its own CQE, which carries no context. */
+ssize_t ofi_sockapi_cancel_uring(struct ofi_sockapi_uring *uring,
+				 struct ofi_sockctx *ctx)
+{
+	struct io_uring_sqe *sqe;
+
+	if (!ctx->uring_sqe_inuse)
+		return 0;
+
+	sqe = io_uring_get_sqe(uring->io_uring);
+	if (!sqe)
+		return -FI_EOVERFLOW;
+
+	io_uring_prep_cancel(sqe, ctx, 0);
+	io_uring_sqe_set_data(sqe, NULL);
+	return -OFI_EINPROGRESS_URING;
+}
+
+int ofi_uring_wait_cqe(ofi_io_uring_t *io_uring)
+{
+	struct io_uring_cqe *cqe;
+
+	return io_uring_wait_cqe(io_uring, &cqe);
+}
+
 int ofi_uring_init(ofi_io_uring_t *io_uring, size_t entries)
 {
 	struct io_uring_params params;